@@ -0,0 +1,644 @@
+#include <chrono>
+#include <cmath>
+#include <fstream>
+#include <iostream>
+#include <memory>
+#include <stdexcept>
+#include <string>
+#include <thread>
+#include <utility>
+#include <vector>
+
+#include <boost/json.hpp>
+#include <boost/program_options.hpp>
+
+#include "backend/aggregation.h"
+#include "backend/bytecode.h"
+#include "backend/control_flow_builder.h"
+#include "backend/dataflow_graph.h"
+#include "backend/parallel_evaluation.h"
+#include "expression_generator.h"
+#include "frontend/parsing/parser.h"
+#include "frontend/scanning/lexer.h"
+#include "maths_static_compiler/maths_static_compiler.hpp"
+#include "support/thread_pool.h"
+
+namespace po = boost::program_options;
+
+namespace
+{
+// Rows of the batch evaluation stage
+constexpr std::size_t batch_rows = 4096;
+
+struct stage_timer
+{
+  boost::json::object& stages;
+
+  // Run the stage once and record its wall time in seconds
+  template<typename Function>
+  auto operator()(const char* name, Function&& function)
+  {
+    const auto start = std::chrono::steady_clock::now();
+    auto result = function();
+    const std::chrono::duration<double> elapsed =
+        std::chrono::steady_clock::now() - start;
+    stages[name] = elapsed.count();
+    std::cout << "  " << name << ": " << elapsed.count() << " s\n";
+    return result;
+  }
+};
+
+// Time partitioned lowering on pools of 1, 2, 4... up to max_threads threads
+boost::json::array lowering_scaling(
+    const std::vector<frontend::statement>& statements,
+    const backend::control_flow_data& serial,
+    std::size_t max_threads)
+{
+  boost::json::array scaling;
+  for (std::size_t threads = 1; threads <= max_threads;
+       threads = threads < max_threads ? std::min(threads * 2, max_threads)
+                                       : threads + 1)
+  {
+    auto pool = support::thread_pool(threads);
+    const auto start = std::chrono::steady_clock::now();
+    const auto data =
+        backend::control_flow_builder(statements, nullptr, nullptr, &pool)
+            .get_data();
+    const std::chrono::duration<double> elapsed =
+        std::chrono::steady_clock::now() - start;
+    if (data.canonical_hash() != serial.canonical_hash()) {
+      throw std::logic_error("Partitioned lowering changed the graph");
+    }
+    std::cout << "  control_flow_builder on " << threads
+              << " threads: " << elapsed.count() << " s\n";
+    boost::json::object sample;
+    sample["threads"] = threads;
+    sample["seconds"] = elapsed.count();
+    scaling.push_back(sample);
+  }
+  return scaling;
+}
+
+// Time one scalar evaluation by levels and a batch on 1, 2, 4... up to
+// max_threads threads, 1 thread evaluating serially
+boost::json::array evaluation_scaling(const backend::bytecode& code,
+                                      std::size_t max_threads)
+{
+  const auto graph = backend::build_dataflow_graph(code);
+  const auto levels = backend::compute_levels(graph);
+  std::vector<double> variables(code.variables.size(), 1.5);
+  std::vector<double> values(graph.values_count());
+  std::vector<double> rows(batch_rows * code.variables.size(), 1.5);
+  std::vector<double> results(batch_rows);
+  const auto outputs = std::span(&code.output_slot, 1);
+
+  auto time = [](auto&& function)
+  {
+    const auto start = std::chrono::steady_clock::now();
+    function();
+    const std::chrono::duration<double> elapsed =
+        std::chrono::steady_clock::now() - start;
+    return elapsed.count();
+  };
+
+  boost::json::array scaling;
+  double serial_scalar = 0;
+  double serial_batch = 0;
+  for (std::size_t threads = 1; threads <= max_threads;
+       threads = threads < max_threads ? std::min(threads * 2, max_threads)
+                                       : threads + 1)
+  {
+    auto pool = support::thread_pool(threads);
+    const auto scalar = time(
+        [&]
+        {
+          if (threads == 1) {
+            backend::execute(code, variables, values);
+          } else {
+            backend::execute_parallel(
+                code, graph, levels, variables, values, pool);
+          }
+        });
+    const auto batch = time(
+        [&]
+        {
+          if (threads == 1) {
+            backend::evaluate_batch(code, rows, outputs, results);
+          } else {
+            backend::evaluate_batch_parallel(
+                code, rows, outputs, results, pool);
+          }
+        });
+    if (threads == 1) {
+      serial_scalar = scalar;
+      serial_batch = batch;
+    }
+    std::cout << "  evaluation on " << threads << " threads: scalar " << scalar
+              << " s (x" << serial_scalar / scalar << "), batch " << batch
+              << " s (x" << serial_batch / batch << ")\n";
+    boost::json::object sample;
+    sample["threads"] = threads;
+    sample["scalar_seconds"] = scalar;
+    sample["batch_seconds"] = batch;
+    sample["scalar_speedup"] = serial_scalar / scalar;
+    sample["batch_speedup"] = serial_batch / batch;
+    scaling.push_back(sample);
+  }
+  return scaling;
+}
+
+// Sum of polynomials in Horner form, one per variable, whose coefficients
+// are decimal literals
+std::string polynomial_source(std::size_t variables_count, std::size_t degree)
+{
+  std::string source;
+  for (std::size_t variable = 0; variable < variables_count; variable++) {
+    std::string polynomial = "0.5";
+    for (std::size_t power = 1; power <= degree; power++) {
+      polynomial = "(" + polynomial + " * x" + std::to_string(variable) + " + "
+          + std::to_string(power + 1) + ".25)";
+    }
+    source += (variable == 0 ? "" : " + ") + polynomial;
+  }
+  return source;
+}
+
+// Time batches of a polynomial with basic instructions, constants as
+// immediates and fused multiply-adds
+boost::json::object polynomial_batches(std::size_t variables_count)
+{
+  constexpr std::size_t degree = 16;
+  constexpr std::size_t repetitions = 64;
+  const auto source = polynomial_source(variables_count, degree);
+  const auto data = backend::control_flow_builder(
+                        frontend::parser(frontend::lexer(source).scan_tokens())
+                            .parse_program())
+                        .get_data();
+  std::vector<double> rows(batch_rows * variables_count, 0.75);
+  std::vector<double> results(batch_rows);
+
+  boost::json::object record;
+  record["degree"] = degree;
+  record["batch_rows"] = batch_rows * repetitions;
+  const std::pair<const char*, backend::lowering_options> variants[] = {
+      {"basic", {.immediate_operands = false}},
+      {"immediate", {}},
+      {"fused", {.fuse_multiply_add = true}},
+  };
+  for (const auto& [name, lowering] : variants) {
+    const auto code = backend::lower(data, {}, {}, lowering);
+    const auto start = std::chrono::steady_clock::now();
+    for (std::size_t repetition = 0; repetition < repetitions; repetition++) {
+      backend::evaluate_batch(
+          code, rows, std::span(&code.output_slot, 1), results);
+    }
+    const std::chrono::duration<double> elapsed =
+        std::chrono::steady_clock::now() - start;
+    std::cout << "  polynomial " << name << ": " << code.instructions.size()
+              << " instructions, " << elapsed.count() << " s\n";
+    boost::json::object variant;
+    variant["instructions"] = code.instructions.size();
+    variant["seconds"] = elapsed.count();
+    record[name] = variant;
+  }
+  return record;
+}
+
+// Polynomial of the given degree written as a sum of powers, each power
+// spelled as a product
+std::string expanded_polynomial_source(std::size_t degree)
+{
+  std::string source = "0.5";
+  for (std::size_t power = 1; power <= degree; power++) {
+    source += " + " + std::to_string(power + 1) + ".25";
+    for (std::size_t factor = 0; factor < power; factor++) {
+      source += " * x";
+    }
+  }
+  return source;
+}
+
+// Time batches of expanded polynomials of degree 5 to 50 before and after
+// rewriting them in Horner form
+boost::json::array polynomial_normalization()
+{
+  constexpr std::size_t repetitions = 16;
+  std::vector<double> rows(batch_rows, 0.75);
+  std::vector<double> results(batch_rows);
+  auto time_batches = [&](const backend::bytecode& code)
+  {
+    const auto start = std::chrono::steady_clock::now();
+    for (std::size_t repetition = 0; repetition < repetitions; repetition++) {
+      backend::evaluate_batch(
+          code, rows, std::span(&code.output_slot, 1), results);
+    }
+    const std::chrono::duration<double> elapsed =
+        std::chrono::steady_clock::now() - start;
+    return elapsed.count();
+  };
+
+  boost::json::array records;
+  for (std::size_t degree = 5; degree <= 50; degree += 5) {
+    auto builder = backend::control_flow_builder(
+        frontend::parser(
+            frontend::lexer(expanded_polynomial_source(degree)).scan_tokens())
+            .parse_program());
+    const auto expanded = backend::lower(builder.get_data());
+    const auto savings = builder.normalize_polynomials();
+    const auto normalized = backend::lower(builder.get_data());
+    const auto expanded_seconds = time_batches(expanded);
+    const auto normalized_seconds = time_batches(normalized);
+    std::cout << "  degree " << degree << ": "
+              << savings.multiplications << " multiplications and "
+              << savings.additions << " additions saved, "
+              << expanded_seconds << " s instead of " << normalized_seconds
+              << " s\n";
+    boost::json::object record;
+    record["degree"] = degree;
+    record["batch_rows"] = batch_rows * repetitions;
+    record["expanded_instructions"] = expanded.instructions.size();
+    record["normalized_instructions"] = normalized.instructions.size();
+    record["saved_multiplications"] = savings.multiplications;
+    record["saved_additions"] = savings.additions;
+    record["expanded_seconds"] = expanded_seconds;
+    record["normalized_seconds"] = normalized_seconds;
+    records.push_back(record);
+  }
+  return records;
+}
+
+// Time batches of a pricing formula on rows where the discount is almost
+// always 0 and the exchange rate usually 1, with and without the fast path
+// compile_profiled() specializes for these values
+boost::json::object profile_guided_specialization()
+{
+  constexpr std::size_t repetitions = 16;
+  const auto* source =
+      "let gross = price * quantity; let taxed = gross + gross * rate; "
+      "let rebate = discount * (taxed - fee / quantity) "
+      "+ discount * discount * (taxed / 2 - fee) / (1 + discount); "
+      "let margin = (fx - 1) * (spread * gross + taxed * markup / (1 + markup))"
+      " + (fx - 1) * (fx - 1) * hedge / (1 + spread); "
+      "(taxed - rebate) * fx + margin";
+  const auto general = maths_static_compiler::compile(source);
+  const auto& variables = general.variables();
+  std::vector<double> rows;
+  rows.reserve(batch_rows * variables.size());
+  for (std::size_t row = 0; row < batch_rows; row++) {
+    for (const auto& variable : variables) {
+      double value = 1.5 + static_cast<double>(row % 17);
+      if (variable == "discount") {
+        value = row % 33 == 0 ? 0.1 : 0;  // 97% of rows without discount
+      } else if (variable == "fx") {
+        value = row % 10 == 0 ? 1.1 : 1;  // Domestic rows
+      }
+      rows.push_back(value);
+    }
+  }
+
+  maths_static_compiler::value_profile profile(general);
+  profile.record_batch(rows);
+  const auto profiled =
+      maths_static_compiler::compile_profiled(source, profile, 0.85);
+  const auto guards = profiled.guarded_values();
+  std::size_t guard_hits = 0;
+  for (std::size_t row = 0; row < batch_rows; row++) {
+    bool hit = true;
+    for (std::size_t variable = 0; variable < variables.size(); variable++) {
+      auto it = guards.find(variables[variable]);
+      hit = hit
+          && (it == guards.end()
+              || backend::identical(rows[row * variables.size() + variable],
+                                    it->second));
+    }
+    guard_hits += hit ? 1 : 0;
+  }
+
+  std::vector<double> results(batch_rows);
+  auto time_batches = [&](const maths_static_compiler::compiled_expression& e)
+  {
+    const auto start = std::chrono::steady_clock::now();
+    for (std::size_t repetition = 0; repetition < repetitions; repetition++) {
+      e.evaluate_batch(rows, results);
+    }
+    const std::chrono::duration<double> elapsed =
+        std::chrono::steady_clock::now() - start;
+    return elapsed.count();
+  };
+  const auto general_seconds = time_batches(general);
+  const auto profiled_seconds = time_batches(profiled);
+  const auto hit_rate =
+      static_cast<double>(guard_hits) / static_cast<double>(batch_rows);
+  std::cout << "  guard hit rate " << hit_rate << ", " << profiled_seconds
+            << " s instead of " << general_seconds << " s\n";
+
+  boost::json::object record;
+  record["batch_rows"] = batch_rows * repetitions;
+  record["guarded_variables"] = guards.size();
+  record["guard_hit_rate"] = hit_rate;
+  record["general_instructions"] = general.code().instructions.size();
+  record["fast_path_instructions"] =
+      maths_static_compiler::compile_specialized(source, guards)
+          .code()
+          .instructions.size();
+  record["general_seconds"] = general_seconds;
+  record["profiled_seconds"] = profiled_seconds;
+  record["speedup"] = general_seconds / profiled_seconds;
+  return record;
+}
+
+// Distinct formulas evaluated once, then one formula evaluated row by row
+// until it reaches its last tier
+boost::json::object tiered_execution()
+{
+  constexpr std::size_t cold_formulas = 256;
+  constexpr std::size_t hot_rows = 200000;
+  const std::string source =
+      "let gross = price * quantity; let taxed = gross + gross * rate; "
+      "let rebate = discount * (taxed - fee / quantity); "
+      "(taxed - rebate) * fx + (fx - 1) * spread * gross";
+  auto values_of = [](const std::vector<std::string>& variables,
+                      std::size_t row)
+  {
+    std::vector<double> values;
+    for (const auto& variable : variables) {
+      if (variable == "discount") {
+        values.push_back(row % 33 == 0 ? 0.1 : 0);
+      } else if (variable == "fx") {
+        values.push_back(row % 10 == 0 ? 1.1 : 1);
+      } else {
+        values.push_back(1.5 + static_cast<double>(row % 17));
+      }
+    }
+    return values;
+  };
+  auto seconds = [](auto&& function)
+  {
+    const auto start = std::chrono::steady_clock::now();
+    function();
+    const std::chrono::duration<double> elapsed =
+        std::chrono::steady_clock::now() - start;
+    return elapsed.count();
+  };
+
+  const auto compiled_cold_seconds = seconds(
+      [&]
+      {
+        for (std::size_t i = 0; i < cold_formulas; i++) {
+          auto compiled = maths_static_compiler::compile(
+              source + " + " + std::to_string(i));
+          compiled.evaluate(values_of(compiled.variables(), i));
+        }
+      });
+  const auto tiered_cold_seconds = seconds(
+      [&]
+      {
+        for (std::size_t i = 0; i < cold_formulas; i++) {
+          auto tiered = maths_static_compiler::tiered_expression(
+              source + " + " + std::to_string(i));
+          tiered.evaluate(values_of(tiered.variables(), i));
+        }
+      });
+
+  auto hot = maths_static_compiler::tiered_expression(source);
+  std::vector<std::vector<double>> rows;
+  for (std::size_t row = 0; row < 1024; row++) {
+    rows.push_back(values_of(hot.variables(), row));
+  }
+  const auto hot_seconds = seconds(
+      [&]
+      {
+        for (std::size_t row = 0; row < hot_rows; row++) {
+          hot.evaluate(rows[row % rows.size()]);
+        }
+      });
+  const auto compiled = maths_static_compiler::compile(source);
+  const auto compiled_hot_seconds = seconds(
+      [&]
+      {
+        for (std::size_t row = 0; row < hot_rows; row++) {
+          compiled.evaluate(rows[row % rows.size()]);
+        }
+      });
+  std::cout << "  " << cold_formulas << " cold formulas in "
+            << tiered_cold_seconds << " s instead of " << compiled_cold_seconds
+            << " s, " << hot_rows << " hot rows in " << hot_seconds
+            << " s instead of " << compiled_hot_seconds << " s\n";
+
+  static const char* const tier_names[] = {
+      "baseline", "optimized", "specialized"};
+  boost::json::object tiers;
+  const auto statistics = hot.statistics();
+  for (std::size_t tier = 0; tier < statistics.size(); tier++) {
+    const auto& tier_statistics = statistics[tier];
+    boost::json::object record;
+    record["rows"] = tier_statistics.rows;
+    record["evaluation_seconds"] = tier_statistics.evaluation_seconds;
+    record["compile_seconds"] = tier_statistics.compile_seconds;
+    record["instructions"] = tier_statistics.instructions;
+    if (tier_statistics.entered_after.has_value()) {
+      record["entered_after"] = *tier_statistics.entered_after;
+    }
+    tiers[tier_names[tier]] = record;
+  }
+
+  boost::json::object record;
+  record["cold_formulas"] = cold_formulas;
+  record["compiled_cold_seconds"] = compiled_cold_seconds;
+  record["tiered_cold_seconds"] = tiered_cold_seconds;
+  record["hot_rows"] = hot_rows;
+  record["hot_seconds"] = hot_seconds;
+  record["compiled_hot_seconds"] = compiled_hot_seconds;
+  record["tiers"] = tiers;
+  return record;
+}
+
+boost::json::object run(const bench::generator_options& generator_options,
+                        std::size_t max_threads)
+{
+  boost::json::object record;
+  boost::json::object stages;
+  stage_timer timed {stages};
+
+  auto expression = timed("generate",
+                          [&]
+                          {
+                            return bench::expression_generator(generator_options)
+                                .generate();
+                          });
+  std::cout << "  nodes: " << expression.nodes << '\n';
+
+  auto tokens =
+      timed("lexer",
+            [&] { return frontend::lexer(expression.source).scan_tokens(); });
+  auto statements = timed(
+      "parser", [&] { return frontend::parser(tokens).parse_program(); });
+  auto data = timed("control_flow_builder",
+                    [&]
+                    {
+                      return backend::control_flow_builder(statements)
+                          .get_data();
+                    });
+  auto code = timed("lower", [&] { return backend::lower(data); });
+  auto scaling = lowering_scaling(statements, data, max_threads);
+
+  std::vector<double> values(code.variables.size(), 1.5);
+  std::vector<double> slots(code.slots_count);
+  timed("evaluate",
+        [&] { return backend::evaluate(code, values, slots); });
+
+  std::vector<double> rows(batch_rows * code.variables.size(), 1.5);
+  std::vector<double> results(batch_rows);
+  timed("evaluate_batch",
+        [&]
+        {
+          backend::evaluate_batch(
+              code, rows, std::span(&code.output_slot, 1), results);
+          return results.front();
+        });
+  // Same rows reduced to their sum without storing the results
+  timed("aggregate_batch",
+        [&]
+        {
+          return backend::aggregate_batch(code, rows, code.output_slot, {})
+              .sum();
+        });
+  // Same batch with one slot per instruction in ssa_position order, the
+  // layout before scheduling and slot reuse
+  const auto separate_code =
+      backend::lower(data, {}, {}, {.reuse_slots = false});
+  timed("evaluate_batch_separate_slots",
+        [&]
+        {
+          backend::evaluate_batch(separate_code,
+                                  rows,
+                                  std::span(&separate_code.output_slot, 1),
+                                  results);
+          return results.front();
+        });
+  // Constants and variables keep their slots, results share the others
+  const auto result_slots = [](const backend::bytecode& lowered)
+  {
+    return lowered.slots_count - lowered.first_variable_slot()
+        - lowered.variables.size();
+  };
+  std::cout << "  result slots: " << result_slots(code) << " (without reuse "
+            << result_slots(separate_code) << ")\n";
+  auto evaluation = evaluation_scaling(code, max_threads);
+
+  record["nodes"] = expression.nodes;
+  record["source_bytes"] = expression.source.size();
+  record["tokens"] = tokens.size();
+  record["operations"] = data.expressions.size();
+  record["batch_rows"] = batch_rows;
+  // Every slot is one column of a batch block
+  record["result_slots"] = result_slots(code);
+  record["separate_result_slots"] = result_slots(separate_code);
+  record["stages"] = stages;
+  record["lowering_scaling"] = scaling;
+  record["evaluation_scaling"] = evaluation;
+  return record;
+}
+
+}  // namespace
+
+int main(int argc, const char* const* argv)
+{
+  po::options_description description(
+      "Time every stage of the pipeline on random expressions of growing "
+      "size\n\nAllowed options");
+  description.add_options()("help,h", "Produce help message")(
+      "min-nodes",
+      po::value<std::size_t>()->default_value(100),
+      "Size of the smallest expression, sizes grow tenfold")(
+      "max-nodes",
+      po::value<std::size_t>()->default_value(10'000'000),
+      "Size of the largest expression")(
+      "max-depth",
+      po::value<std::size_t>()->default_value(64),
+      "Depth at which subtrees are cut to a single operand")(
+      "variables",
+      po::value<std::size_t>()->default_value(8),
+      "Number of distinct variables")(
+      "literal-reuse",
+      po::value<double>()->default_value(0.5),
+      "Chance for a literal to repeat an earlier one")(
+      "duplicates",
+      po::value<double>()->default_value(0.1),
+      "Chance for a subtree to repeat an earlier one")(
+      "seed", po::value<std::uint64_t>()->default_value(1), "Random seed")(
+      "threads",
+      po::value<std::size_t>()->default_value(
+          std::max(1U, std::thread::hardware_concurrency())),
+      "Largest thread pool timed for partitioned lowering and parallel "
+      "evaluation")(
+      "output,o",
+      po::value<std::string>()->default_value("bench.json"),
+      "JSON file receiving the timings");
+
+  po::variables_map vm;
+  try {
+    po::store(po::parse_command_line(argc, argv, description), vm);
+    po::notify(vm);
+  } catch (const std::exception& exception) {
+    std::cerr << exception.what() << '\n';
+    return 1;
+  }
+  if (vm.count("help") > 0) {
+    std::cout << description << '\n';
+    return 0;
+  }
+
+  bench::generator_options generator_options {
+      .max_depth = vm.at("max-depth").as<std::size_t>(),
+      .variables_count = vm.at("variables").as<std::size_t>(),
+      .literal_reuse = vm.at("literal-reuse").as<double>(),
+      .duplicate_ratio = vm.at("duplicates").as<double>(),
+      .seed = vm.at("seed").as<std::uint64_t>(),
+  };
+
+  boost::json::object options;
+  options["max_depth"] = generator_options.max_depth;
+  options["variables"] = generator_options.variables_count;
+  options["literal_reuse"] = generator_options.literal_reuse;
+  options["duplicates"] = generator_options.duplicate_ratio;
+  options["seed"] = generator_options.seed;
+  const auto max_threads = vm.at("threads").as<std::size_t>();
+  options["threads"] = max_threads;
+
+  boost::json::array runs;
+  try {
+    for (auto nodes = vm.at("min-nodes").as<std::size_t>();
+         nodes <= vm.at("max-nodes").as<std::size_t>();
+         nodes *= 10)
+    {
+      std::cout << nodes << " nodes\n";
+      generator_options.nodes = nodes;
+      runs.push_back(run(generator_options, max_threads));
+    }
+  } catch (const std::exception& exception) {
+    std::cerr << exception.what() << '\n';
+    return 1;
+  }
+
+  std::cout << "polynomial\n";
+  boost::json::object report;
+  report["options"] = options;
+  report["runs"] = runs;
+  report["polynomial"] = polynomial_batches(
+      std::max<std::size_t>(1, generator_options.variables_count));
+  std::cout << "polynomial normalization\n";
+  report["polynomial_normalization"] = polynomial_normalization();
+  std::cout << "profile guided specialization\n";
+  report["profile_guided_specialization"] = profile_guided_specialization();
+  std::cout << "tiered execution\n";
+  report["tiered_execution"] = tiered_execution();
+  const auto output = vm.at("output").as<std::string>();
+  std::ofstream file(output);
+  if (!file.is_open()) {
+    std::cerr << "Unable to open file " << output << '\n';
+    return 1;
+  }
+  file << report;
+  return 0;
+}
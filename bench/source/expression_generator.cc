@@ -0,0 +1,111 @@
+#include <array>
+
+#include "expression_generator.h"
+
+namespace
+{
+// Subtrees up to this size are remembered for duplication
+constexpr std::size_t max_duplicated_nodes = 1024;
+constexpr std::size_t max_remembered_subtrees = 256;
+constexpr std::size_t max_remembered_literals = 64;
+}  // namespace
+
+namespace bench
+{
+
+expression_generator::expression_generator(generator_options options)
+    : m_options(options)
+    , m_random(options.seed)
+{
+}
+
+generated_expression expression_generator::generate()
+{
+  generated_expression expression;
+  // Every node takes 4 characters on average
+  expression.source.reserve(m_options.nodes * 4);
+  expression.nodes =
+      append_subtree(expression.source, std::max<std::size_t>(1, m_options.nodes), 0);
+  return expression;
+}
+
+std::size_t expression_generator::append_subtree(std::string& source,
+                                                 std::size_t budget,
+                                                 std::size_t depth)
+{
+  if (budget < 3 || depth >= m_options.max_depth) {
+    append_operand(source);
+    return 1;
+  }
+  if (budget <= max_duplicated_nodes && !m_subtrees.empty()
+      && chance(m_options.duplicate_ratio))
+  {
+    // Only subtrees using most of the budget, so the size stays close to the
+    // requested one
+    const auto& candidate =
+        m_subtrees[std::uniform_int_distribution<std::size_t>(
+            0, m_subtrees.size() - 1)(m_random)];
+    if (candidate.nodes <= budget && 2 * candidate.nodes >= budget) {
+      source += candidate.source;
+      return candidate.nodes;
+    }
+  }
+
+  static constexpr std::array<char, 4> operators = {'+', '-', '*', '/'};
+  const auto start = source.size();
+  // Split unevenly, so the depth stays logarithmic without being uniform
+  const auto children = budget - 1;
+  const auto left_budget = std::uniform_int_distribution<std::size_t>(
+      children / 4, children - children / 4)(m_random);
+  source += '(';
+  auto nodes = append_subtree(source, std::max<std::size_t>(1, left_budget), depth + 1);
+  source += ' ';
+  source += operators[std::uniform_int_distribution<std::size_t>(0, 3)(m_random)];
+  source += ' ';
+  nodes += append_subtree(
+      source, std::max<std::size_t>(1, children - left_budget), depth + 1);
+  source += ')';
+  nodes++;
+
+  if (nodes <= max_duplicated_nodes) {
+    subtree remembered {source.substr(start), nodes};
+    if (m_subtrees.size() < max_remembered_subtrees) {
+      m_subtrees.push_back(std::move(remembered));
+    } else {
+      m_subtrees[std::uniform_int_distribution<std::size_t>(
+          0, max_remembered_subtrees - 1)(m_random)] = std::move(remembered);
+    }
+  }
+  return nodes;
+}
+
+void expression_generator::append_operand(std::string& source)
+{
+  if (m_options.variables_count > 0 && chance(0.5)) {
+    source += 'x';
+    source += std::to_string(std::uniform_int_distribution<std::size_t>(
+        0, m_options.variables_count - 1)(m_random));
+    return;
+  }
+  if (!m_literals.empty() && chance(m_options.literal_reuse)) {
+    source += m_literals[std::uniform_int_distribution<std::size_t>(
+        0, m_literals.size() - 1)(m_random)];
+    return;
+  }
+  auto literal = std::to_string(
+      std::uniform_int_distribution<int>(100, 999999)(m_random));
+  if (chance(0.5)) {
+    literal.insert(literal.size() - 2, ".");
+  }
+  if (m_literals.size() < max_remembered_literals) {
+    m_literals.push_back(literal);
+  }
+  source += literal;
+}
+
+bool expression_generator::chance(double probability)
+{
+  return std::bernoulli_distribution(probability)(m_random);
+}
+
+}  // namespace bench
@@ -0,0 +1,60 @@
+#ifndef EXPRESSION_GENERATOR_H
+#define EXPRESSION_GENERATOR_H
+
+#include <cstdint>
+#include <random>
+#include <string>
+#include <vector>
+
+namespace bench
+{
+
+struct generator_options
+{
+  std::size_t nodes = 1000;  // Operators and operands of the expression
+  std::size_t max_depth = 64;  // Deeper subtrees are cut to a single operand
+  std::size_t variables_count = 8;
+  double literal_reuse = 0.5;  // Chance for a literal to repeat an earlier one
+  double duplicate_ratio = 0.1;  // Chance for a subtree to repeat an earlier one
+  std::uint64_t seed = 1;
+};
+
+struct generated_expression
+{
+  std::string source;
+  std::size_t nodes;
+};
+
+// Random expressions for benchmarks, the same options always give the same
+// expression
+class expression_generator
+{
+public:
+  explicit expression_generator(generator_options options);
+
+  generated_expression generate();
+
+private:
+  // Append a subtree of about budget nodes and return its actual size
+  std::size_t append_subtree(std::string& source,
+                             std::size_t budget,
+                             std::size_t depth);
+  void append_operand(std::string& source);
+
+  bool chance(double probability);
+
+  struct subtree
+  {
+    std::string source;
+    std::size_t nodes;
+  };
+
+  generator_options m_options;
+  std::mt19937_64 m_random;
+  std::vector<std::string> m_literals;
+  std::vector<subtree> m_subtrees;  // Candidates for duplication
+};
+
+}  // namespace bench
+
+#endif
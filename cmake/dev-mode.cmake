@@ -3,6 +3,7 @@ include(cmake/folders.cmake)
 include(CTest)
 if(BUILD_TESTING)
   add_subdirectory(test)
+  add_subdirectory(bench)
 endif()
 
 add_custom_target(
@@ -0,0 +1,6 @@
+include(CMakeFindDependencyMacro)
+find_dependency(Threads)
+find_dependency(fmt)
+find_dependency(Boost 1.87.0 COMPONENTS program_options json)
+
+include("${CMAKE_CURRENT_LIST_DIR}/maths_static_compilerTargets.cmake")
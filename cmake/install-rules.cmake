@@ -1,8 +1,71 @@
+if(PROJECT_IS_TOP_LEVEL)
+  set(
+      CMAKE_INSTALL_INCLUDEDIR "include/maths_static_compiler-${PROJECT_VERSION}"
+      CACHE STRING ""
+  )
+  set_property(CACHE CMAKE_INSTALL_INCLUDEDIR PROPERTY TYPE PATH)
+endif()
+
+include(CMakePackageConfigHelpers)
+include(GNUInstallDirs)
+
+# find_package(<package>) call for consumers to find this project
+set(package maths_static_compiler)
+
 install(
-    TARGETS maths_static_compiler_exe
+    DIRECTORY include/
+    DESTINATION "${CMAKE_INSTALL_INCLUDEDIR}"
+    COMPONENT maths_static_compiler_Development
+)
+
+install(
+    TARGETS maths_static_compiler_lib
+    EXPORT maths_static_compilerTargets
+    RUNTIME COMPONENT maths_static_compiler_Runtime
+    LIBRARY COMPONENT maths_static_compiler_Runtime
+    NAMELINK_COMPONENT maths_static_compiler_Development
+    ARCHIVE COMPONENT maths_static_compiler_Development
+    INCLUDES DESTINATION "${CMAKE_INSTALL_INCLUDEDIR}"
+)
+
+install(
+    TARGETS maths_static_compiler_exe maths_static_compiler_client maths_static_compiler_loadgen
     RUNTIME COMPONENT maths_static_compiler_Runtime
 )
 
+write_basic_package_version_file(
+    "${package}ConfigVersion.cmake"
+    COMPATIBILITY SameMajorVersion
+)
+
+# Allow package maintainers to freely override the path for the configs
+set(
+    maths_static_compiler_INSTALL_CMAKEDIR "${CMAKE_INSTALL_LIBDIR}/cmake/${package}"
+    CACHE STRING "CMake package config location relative to the install prefix"
+)
+set_property(CACHE maths_static_compiler_INSTALL_CMAKEDIR PROPERTY TYPE PATH)
+mark_as_advanced(maths_static_compiler_INSTALL_CMAKEDIR)
+
+install(
+    FILES cmake/install-config.cmake
+    DESTINATION "${maths_static_compiler_INSTALL_CMAKEDIR}"
+    RENAME "${package}Config.cmake"
+    COMPONENT maths_static_compiler_Development
+)
+
+install(
+    FILES "${PROJECT_BINARY_DIR}/${package}ConfigVersion.cmake"
+    DESTINATION "${maths_static_compiler_INSTALL_CMAKEDIR}"
+    COMPONENT maths_static_compiler_Development
+)
+
+install(
+    EXPORT maths_static_compilerTargets
+    NAMESPACE maths_static_compiler::
+    DESTINATION "${maths_static_compiler_INSTALL_CMAKEDIR}"
+    COMPONENT maths_static_compiler_Development
+)
+
 if(PROJECT_IS_TOP_LEVEL)
   include(CPack)
 endif()
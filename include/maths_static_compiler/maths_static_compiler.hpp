@@ -0,0 +1,399 @@
+#ifndef MATHS_STATIC_COMPILER_HPP
+#define MATHS_STATIC_COMPILER_HPP
+
+#include <array>
+#include <cstdint>
+#include <filesystem>
+#include <functional>
+#include <map>
+#include <memory>
+#include <optional>
+#include <span>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include "task.hpp"
+
+namespace backend
+{
+struct bytecode;
+struct dataflow_graph;
+struct guarded_code;
+struct parallel_schedule;
+}  // namespace backend
+
+namespace support
+{
+class thread_pool;
+}  // namespace support
+
+namespace maths_static_compiler
+{
+
+// Result of compiling an expression once, ready to be evaluated many times.
+//
+// The source may also be a program of ';'-separated statements, each one an
+// output ("margin = revenue - cost" or a bare expression) or a binding that
+// is not an output ("let t = a * b"). All outputs are computed by one shared
+// graph, so common subexpressions are evaluated once.
+//
+// Objects are immutable and cheap to copy (copies share the compiled code),
+// every member function may be called from any number of threads at once.
+// Evaluation never performs console input or output.
+class compiled_expression
+{
+public:
+  explicit compiled_expression(std::shared_ptr<const backend::bytecode> code);
+
+  // Evaluation takes the fast path, when given, for the values its guards
+  // hold for and the general code otherwise
+  compiled_expression(std::shared_ptr<const backend::bytecode> code,
+                      std::shared_ptr<const backend::guarded_code> fast_path);
+
+  // Distinct variable names in the order evaluate() expects their values
+  const std::vector<std::string>& variables() const;
+
+  // Output names in the order evaluate_all() writes them
+  const std::vector<std::string>& outputs() const;
+
+  // Evaluate with one value per variable and return the last output. Throws
+  // std::invalid_argument when the number of values does not match
+  // variables()
+  double evaluate(std::span<const double> values) const;
+
+  // Like evaluate(), writing every output into results in outputs() order
+  void evaluate_all(std::span<const double> values,
+                    std::span<double> results) const;
+
+  // Evaluate a row-major table with variables().size() columns, writing the
+  // last output of each row. rows.size() must equal
+  // results.size() * variables().size()
+  void evaluate_batch(std::span<const double> rows,
+                      std::span<double> results) const;
+
+  // Like evaluate_batch(), writing outputs().size() values per row
+  void evaluate_batch_all(std::span<const double> rows,
+                          std::span<double> results) const;
+
+  // Overloads splitting the work between the threads of a pool when the cost
+  // model expects it to pay: blocks of rows of a batch, independent
+  // instructions of a wide program for one evaluation. Single evaluations
+  // taking the fast path or computing exact values stay on the calling thread
+  double evaluate(std::span<const double> values,
+                  support::thread_pool& pool) const;
+  void evaluate_all(std::span<const double> values,
+                    std::span<double> results,
+                    support::thread_pool& pool) const;
+  void evaluate_batch(std::span<const double> rows,
+                      std::span<double> results,
+                      support::thread_pool& pool) const;
+  void evaluate_batch_all(std::span<const double> rows,
+                          std::span<double> results,
+                          support::thread_pool& pool) const;
+
+  // Number of operations the shared graph saves compared to evaluating every
+  // output on its own
+  std::size_t saved_operations() const;
+
+  // Largest error of batch results relative to the largest magnitude of each
+  // output, proven by compile() with variable ranges. 0 for other expressions
+  double error_bound() const;
+
+  // Instructions evaluate_batch() runs in single precision
+  std::size_t single_precision_instructions() const;
+
+  // Instructions evaluated exactly in 64-bit integers, see compile_exact()
+  std::size_t exact_instructions() const;
+
+  // Values the fast path of compile_profiled() is guarded by, empty when
+  // there is no fast path
+  std::map<std::string, double> guarded_values() const;
+
+  // Instructions of that fast path, 0 when there is none
+  std::size_t fast_path_instructions() const;
+
+  // Write the compiled code to a versioned binary file that load_ir() maps
+  // back without compiling again
+  void save_ir(const std::filesystem::path& path) const;
+
+  // Internal representation, for tools built on top of the library. The
+  // general code when there is a fast path, which save_ir() also leaves out
+  const backend::bytecode& code() const { return *m_code; }
+
+private:
+  void check_values_count(std::size_t values_count) const;
+  void check_rows_count(std::size_t values_count,
+                        std::size_t rows_count) const;
+  void check_results_count(std::size_t results_count) const;
+  // Whether one evaluation with these values is split between threads
+  bool runs_parallel(std::span<const double> values) const;
+  // Evaluate the general code with m_schedule, returning the values it
+  // numbers
+  std::span<const double> execute_parallel(std::span<const double> values,
+                                           support::thread_pool& pool) const;
+  // Batch of the last output or of every output, rows the guards do not
+  // hold for are gathered and evaluated by the general code. Blocks of rows
+  // are split between the threads of pool when given
+  void run_batch(std::span<const double> rows,
+                 bool all_outputs,
+                 std::span<double> results,
+                 support::thread_pool* pool) const;
+
+  std::shared_ptr<const backend::bytecode> m_code;
+  std::shared_ptr<const backend::guarded_code> m_fast_path;
+  // Levels of the general code, only for programs wide enough to split
+  std::shared_ptr<const backend::parallel_schedule> m_schedule;
+};
+
+// Histogram of the values each variable of a compiled expression takes,
+// recorded alongside its evaluations to find the values compile_profiled()
+// specializes the program for. Only the first tracked_values distinct values
+// of a variable are counted, a value taken by most rows is among them unless
+// the rows are ordered by it. A profile is meant to be used by one thread at
+// a time
+class value_profile
+{
+public:
+  static constexpr std::size_t tracked_values = 16;
+
+  explicit value_profile(const compiled_expression& compiled);
+
+  // Count the values of one evaluation, in variables() order
+  void record(std::span<const double> values);
+
+  // Count every row of a table as given to evaluate_batch()
+  void record_batch(std::span<const double> rows);
+
+  std::size_t rows() const { return m_rows; }
+
+  // Variables taking one value in at least min_share of the rows, with that
+  // value
+  std::map<std::string, double> dominant_values(double min_share) const;
+
+private:
+  std::vector<std::string> m_variables;
+  // Distinct values of every variable with their number of rows
+  std::vector<std::vector<std::pair<double, std::size_t>>> m_counts;
+  std::size_t m_rows = 0;
+};
+
+// Stateful evaluation that keeps the value of every instruction, so that
+// changing a few variables only recomputes the instructions depending on them.
+//
+// Recomputation follows the uses of changed values in instruction order and
+// stops wherever a recomputed value did not change. A session is meant to be
+// used by one thread at a time.
+class evaluation_session
+{
+public:
+  // Fully evaluate with one value per variable
+  evaluation_session(compiled_expression compiled,
+                     std::span<const double> values);
+
+  // Set variables (indexes into variables()) to new values and recompute
+  // what depends on them
+  void update(std::span<const std::size_t> variables,
+              std::span<const double> values);
+
+  void update(std::size_t variable, double value)
+  {
+    update(std::span(&variable, 1), std::span(&value, 1));
+  }
+
+  const compiled_expression& compiled() const { return m_compiled; }
+
+  // The last output, like compiled_expression::evaluate()
+  double result() const;
+
+  // Every output in compiled_expression::outputs() order
+  void outputs(std::span<double> results) const;
+
+  // Instructions recomputed by the last update() or the constructor
+  std::size_t last_recomputed() const { return m_last_recomputed; }
+
+  std::size_t instructions_count() const;
+
+private:
+  void schedule_users(std::size_t value);
+  void recompute();
+
+  compiled_expression m_compiled;
+  std::shared_ptr<const backend::dataflow_graph> m_graph;
+  // Compiled code reuses slots, the session keeps every value: constants and
+  // variables in their slots, then the result of every instruction in order
+  std::vector<double> m_values;
+  // Instruction indexes waiting for recomputation, as a min-heap so they are
+  // processed in topological order
+  std::vector<std::uint32_t> m_pending;
+  std::vector<bool> m_is_pending;
+  std::size_t m_last_recomputed = 0;
+};
+
+// Supplies the value of a variable given its name, e.g. a coroutine awaiting
+// a cache service, a file or a socket
+using variable_provider =
+    std::function<task<double>(const std::string& name)>;
+
+// Evaluate every output with variable values from the provider, in outputs()
+// order. Every lookup starts at once and each operation runs as soon as its
+// operands are known, on the thread delivering the last of them, so the
+// evaluation waits for the slowest lookup instead of the sum of all of them.
+// An exception of the provider is rethrown once every lookup has completed
+task<std::vector<double>> evaluate_async(compiled_expression compiled,
+                                         variable_provider provider);
+
+// Run the whole pipeline: lexing, parsing, lowering and optimizations.
+// Invalid expressions are reported with exceptions derived from
+// std::exception
+compiled_expression compile(std::string_view source);
+
+// Like compile(), evaluating polynomials in Horner form with their like terms
+// collected, and computing a * b + c and a * b - c with one rounding when the
+// product is not used elsewhere, like -ffast-math contraction. Results may
+// differ from compile() in the last bits, evaluation dispatches fewer
+// instructions and uses the FMA unit where the processor has one
+compiled_expression compile_fast_math(std::string_view source);
+
+// Like compile(), binding the given variables to their values at compile
+// time. Operations only depending on bound values are folded and those made
+// trivial by them (e.g. multiplied by a zero parameter) removed, so the
+// program left only reads, and evaluate() only takes, the other variables.
+// Names the source does not use are ignored
+compiled_expression compile_specialized(
+    std::string_view source, const std::map<std::string, double>& definitions);
+
+// Like compile(), adding a fast path specialized for the dominant values of
+// the profile (see compile_specialized()) when this removes instructions.
+// The fast path runs when every variable it binds has its dominant value,
+// e.g. a discount of 0 or an exchange rate of 1, which only costs a few
+// comparisons. Other values take the general code
+compiled_expression compile_profiled(std::string_view source,
+                                     const value_profile& profile,
+                                     double min_share = 0.9);
+
+enum class execution_tier
+{
+  baseline,  // Lowered without optimizations
+  optimized,  // Like compile()
+  specialized,  // Like compile_profiled()
+};
+
+// Rows evaluated before a tiered_expression moves to the next tier, an
+// evaluate() call being one row
+struct tier_thresholds
+{
+  std::uint64_t optimize_after = 64;
+  // Rows profiled at the optimized tier
+  std::uint64_t specialize_after = 4096;
+  double min_share = 0.9;  // See compile_profiled()
+};
+
+struct tier_statistics
+{
+  std::uint64_t evaluations = 0;  // Calls, a batch being one call
+  std::uint64_t rows = 0;
+  // Extrapolated from every batch and one in 64 single rows
+  double evaluation_seconds = 0;
+  double compile_seconds = 0;
+  // Of the fast path at the specialized tier
+  std::size_t instructions = 0;
+  // Rows evaluated at lower tiers when this tier's code was swapped in,
+  // empty when the tier was never reached
+  std::optional<std::uint64_t> entered_after;
+};
+
+// Expression compiled at first with the cheapest pipeline, then compiled
+// again with stronger ones as it proves to be evaluated often.
+//
+// The baseline tier only lowers the source, so an expression evaluated once
+// costs little more than its parsing. Once it has evaluated optimize_after
+// rows, the code of compile() is compiled on a background thread and
+// swapped in, evaluations never wait for it. The values of the next
+// specialize_after rows are profiled, and when they find dominant values the
+// guarded code of compile_profiled() is swapped in the same way.
+//
+// variables() stays the same at every tier: the variables of the source
+// even when optimizations remove some. Copies share the tiers and, like
+// compiled_expression, may be evaluated by any number of threads at once
+class tiered_expression
+{
+public:
+  // Invalid expressions throw like compile()
+  explicit tiered_expression(std::string_view source,
+                             tier_thresholds thresholds = {});
+
+  const std::vector<std::string>& variables() const;
+  const std::vector<std::string>& outputs() const;
+
+  double evaluate(std::span<const double> values) const;
+  void evaluate_all(std::span<const double> values,
+                    std::span<double> results) const;
+  void evaluate_batch(std::span<const double> rows,
+                      std::span<double> results) const;
+
+  execution_tier tier() const;
+
+  // Indexed by execution_tier
+  std::array<tier_statistics, 3> statistics() const;
+
+private:
+  struct state;
+
+  std::shared_ptr<state> m_state;
+};
+
+struct variable_range
+{
+  double lower;
+  double upper;
+};
+
+// Like compile(), also proving which operations may run in single precision
+// when every variable stays within its range and a relative error of the
+// outputs up to the tolerance is acceptable. Only the batch evaluation uses
+// single precision, which roughly doubles its SIMD width. When even double
+// precision cannot be proven (e.g. a divisor range contains zero) everything
+// runs in double. Throws when a variable has no range
+compiled_expression compile(std::string_view source,
+                            const std::map<std::string, variable_range>& ranges,
+                            double tolerance);
+
+// Like compile(), evaluating exactly in 64-bit integers whatever only adds,
+// subtracts and multiplies integer or decimal literals and the variables
+// listed with their decimal scale (0 for integers, 2 for cents). Divisions
+// stay exact when the divisor is a constant like 100 or 8, everything else is
+// computed in double from the exact values. Variable values must be whole
+// numbers of their units, otherwise std::invalid_argument is thrown, and an
+// exact value leaving the int64 range throws std::overflow_error.
+// evaluation_session recomputes in double
+compiled_expression compile_exact(
+    std::string_view source,
+    const std::map<std::string, unsigned>& variable_scales);
+
+enum class differentiation_mode
+{
+  forward,  // Cheaper when there are fewer variables than outputs
+  reverse,  // Cheaper when there are fewer outputs than variables
+};
+
+// Like compile(), also computing the derivative of every output by every
+// variable. The derivatives follow the values in outputs(), named
+// "d<output>/d<variable>" for each output and then each variable, and are
+// computed by the same graph as the values, so the terms they share are
+// evaluated once. evaluate() still returns the last value
+compiled_expression compile_gradient(
+    std::string_view source,
+    differentiation_mode mode = differentiation_mode::reverse);
+
+// Load a file written by compiled_expression::save_ir(). The file is mapped
+// read-only and its code is used in place without parsing, so loading takes
+// microseconds and every process mapping the same file shares its pages.
+// Throws std::invalid_argument when the file is not a valid IR file of this
+// version, including checksum mismatches, and std::system_error when it
+// cannot be read
+compiled_expression load_ir(const std::filesystem::path& path);
+
+}  // namespace maths_static_compiler
+
+#endif
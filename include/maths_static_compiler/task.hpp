@@ -0,0 +1,209 @@
+#ifndef MATHS_STATIC_COMPILER_TASK_HPP
+#define MATHS_STATIC_COMPILER_TASK_HPP
+
+#include <atomic>
+#include <coroutine>
+#include <exception>
+#include <optional>
+#include <semaphore>
+#include <span>
+#include <utility>
+
+namespace maths_static_compiler
+{
+
+template<typename T>
+class task;
+
+template<typename T>
+T sync_wait(task<T> awaited);
+
+template<typename T>
+class when_all_awaiter;
+
+namespace detail
+{
+template<typename T>
+struct task_result
+{
+  std::optional<T> value;
+
+  void return_value(T result) { value.emplace(std::move(result)); }
+  T take() { return std::move(*value); }
+};
+
+template<>
+struct task_result<void>
+{
+  void return_void() {}
+  void take() {}
+};
+}  // namespace detail
+
+// Lazily started coroutine producing a T. Awaiting a task starts it and
+// resumes the awaiting coroutine on whichever thread the task completes,
+// sync_wait() blocks a thread that is not a coroutine until it completes.
+// Tasks may await anything, e.g. an awaitable resumed by an I/O thread
+template<typename T = void>
+class task
+{
+public:
+  struct promise_type : detail::task_result<T>
+  {
+    std::coroutine_handle<> continuation = std::noop_coroutine();
+    // Tasks awaited together by when_all() still running, the last one
+    // resumes the continuation
+    std::atomic<std::size_t>* running = nullptr;
+    std::binary_semaphore* finished = nullptr;  // Released for sync_wait()
+    std::exception_ptr exception;
+
+    task get_return_object()
+    {
+      return task(std::coroutine_handle<promise_type>::from_promise(*this));
+    }
+
+    std::suspend_always initial_suspend() noexcept { return {}; }
+
+    auto final_suspend() noexcept
+    {
+      struct final_awaiter
+      {
+        bool await_ready() noexcept { return false; }
+
+        std::coroutine_handle<> await_suspend(
+            std::coroutine_handle<promise_type> handle) noexcept
+        {
+          auto& promise = handle.promise();
+          if (promise.finished != nullptr) {
+            promise.finished->release();  // The frame may be destroyed now
+            return std::noop_coroutine();
+          }
+          if (promise.running != nullptr
+              && promise.running->fetch_sub(1, std::memory_order_acq_rel) > 1)
+          {
+            return std::noop_coroutine();
+          }
+          return promise.continuation;
+        }
+
+        void await_resume() noexcept {}
+      };
+      return final_awaiter {};
+    }
+
+    void unhandled_exception() { exception = std::current_exception(); }
+  };
+
+  task(task&& other) noexcept
+      : m_handle(std::exchange(other.m_handle, nullptr))
+  {
+  }
+
+  task& operator=(task&& other) noexcept
+  {
+    if (this != &other) {
+      destroy();
+      m_handle = std::exchange(other.m_handle, nullptr);
+    }
+    return *this;
+  }
+
+  ~task() { destroy(); }
+
+  bool await_ready() const noexcept { return false; }
+
+  std::coroutine_handle<> await_suspend(std::coroutine_handle<> continuation)
+  {
+    m_handle.promise().continuation = continuation;
+    return m_handle;
+  }
+
+  T await_resume()
+  {
+    if (m_handle.promise().exception) {
+      std::rethrow_exception(m_handle.promise().exception);
+    }
+    return m_handle.promise().take();
+  }
+
+private:
+  explicit task(std::coroutine_handle<promise_type> handle)
+      : m_handle(handle)
+  {
+  }
+
+  void destroy()
+  {
+    if (m_handle) {
+      m_handle.destroy();
+    }
+  }
+
+  friend T sync_wait<T>(task<T> awaited);
+  friend class when_all_awaiter<T>;
+
+  std::coroutine_handle<promise_type> m_handle;
+};
+
+// Start every task and resume once all of them have completed, on the thread
+// completing the last one. Resuming rethrows the first exception of the
+// tasks in their order
+template<typename T>
+class when_all_awaiter
+{
+public:
+  explicit when_all_awaiter(std::span<task<T>> tasks)
+      : m_tasks(tasks)
+      , m_running(tasks.size() + 1)
+  {
+  }
+
+  bool await_ready() const noexcept { return m_tasks.empty(); }
+
+  // The extra count keeps tasks completing during the loop from resuming
+  // the continuation before every task has started
+  bool await_suspend(std::coroutine_handle<> continuation)
+  {
+    for (auto& started : m_tasks) {
+      started.m_handle.promise().continuation = continuation;
+      started.m_handle.promise().running = &m_running;
+      started.m_handle.resume();
+    }
+    return m_running.fetch_sub(1, std::memory_order_acq_rel) > 1;
+  }
+
+  void await_resume()
+  {
+    for (auto& completed : m_tasks) {
+      if (completed.m_handle.promise().exception) {
+        std::rethrow_exception(completed.m_handle.promise().exception);
+      }
+    }
+  }
+
+private:
+  std::span<task<T>> m_tasks;
+  std::atomic<std::size_t> m_running;
+};
+
+template<typename T>
+when_all_awaiter<T> when_all(std::span<task<T>> tasks)
+{
+  return when_all_awaiter<T>(tasks);
+}
+
+// Run a task to completion from a thread that is not a coroutine and return
+// its result
+template<typename T>
+T sync_wait(task<T> awaited)
+{
+  std::binary_semaphore finished(0);
+  awaited.m_handle.promise().finished = &finished;
+  awaited.m_handle.resume();
+  finished.acquire();
+  return awaited.await_resume();
+}
+
+}  // namespace maths_static_compiler
+
+#endif
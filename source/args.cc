@@ -1,5 +1,7 @@
 #include <iostream>
 #include <optional>
+#include <thread>
+#include <vector>
 
 #include <boost/program_options.hpp>
 
@@ -14,9 +16,27 @@ struct args_options
 {
   bool help;
   bool version;
+  bool incremental;
+  bool time_passes;
+  bool stats;
+  bool fast_math;
+  bool compensated_sum;
 
   std::optional<std::string> input_line;
   std::optional<std::string> json_debug_filename;
+  std::string json_sections;
+  std::optional<std::string> cache_directory;
+  std::optional<std::string> emit_ir;
+  std::optional<std::string> load_ir;
+  std::optional<std::string> gradient;
+  std::vector<std::string> ranges;
+  double tolerance;
+  std::vector<std::string> exact_variables;
+  std::vector<std::string> definitions;
+  std::optional<std::string> aggregates;
+  std::size_t jobs_count;
+  std::optional<std::string> server_socket;
+  std::size_t workers_count;
 };
 
 static inline po::options_description generate_description()
@@ -30,13 +50,82 @@ static inline po::options_description generate_description()
       "version,v", "Produce version string")(
       "input-line,i",
       po::value<std::string>(),
-      "Entering a mathematical expression in a line, e.g. (1 + 2) * 3");
+      "Entering a mathematical expression in a line, e.g. (1 + 2) * 3")(
+      "cache-dir",
+      po::value<std::string>(),
+      "Reuse compiled expressions stored in the directory, e.g. .cache")(
+      "emit-ir",
+      po::value<std::string>(),
+      "Write the optimized program to a binary IR file instead of evaluating "
+      "it, e.g. formula.ir")(
+      "load-ir",
+      po::value<std::string>(),
+      "Evaluate a binary IR file written by --emit-ir instead of compiling an "
+      "expression")(
+      "incremental",
+      "After the result, keep reading variable updates (e.g. x=2 y=3) and "
+      "recompute only what depends on them")(
+      "gradient",
+      po::value<std::string>()->implicit_value("reverse"),
+      "Also compute the derivatives of every output by every variable, in "
+      "forward or reverse (default) mode")(
+      "range",
+      po::value<std::vector<std::string>>()->composing(),
+      "Declare the range of a variable, e.g. x=0:10. With every range given, "
+      "prove where batches may be evaluated in single precision")(
+      "tolerance",
+      po::value<double>()->default_value(1e-4),
+      "Relative error of the outputs accepted with --range")(
+      "exact",
+      po::value<std::vector<std::string>>()->composing(),
+      "Declare an integer variable, e.g. n, or a fixed-point one with its "
+      "decimal scale, e.g. price=2. Whatever only depends on exact values is "
+      "evaluated in 64-bit integers")(
+      "define",
+      po::value<std::vector<std::string>>()->composing(),
+      "Bind a variable at compile time, e.g. rate=0.05. Whatever only depends "
+      "on bound values is folded into constants")(
+      "jobs,j",
+      po::value<std::size_t>()->default_value(
+          std::max(1U, std::thread::hardware_concurrency())),
+      "Number of threads lowering large programs in partitions and "
+      "evaluating wide ones, 1 runs everything on the main thread")(
+      "aggregate",
+      po::value<std::string>(),
+      "Read rows of variable values from the standard input and print "
+      "reductions of the result instead of each one: a comma-separated list "
+      "of count, sum, mean, min, max and histogram=lower:upper:bins")(
+      "compensated-sum",
+      "Sum and average with --aggregate using compensated summation, which "
+      "keeps the error within a few roundings however many rows there are")(
+      "fast-math",
+      "Evaluate polynomials in Horner form and fuse a * b + c into one "
+      "multiply-add rounded once, results may differ in the last bits");
   po::options_description debug_desc("Debug options");
   debug_desc.add_options()(
       "json-debug-file,o",
       po::value<std::string>(),
-      "Enter the name of the file to output, e.g. filename.txt");
+      "Enter the name of the file to output, e.g. filename.txt")(
+      "json-sections",
+      po::value<std::string>()->default_value("tokens,ast,ir,stats"),
+      "Comma-separated sections written to the JSON debug file, the result "
+      "is always written")(
+      "time-passes",
+      "Print the time, allocations and IR sizes of every compiler phase and "
+      "optimization pass")(
+      "stats", "Print the same statistics as JSON");
   desc.add(debug_desc);
+  po::options_description server_desc("Server options");
+  server_desc.add_options()(
+      "server",
+      po::value<std::string>(),
+      "Serve compile and evaluate requests on the Unix domain socket, e.g. "
+      "/tmp/maths_static_compiler.sock")(
+      "workers",
+      po::value<std::size_t>()->default_value(
+          std::max(1U, std::thread::hardware_concurrency())),
+      "Number of worker threads of the server");
+  desc.add(server_desc);
   return desc;
 }
 
@@ -50,11 +139,45 @@ static inline args_options parse_options(int argc,
   return args_options {
       .help = vm.count("help") > 0,
       .version = vm.count("version") > 0,
+      .incremental = vm.count("incremental") > 0,
+      .time_passes = vm.count("time-passes") > 0,
+      .stats = vm.count("stats") > 0,
+      .fast_math = vm.count("fast-math") > 0,
+      .compensated_sum = vm.count("compensated-sum") > 0,
       .input_line = vm.count("input-line")
           ? vm.at("input-line").as<std::string>()
           : std::optional<std::string>(std::nullopt),
       .json_debug_filename = vm.count("json-debug-file")
           ? vm.at("json-debug-file").as<std::string>()
           : std::optional<std::string>(std::nullopt),
+      .json_sections = vm.at("json-sections").as<std::string>(),
+      .cache_directory = vm.count("cache-dir")
+          ? vm.at("cache-dir").as<std::string>()
+          : std::optional<std::string>(std::nullopt),
+      .emit_ir = vm.count("emit-ir") ? vm.at("emit-ir").as<std::string>()
+                                     : std::optional<std::string>(std::nullopt),
+      .load_ir = vm.count("load-ir") ? vm.at("load-ir").as<std::string>()
+                                     : std::optional<std::string>(std::nullopt),
+      .gradient = vm.count("gradient")
+          ? vm.at("gradient").as<std::string>()
+          : std::optional<std::string>(std::nullopt),
+      .ranges = vm.count("range")
+          ? vm.at("range").as<std::vector<std::string>>()
+          : std::vector<std::string>(),
+      .tolerance = vm.at("tolerance").as<double>(),
+      .exact_variables = vm.count("exact")
+          ? vm.at("exact").as<std::vector<std::string>>()
+          : std::vector<std::string>(),
+      .definitions = vm.count("define")
+          ? vm.at("define").as<std::vector<std::string>>()
+          : std::vector<std::string>(),
+      .aggregates = vm.count("aggregate")
+          ? vm.at("aggregate").as<std::string>()
+          : std::optional<std::string>(std::nullopt),
+      .jobs_count = vm.at("jobs").as<std::size_t>(),
+      .server_socket = vm.count("server")
+          ? vm.at("server").as<std::string>()
+          : std::optional<std::string>(std::nullopt),
+      .workers_count = vm.at("workers").as<std::size_t>(),
   };
 }
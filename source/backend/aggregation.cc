@@ -0,0 +1,91 @@
+#include <algorithm>
+#include <cmath>
+
+#include "aggregation.h"
+
+namespace backend
+{
+
+aggregate::aggregate(const aggregation_options& options)
+    : m_options(options)
+{
+  if (options.histogram.has_value()) {
+    m_histogram.assign(options.histogram->count + 2, 0);
+  }
+}
+
+void aggregate::add(std::span<const double> values)
+{
+  m_count += values.size();
+  if (m_options.compensated) {
+    for (const double value : values) {
+      add_to_sum(value);
+    }
+  } else {
+    for (const double value : values) {
+      m_sum += value;
+    }
+  }
+  for (const double value : values) {
+    m_min = value < m_min ? value : m_min;
+    m_max = value > m_max ? value : m_max;
+  }
+  if (!m_options.histogram.has_value()) {
+    return;
+  }
+  const auto& bins = *m_options.histogram;
+  const double scale =
+      static_cast<double>(bins.count) / (bins.upper - bins.lower);
+  for (const double value : values) {
+    if (value < bins.lower) {
+      m_histogram[bins.count]++;
+    } else if (value < bins.upper) {
+      // Rounding may put values just below the upper bound past the last bin
+      const auto bin = static_cast<std::size_t>((value - bins.lower) * scale);
+      m_histogram[std::min(bin, bins.count - 1)]++;
+    } else {
+      m_histogram[bins.count + 1]++;
+    }
+  }
+}
+
+void aggregate::merge(const aggregate& other)
+{
+  m_count += other.m_count;
+  if (m_options.compensated) {
+    add_to_sum(other.m_sum);
+    m_compensation += other.m_compensation;
+  } else {
+    m_sum += other.m_sum;
+  }
+  m_min = std::min(m_min, other.m_min);
+  m_max = std::max(m_max, other.m_max);
+  for (std::size_t bin = 0; bin < m_histogram.size(); bin++) {
+    m_histogram[bin] += other.m_histogram[bin];
+  }
+}
+
+void aggregate::add_to_sum(double value)
+{
+  // The smaller operand loses the low-order bits, they are kept aside
+  const double sum = m_sum + value;
+  m_compensation += std::fabs(m_sum) >= std::fabs(value)
+      ? (m_sum - sum) + value
+      : (value - sum) + m_sum;
+  m_sum = sum;
+}
+
+aggregate aggregate_batch(const bytecode& code,
+                          std::span<const double> rows,
+                          slot_index output,
+                          const aggregation_options& options)
+{
+  aggregate result(options);
+  reduce_batch(code,
+               rows,
+               output,
+               [&](std::span<const double> values) { result.add(values); });
+  return result;
+}
+
+}  // namespace backend
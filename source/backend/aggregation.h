@@ -0,0 +1,76 @@
+#ifndef AGGREGATION_H
+#define AGGREGATION_H
+
+#include <cstddef>
+#include <limits>
+#include <optional>
+#include <span>
+#include <vector>
+
+#include "bytecode.h"
+
+namespace backend
+{
+
+struct histogram_bins
+{
+  double lower;
+  double upper;
+  std::size_t count;  // Of equal width between lower and upper
+};
+
+struct aggregation_options
+{
+  // Neumaier's variant of Kahan summation for the sum and the mean, whose
+  // error then stays within a few roundings whatever the number of rows
+  bool compensated = false;
+  std::optional<histogram_bins> histogram;
+};
+
+// Running reduction of the values of an output: count, sum, mean, minimum,
+// maximum and optionally a histogram, in memory independent of the number of
+// values. Partial aggregates of consecutive runs of values are merged in
+// their order, so the result only depends on how the values were split
+class aggregate
+{
+public:
+  explicit aggregate(const aggregation_options& options);
+
+  void add(std::span<const double> values);
+
+  // Append the values reduced by other, which follow those of this one
+  void merge(const aggregate& other);
+
+  std::size_t count() const { return m_count; }
+  double sum() const { return m_sum + m_compensation; }
+  double mean() const { return sum() / static_cast<double>(m_count); }
+  // NaN values are left out of the minimum and the maximum
+  double min() const { return m_min; }
+  double max() const { return m_max; }
+
+  // Values in every bin, then those below the lower bound and those at or
+  // above the upper bound or NaN. Empty without histogram_bins
+  const std::vector<std::size_t>& histogram() const { return m_histogram; }
+
+private:
+  void add_to_sum(double value);
+
+  aggregation_options m_options;
+  std::size_t m_count = 0;
+  double m_sum = 0;
+  double m_compensation = 0;  // Low-order bits lost by m_sum
+  double m_min = std::numeric_limits<double>::infinity();
+  double m_max = -std::numeric_limits<double>::infinity();
+  std::vector<std::size_t> m_histogram;
+};
+
+// Evaluate every row of a table like evaluate_batch() and reduce the value of
+// the output slot, which is never stored for all rows
+aggregate aggregate_batch(const bytecode& code,
+                          std::span<const double> rows,
+                          slot_index output,
+                          const aggregation_options& options);
+
+}  // namespace backend
+
+#endif
@@ -0,0 +1,838 @@
+#include <algorithm>
+#include <array>
+#include <cmath>
+#include <limits>
+#include <optional>
+#include <stdexcept>
+#include <type_traits>
+#include <utility>
+
+#include "bytecode.h"
+
+#include "scheduling.h"
+#include "type_inference.h"
+
+namespace
+{
+// Rows evaluated together by evaluate_batch, each slot of the block is one
+// column of this many values
+constexpr std::size_t batch_block_size = 256;
+
+// The double kernels are also compiled for processors with FMA and the
+// version matching the host is picked at load time. Elsewhere std::fma may
+// be a library call
+#if defined(__GNUC__) && defined(__x86_64__)
+#  define WITH_FMA_CLONE __attribute__((target_clones("fma", "default")))
+#else
+#  define WITH_FMA_CLONE
+#endif
+
+WITH_FMA_CLONE void run_block(const backend::bytecode& code,
+                              double* columns,
+                              std::size_t block_size,
+                              std::size_t rows_count)
+{
+  using backend::opcode;
+  for (const auto& instruction : code.instructions) {
+    double* destination = columns + instruction.destination * block_size;
+    const double* left = columns + instruction.left * block_size;
+    const double* right = columns + instruction.right * block_size;
+    const double* addend = columns + instruction.addend * block_size;
+    const double immediate = instruction.immediate;
+    switch (instruction.op) {
+      case opcode::add:
+        for (std::size_t i = 0; i < rows_count; i++) {
+          destination[i] = left[i] + right[i];
+        }
+        break;
+      case opcode::subtract:
+        for (std::size_t i = 0; i < rows_count; i++) {
+          destination[i] = left[i] - right[i];
+        }
+        break;
+      case opcode::multiply:
+        for (std::size_t i = 0; i < rows_count; i++) {
+          destination[i] = left[i] * right[i];
+        }
+        break;
+      case opcode::divide:
+        for (std::size_t i = 0; i < rows_count; i++) {
+          destination[i] = left[i] / right[i];
+        }
+        break;
+      case opcode::power:
+        for (std::size_t i = 0; i < rows_count; i++) {
+          destination[i] = std::pow(left[i], right[i]);
+        }
+        break;
+      case opcode::add_immediate:
+        for (std::size_t i = 0; i < rows_count; i++) {
+          destination[i] = left[i] + immediate;
+        }
+        break;
+      case opcode::multiply_immediate:
+        for (std::size_t i = 0; i < rows_count; i++) {
+          destination[i] = left[i] * immediate;
+        }
+        break;
+      case opcode::divide_immediate:
+        for (std::size_t i = 0; i < rows_count; i++) {
+          destination[i] = left[i] / immediate;
+        }
+        break;
+      case opcode::immediate_subtract:
+        for (std::size_t i = 0; i < rows_count; i++) {
+          destination[i] = immediate - left[i];
+        }
+        break;
+      case opcode::immediate_divide:
+        for (std::size_t i = 0; i < rows_count; i++) {
+          destination[i] = immediate / left[i];
+        }
+        break;
+      case opcode::multiply_add:
+        for (std::size_t i = 0; i < rows_count; i++) {
+          destination[i] = std::fma(left[i], right[i], addend[i]);
+        }
+        break;
+      case opcode::multiply_subtract:
+        for (std::size_t i = 0; i < rows_count; i++) {
+          destination[i] = std::fma(left[i], right[i], -addend[i]);
+        }
+        break;
+      case opcode::multiply_add_immediate:
+        for (std::size_t i = 0; i < rows_count; i++) {
+          destination[i] = std::fma(left[i], right[i], immediate);
+        }
+        break;
+    }
+  }
+}
+
+// Code with single precision or exact slots only has the basic opcodes,
+// which mirror expression_op
+backend::expression_op basic_operator(backend::opcode op)
+{
+  return static_cast<backend::expression_op>(op);
+}
+
+template<typename Result, typename Left, typename Right>
+void apply_columns(backend::expression_op op,
+                   Result* destination,
+                   const Left* left,
+                   const Right* right,
+                   std::size_t rows_count)
+{
+  switch (op) {
+    case backend::expression_op::add:
+      for (std::size_t i = 0; i < rows_count; i++) {
+        destination[i] =
+            static_cast<Result>(left[i]) + static_cast<Result>(right[i]);
+      }
+      break;
+    case backend::expression_op::subtract:
+      for (std::size_t i = 0; i < rows_count; i++) {
+        destination[i] =
+            static_cast<Result>(left[i]) - static_cast<Result>(right[i]);
+      }
+      break;
+    case backend::expression_op::multiply:
+      for (std::size_t i = 0; i < rows_count; i++) {
+        destination[i] =
+            static_cast<Result>(left[i]) * static_cast<Result>(right[i]);
+      }
+      break;
+    case backend::expression_op::divide:
+      for (std::size_t i = 0; i < rows_count; i++) {
+        destination[i] =
+            static_cast<Result>(left[i]) / static_cast<Result>(right[i]);
+      }
+      break;
+    case backend::expression_op::power:
+      for (std::size_t i = 0; i < rows_count; i++) {
+        destination[i] = std::pow(static_cast<Result>(left[i]),
+                                  static_cast<Result>(right[i]));
+      }
+      break;
+  }
+}
+
+// Like run_block, with every slot living in the column set of its precision.
+// An operation runs in the precision of its destination
+void run_mixed_block(const backend::bytecode& code,
+                     double* columns,
+                     float* single_columns,
+                     std::size_t block_size,
+                     std::size_t rows_count)
+{
+  const auto& single = code.single_precision_slots;
+  auto with_column = [&](backend::slot_index slot, auto&& function)
+  {
+    if (single[slot]) {
+      function(single_columns + slot * block_size);
+    } else {
+      function(columns + slot * block_size);
+    }
+  };
+  for (const auto& instruction : code.instructions) {
+    with_column(
+        instruction.destination,
+        [&](auto* destination)
+        {
+          with_column(
+              instruction.left,
+              [&](const auto* left)
+              {
+                with_column(instruction.right,
+                            [&](const auto* right)
+                            {
+                              apply_columns(basic_operator(instruction.op),
+                                            destination,
+                                            left,
+                                            right,
+                                            rows_count);
+                            });
+              });
+        });
+  }
+}
+
+// Exact operation over a block, the factors are shared by every row
+void apply_exact_columns(backend::expression_op op,
+                         std::int64_t* destination,
+                         const std::int64_t* left,
+                         const std::int64_t* right,
+                         backend::exact_factors factors,
+                         std::size_t rows_count)
+{
+  bool overflow = false;
+  switch (op) {
+    case backend::expression_op::add:
+    case backend::expression_op::subtract: {
+      const bool add = op == backend::expression_op::add;
+      for (std::size_t i = 0; i < rows_count; i++) {
+        std::int64_t scaled_left = 0;
+        std::int64_t scaled_right = 0;
+        overflow |= backend::multiply_overflows(left[i], factors.left, scaled_left);
+        overflow |=
+            backend::multiply_overflows(right[i], factors.right, scaled_right);
+        overflow |= add
+            ? backend::add_overflows(scaled_left, scaled_right, destination[i])
+            : backend::subtract_overflows(
+                  scaled_left, scaled_right, destination[i]);
+      }
+      break;
+    }
+    case backend::expression_op::multiply:
+      for (std::size_t i = 0; i < rows_count; i++) {
+        overflow |=
+            backend::multiply_overflows(left[i], right[i], destination[i]);
+      }
+      break;
+    case backend::expression_op::divide:
+      for (std::size_t i = 0; i < rows_count; i++) {
+        overflow |=
+            backend::multiply_overflows(left[i], factors.left, destination[i]);
+      }
+      break;
+    case backend::expression_op::power:
+      break;  // UNREACHABLE, powers are never exact
+  }
+  if (overflow) {
+    throw std::overflow_error("Exact evaluation overflowed 64-bit integers");
+  }
+}
+
+// Evaluate the rows block by block in columns of batch_block_size values,
+// one per slot, and call block(columns, first_row, rows_count) after each
+template<typename Block>
+void for_each_block(const backend::bytecode& code,
+                    std::span<const double> rows,
+                    std::size_t total_rows,
+                    Block&& block)
+{
+  const auto variables_count = code.variables.size();
+  thread_local std::vector<double> columns;
+  columns.resize(code.slots_count * batch_block_size);
+
+  for (std::size_t slot = 0; slot < code.constants.size(); slot++) {
+    std::fill_n(columns.begin() + static_cast<std::ptrdiff_t>(
+                                      slot * batch_block_size),
+                batch_block_size,
+                code.constants[slot]);
+  }
+
+  for (std::size_t first_row = 0; first_row < total_rows;
+       first_row += batch_block_size)
+  {
+    const auto rows_count = std::min(batch_block_size, total_rows - first_row);
+    for (std::size_t variable = 0; variable < variables_count; variable++) {
+      double* column =
+          columns.data() + (code.first_variable_slot() + variable) * batch_block_size;
+      for (std::size_t i = 0; i < rows_count; i++) {
+        column[i] = rows[(first_row + i) * variables_count + variable];
+      }
+    }
+    run_block(code, columns.data(), batch_block_size, rows_count);
+    block(static_cast<const double*>(columns.data()), first_row, rows_count);
+  }
+}
+
+}  // namespace
+
+namespace backend
+{
+
+namespace
+{
+// Owner of the arrays bytecode views, kept alive by bytecode::storage
+struct lowered_arrays
+{
+  std::vector<double> constants;
+  std::vector<instruction> instructions;
+};
+}  // namespace
+
+bytecode lower(const control_flow_data& data,
+               const std::set<ssa_position>& single_precision,
+               const std::map<ssa_position, unsigned>& exact_scales,
+               lowering_options options)
+{
+  auto arrays = std::make_shared<lowered_arrays>();
+  auto& constants = arrays->constants;
+  auto& instructions = arrays->instructions;
+
+  bytecode code;
+  // Positions are dense, so a vector maps them without a node per position
+  std::vector<slot_index> slots(data.control_flow_index);
+  for (const auto& [position, define] : data.defines) {
+    slots[position] = static_cast<slot_index>(constants.size());
+    constants.push_back(define);
+  }
+
+  std::map<std::string, slot_index> variable_slots;
+  for (const auto& [position, variable] : data.variables) {
+    auto [it, inserted] = variable_slots.emplace(
+        variable,
+        static_cast<slot_index>(constants.size() + code.variables.size()));
+    if (inserted) {
+      code.variables.push_back(variable);
+    }
+    slots[position] = it->second;
+  }
+
+  code.slots_count =
+      static_cast<slot_index>(constants.size() + code.variables.size());
+  // Slots hold values of one precision or exact scale, so the per slot
+  // tables stay valid when slots are reused
+  auto slot_class = [&](ssa_position position)
+  {
+    auto scale = exact_scales.find(position);
+    return std::make_pair(
+        single_precision.contains(position),
+        scale == exact_scales.end() ? -1 : static_cast<int>(scale->second));
+  };
+  std::map<std::pair<bool, int>, std::vector<slot_index>> free_slots;
+  auto allocate_slot = [&](ssa_position position)
+  {
+    auto& free = free_slots[slot_class(position)];
+    if (!options.reuse_slots || free.empty()) {
+      return code.slots_count++;
+    }
+    const auto slot = free.back();
+    free.pop_back();
+    return slot;
+  };
+
+  // Constants become immediates and products with one use are fused into
+  // the addition or subtraction reading them. Code with single precision or
+  // exact slots keeps the basic opcodes its kernels implement
+  struct selection
+  {
+    opcode op;
+    ssa_position left;
+    ssa_position right;
+    ssa_position addend;
+    double immediate = 0;
+  };
+  const bool double_only = single_precision.empty() && exact_scales.empty();
+  std::vector<const expression*> operations(data.control_flow_index, nullptr);
+  std::vector<std::uint32_t> uses_count(data.control_flow_index, 0);
+  for (const auto& [position, expr] : data.expressions) {
+    operations[position] = &expr;
+    uses_count[expr.get_left()]++;
+    uses_count[expr.get_right()]++;
+  }
+  uses_count[data.out_index] += 2;
+  for (const auto& [_, position] : data.outputs) {
+    uses_count[position] += 2;
+  }
+  auto is_immediate = [&](ssa_position position)
+  {
+    return double_only && options.immediate_operands
+        && data.defines.contains(position);
+  };
+  auto is_fused_product = [&](ssa_position position)
+  {
+    return double_only && options.fuse_multiply_add
+        && operations[position] != nullptr
+        && operations[position]->get_operator() == expression_op::multiply
+        && uses_count[position] == 1;
+  };
+  std::vector<bool> fused(data.control_flow_index, false);
+  auto select = [&](const expression& expr)
+  {
+    const auto op = expr.get_operator();
+    const auto left = expr.get_left();
+    const auto right = expr.get_right();
+    if (op == expression_op::add || op == expression_op::subtract) {
+      // Only the left operand of a subtraction, c - a * b has no opcode
+      std::optional<std::pair<ssa_position, ssa_position>> product_addend;
+      if (is_fused_product(left)) {
+        product_addend = {left, right};
+      } else if (op == expression_op::add && is_fused_product(right)) {
+        product_addend = {right, left};
+      }
+      if (product_addend.has_value()) {
+        const auto [product, addend] = *product_addend;
+        fused[product] = true;
+        const auto& multiply = *operations[product];
+        if (is_immediate(addend)) {
+          const auto value = data.defines.at(addend);
+          return selection {opcode::multiply_add_immediate,
+                            multiply.get_left(),
+                            multiply.get_right(),
+                            multiply.get_left(),
+                            op == expression_op::add ? value : -value};
+        }
+        return selection {op == expression_op::add ? opcode::multiply_add
+                                                   : opcode::multiply_subtract,
+                          multiply.get_left(),
+                          multiply.get_right(),
+                          addend};
+      }
+    }
+    if (is_immediate(right)) {
+      const auto value = data.defines.at(right);
+      switch (op) {
+        case expression_op::add:
+          return selection {opcode::add_immediate, left, left, left, value};
+        case expression_op::subtract:
+          return selection {opcode::add_immediate, left, left, left, -value};
+        case expression_op::multiply:
+          return selection {
+              opcode::multiply_immediate, left, left, left, value};
+        case expression_op::divide:
+          return selection {opcode::divide_immediate, left, left, left, value};
+        case expression_op::power:
+          break;
+      }
+    }
+    if (is_immediate(left)) {
+      const auto value = data.defines.at(left);
+      switch (op) {
+        case expression_op::add:
+          return selection {opcode::add_immediate, right, right, right, value};
+        case expression_op::subtract:
+          return selection {
+              opcode::immediate_subtract, right, right, right, value};
+        case expression_op::multiply:
+          return selection {
+              opcode::multiply_immediate, right, right, right, value};
+        case expression_op::divide:
+          return selection {
+              opcode::immediate_divide, right, right, right, value};
+        case expression_op::power:
+          break;
+      }
+    }
+    return selection {static_cast<opcode>(op), left, right, left};
+  };
+
+  std::vector<ssa_position> order;
+  if (options.reuse_slots) {
+    order = schedule_operations(data);
+  } else {
+    order.reserve(data.expressions.size());
+    for (const auto& [position, _] : data.expressions) {
+      order.push_back(position);
+    }
+  }
+  std::vector<selection> selections;
+  selections.reserve(order.size());
+  for (const auto position : order) {
+    selections.push_back(select(*operations[position]));
+  }
+
+  // Instruction reading every operation result last, outputs stay live
+  constexpr auto live_to_end = std::numeric_limits<std::size_t>::max();
+  std::vector<std::size_t> last_uses(data.control_flow_index, 0);
+  for (std::size_t index = 0; index < order.size(); index++) {
+    if (fused[order[index]]) {
+      continue;
+    }
+    last_uses[selections[index].left] = index;
+    last_uses[selections[index].right] = index;
+    last_uses[selections[index].addend] = index;
+  }
+  last_uses[data.out_index] = live_to_end;
+  for (const auto& [_, position] : data.outputs) {
+    last_uses[position] = live_to_end;
+  }
+
+  instructions.reserve(order.size());
+  for (std::size_t index = 0; index < order.size(); index++) {
+    if (fused[order[index]]) {
+      continue;
+    }
+    const auto& selected = selections[index];
+    const auto left = slots[selected.left];
+    const auto right = slots[selected.right];
+    const auto addend = slots[selected.addend];
+    // Operands read for the last time may already hold the result, every
+    // evaluator reads the operands of a row before writing its result
+    for (const auto operand : {selected.left, selected.right, selected.addend})
+    {
+      if (operations[operand] != nullptr && last_uses[operand] == index) {
+        free_slots[slot_class(operand)].push_back(slots[operand]);
+        last_uses[operand] = live_to_end;  // Freed once for "x * x"
+      }
+    }
+    slots[order[index]] = allocate_slot(order[index]);
+    instructions.push_back(instruction {
+        .op = selected.op,
+        .destination = slots[order[index]],
+        .left = left,
+        .right = right,
+        .addend = addend,
+        .immediate = selected.immediate,
+    });
+  }
+  code.constants = constants;
+  code.instructions = instructions;
+  code.storage = std::move(arrays);
+
+  code.output_slot = slots.at(data.out_index);
+  for (const auto& [name, position] : data.outputs) {
+    code.output_names.push_back(name);
+    code.output_slots.push_back(slots.at(position));
+  }
+  code.saved_operations = data.get_sharing_stats().saved_operations();
+  if (!single_precision.empty()) {
+    code.single_precision_slots.assign(code.slots_count, false);
+    for (const auto position : single_precision) {
+      code.single_precision_slots[slots.at(position)] = true;
+    }
+  }
+  if (!exact_scales.empty()) {
+    code.exact_scales.assign(code.slots_count, -1);
+    for (const auto& [position, scale] : exact_scales) {
+      code.exact_scales[slots.at(position)] = static_cast<int>(scale);
+    }
+  }
+  return code;
+}
+
+bytecode rebase_variables(const bytecode& code,
+                          const std::vector<std::string>& variables)
+{
+  // Variable slots follow the constants and result slots the variables
+  const auto first_variable = code.first_variable_slot();
+  const auto first_result = first_variable + code.variables.size();
+  const auto shift =
+      static_cast<slot_index>(variables.size() - code.variables.size());
+  auto rebase = [&](slot_index slot)
+  {
+    if (slot < first_variable) {
+      return slot;
+    }
+    if (slot >= first_result) {
+      return slot + shift;
+    }
+    const auto& name = code.variables[slot - first_variable];
+    auto it = std::find(variables.begin(), variables.end(), name);
+    if (it == variables.end()) {
+      throw std::invalid_argument("Variable \"" + name + "\" is not rebased");
+    }
+    return first_variable
+        + static_cast<slot_index>(it - variables.begin());
+  };
+
+  auto arrays = std::make_shared<lowered_arrays>();
+  arrays->constants.assign(code.constants.begin(), code.constants.end());
+  for (auto rebased : code.instructions) {
+    rebased.destination = rebase(rebased.destination);
+    rebased.left = rebase(rebased.left);
+    rebased.right = rebase(rebased.right);
+    rebased.addend = rebase(rebased.addend);
+    arrays->instructions.push_back(rebased);
+  }
+  bytecode result = code;
+  result.constants = arrays->constants;
+  result.variables = variables;
+  result.instructions = arrays->instructions;
+  result.storage = std::move(arrays);
+  result.slots_count += shift;
+  result.output_slot = rebase(code.output_slot);
+  for (auto& slot : result.output_slots) {
+    slot = rebase(slot);
+  }
+  return result;
+}
+
+WITH_FMA_CLONE void execute(const bytecode& code,
+                            std::span<const double> variables,
+                            std::span<double> slots)
+{
+  std::copy(code.constants.begin(), code.constants.end(), slots.begin());
+  std::copy(variables.begin(),
+            variables.end(),
+            slots.begin() + code.first_variable_slot());
+  for (const auto& instruction : code.instructions) {
+    slots[instruction.destination] =
+        apply_instruction(instruction,
+                          slots[instruction.left],
+                          slots[instruction.right],
+                          slots[instruction.addend]);
+  }
+}
+
+void evaluate_batch(const bytecode& code,
+                    std::span<const double> rows,
+                    std::span<const slot_index> outputs,
+                    std::span<double> results)
+{
+  if (!code.exact_scales.empty()) {
+    evaluate_exact_batch(code, rows, outputs, results);
+    return;
+  }
+  if (!code.single_precision_slots.empty()) {
+    evaluate_mixed_batch(code, rows, outputs, results);
+    return;
+  }
+  for_each_block(code,
+                 rows,
+                 results.size() / outputs.size(),
+                 [&](const double* columns,
+                     std::size_t first_row,
+                     std::size_t rows_count)
+                 {
+                   for (std::size_t output = 0; output < outputs.size();
+                        output++)
+                   {
+                     const double* column =
+                         columns + outputs[output] * batch_block_size;
+                     for (std::size_t i = 0; i < rows_count; i++) {
+                       results[(first_row + i) * outputs.size() + output] =
+                           column[i];
+                     }
+                   }
+                 });
+}
+
+void reduce_batch(const bytecode& code,
+                  std::span<const double> rows,
+                  slot_index output,
+                  const std::function<void(std::span<const double>)>& reduce)
+{
+  const auto variables_count = code.variables.size();
+  const auto total_rows =
+      variables_count == 0 ? 0 : rows.size() / variables_count;
+  if (code.exact_scales.empty() && code.single_precision_slots.empty()) {
+    for_each_block(
+        code,
+        rows,
+        total_rows,
+        [&](const double* columns, std::size_t, std::size_t rows_count)
+        {
+          reduce(std::span(columns + output * batch_block_size, rows_count));
+        });
+    return;
+  }
+  // The other kernels store a block of results at a time
+  std::array<double, batch_block_size> results {};
+  for (std::size_t first_row = 0; first_row < total_rows;
+       first_row += batch_block_size)
+  {
+    const auto rows_count = std::min(batch_block_size, total_rows - first_row);
+    const auto block = std::span(results.data(), rows_count);
+    evaluate_batch(
+        code,
+        rows.subspan(first_row * variables_count, rows_count * variables_count),
+        std::span(&output, 1),
+        block);
+    reduce(block);
+  }
+}
+
+void evaluate_mixed_batch(const bytecode& code,
+                          std::span<const double> rows,
+                          std::span<const slot_index> outputs,
+                          std::span<double> results)
+{
+  const auto& single = code.single_precision_slots;
+  const auto variables_count = code.variables.size();
+  const auto total_rows = results.size() / outputs.size();
+  thread_local std::vector<double> columns;
+  thread_local std::vector<float> single_columns;
+  columns.resize(code.slots_count * batch_block_size);
+  single_columns.resize(code.slots_count * batch_block_size);
+
+  // Run a function on the column of the slot in its own precision
+  auto with_column = [&](std::size_t slot, auto&& function)
+  {
+    if (single[slot]) {
+      function(single_columns.data() + slot * batch_block_size);
+    } else {
+      function(columns.data() + slot * batch_block_size);
+    }
+  };
+
+  for (std::size_t slot = 0; slot < code.constants.size(); slot++) {
+    with_column(slot,
+                [&](auto* column)
+                {
+                  using value_type = std::remove_pointer_t<decltype(column)>;
+                  std::fill_n(column,
+                              batch_block_size,
+                              static_cast<value_type>(code.constants[slot]));
+                });
+  }
+
+  for (std::size_t first_row = 0; first_row < total_rows;
+       first_row += batch_block_size)
+  {
+    const auto rows_count = std::min(batch_block_size, total_rows - first_row);
+    for (std::size_t variable = 0; variable < variables_count; variable++) {
+      with_column(
+          code.first_variable_slot() + variable,
+          [&](auto* column)
+          {
+            using value_type = std::remove_pointer_t<decltype(column)>;
+            for (std::size_t i = 0; i < rows_count; i++) {
+              column[i] = static_cast<value_type>(
+                  rows[(first_row + i) * variables_count + variable]);
+            }
+          });
+    }
+    run_mixed_block(code,
+                    columns.data(),
+                    single_columns.data(),
+                    batch_block_size,
+                    rows_count);
+    for (std::size_t output = 0; output < outputs.size(); output++) {
+      with_column(outputs[output],
+                  [&](const auto* column)
+                  {
+                    for (std::size_t i = 0; i < rows_count; i++) {
+                      results[(first_row + i) * outputs.size() + output] =
+                          column[i];
+                    }
+                  });
+    }
+  }
+}
+
+void evaluate_exact_batch(const bytecode& code,
+                          std::span<const double> rows,
+                          std::span<const slot_index> outputs,
+                          std::span<double> results)
+{
+  const auto& scales = code.exact_scales;
+  const auto variables_count = code.variables.size();
+  const auto total_rows = results.size() / outputs.size();
+  thread_local std::vector<double> columns;
+  thread_local std::vector<std::int64_t> exact_columns;
+  columns.resize(code.slots_count * batch_block_size);
+  exact_columns.resize(code.slots_count * batch_block_size);
+  auto column = [&](std::size_t slot)
+  { return columns.data() + slot * batch_block_size; };
+  auto exact_column = [&](std::size_t slot)
+  { return exact_columns.data() + slot * batch_block_size; };
+  auto scale = [&](std::size_t slot)
+  { return static_cast<unsigned>(scales[slot]); };
+
+  for (std::size_t slot = 0; slot < code.constants.size(); slot++) {
+    std::fill_n(column(slot), batch_block_size, code.constants[slot]);
+    if (scales[slot] >= 0) {
+      std::fill_n(exact_column(slot),
+                  batch_block_size,
+                  to_exact(code.constants[slot], scale(slot)));
+    }
+  }
+  // Exact results are only converted when a double operation or an output
+  // reads them
+  std::vector<bool> read_as_double(code.slots_count, false);
+  for (const auto& instruction : code.instructions) {
+    if (scales[instruction.destination] < 0) {
+      read_as_double[instruction.left] = true;
+      read_as_double[instruction.right] = true;
+    }
+  }
+  for (const auto slot : outputs) {
+    read_as_double[slot] = true;
+  }
+  // The factors only depend on scales and constants
+  std::vector<exact_factors> factors;
+  factors.reserve(code.instructions.size());
+  for (const auto& instruction : code.instructions) {
+    factors.push_back(scales[instruction.destination] < 0
+                          ? exact_factors {1, 1}
+                          : get_exact_factors(basic_operator(instruction.op),
+                                              scale(instruction.left),
+                                              scale(instruction.right),
+                                              exact_column(instruction.right)[0],
+                                              scale(instruction.destination)));
+  }
+
+  for (std::size_t first_row = 0; first_row < total_rows;
+       first_row += batch_block_size)
+  {
+    const auto rows_count = std::min(batch_block_size, total_rows - first_row);
+    for (std::size_t variable = 0; variable < variables_count; variable++) {
+      const auto slot = code.first_variable_slot() + variable;
+      for (std::size_t i = 0; i < rows_count; i++) {
+        column(slot)[i] = rows[(first_row + i) * variables_count + variable];
+      }
+      if (scales[slot] >= 0) {
+        for (std::size_t i = 0; i < rows_count; i++) {
+          exact_column(slot)[i] = to_exact(column(slot)[i], scale(slot));
+        }
+      }
+    }
+    for (std::size_t index = 0; index < code.instructions.size(); index++) {
+      const auto& instruction = code.instructions[index];
+      const auto destination = instruction.destination;
+      if (scales[destination] < 0) {
+        // Exact operands are read through their double columns
+        apply_columns(basic_operator(instruction.op),
+                      column(destination),
+                      column(instruction.left),
+                      column(instruction.right),
+                      rows_count);
+        continue;
+      }
+      apply_exact_columns(basic_operator(instruction.op),
+                          exact_column(destination),
+                          exact_column(instruction.left),
+                          exact_column(instruction.right),
+                          factors[index],
+                          rows_count);
+      if (!read_as_double[destination]) {
+        continue;
+      }
+      for (std::size_t i = 0; i < rows_count; i++) {
+        column(destination)[i] =
+            from_exact(exact_column(destination)[i], scale(destination));
+      }
+    }
+    for (std::size_t output = 0; output < outputs.size(); output++) {
+      for (std::size_t i = 0; i < rows_count; i++) {
+        results[(first_row + i) * outputs.size() + output] =
+            column(outputs[output])[i];
+      }
+    }
+  }
+}
+
+}  // namespace backend
@@ -0,0 +1,235 @@
+#ifndef BYTECODE_H
+#define BYTECODE_H
+
+#include <algorithm>
+#include <bit>
+#include <cmath>
+#include <cstdint>
+#include <functional>
+#include <map>
+#include <memory>
+#include <set>
+#include <span>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "control_flow_builder.h"
+
+namespace backend
+{
+
+typedef std::uint32_t slot_index;
+
+// The first operations mirror expression_op. Immediate forms read one operand
+// from instruction::immediate instead of a slot, fused forms compute
+// left * right + addend rounded once, like std::fma
+enum class opcode : std::uint32_t
+{
+  add,
+  subtract,
+  divide,
+  multiply,
+  power,
+  add_immediate,  // left + immediate, also left - constant
+  multiply_immediate,
+  divide_immediate,  // left / immediate
+  immediate_subtract,  // immediate - left
+  immediate_divide,  // immediate / left
+  multiply_add,
+  multiply_subtract,  // left * right - addend
+  multiply_add_immediate,  // left * right + immediate
+};
+
+constexpr opcode last_opcode = opcode::multiply_add_immediate;
+
+// Operand fields an opcode does not read repeat left, so every slot field of
+// an instruction is valid
+struct instruction
+{
+  opcode op;
+  slot_index destination;
+  slot_index left;
+  slot_index right;
+  slot_index addend;
+  double immediate;
+};
+
+constexpr bool is_basic(opcode op)
+{
+  return op <= opcode::power;
+}
+
+// Result of an instruction given the values of its left, right and addend
+// slots
+inline double apply_instruction(const instruction& instruction,
+                                double left,
+                                double right,
+                                double addend)
+{
+  switch (instruction.op) {
+    case opcode::add:
+      return left + right;
+    case opcode::subtract:
+      return left - right;
+    case opcode::divide:
+      return left / right;
+    case opcode::multiply:
+      return left * right;
+    case opcode::power:
+      return std::pow(left, right);
+    case opcode::add_immediate:
+      return left + instruction.immediate;
+    case opcode::multiply_immediate:
+      return left * instruction.immediate;
+    case opcode::divide_immediate:
+      return left / instruction.immediate;
+    case opcode::immediate_subtract:
+      return instruction.immediate - left;
+    case opcode::immediate_divide:
+      return instruction.immediate / left;
+    case opcode::multiply_add:
+      return std::fma(left, right, addend);
+    case opcode::multiply_subtract:
+      return std::fma(left, right, -addend);
+    case opcode::multiply_add_immediate:
+      return std::fma(left, right, instruction.immediate);
+  }
+  return 0;  // UNREACHABLE
+}
+
+// Flat, immutable form of the optimized control flow data used for
+// evaluation. Values live in numbered slots: the constants come first,
+// followed by one slot per distinct variable name and the instruction results.
+// A result slot may be written by several instructions, each value is read
+// before the next instruction writing its slot.
+//
+// The constant pool and the instructions are views into storage, which is
+// either built by lower() or a mapped IR file (see map_ir), so copies of a
+// bytecode share them
+struct bytecode
+{
+  std::span<const double> constants;
+  std::vector<std::string> variables;
+  std::span<const instruction> instructions;
+  std::vector<std::string> output_names;
+  std::vector<slot_index> output_slots;
+  slot_index slots_count = 0;
+  slot_index output_slot = 0;  // Last output, the result of an expression
+  std::size_t saved_operations = 0;  // See control_flow_data::get_sharing_stats
+  // Slots evaluate_batch() computes and stores in single precision, empty
+  // when everything runs in double. See analyze_precision
+  std::vector<bool> single_precision_slots;
+  double error_bound = 0;  // Proven relative error of the outputs
+  // Scale of every slot evaluated exactly in int64 and -1 for doubles, empty
+  // when nothing is exact. See infer_types
+  std::vector<int> exact_scales;
+  std::shared_ptr<const void> storage;  // Keeps the views alive
+
+  constexpr slot_index first_variable_slot() const
+  {
+    return static_cast<slot_index>(constants.size());
+  }
+};
+
+// Code specialized for variables bound to the values they usually take, run
+// instead of the general code when every guard holds. It reads the variables
+// of the general code, see rebase_variables()
+// Whether two values have the same bits: -0.0 is not 0, whose division
+// gives infinities of the other sign, and a NaN is itself
+inline bool identical(double left, double right)
+{
+  return std::bit_cast<std::uint64_t>(left)
+      == std::bit_cast<std::uint64_t>(right);
+}
+
+struct guarded_code
+{
+  // Index into the variables and the value it must equal
+  std::vector<std::pair<std::size_t, double>> guards;
+  bytecode code;
+
+  bool guards_hold(std::span<const double> values) const
+  {
+    return std::all_of(
+        guards.begin(),
+        guards.end(),
+        [&](const std::pair<std::size_t, double>& guard)
+        { return identical(values[guard.first], guard.second); });
+  }
+};
+
+struct lowering_options
+{
+  // Instructions follow schedule_operations() and a result slot is reused
+  // once the last instruction reading it has run, so slots_count is the peak
+  // number of live values. Otherwise instructions keep the ssa_position order
+  // and every result has its own slot
+  bool reuse_slots = true;
+  // Read constant operands from the instruction, results are unchanged
+  bool immediate_operands = true;
+  // Compute a * b + c and a * b - c with one rounding when the product has no
+  // other use. Results may differ in the last bits, like -ffast-math
+  bool fuse_multiply_add = false;
+};
+
+// Values at the single_precision positions are evaluated in float and the
+// ones with exact_scales in int64 by evaluate_batch(), such code only uses
+// the basic opcodes
+bytecode lower(const control_flow_data& data,
+               const std::set<ssa_position>& single_precision = {},
+               const std::map<ssa_position, unsigned>& exact_scales = {},
+               lowering_options options = {});
+
+// Same code reading a list of variables that contains its own, e.g. the
+// variables of the program it was specialized from, so both take the same
+// values. Only for code without single precision or exact slots
+bytecode rebase_variables(const bytecode& code,
+                          const std::vector<std::string>& variables);
+
+// Run every instruction with the variables given in bytecode::variables
+// order, the slots buffer must hold at least slots_count values. Every output
+// can be read from its slot afterwards
+void execute(const bytecode& code,
+             std::span<const double> variables,
+             std::span<double> slots);
+
+inline double evaluate(const bytecode& code,
+                       std::span<const double> variables,
+                       std::span<double> slots)
+{
+  execute(code, variables, slots);
+  return slots[code.output_slot];
+}
+
+// Evaluate every row of a row-major table with one column per variable and
+// write the given output slots row by row into results. Rows are processed in
+// column blocks so every instruction runs as a tight loop over the block
+void evaluate_batch(const bytecode& code,
+                    std::span<const double> rows,
+                    std::span<const slot_index> outputs,
+                    std::span<double> results);
+
+// Like evaluate_batch() for one output slot, handing its values to reduce
+// block by block instead of storing them, so memory does not grow with the
+// number of rows. Code without variables has no rows
+void reduce_batch(const bytecode& code,
+                  std::span<const double> rows,
+                  slot_index output,
+                  const std::function<void(std::span<const double>)>& reduce);
+
+// evaluate_batch() for code with single precision slots
+void evaluate_mixed_batch(const bytecode& code,
+                          std::span<const double> rows,
+                          std::span<const slot_index> outputs,
+                          std::span<double> results);
+
+// evaluate_batch() for code with exact slots, throws std::overflow_error
+void evaluate_exact_batch(const bytecode& code,
+                          std::span<const double> rows,
+                          std::span<const slot_index> outputs,
+                          std::span<double> results);
+
+}  // namespace backend
+
+#endif
@@ -0,0 +1,389 @@
+#include <charconv>
+#include <fstream>
+#include <functional>
+#include <sstream>
+#include <thread>
+
+#include "compilation_cache.h"
+
+#include <unistd.h>
+
+#include "source_graph.h"
+
+namespace
+{
+constexpr std::string_view disk_format_header = "maths_static_compiler-ir 2";
+
+auto constexpr is_whitespace(char symbol) -> bool
+{
+  return symbol == '\n' || symbol == '\r' || symbol == '\t' || symbol == ' ';
+}
+
+auto constexpr is_word(char symbol) -> bool
+{
+  return ('0' <= symbol && symbol <= '9') || ('a' <= symbol && symbol <= 'z')
+      || ('A' <= symbol && symbol <= 'Z') || symbol == '.';
+}
+
+std::uint64_t hash_text(std::string_view text)
+{
+  std::uint64_t hash = 0xcbf29ce484222325ULL;  // FNV-1a
+  for (const char symbol : text) {
+    hash ^= static_cast<unsigned char>(symbol);
+    hash *= 0x100000001b3ULL;
+  }
+  return hash;
+}
+
+std::string key_to_string(std::uint64_t key)
+{
+  std::array<char, 16> buffer {};
+  auto [end, _] = std::to_chars(buffer.begin(), buffer.end(), key, 16);
+  return std::string(static_cast<std::size_t>(buffer.end() - end), '0')
+      + std::string(buffer.begin(), end);
+}
+
+std::string double_to_string(double value)
+{
+  std::array<char, 64> buffer {};
+  auto [end, _] = std::to_chars(
+      buffer.begin(), buffer.end(), value, std::chars_format::hex);
+  return std::string(buffer.begin(), end);
+}
+
+std::optional<double> string_to_double(const std::string& str)
+{
+  double value = 0;
+  auto [end, error] = std::from_chars(
+      str.data(), str.data() + str.size(), value, std::chars_format::hex);
+  if (error != std::errc() || end != str.data() + str.size()) {
+    return std::nullopt;
+  }
+  return value;
+}
+
+void write_data(std::ostream& stream, const backend::control_flow_data& data)
+{
+  stream << disk_format_header << '\n';
+  for (const auto& [position, define] : data.defines) {
+    stream << "define " << position << ' ' << double_to_string(define)
+           << '\n';
+  }
+  for (const auto& [position, variable] : data.variables) {
+    stream << "variable " << position << ' ' << variable << '\n';
+  }
+  for (const auto& [position, expr] : data.expressions) {
+    stream << "expression " << position << ' ' << expr.get_left() << ' '
+           << backend::expression_op_to_string(expr.get_operator()) << ' '
+           << expr.get_right() << '\n';
+  }
+  for (const auto& [name, position] : data.outputs) {
+    stream << "output " << position << ' ' << name << '\n';
+  }
+}
+
+std::optional<backend::control_flow_data> read_data(std::istream& stream)
+{
+  static const std::map<std::string, backend::expression_op> operators = {
+      {"+", backend::expression_op::add},
+      {"-", backend::expression_op::subtract},
+      {"/", backend::expression_op::divide},
+      {"*", backend::expression_op::multiply},
+      {"^", backend::expression_op::power},
+  };
+
+  std::string line;
+  if (!std::getline(stream, line) || line != disk_format_header) {
+    return std::nullopt;
+  }
+  backend::control_flow_data data;
+  data.defines.clear();
+  ssa_position last_position = 0;
+  // A damaged file must not name positions the graph lacks, operands are
+  // written before their users
+  auto known = [&](ssa_position position)
+  {
+    return data.defines.contains(position)
+        || data.variables.contains(position)
+        || data.expressions.contains(position);
+  };
+  while (std::getline(stream, line)) {
+    std::istringstream line_stream(line);
+    std::string kind;
+    ssa_position position = 0;
+    if (!(line_stream >> kind >> position)) {
+      return std::nullopt;
+    }
+    if (kind == "output") {
+      if (!known(position)) {
+        return std::nullopt;
+      }
+      std::string name;
+      line_stream >> name;
+      data.outputs.emplace_back(name, position);
+      continue;
+    }
+    if (known(position)) {
+      return std::nullopt;
+    }
+    if (kind == "define") {
+      std::string value;
+      line_stream >> value;
+      auto define = string_to_double(value);
+      if (!define.has_value()) {
+        return std::nullopt;
+      }
+      data.defines[position] = *define;
+    } else if (kind == "variable") {
+      std::string name;
+      line_stream >> name;
+      data.variables[position] = name;
+    } else if (kind == "expression") {
+      ssa_position left = 0;
+      ssa_position right = 0;
+      std::string op;
+      line_stream >> left >> op >> right;
+      if (!line_stream || !operators.contains(op) || !known(left)
+          || !known(right) || left >= position || right >= position)
+      {
+        return std::nullopt;
+      }
+      data.expressions.insert(std::make_pair(
+          position, backend::expression(left, operators.at(op), right)));
+      data.uses[left].insert(position);
+      data.uses[right].insert(position);
+    } else {
+      return std::nullopt;
+    }
+    data.uses[position];
+    last_position = std::max(last_position, position);
+  }
+  if (data.outputs.empty()) {
+    return std::nullopt;
+  }
+  data.out_index = data.outputs.back().second;
+  data.control_flow_index = last_position + 1;
+  return data;
+}
+
+// Write through a temporary file, so concurrent readers (possibly from other
+// processes) never observe a partially written entry
+void write_file_atomically(const std::filesystem::path& path,
+                           const std::string& content)
+{
+  // Thread ids repeat across processes sharing the directory, process ids
+  // do not while they run
+  auto temporary_path = path;
+  temporary_path += ".tmp" + std::to_string(::getpid()) + '-'
+      + std::to_string(std::hash<std::thread::id> {}(std::this_thread::get_id()));
+  {
+    std::ofstream file(temporary_path, std::ios::trunc);
+    if (!file.is_open()) {
+      return;
+    }
+    file << content;
+    if (!file) {
+      return;
+    }
+  }
+  std::error_code error;
+  std::filesystem::rename(temporary_path, path, error);
+  if (error) {
+    std::filesystem::remove(temporary_path, error);
+  }
+}
+
+}  // namespace
+
+namespace backend
+{
+
+compilation_cache::compilation_cache(
+    std::size_t capacity, std::optional<std::filesystem::path> directory)
+    : m_shard_capacity {std::max<std::size_t>(1, capacity / shards_count)}
+    , m_directory {std::move(directory)}
+{
+  if (m_directory.has_value()) {
+    std::filesystem::create_directories(*m_directory);
+  }
+}
+
+compilation_cache::data_ptr compilation_cache::get_or_compile(
+    std::string_view source, const std::map<std::string, double>& definitions)
+{
+  // Sources never contain '#', so the suffix cannot be confused with them
+  auto normalized_source = normalize_source(source);
+  for (const auto& [name, value] : definitions) {
+    normalized_source += " #" + name + '=' + double_to_string(value);
+  }
+  const auto source_hash = hash_text(normalized_source);
+
+  auto alias = m_aliases[source_hash % shards_count].find(source_hash);
+  if (alias.has_value() && alias->normalized_source == normalized_source) {
+    if (auto data = find_entry(alias->key)) {
+      m_hits++;
+      return data;
+    }
+  }
+
+  if (m_directory.has_value()) {
+    if (auto key = load_alias_from_disk(source_hash, normalized_source)) {
+      auto data = find_entry(*key);
+      if (data) {
+        m_hits++;
+      } else if ((data = load_from_disk(*key))) {
+        m_disk_hits++;
+        data = find_or_insert_entry(*key, data);
+      }
+      if (data) {
+        insert_alias(source_hash, {std::move(normalized_source), *key});
+        return data;
+      }
+    }
+  }
+
+  m_misses++;
+  auto graph = source_graph(source);
+  if (!definitions.empty()) {
+    graph.builder().define_variables(definitions);
+  }
+  data_ptr data = std::make_shared<const control_flow_data>(graph.data());
+
+  const auto key = data->canonical_hash();
+  auto cached = find_or_insert_entry(key, data);
+  bool stored = true;
+  if (cached == data) {
+    stored = store_to_disk(key, *data);
+  } else if (cached->is_equivalent(*data)) {
+    data = cached;  // Another spelling of the same graph is already cached
+  } else {
+    return data;  // The hashes collide, the source keeps being compiled
+  }
+  source_alias new_alias {std::move(normalized_source), key};
+  if (stored) {
+    store_alias_to_disk(source_hash, new_alias);
+  }
+  insert_alias(source_hash, std::move(new_alias));
+  return data;
+}
+
+compilation_cache_stats compilation_cache::stats() const
+{
+  return compilation_cache_stats {
+      .hits = m_hits.load(),
+      .disk_hits = m_disk_hits.load(),
+      .misses = m_misses.load(),
+      .evictions = m_evictions.load(),
+  };
+}
+
+std::string compilation_cache::normalize_source(std::string_view source)
+{
+  std::string normalized;
+  normalized.reserve(source.size());
+  bool pending_space = false;
+  for (const char symbol : source) {
+    if (is_whitespace(symbol)) {
+      pending_space = !normalized.empty();
+      continue;
+    }
+    const char previous = normalized.empty() ? '\0' : normalized.back();
+    if (pending_space
+        && ((is_word(previous) && is_word(symbol))
+            || (previous == '*' && symbol == '*')))
+    {
+      normalized.push_back(' ');
+    }
+    pending_space = false;
+    normalized.push_back(symbol);
+  }
+  return normalized;
+}
+
+compilation_cache::data_ptr compilation_cache::find_entry(std::uint64_t key)
+{
+  return m_entries[key % shards_count].find(key).value_or(nullptr);
+}
+
+compilation_cache::data_ptr compilation_cache::find_or_insert_entry(
+    std::uint64_t key, data_ptr data)
+{
+  auto [cached, evicted] = m_entries[key % shards_count].find_or_insert(
+      key, std::move(data), m_shard_capacity);
+  m_evictions += evicted;
+  return cached;
+}
+
+void compilation_cache::insert_alias(std::uint64_t source_hash,
+                                     source_alias alias)
+{
+  // Aliases only point at entries, losing one costs a recompilation at most,
+  // so their evictions are not reported
+  m_aliases[source_hash % shards_count].insert(
+      source_hash, std::move(alias), m_shard_capacity);
+}
+
+compilation_cache::data_ptr compilation_cache::load_from_disk(
+    std::uint64_t key) const
+{
+  std::ifstream file(*m_directory / (key_to_string(key) + ".ir"));
+  if (!file.is_open()) {
+    return nullptr;
+  }
+  auto data = read_data(file);
+  if (!data.has_value() || data->canonical_hash() != key) {
+    return nullptr;  // Corrupted or written by an incompatible version
+  }
+  return std::make_shared<const control_flow_data>(std::move(*data));
+}
+
+std::optional<std::uint64_t> compilation_cache::load_alias_from_disk(
+    std::uint64_t source_hash, const std::string& normalized_source) const
+{
+  std::ifstream file(*m_directory / (key_to_string(source_hash) + ".src"));
+  std::string stored_source;
+  std::string key;
+  if (!file.is_open() || !std::getline(file, stored_source)
+      || !std::getline(file, key) || stored_source != normalized_source)
+  {
+    return std::nullopt;
+  }
+  std::uint64_t value = 0;
+  auto [end, error] =
+      std::from_chars(key.data(), key.data() + key.size(), value, 16);
+  if (error != std::errc() || end != key.data() + key.size()) {
+    return std::nullopt;
+  }
+  return value;
+}
+
+bool compilation_cache::store_to_disk(std::uint64_t key,
+                                      const control_flow_data& data) const
+{
+  if (!m_directory.has_value()) {
+    return true;
+  }
+  // The first graph written under a key stays, other processes may have
+  // aliased sources to it
+  if (auto existing = load_from_disk(key)) {
+    return existing->is_equivalent(data);
+  }
+  std::ostringstream stream;
+  write_data(stream, data);
+  write_file_atomically(*m_directory / (key_to_string(key) + ".ir"),
+                        stream.str());
+  return true;
+}
+
+void compilation_cache::store_alias_to_disk(std::uint64_t source_hash,
+                                            const source_alias& alias) const
+{
+  if (!m_directory.has_value()) {
+    return;
+  }
+  write_file_atomically(*m_directory / (key_to_string(source_hash) + ".src"),
+                        alias.normalized_source + '\n'
+                            + key_to_string(alias.key) + '\n');
+}
+
+}  // namespace backend
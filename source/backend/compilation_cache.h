@@ -0,0 +1,170 @@
+#ifndef COMPILATION_CACHE_H
+#define COMPILATION_CACHE_H
+
+#include <array>
+#include <atomic>
+#include <cstdint>
+#include <filesystem>
+#include <list>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+
+#include "control_flow_builder.h"
+
+namespace backend
+{
+
+struct compilation_cache_stats
+{
+  std::uint64_t hits;  // Served from memory
+  std::uint64_t disk_hits;  // Served from the cache directory
+  std::uint64_t misses;  // Went through the whole pipeline
+  std::uint64_t evictions;  // Dropped from memory by the LRU policy
+};
+
+// Cache of optimized control flow data in front of the compiler pipeline.
+//
+// Entries are keyed by control_flow_data::canonical_hash(), so spellings that
+// optimize to the same graph ("a*b" and "(b) * a") share a single entry. A
+// graph whose hash collides with a cached, different graph is not cached. A
+// second, cheaper index maps the normalized source text to that key, which
+// lets repeated inputs skip lexing, parsing and every optimization pass.
+//
+// Both indexes are size-bounded LRUs split into independently locked shards,
+// so concurrent lookups of different formulas rarely contend. When a cache
+// directory is given, entries are also persisted there and survive restarts.
+//
+// Programs specialized for bound variables are indexed by their source text
+// together with the values, so every parameter set gets its own entry.
+class compilation_cache
+{
+public:
+  using data_ptr = std::shared_ptr<const control_flow_data>;
+
+  explicit compilation_cache(
+      std::size_t capacity = 4096,
+      std::optional<std::filesystem::path> directory = std::nullopt);
+
+  // Return the compiled data for the source, compiling it on a miss.
+  // Variables given definitions are bound at compile time, see
+  // control_flow_builder::define_variables(). Compilation errors propagate as
+  // the pipeline's own exceptions
+  data_ptr get_or_compile(
+      std::string_view source,
+      const std::map<std::string, double>& definitions = {});
+
+  compilation_cache_stats stats() const;
+
+  // Whitespace-insensitive form of the source used by the text index. Spaces
+  // are only kept where removing them would merge two tokens
+  static std::string normalize_source(std::string_view source);
+
+private:
+  static constexpr std::size_t shards_count = 16;
+
+  template<typename Value>
+  class lru_shard
+  {
+  public:
+    std::optional<Value> find(std::uint64_t key)
+    {
+      std::lock_guard lock(m_mutex);
+      auto it = m_index.find(key);
+      if (it == m_index.end()) {
+        return std::nullopt;
+      }
+      m_order.splice(m_order.begin(), m_order, it->second);
+      return it->second->second;
+    }
+
+    // Returns the number of evicted entries
+    std::size_t insert(std::uint64_t key, Value value, std::size_t capacity)
+    {
+      std::lock_guard lock(m_mutex);
+      if (auto it = m_index.find(key); it != m_index.end()) {
+        it->second->second = std::move(value);
+        m_order.splice(m_order.begin(), m_order, it->second);
+        return 0;
+      }
+      return insert_new(key, std::move(value), capacity);
+    }
+
+    // Insert unless the key is already present, return the value stored
+    // under the key and the number of evicted entries
+    std::pair<Value, std::size_t> find_or_insert(std::uint64_t key,
+                                                 Value value,
+                                                 std::size_t capacity)
+    {
+      std::lock_guard lock(m_mutex);
+      if (auto it = m_index.find(key); it != m_index.end()) {
+        m_order.splice(m_order.begin(), m_order, it->second);
+        return {it->second->second, 0};
+      }
+      const auto evicted = insert_new(key, value, capacity);
+      return {std::move(value), evicted};
+    }
+
+  private:
+    using entry = std::pair<std::uint64_t, Value>;
+
+    std::size_t insert_new(std::uint64_t key,
+                           Value value,
+                           std::size_t capacity)
+    {
+      m_order.emplace_front(key, std::move(value));
+      m_index[key] = m_order.begin();
+      std::size_t evicted = 0;
+      while (m_order.size() > capacity) {
+        m_index.erase(m_order.back().first);
+        m_order.pop_back();
+        evicted++;
+      }
+      return evicted;
+    }
+
+    std::mutex m_mutex;
+    std::list<entry> m_order;  // Most recently used first
+    std::unordered_map<std::uint64_t, typename std::list<entry>::iterator>
+        m_index;
+  };
+
+  struct source_alias
+  {
+    std::string normalized_source;  // Guards against text hash collisions
+    std::uint64_t key;
+  };
+
+  data_ptr find_entry(std::uint64_t key);
+  // The entry already cached under the key when there is one
+  data_ptr find_or_insert_entry(std::uint64_t key, data_ptr data);
+  void insert_alias(std::uint64_t source_hash, source_alias alias);
+
+  data_ptr load_from_disk(std::uint64_t key) const;
+  std::optional<std::uint64_t> load_alias_from_disk(
+      std::uint64_t source_hash, const std::string& normalized_source) const;
+  // False when the directory holds another graph under the key, whose hash
+  // collides with this one
+  bool store_to_disk(std::uint64_t key, const control_flow_data& data) const;
+  void store_alias_to_disk(std::uint64_t source_hash,
+                           const source_alias& alias) const;
+
+  std::size_t m_shard_capacity;
+  std::optional<std::filesystem::path> m_directory;
+
+  std::array<lru_shard<data_ptr>, shards_count> m_entries;
+  std::array<lru_shard<source_alias>, shards_count> m_aliases;
+
+  std::atomic<std::uint64_t> m_hits = 0;
+  std::atomic<std::uint64_t> m_disk_hits = 0;
+  std::atomic<std::uint64_t> m_misses = 0;
+  std::atomic<std::uint64_t> m_evictions = 0;
+};
+
+}  // namespace backend
+
+#endif
@@ -1,13 +1,552 @@
+#include <algorithm>
+#include <atomic>
+#include <bit>
+#include <cmath>
+#include <exception>
+#include <latch>
+#include <limits>
+#include <optional>
+#include <string_view>
+#include <tuple>
+#include <unordered_map>
+#include <utility>
+#include <vector>
 
 #include "control_flow_builder.h"
 
-#include "boost/json.hpp"
 #include "exceptions.h"
 #include "frontend/parsing/expression.h"
+#include "polynomial.h"
 
 namespace backend
 {
 
+namespace
+{
+constexpr std::uint64_t hash_mix(std::uint64_t seed, std::uint64_t value)
+{
+  // splitmix64 finalizer over the combined value
+  std::uint64_t x = seed ^ (value + 0x9e3779b97f4a7c15ULL + (seed << 6U)
+                            + (seed >> 2U));
+  x = (x ^ (x >> 30U)) * 0xbf58476d1ce4e5b9ULL;
+  x = (x ^ (x >> 27U)) * 0x94d049bb133111ebULL;
+  return x ^ (x >> 31U);
+}
+
+std::uint64_t hash_string(const std::string& str)
+{
+  std::uint64_t hash = 0xcbf29ce484222325ULL;  // FNV-1a
+  for (const char symbol : str) {
+    hash ^= static_cast<unsigned char>(symbol);
+    hash *= 0x100000001b3ULL;
+  }
+  return hash;
+}
+
+enum hash_tag : std::uint64_t
+{
+  define_tag = 1,
+  variable_tag,
+  expression_tag,
+};
+
+
+expression_op binary_operator(frontend::token_type type)
+{
+  static const std::map<frontend::token_type, expression_op>
+      expression_map = {
+      {frontend::token_type::multiply, expression_op::multiply},
+      {frontend::token_type::add, expression_op::add},
+      {frontend::token_type::subtract, expression_op::subtract},
+      {frontend::token_type::delimiter, expression_op::divide},
+      {frontend::token_type::power, expression_op::power},
+  };
+
+  auto it = expression_map.find(type);
+  if (it == expression_map.end()) {
+    throw control_flow_error(
+        "Not implemented binary expression construction for this operator");
+  }
+  return it->second;
+}
+
+constexpr const char* variable_exponent_message =
+    "Derivatives of powers with a variable exponent are not supported";
+
+// Larger integer exponents go to the power operation, whose result is
+// rounded once rather than after every multiplication
+constexpr unsigned max_chain_exponent = 256;
+
+// Depth-first search for an ascending chain 1 = a0 < a1 < ... = target
+// where every element is the sum of two earlier ones, with at most length
+// additions
+bool find_addition_chain(unsigned target,
+                         std::size_t length,
+                         std::vector<unsigned>& chain)
+{
+  const auto last = chain.back();
+  if (last == target) {
+    return true;
+  }
+  const auto remaining = length + 1 - chain.size();
+  // Doubling at every remaining step is the fastest way up
+  if (remaining == 0 || (std::uint64_t {last} << remaining) < target) {
+    return false;
+  }
+  for (auto i = chain.size(); i-- > 0;) {
+    for (auto j = i + 1; j-- > 0;) {
+      const auto next = chain[i] + chain[j];
+      if (next <= last) {
+        break;
+      }
+      if (next > target) {
+        continue;
+      }
+      chain.push_back(next);
+      if (find_addition_chain(target, length, chain)) {
+        return true;
+      }
+      chain.pop_back();
+    }
+  }
+  return false;
+}
+
+// Shortest addition chain of every exponent up to max_chain_exponent, so
+// x^n takes chain.size() - 1 multiplications, e.g. 5 for x^13 or x^15
+const std::vector<unsigned>& addition_chain(unsigned exponent)
+{
+  static const auto chains = []
+  {
+    std::vector<std::vector<unsigned>> shortest(max_chain_exponent + 1);
+    for (unsigned target = 1; target <= max_chain_exponent; target++) {
+      auto& chain = shortest[target] = {1};
+      auto length = static_cast<std::size_t>(std::bit_width(target) - 1);
+      while (!find_addition_chain(target, length, chain)) {
+        length++;
+      }
+    }
+    return shortest;
+  }();
+  return chains.at(exponent);
+}
+
+// Powers with a constant integer exponent become multiplications, computed
+// once for both lowerings so they build the same graph. Constant powers are
+// folded, value_of gives the literal a value stands for
+template<typename Value, typename ValueOf, typename Operation, typename Define>
+Value lower_power(Value base,
+                  Value exponent,
+                  ValueOf value_of,
+                  Operation operation,
+                  Define define)
+{
+  const std::optional<double> exponent_value = value_of(exponent);
+  if (!exponent_value.has_value()) {
+    return operation(base, expression_op::power, exponent);
+  }
+  if (const std::optional<double> base_value = value_of(base)) {
+    return define(std::pow(*base_value, *exponent_value));
+  }
+  const auto magnitude = std::fabs(*exponent_value);
+  double integral_part = 0;
+  if (std::fpclassify(std::modf(magnitude, &integral_part)) != FP_ZERO
+      || magnitude > max_chain_exponent)
+  {
+    return operation(base, expression_op::power, exponent);
+  }
+  if (std::fpclassify(magnitude) == FP_ZERO) {
+    return define(1);  // Like std::pow, even for a NaN base
+  }
+  const auto& chain = addition_chain(static_cast<unsigned>(magnitude));
+  std::vector<Value> powers {base};
+  for (std::size_t k = 1; k < chain.size(); k++) {
+    // Any two earlier powers adding up to this one
+    const auto* end = chain.data() + k;
+    for (std::size_t i = k; i-- > 0;) {
+      const auto* j = std::find(chain.data(), end, chain[k] - chain[i]);
+      if (j != end) {
+        const auto other = static_cast<std::size_t>(j - chain.data());
+        powers.push_back(
+            operation(powers[i], expression_op::multiply, powers[other]));
+        break;
+      }
+    }
+  }
+  if (*exponent_value < 0) {
+    return operation(define(1), expression_op::divide, powers.back());
+  }
+  return powers.back();
+}
+
+// Operation identity for value numbering, commutative operands unordered
+struct value_key
+{
+  ssa_position left;
+  expression_op op;
+  ssa_position right;
+
+  static value_key of(ssa_position left, expression_op op, ssa_position right)
+  {
+    if ((op == expression_op::add || op == expression_op::multiply)
+        && right < left)
+    {
+      std::swap(left, right);
+    }
+    return {left, op, right};
+  }
+
+  bool operator==(const value_key& other) const = default;
+};
+
+struct value_key_hash
+{
+  std::size_t operator()(const value_key& key) const
+  {
+    return hash_mix(hash_mix(key.op, key.left), key.right);
+  }
+};
+
+enum class fragment_node_kind
+{
+  define,
+  name,
+  partition,  // Root of another partition
+  operation,
+};
+
+struct fragment_node
+{
+  fragment_node_kind kind;
+  expression_op op = expression_op::add;
+  std::size_t left = 0;  // Operand nodes, or the index of the other partition
+  std::size_t right = 0;
+  double value = 0;
+  std::string_view name = {};
+};
+
+// Subtree lowered on its own, with its copies already merged
+struct partition
+{
+  explicit partition(const frontend::expression* subtree)
+      : root(subtree)
+  {
+  }
+
+  const frontend::expression* root;
+  // In the order the serial lowering would add them, the root last
+  std::vector<fragment_node> nodes;
+  // Lowering stops at the first error, which is reported when merging
+  // reaches that point
+  std::exception_ptr error;
+};
+
+// Syntax tree nodes starting another partition
+using partition_roots =
+    std::unordered_map<const frontend::expression*, std::size_t>;
+
+std::array<const frontend::expression*, 2> children_of(
+    const frontend::expression& expr)
+{
+  if (auto binary = dynamic_cast<const frontend::binary_expression*>(&expr)) {
+    return {binary->get_left(), binary->get_right()};
+  }
+  if (auto grouping = dynamic_cast<const frontend::grouping_expression*>(&expr))
+  {
+    return {grouping->get_expr(), nullptr};
+  }
+  if (auto unary = dynamic_cast<const frontend::unary_expression*>(&expr)) {
+    return {unary->get_expr(), nullptr};
+  }
+  return {nullptr, nullptr};
+}
+
+// Iterative, as partitions are only cut at their size and may be deep
+void lower_partition(partition& part, const partition_roots& roots)
+{
+  std::unordered_map<value_key, std::size_t, value_key_hash> operations;
+  std::unordered_map<std::uint64_t, std::size_t> defines;
+  std::unordered_map<std::string_view, std::size_t> names;
+  auto add_node = [&](fragment_node node)
+  {
+    part.nodes.push_back(node);
+    return part.nodes.size() - 1;
+  };
+  // Literals are only merged when identical here, the merge applies the
+  // tolerance of the builder
+  auto define = [&](double value)
+  {
+    auto [it, inserted] = defines.try_emplace(
+        std::bit_cast<std::uint64_t>(value), part.nodes.size());
+    if (inserted) {
+      add_node({.kind = fragment_node_kind::define, .value = value});
+    }
+    return it->second;
+  };
+  auto operation = [&](std::size_t left, expression_op op, std::size_t right)
+  {
+    auto [it, inserted] = operations.try_emplace(
+        value_key::of(left, op, right), part.nodes.size());
+    if (inserted) {
+      add_node({.kind = fragment_node_kind::operation,
+                .op = op,
+                .left = left,
+                .right = right});
+    }
+    return it->second;
+  };
+  auto literal = [&](std::size_t node) -> std::optional<double>
+  {
+    if (part.nodes[node].kind != fragment_node_kind::define) {
+      return std::nullopt;
+    }
+    return part.nodes[node].value;
+  };
+
+  struct pending
+  {
+    const frontend::expression* expr;
+    bool expanded;  // Operands are on the values stack
+  };
+  std::vector<pending> work {{part.root, false}};
+  std::vector<std::size_t> values;
+  try {
+    while (!work.empty()) {
+      const auto [expr, expanded] = work.back();
+      work.pop_back();
+      if (auto it = roots.find(expr); expr != part.root && it != roots.end()) {
+        values.push_back(add_node(
+            {.kind = fragment_node_kind::partition, .left = it->second}));
+      } else if (auto binary =
+                     dynamic_cast<const frontend::binary_expression*>(expr))
+      {
+        if (!expanded) {
+          work.push_back({expr, true});
+          work.push_back({binary->get_right(), false});
+          work.push_back({binary->get_left(), false});
+          continue;
+        }
+        const auto right = values.back();
+        values.pop_back();
+        const auto left = values.back();
+        const auto op = binary_operator(binary->get_token().get_type());
+        values.back() = op == expression_op::power
+            ? lower_power(left, right, literal, operation, define)
+            : operation(left, op, right);
+      } else if (auto grouping =
+                     dynamic_cast<const frontend::grouping_expression*>(expr))
+      {
+        work.push_back({grouping->get_expr(), false});
+      } else if (auto number =
+                     dynamic_cast<const frontend::number_expression*>(expr))
+      {
+        values.push_back(define(number->get_value()));
+      } else if (auto variable =
+                     dynamic_cast<const frontend::variable_expression*>(expr))
+      {
+        const std::string_view name = variable->get_token().get_lexeme();
+        auto [named, inserted] = names.try_emplace(name, part.nodes.size());
+        if (inserted) {
+          add_node({.kind = fragment_node_kind::name, .name = name});
+        }
+        values.push_back(named->second);
+      } else if (auto unary =
+                     dynamic_cast<const frontend::unary_expression*>(expr))
+      {
+        if (!expanded) {
+          work.push_back({expr, true});
+          work.push_back({unary->get_expr(), false});
+          continue;
+        }
+        if (unary->get_token().get_type() != frontend::token_type::subtract) {
+          throw control_flow_error(
+              "Not implemented unary expression construction for this "
+              "operator");
+        }
+        values.back() =
+            operation(values.back(), expression_op::multiply, define(-1));
+      } else {
+        throw control_flow_error(
+            "No implemented for this expression");  // UNREACHABLE
+      }
+    }
+  } catch (...) {
+    part.error = std::current_exception();
+  }
+}
+
+}  // namespace
+
+control_flow_data::control_flow_data(std::pmr::memory_resource* resource)
+    : defines(resource)
+    , variables(resource)
+    , expressions(resource)
+    , uses(resource)
+    , outputs(resource)
+{
+  defines = {
+      {MINUS_ONE_SSA_POSITION, -1},
+      {ZERO_SSA_POSITION, 0},
+      {ONE_SSA_POSITION, 1},
+  };
+}
+
+control_flow_builder::control_flow_builder(
+    const std::vector<frontend::statement>& statements,
+    support::statistics* statistics,
+    support::arena* arena,
+    support::thread_pool* pool,
+    bool optimized)
+    : m_resource(resource_of(arena))
+    , m_data(m_resource)
+    , m_statistics(statistics)
+    , m_bindings(m_resource)
+    , m_variable_positions(m_resource)
+{
+  if (m_statistics != nullptr) {
+    m_statistics->begin_phase("lowering");
+  }
+  const bool values_numbered =
+      pool != nullptr && add_partitioned(statements, *pool);
+  if (!values_numbered) {
+    for (const auto& statement : statements) {
+      add_statement(statement, add_expression(*statement.get_expr()));
+    }
+  }
+  if (m_data.outputs.empty()) {
+    throw control_flow_error("Expect at least one output statement");
+  }
+  m_data.out_index = m_data.outputs.back().second;
+  if (m_statistics != nullptr) {
+    m_statistics->end_phase(m_data.get_ir_size());
+  }
+  if (optimized) {
+    optimize(values_numbered);
+  }
+}
+
+bool control_flow_builder::add_partitioned(
+    const std::vector<frontend::statement>& statements,
+    support::thread_pool& pool)
+{
+  // Cut the syntax trees bottom up wherever a subtree not yet in a partition
+  // reaches the partition size, a cut subtree counts as one node above it
+  std::vector<partition> partitions;
+  partition_roots roots;
+  std::vector<std::size_t> statement_partitions;
+  std::vector<std::pair<const frontend::expression*, bool>> work;
+  std::vector<std::size_t> sizes;
+  for (const auto& statement : statements) {
+    const auto* root = statement.get_expr();
+    work.assign(1, {root, false});
+    while (!work.empty()) {
+      const auto [expr, expanded] = work.back();
+      work.pop_back();
+      const auto children = children_of(*expr);
+      if (!expanded && children[0] != nullptr) {
+        work.emplace_back(expr, true);
+        for (const auto* child : children) {
+          if (child != nullptr) {
+            work.emplace_back(child, false);
+          }
+        }
+        continue;
+      }
+      std::size_t size = 1;
+      for (const auto* child : children) {
+        if (child != nullptr) {
+          size += sizes.back();
+          sizes.pop_back();
+        }
+      }
+      if (size >= partition_nodes && expr != root) {
+        roots.emplace(expr, partitions.size());
+        partitions.emplace_back(expr);
+        size = 1;
+      }
+      sizes.push_back(size);
+    }
+    sizes.clear();
+    statement_partitions.push_back(partitions.size());
+    partitions.emplace_back(root);
+  }
+  if (roots.empty()) {
+    return false;
+  }
+
+  if (m_statistics != nullptr) {
+    m_statistics->begin_phase("partition_lowering");
+  }
+  // The arena is not shared between threads, partitions use the heap
+  std::atomic<std::size_t> next_partition = 0;
+  std::latch lowered(static_cast<std::ptrdiff_t>(pool.size()));
+  for (std::size_t i = 0; i < pool.size(); i++) {
+    pool.submit(
+        [&]
+        {
+          for (auto index = next_partition++; index < partitions.size();
+               index = next_partition++)
+          {
+            lower_partition(partitions[index], roots);
+          }
+          lowered.count_down();
+        });
+  }
+  lowered.wait();
+  if (m_statistics != nullptr) {
+    m_statistics->end_phase();
+    m_statistics->begin_phase("value_numbering");
+  }
+
+  // Splicing partitions where the serial lowering would have reached them
+  // adds every position in the same order, and numbering values on the way
+  // keeps the first of every copy like copy propagation does
+  std::pmr::unordered_map<value_key, ssa_position, value_key_hash> values(
+      m_resource);
+  auto splice = [&](auto& self, std::size_t index) -> ssa_position
+  {
+    const auto& part = partitions[index];
+    std::pmr::vector<ssa_position> positions(m_resource);
+    positions.reserve(part.nodes.size());
+    for (const auto& node : part.nodes) {
+      switch (node.kind) {
+        case fragment_node_kind::define:
+          positions.push_back(add_define(node.value));
+          break;
+        case fragment_node_kind::name:
+          positions.push_back(add_name(node.name));
+          break;
+        case fragment_node_kind::partition:
+          positions.push_back(self(self, node.left));
+          break;
+        case fragment_node_kind::operation: {
+          const auto left = positions[node.left];
+          const auto right = positions[node.right];
+          auto [it, inserted] = values.try_emplace(
+              value_key::of(left, node.op, right), m_data.control_flow_index);
+          if (inserted) {
+            add_operation(left, node.op, right);
+          }
+          positions.push_back(it->second);
+          break;
+        }
+      }
+    }
+    if (part.error) {
+      std::rethrow_exception(part.error);
+    }
+    m_data.out_index = positions.back();
+    return positions.back();
+  };
+  for (std::size_t i = 0; i < statements.size(); i++) {
+    add_statement(statements[i], splice(splice, statement_partitions[i]));
+  }
+  if (m_statistics != nullptr) {
+    m_statistics->end_phase(m_data.get_ir_size());
+  }
+  return true;
+}
+
 ssa_position control_flow_builder::add_expression(
     const frontend::expression& expr)
 {
@@ -36,35 +575,103 @@ ssa_position control_flow_builder::add_expression(
     throw control_flow_error(
         "No implemented for this expression");  // UNREACHABLE
   }
-  m_data.out_index = m_data.control_flow_index - 1;
+  m_data.out_index = position;
   return position;
 };
 
 ssa_position control_flow_builder::add_expression(
     const frontend::number_expression& expr)
 {
-  auto value = expr.get_value();
-  m_data.uses[m_data.control_flow_index] = {};
-  auto it = std::find_if(m_data.defines.begin(),
-                         m_data.defines.end(),
-                         [&](const auto& pair)
-                         {
-                           return (std::fabs(pair.second - value)
-                                   < std::numeric_limits<double>::epsilon());
-                         });
-  if (it != m_data.defines.end()) {
-    return it->first;
-  } else {
-    m_data.defines[m_data.control_flow_index] = value;
-    return m_data.control_flow_index++;
-  }
+  return add_define(expr.get_value());
 }
 
 ssa_position control_flow_builder::add_expression(
     const frontend::variable_expression& expr)
 {
+  return add_name(expr.get_token().get_lexeme());
+}
+
+ssa_position control_flow_builder::add_define(double value)
+{
+  if (auto equal_position = find_define(value)) {
+    return *equal_position;
+  }
+  m_data.uses[m_data.control_flow_index];
+  m_data.defines[m_data.control_flow_index] = value;
+  m_define_values.emplace(value, m_data.control_flow_index);
+  return m_data.control_flow_index++;
+}
+
+std::optional<ssa_position> control_flow_builder::find_define(
+    double value) const
+{
+  // Defines added while lowering are at least an epsilon apart, so only a
+  // few values around this one can be equal to it. The first one is used,
+  // skipping those dead code elimination has dropped
+  constexpr auto epsilon = std::numeric_limits<double>::epsilon();
+  std::optional<ssa_position> equal_position;
+  for (auto it = m_define_values.lower_bound(value - 2 * epsilon);
+       it != m_define_values.end() && it->first <= value + 2 * epsilon;
+       it++)
+  {
+    if (std::fabs(it->first - value) < epsilon
+        && (!equal_position.has_value() || it->second < *equal_position)
+        && m_data.defines.contains(it->second))
+    {
+      equal_position = it->second;
+    }
+  }
+  return equal_position;
+}
+
+void control_flow_builder::make_define(ssa_position position, double value)
+{
+  if (auto it = m_data.expressions.find(position);
+      it != m_data.expressions.end())
+  {
+    m_data.uses[it->second.m_left].erase(position);
+    m_data.uses[it->second.m_right].erase(position);
+    m_data.expressions.erase(it);
+  }
+  // Users come after their operands, so only an earlier define can replace
+  // this position
+  if (auto equal_position = find_define(value);
+      equal_position.has_value() && *equal_position < position)
+  {
+    replace_position(position, *equal_position);
+    return;
+  }
+  m_data.uses[position];
+  m_data.defines[position] = value;
+  m_define_values.emplace(value, position);
+}
+
+void control_flow_builder::restore_fixed_defines()
+{
+  static const std::map<ssa_position, double> fixed_defines = {
+      {MINUS_ONE_SSA_POSITION, -1},
+      {ZERO_SSA_POSITION, 0},
+      {ONE_SSA_POSITION, 1},
+  };
+  for (const auto& [pos, value] : fixed_defines) {
+    m_data.defines.emplace(pos, value);
+    m_data.uses[pos];
+  }
+}
+
+ssa_position control_flow_builder::add_name(std::string_view name)
+{
+  if (auto it = m_bindings.find(name); it != m_bindings.end()) {
+    return it->second;
+  }
+  if (auto it = m_variable_positions.find(name);
+      it != m_variable_positions.end())
+  {
+    return it->second;
+  }
   m_data.uses[m_data.control_flow_index] = {};
-  m_data.variables[m_data.control_flow_index] = expr.get_token().get_lexeme();
+  m_data.variables[m_data.control_flow_index] = name;
+  m_variable_positions.emplace(name, m_data.control_flow_index);
   return m_data.control_flow_index++;
 }
 
@@ -74,25 +681,11 @@ ssa_position control_flow_builder::add_expression(
   ssa_position left_position = add_expression(*expr.get_left());
   ssa_position right_position = add_expression(*expr.get_right());
 
-  const std::map<frontend::token_type, expression_op> expression_map = {
-      {frontend::token_type::multiply, expression_op::multiply},
-      {frontend::token_type::add, expression_op::add},
-      {frontend::token_type::subtract, expression_op::subtract},
-      {frontend::token_type::delimiter, expression_op::divide},
-  };
-
-  auto type = expr.get_token().get_type();
-  if (!expression_map.contains(type)) {
-    throw control_flow_error(
-        "Not implemented binary expression construction for this operator");
+  const auto op = binary_operator(expr.get_token().get_type());
+  if (op == expression_op::power) {
+    return add_power(left_position, right_position);
   }
-  const auto b_expr =
-      expression(left_position, expression_map.at(type), right_position);
-  m_data.expressions.insert(std::make_pair(m_data.control_flow_index, b_expr));
-  m_data.uses[left_position].insert(m_data.control_flow_index);
-  m_data.uses[right_position].insert(m_data.control_flow_index);
-  m_data.uses[m_data.control_flow_index] = {};
-  return m_data.control_flow_index++;
+  return add_operation(left_position, op, right_position);
 }
 
 ssa_position control_flow_builder::add_expression(
@@ -105,13 +698,8 @@ ssa_position control_flow_builder::add_expression(
     throw control_flow_error(
         "Not implemented unary expression construction for this operator");
   }
-  const auto b_expr =
-      expression(position, expression_op::multiply, MINUS_ONE_SSA_POSITION);
-  m_data.expressions.insert(std::make_pair(m_data.control_flow_index, b_expr));
-  m_data.uses[position].insert(m_data.control_flow_index);
-  m_data.uses[MINUS_ONE_SSA_POSITION].insert(m_data.control_flow_index);
-  m_data.uses[m_data.control_flow_index] = {};
-  return m_data.control_flow_index++;
+  return add_operation(
+      position, expression_op::multiply, MINUS_ONE_SSA_POSITION);
 }
 
 ssa_position control_flow_builder::add_expression(
@@ -120,14 +708,79 @@ ssa_position control_flow_builder::add_expression(
   return add_expression(*expr.get_expr());
 }
 
+ssa_position control_flow_builder::add_operation(ssa_position left,
+                                                 expression_op op,
+                                                 ssa_position right)
+{
+  // New positions are always the largest ones
+  m_data.expressions.emplace_hint(m_data.expressions.end(),
+                                  m_data.control_flow_index,
+                                  expression(left, op, right));
+  m_data.uses[left].insert(m_data.control_flow_index);
+  m_data.uses[right].insert(m_data.control_flow_index);
+  m_data.uses.emplace_hint(m_data.uses.end(),
+                           m_data.control_flow_index,
+                           std::pmr::set<ssa_position>());
+  return m_data.control_flow_index++;
+}
+
+ssa_position control_flow_builder::add_power(ssa_position base,
+                                             ssa_position exponent)
+{
+  return lower_power(
+      base,
+      exponent,
+      [this](ssa_position position) -> std::optional<double>
+      {
+        auto it = m_data.defines.find(position);
+        if (it == m_data.defines.end()) {
+          return std::nullopt;
+        }
+        return it->second;
+      },
+      [this](ssa_position left, expression_op op, ssa_position right)
+      { return add_operation(left, op, right); },
+      [this](double value) { return add_define(value); });
+}
+
+void control_flow_builder::add_statement(const frontend::statement& statement,
+                                         ssa_position position)
+{
+  if (!statement.get_name().has_value()) {
+    auto name = std::string("result");
+    if (!m_data.outputs.empty()) {
+      name += std::to_string(m_data.outputs.size());
+    }
+    m_data.outputs.emplace_back(name, position);
+    return;
+  }
+  const auto name = statement.get_name()->get_lexeme();
+  if (!m_bindings.emplace(name, position).second) {
+    throw control_flow_error("Redefinition of \"" + name + "\"");
+  }
+  if (!statement.is_let()) {
+    m_data.outputs.emplace_back(name, position);
+  }
+}
+
 void control_flow_builder::replace_position(ssa_position old_position,
                                             ssa_position new_position)
 {
   for (auto dependency_pos : m_data.uses.at(old_position)) {
     m_data.expressions.at(dependency_pos)
         .replace_position(old_position, new_position);
+    m_data.uses[new_position].insert(dependency_pos);
   }
   m_data.uses.erase(old_position);
+  // The replaced expression is unreachable now, so later passes must not see
+  // it again
+  if (auto it = m_data.expressions.find(old_position);
+      it != m_data.expressions.end())
+  {
+    m_data.uses[it->second.m_left].erase(old_position);
+    m_data.uses[it->second.m_right].erase(old_position);
+    m_data.expressions.erase(it);
+  }
   if (m_data.variables.contains(old_position)) {
     m_data.variables.insert(
         std::make_pair(new_position, m_data.variables.at(old_position)));
@@ -141,74 +794,104 @@ void control_flow_builder::replace_position(ssa_position old_position,
   if (m_data.out_index == old_position) {
     m_data.out_index = new_position;
   }
+  for (auto& [_, output_position] : m_data.outputs) {
+    if (output_position == old_position) {
+      output_position = new_position;
+    }
+  }
+}
+
+void control_flow_builder::constant_folding()
+{
+  // Folded positions are rewired before their users are visited, so chains
+  // of constant operations fold in one pass
+  for (auto it = m_data.expressions.begin(); it != m_data.expressions.end();) {
+    const auto [pos, expr] = *it++;
+    auto left = m_data.defines.find(expr.m_left);
+    auto right = m_data.defines.find(expr.m_right);
+    if (left != m_data.defines.end() && right != m_data.defines.end()) {
+      make_define(
+          pos, apply_operator(expr.m_operator, left->second, right->second));
+    }
+  }
 }
 
 void control_flow_builder::copy_propagation()
 {
-  std::map<backend::expression, ssa_position> expressions_using = {};
-  for (auto pair : m_data.expressions) {
-    if (!expressions_using.contains(pair.second)) {
-      expressions_using[pair.second] = pair.first;
+  std::pmr::map<backend::expression, ssa_position> expressions_using(
+      m_resource);
+  for (auto it = m_data.expressions.begin(); it != m_data.expressions.end();) {
+    const auto [pos, expr] = *it++;
+    if (!expressions_using.contains(expr)) {
+      expressions_using[expr] = pos;
     } else {
-      replace_position(pair.first, expressions_using[pair.second]);
+      replace_position(pos, expressions_using[expr]);
     }
   }
 }
 
 void control_flow_builder::algebraic_simplification()
 {
-  for (auto& [pos, expr] : m_data.expressions) {
-    if ((expr.m_operator == expression_op::multiply
+  for (auto it = m_data.expressions.begin(); it != m_data.expressions.end();) {
+    const auto [pos, expr] = *it++;
+    const auto op = expr.m_operator;
+    if ((op == expression_op::multiply
          && expr.is_one_of_positions_equal(ZERO_SSA_POSITION))  // x * 0 = 0
-        || (expr.m_operator == expression_op::subtract
+        || (op == expression_op::subtract
             && expr.m_left == expr.m_right))  // x - x = 0
     {
       replace_position(pos, ZERO_SSA_POSITION);
-    } else if ((expr.m_operator == expression_op::multiply
-                && expr.is_one_of_positions_equal(
-                    ONE_SSA_POSITION))  // x * 1 = x
-               || (expr.m_operator == expression_op::divide
-                   && expr.is_one_of_positions_equal(
-                       ONE_SSA_POSITION))  // x / 1 = x
-               || (expr.m_operator == expression_op::add
-                   && expr.is_one_of_positions_equal(
-                       ZERO_SSA_POSITION))  // x + 0 = x
-               || (expr.m_operator == expression_op::subtract
-                   && expr.is_one_of_positions_equal(
-                       ZERO_SSA_POSITION)))  // x - 0 = x
+    } else if ((op == expression_op::multiply
+                && expr.m_left == ONE_SSA_POSITION)  // 1 * x = x
+               || (op == expression_op::add
+                   && expr.m_left == ZERO_SSA_POSITION))  // 0 + x = x
+    {
+      replace_position(pos, expr.m_right);
+    } else if (((op == expression_op::multiply
+                 || op == expression_op::divide)
+                && expr.m_right == ONE_SSA_POSITION)  // x * 1 = x, x / 1 = x
+               || ((op == expression_op::add || op == expression_op::subtract)
+                   && expr.m_right
+                       == ZERO_SSA_POSITION))  // x + 0 = x, x - 0 = x
     {
-      auto x_position =
-          (expr.m_left == 0 || expr.m_left == 1) ? expr.m_right : expr.m_left;
-      replace_position(pos, x_position);
+      replace_position(pos, expr.m_left);
     }
   }
 }
 
 void control_flow_builder::dead_code_elimination()
 {
-  std::set<ssa_position> marked_positions = {};
-  std::vector<ssa_position> worked_positions = {
-      m_data.out_index,
-  };
+  std::pmr::vector<bool> marked_positions(
+      m_data.control_flow_index, false, m_resource);
+  std::pmr::vector<ssa_position> worked_positions({m_data.out_index},
+                                                  m_resource);
+  for (const auto& [_, position] : m_data.outputs) {
+    worked_positions.push_back(position);
+  }
   while (!worked_positions.empty()) {
     auto pos = worked_positions.back();
     worked_positions.pop_back();
-    marked_positions.insert(pos);
-    if (m_data.expressions.contains(pos)) {
-      auto expr = m_data.expressions.at(pos);
-      worked_positions.push_back(expr.m_left);
-      worked_positions.push_back(expr.m_right);
+    // Shared operands are reached once per user
+    if (marked_positions[pos]) {
+      continue;
+    }
+    marked_positions[pos] = true;
+    if (auto it = m_data.expressions.find(pos);
+        it != m_data.expressions.end())
+    {
+      worked_positions.push_back(it->second.m_left);
+      worked_positions.push_back(it->second.m_right);
     }
   }
   for (ssa_position i = 0; i < m_data.control_flow_index; i++) {
-    if (marked_positions.contains(i)) {
+    if (marked_positions[i]) {
       continue;
     }
-    if (m_data.expressions.contains(i)) {
-      auto expr = m_data.expressions.at(i);
-      m_data.uses[expr.m_left].erase(i);
-      m_data.uses[expr.m_right].erase(i);
-      m_data.expressions.erase(i);
+    if (auto it = m_data.expressions.find(i); it != m_data.expressions.end())
+    {
+      m_data.uses[it->second.m_left].erase(i);
+      m_data.uses[it->second.m_right].erase(i);
+      m_data.expressions.erase(it);
     }
     m_data.variables.erase(i);
     m_data.defines.erase(i);
@@ -216,21 +899,601 @@ void control_flow_builder::dead_code_elimination()
   }
 }
 
-boost::json::object control_flow_data::to_json() const
+ssa_position control_flow_builder::power_derivative(ssa_position base,
+                                                    ssa_position exponent)
+{
+  auto it = m_data.defines.find(exponent);
+  const auto decremented = it != m_data.defines.end()
+      ? add_define(it->second - 1)
+      : add_operation(exponent, expression_op::subtract, ONE_SSA_POSITION);
+  return add_operation(
+      exponent, expression_op::multiply, add_power(base, decremented));
+}
+
+control_flow_builder::derivative_map
+control_flow_builder::forward_derivatives()
+{
+  // Derivatives known to be zero are not materialized, which keeps the
+  // tangent of every variable as sparse as its uses
+  auto sum = [this](ssa_position left, ssa_position right) -> ssa_position
+  {
+    if (left == ZERO_SSA_POSITION) {
+      return right;
+    }
+    if (right == ZERO_SSA_POSITION) {
+      return left;
+    }
+    return add_operation(left, expression_op::add, right);
+  };
+  auto product = [this](ssa_position left, ssa_position right) -> ssa_position
+  {
+    if (left == ZERO_SSA_POSITION || right == ZERO_SSA_POSITION) {
+      return ZERO_SSA_POSITION;
+    }
+    return add_operation(left, expression_op::multiply, right);
+  };
+  auto difference = [&](ssa_position left, ssa_position right) -> ssa_position
+  {
+    if (right == ZERO_SSA_POSITION) {
+      return left;
+    }
+    if (left == ZERO_SSA_POSITION) {
+      return product(right, MINUS_ONE_SSA_POSITION);
+    }
+    return add_operation(left, expression_op::subtract, right);
+  };
+
+  std::pmr::vector<std::pair<ssa_position, expression>> original_expressions(
+      m_data.expressions.begin(), m_data.expressions.end(), m_resource);
+  // Derivatives of every output by every variable
+  derivative_map derivatives(m_resource);
+  for (const auto& [variable_pos, _] : m_data.variables) {
+    std::pmr::map<ssa_position, ssa_position> tangents(
+        {{variable_pos, ONE_SSA_POSITION}}, m_resource);
+    auto tangent = [&](ssa_position pos)
+    {
+      auto it = tangents.find(pos);
+      return it == tangents.end() ? ZERO_SSA_POSITION : it->second;
+    };
+    for (const auto& [pos, expr] : original_expressions) {
+      const auto left = expr.get_left();
+      const auto right = expr.get_right();
+      const auto left_tangent = tangent(left);
+      const auto right_tangent = tangent(right);
+      if (left_tangent == ZERO_SSA_POSITION
+          && right_tangent == ZERO_SSA_POSITION)
+      {
+        continue;
+      }
+      switch (expr.get_operator()) {
+        case expression_op::add:
+          tangents[pos] = sum(left_tangent, right_tangent);
+          break;
+        case expression_op::subtract:
+          tangents[pos] = difference(left_tangent, right_tangent);
+          break;
+        case expression_op::multiply:
+          tangents[pos] = sum(product(left_tangent, right),
+                              product(left, right_tangent));
+          break;
+        case expression_op::divide: {
+          // (l / r)' = (l' - (l / r) * r') / r
+          const auto numerator =
+              difference(left_tangent, product(pos, right_tangent));
+          tangents[pos] = numerator == ZERO_SSA_POSITION
+              ? ZERO_SSA_POSITION
+              : add_operation(numerator, expression_op::divide, right);
+          break;
+        }
+        case expression_op::power:
+          if (right_tangent != ZERO_SSA_POSITION) {
+            throw control_flow_error(variable_exponent_message);
+          }
+          tangents[pos] =
+              product(power_derivative(left, right), left_tangent);
+          break;
+      }
+    }
+    for (const auto& [output_name, output_pos] : m_data.outputs) {
+      derivatives[output_pos][variable_pos] = tangent(output_pos);
+    }
+  }
+  return derivatives;
+}
+
+control_flow_builder::derivative_map
+control_flow_builder::reverse_derivatives()
 {
-  boost::json::object obj;
+  std::pmr::vector<std::pair<ssa_position, expression>> original_expressions(
+      m_data.expressions.begin(), m_data.expressions.end(), m_resource);
+  // Values depending on a variable, which exponents must not
+  std::pmr::set<ssa_position> varying(m_resource);
+  for (const auto& [pos, _] : m_data.variables) {
+    varying.insert(pos);
+  }
+  for (const auto& [pos, expr] : original_expressions) {
+    if (expr.get_operator() == expression_op::power
+        && varying.contains(expr.get_right()))
+    {
+      throw control_flow_error(variable_exponent_message);
+    }
+    if (varying.contains(expr.get_left()) || varying.contains(expr.get_right()))
+    {
+      varying.insert(pos);
+    }
+  }
+  derivative_map derivatives(m_resource);
+  for (const auto& [_, output_pos] : m_data.outputs) {
+    std::pmr::map<ssa_position, ssa_position> adjoints(
+        {{output_pos, ONE_SSA_POSITION}}, m_resource);
+    auto accumulate = [&](ssa_position pos, ssa_position contribution)
+    {
+      if (m_data.defines.contains(pos)) {
+        return;
+      }
+      auto [it, inserted] = adjoints.emplace(pos, contribution);
+      if (!inserted) {
+        it->second = add_operation(it->second, expression_op::add, contribution);
+      }
+    };
+    auto accumulate_negated = [&](ssa_position pos, ssa_position contribution)
+    {
+      if (m_data.defines.contains(pos)) {
+        return;
+      }
+      auto [it, inserted] = adjoints.emplace(pos, ZERO_SSA_POSITION);
+      it->second = inserted
+          ? add_operation(
+                contribution, expression_op::multiply, MINUS_ONE_SSA_POSITION)
+          : add_operation(it->second, expression_op::subtract, contribution);
+    };
+
+    // Users always have higher positions than their operands, so visiting
+    // expressions backwards completes every adjoint before it is propagated
+    for (auto it = original_expressions.rbegin();
+         it != original_expressions.rend();
+         it++)
+    {
+      const auto& [pos, expr] = *it;
+      auto adjoint_it = adjoints.find(pos);
+      if (adjoint_it == adjoints.end()) {
+        continue;
+      }
+      const auto adjoint = adjoint_it->second;
+      const auto left = expr.get_left();
+      const auto right = expr.get_right();
+      switch (expr.get_operator()) {
+        case expression_op::add:
+          accumulate(left, adjoint);
+          accumulate(right, adjoint);
+          break;
+        case expression_op::subtract:
+          accumulate(left, adjoint);
+          accumulate_negated(right, adjoint);
+          break;
+        case expression_op::multiply:
+          accumulate(left,
+                     add_operation(adjoint, expression_op::multiply, right));
+          accumulate(right,
+                     add_operation(adjoint, expression_op::multiply, left));
+          break;
+        case expression_op::divide: {
+          const auto quotient =
+              add_operation(adjoint, expression_op::divide, right);
+          accumulate(left, quotient);
+          accumulate_negated(
+              right, add_operation(quotient, expression_op::multiply, pos));
+          break;
+        }
+        case expression_op::power:
+          accumulate(left,
+                     add_operation(adjoint,
+                                   expression_op::multiply,
+                                   power_derivative(left, right)));
+          break;
+      }
+    }
+    for (const auto& [variable_pos, variable_name] : m_data.variables) {
+      auto it = adjoints.find(variable_pos);
+      derivatives[output_pos][variable_pos] =
+          it == adjoints.end() ? ZERO_SSA_POSITION : it->second;
+    }
+  }
+  return derivatives;
+}
+
+void control_flow_builder::add_derivatives(differentiation_mode mode)
+{
+  restore_fixed_defines();
+
+  const auto derivatives = mode == differentiation_mode::forward
+      ? forward_derivatives()
+      : reverse_derivatives();
+  const std::pmr::vector<std::pair<std::string, ssa_position>> value_outputs(
+      m_data.outputs, m_resource);
+  for (const auto& [output_name, output_pos] : value_outputs) {
+    for (const auto& [variable_pos, variable_name] : m_data.variables) {
+      m_data.outputs.emplace_back("d" + output_name + "/d" + variable_name,
+                                  derivatives.at(output_pos).at(variable_pos));
+    }
+  }
+
+  optimize();
+  // Simplified derivative terms often turn out to be copies of each other
+  run_pass("copy_propagation", &control_flow_builder::copy_propagation);
+  run_pass("dead_code_elimination",
+           &control_flow_builder::dead_code_elimination);
+}
+
+polynomial_savings control_flow_builder::normalize_polynomials()
+{
+  m_polynomial_savings = {};
+  run_pass("polynomial_normalization",
+           &control_flow_builder::polynomial_normalization);
+  optimize();
+  return m_polynomial_savings;
+}
+
+void control_flow_builder::define_variables(
+    const std::map<std::string, double>& values)
+{
+  restore_fixed_defines();
+  std::pmr::vector<std::pair<ssa_position, double>> bound(m_resource);
+  for (const auto& [position, name] : m_data.variables) {
+    if (auto it = values.find(name); it != values.end()) {
+      bound.emplace_back(position, it->second);
+    }
+  }
+  for (const auto& [position, value] : bound) {
+    m_variable_positions.erase(m_data.variables.at(position));
+    m_data.variables.erase(position);
+    make_define(position, value);
+  }
+  // Simplifying may leave operations of constants to fold, e.g. 0 * x + 2
+  std::size_t operations = 0;
+  do {
+    operations = m_data.expressions.size();
+    run_pass("constant_folding", &control_flow_builder::constant_folding);
+    run_pass("algebraic_simplification",
+             &control_flow_builder::algebraic_simplification);
+  } while (m_data.expressions.size() < operations);
+  run_pass("copy_propagation", &control_flow_builder::copy_propagation);
+  run_pass("dead_code_elimination",
+           &control_flow_builder::dead_code_elimination);
+}
+
+void control_flow_builder::polynomial_normalization()
+{
+  // Expanding products of sums grows polynomials quickly, larger ones are
+  // left as they are
+  constexpr std::size_t max_terms = 128;
+  constexpr unsigned max_degree = 64;
+
+  struct polynomial_node
+  {
+    std::optional<polynomial> value;  // Empty when too large or absorbed
+    std::size_t multiplications = 0;
+    std::size_t additions = 0;
+    bool absorbed = false;  // Expanded into the polynomial of its only user
+  };
+  std::pmr::map<ssa_position, polynomial_node> nodes(m_resource);
+  std::pmr::set<ssa_position> outputs({m_data.out_index}, m_resource);
+  for (const auto& [_, position] : m_data.outputs) {
+    outputs.insert(position);
+  }
+  auto expandable = [&](ssa_position position) -> polynomial_node*
+  {
+    auto it = nodes.find(position);
+    if (it == nodes.end() || !it->second.value.has_value()
+        || outputs.contains(position) || m_data.uses.at(position).size() != 1)
+    {
+      return nullptr;
+    }
+    return &it->second;
+  };
+  auto operand = [this](ssa_position position, const polynomial_node* node)
+  {
+    if (node != nullptr) {
+      return *node->value;
+    }
+    if (auto it = m_data.defines.find(position); it != m_data.defines.end()) {
+      return polynomial::constant(it->second);
+    }
+    return polynomial::atom(position);
+  };
+
+  // Operands come before their users, so the polynomials of the operands
+  // are known when reaching an operation
+  for (const auto& [position, expr] : m_data.expressions) {
+    const auto op = expr.m_operator;
+    auto divisor = m_data.defines.find(expr.m_right);
+    if (op == expression_op::power
+        || (op == expression_op::divide
+            && (divisor == m_data.defines.end()
+                || std::fpclassify(divisor->second) == FP_ZERO)))
+    {
+      continue;
+    }
+    auto* left = expandable(expr.m_left);
+    auto* right = expr.m_right == expr.m_left ? left : expandable(expr.m_right);
+    auto left_value = operand(expr.m_left, left);
+    const auto right_value = operand(expr.m_right, right);
+
+    polynomial_node node;
+    if (op == expression_op::multiply) {
+      node.multiplications = 1;
+      if (left_value.terms().size() * right_value.terms().size() <= max_terms
+          && left_value.degree() + right_value.degree() <= max_degree)
+      {
+        node.value = left_value * right_value;
+      }
+    } else if (op == expression_op::divide) {
+      node.multiplications = 1;
+      node.value = std::move(left_value *= 1 / divisor->second);
+    } else {
+      node.additions = 1;
+      if (left_value.terms().size() + right_value.terms().size() <= max_terms)
+      {
+        node.value = std::move(op == expression_op::add
+                                   ? left_value += right_value
+                                   : left_value -= right_value);
+      }
+    }
+    if (node.value.has_value()) {
+      for (auto* child : {left, right == left ? nullptr : right}) {
+        if (child != nullptr) {
+          child->absorbed = true;
+          child->value.reset();
+          node.multiplications += child->multiplications;
+          node.additions += child->additions;
+        }
+      }
+    }
+    nodes.emplace(position, std::move(node));
+  }
+
+  // Polynomials not absorbed by their user are rewritten when it saves
+  // operations of both kinds
+  std::pmr::map<ssa_position, horner_form> rewrites(m_resource);
+  for (const auto& [position, node] : nodes) {
+    if (!node.value.has_value()) {
+      continue;
+    }
+    auto form = to_horner_form(*node.value);
+    const auto multiplications = form.multiplications();
+    const auto additions = form.additions();
+    if (multiplications <= node.multiplications
+        && additions <= node.additions
+        && multiplications + additions
+            < node.multiplications + node.additions)
+    {
+      m_polynomial_savings.multiplications +=
+          node.multiplications - multiplications;
+      m_polynomial_savings.additions += node.additions - additions;
+      rewrites.emplace(position, std::move(form));
+    }
+  }
+  if (rewrites.empty()) {
+    return;
+  }
+  std::pmr::set<ssa_position> replaced(m_resource);
+  std::pmr::vector<ssa_position> worked_positions(m_resource);
+  for (const auto& [position, _] : rewrites) {
+    worked_positions.push_back(position);
+    while (!worked_positions.empty()) {
+      const auto& expr = m_data.expressions.at(worked_positions.back());
+      worked_positions.pop_back();
+      for (auto child : {expr.m_left, expr.m_right}) {
+        if (auto it = nodes.find(child);
+            it != nodes.end() && it->second.absorbed
+            && replaced.insert(child).second)
+        {
+          worked_positions.push_back(child);
+        }
+      }
+    }
+  }
+
+  // Rewritten polynomials are emitted where they were, which keeps operands
+  // before their users
+  auto previous = std::exchange(m_data, control_flow_data(m_resource));
+  m_define_values.clear();
+  for (const auto& [position, value] : m_data.defines) {
+    m_define_values.emplace(value, position);
+  }
+  m_variable_positions.clear();
+  std::pmr::vector<ssa_position> renumbered(
+      previous.control_flow_index, 0, m_resource);
+  for (ssa_position position = 0; position < previous.control_flow_index;
+       position++)
+  {
+    if (auto define = previous.defines.find(position);
+        define != previous.defines.end())
+    {
+      renumbered[position] = add_define(define->second);
+    } else if (auto variable = previous.variables.find(position);
+               variable != previous.variables.end())
+    {
+      renumbered[position] = m_data.control_flow_index++;
+      m_data.uses[renumbered[position]];
+      m_data.variables.emplace(renumbered[position], variable->second);
+      m_variable_positions.emplace(variable->second, renumbered[position]);
+    } else if (auto rewrite = rewrites.find(position);
+               rewrite != rewrites.end())
+    {
+      std::pmr::vector<ssa_position> emitted(m_resource);
+      for (const auto& node : rewrite->second.nodes) {
+        if (node.op.has_value()) {
+          emitted.push_back(add_operation(
+              emitted[node.left], *node.op, emitted[node.right]));
+        } else {
+          emitted.push_back(node.is_atom ? renumbered[node.atom]
+                                         : add_define(node.value));
+        }
+      }
+      renumbered[position] = emitted.back();
+    } else if (auto operation = previous.expressions.find(position);
+               operation != previous.expressions.end()
+               && !replaced.contains(position))
+    {
+      renumbered[position] =
+          add_operation(renumbered[operation->second.m_left],
+                        operation->second.m_operator,
+                        renumbered[operation->second.m_right]);
+    }
+  }
+  for (const auto& [name, position] : previous.outputs) {
+    m_data.outputs.emplace_back(name, renumbered[position]);
+  }
+  m_data.out_index = renumbered[previous.out_index];
+  for (auto it = m_bindings.begin(); it != m_bindings.end();) {
+    if (it->second < renumbered.size() && !replaced.contains(it->second)
+        && previous.uses.contains(it->second))
+    {
+      it->second = renumbered[it->second];
+      it++;
+    } else {
+      it = m_bindings.erase(it);
+    }
+  }
+}
+
+void control_flow_data::write_json(support::json_writer& writer) const
+{
+  writer.begin_object();
   for (auto& [position, define] : defines) {
-    obj["%" + std::to_string(position)] = std::to_string(define);
+    writer.member("%" + std::to_string(position), std::to_string(define));
   }
   for (auto& [position, variable] : variables) {
-    obj["%" + std::to_string(position)] = variable;
+    writer.member("%" + std::to_string(position), variable);
   }
   for (auto& [position, expr] : expressions) {
-    obj["%" + std::to_string(position)] = "%" + std::to_string(expr.get_left())
-        + " " + expression_op_to_string(expr.get_operator()) + " %"
-        + std::to_string(expr.get_right());
+    writer.member("%" + std::to_string(position),
+                  "%" + std::to_string(expr.get_left()) + " "
+                      + expression_op_to_string(expr.get_operator()) + " %"
+                      + std::to_string(expr.get_right()));
   }
-  return obj;
-};
+  writer.end_object();
+}
+
+
+std::uint64_t control_flow_data::canonical_hash() const
+{
+  std::map<ssa_position, std::uint64_t> hashes;
+  for (const auto& [position, define] : defines) {
+    // +0.0 and -0.0 compare equal in the builder, so hash them equally too
+    hashes[position] =
+        hash_mix(define_tag, std::bit_cast<std::uint64_t>(define + 0.0));
+  }
+  for (const auto& [position, variable] : variables) {
+    hashes[position] = hash_mix(variable_tag, hash_string(variable));
+  }
+  // Operands always have lower positions, so one ordered pass is enough
+  for (const auto& [position, expr] : expressions) {
+    auto left = hashes.at(expr.get_left());
+    auto right = hashes.at(expr.get_right());
+    const auto op = expr.get_operator();
+    if ((op == expression_op::add || op == expression_op::multiply)
+        && right < left)
+    {
+      std::swap(left, right);
+    }
+    hashes[position] =
+        hash_mix(hash_mix(hash_mix(expression_tag, op), left), right);
+  }
+  std::uint64_t hash = hashes.at(out_index);
+  for (const auto& [name, position] : outputs) {
+    hash = hash_mix(hash_mix(hash, hash_string(name)), hashes.at(position));
+  }
+  return hash;
+}
+
+bool control_flow_data::is_equivalent(const control_flow_data& other) const
+{
+  // Values of both graphs get the same number when they are computed the
+  // same way: kind (a define, a variable or an operator), then operands
+  using value_key =
+      std::tuple<int, std::uint64_t, std::uint64_t, std::string_view>;
+  std::map<value_key, std::size_t> numbers;
+  auto number_values = [&](const control_flow_data& data)
+  {
+    std::map<ssa_position, std::size_t> values;
+    auto number = [&](ssa_position position, value_key key)
+    { values[position] = numbers.emplace(key, numbers.size()).first->second; };
+    for (const auto& [position, define] : data.defines) {
+      const auto bits = std::bit_cast<std::uint64_t>(define + 0.0);
+      number(position, {-2, bits, 0, {}});
+    }
+    for (const auto& [position, variable] : data.variables) {
+      number(position, {-1, 0, 0, variable});
+    }
+    for (const auto& [position, expr] : data.expressions) {
+      auto left = values.at(expr.get_left());
+      auto right = values.at(expr.get_right());
+      const auto op = expr.get_operator();
+      if ((op == expression_op::add || op == expression_op::multiply)
+          && right < left)
+      {
+        std::swap(left, right);
+      }
+      number(position, {static_cast<int>(op), left, right, {}});
+    }
+    return values;
+  };
+  const auto values = number_values(*this);
+  const auto other_values = number_values(other);
+  return values.at(out_index) == other_values.at(other.out_index)
+      && std::ranges::equal(
+             outputs,
+             other.outputs,
+             [&](const auto& output, const auto& other_output)
+             {
+               return output.first == other_output.first
+                   && values.at(output.second)
+                   == other_values.at(other_output.second);
+             });
+}
+
+support::ir_size control_flow_data::get_ir_size() const
+{
+  std::size_t uses_count = 0;
+  for (const auto& [_, users] : uses) {
+    uses_count += users.size();
+  }
+  return support::ir_size {
+      .instructions = expressions.size(),
+      .constants = defines.size(),
+      .variables = variables.size(),
+      .uses = uses_count,
+  };
+}
+
+sharing_stats control_flow_data::get_sharing_stats() const
+{
+  std::size_t independent_operations = 0;
+  // Index of the last output whose walk reached each position, so the
+  // marks need no clearing between outputs
+  std::vector<std::size_t> visited_by(control_flow_index, outputs.size());
+  std::vector<ssa_position> worked_positions;
+  for (std::size_t output = 0; output < outputs.size(); output++) {
+    worked_positions.assign(1, outputs[output].second);
+    while (!worked_positions.empty()) {
+      auto pos = worked_positions.back();
+      worked_positions.pop_back();
+      auto it = expressions.find(pos);
+      if (it == expressions.end() || visited_by[pos] == output) {
+        continue;
+      }
+      visited_by[pos] = output;
+      independent_operations++;
+      worked_positions.push_back(it->second.get_left());
+      worked_positions.push_back(it->second.get_right());
+    }
+  }
+  return sharing_stats {
+      .independent_operations = independent_operations,
+      .shared_operations = expressions.size(),
+  };
+}
 
 }  // namespace backend
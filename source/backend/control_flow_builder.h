@@ -1,11 +1,25 @@
 #ifndef CONTROL_FLOW_BUILDER_H
 #define CONTROL_FLOW_BUILDER_H
 
+#include <cmath>
+#include <cstdint>
 #include <iostream>
 #include <map>
+#include <memory_resource>
+#include <optional>
 #include <set>
+#include <string>
+#include <string_view>
+#include <tuple>
+#include <vector>
 
+#include "exceptions.h"
 #include "frontend/parsing/expression.h"
+#include "frontend/parsing/statement.h"
+#include "support/arena.h"
+#include "support/json_writer.h"
+#include "support/statistics.h"
+#include "support/thread_pool.h"
 
 typedef unsigned long ssa_position;
 
@@ -18,14 +32,32 @@ enum expression_op
   subtract,
   divide,
   multiply,
+  power,  // Integer exponents are lowered to multiplications instead
 };
 
 static char expression_op_to_string(expression_op op)
 {
-  static const std::array<const char, 4> mapper = {'+', '-', '/', '*'};
+  static const std::array<const char, 5> mapper = {'+', '-', '/', '*', '^'};
   return mapper[static_cast<size_t>(op)];
 }
 
+constexpr double apply_operator(expression_op op, double left, double right)
+{
+  switch (op) {
+    case expression_op::add:
+      return left + right;
+    case expression_op::subtract:
+      return left - right;
+    case expression_op::multiply:
+      return left * right;
+    case expression_op::divide:
+      return left / right;
+    case expression_op::power:
+      return std::pow(left, right);
+  }
+  return 0;  // UNREACHABLE
+}
+
 class expression
 
 {
@@ -37,15 +69,11 @@ public:
   {
   }
 
+  // Operands of commutative operators are compared as unordered, so that
+  // copy propagation merges "a + b" with "b + a"
   constexpr auto operator<=>(const expression& other) const
   {
-    if (m_operator == other.m_operator && m_left == other.m_right
-        && m_right == other.m_left)
-    {
-      return std::strong_ordering::equal;
-    }
-    return std::tie(m_left, m_operator, m_right)
-        <=> std::tie(other.m_left, other.m_operator, other.m_right);
+    return canonical_form() <=> other.canonical_form();
   }
 
   constexpr ssa_position get_left() const { return m_left; }
@@ -55,6 +83,18 @@ public:
   constexpr ssa_position get_right() const { return m_right; }
 
 private:
+  constexpr std::tuple<ssa_position, expression_op, ssa_position>
+  canonical_form() const
+  {
+    if ((m_operator == expression_op::add
+         || m_operator == expression_op::multiply)
+        && m_right < m_left)
+    {
+      return {m_right, m_operator, m_left};
+    }
+    return {m_left, m_operator, m_right};
+  }
+
   void replace_position(ssa_position old_pos, ssa_position new_pos)
   {
     if (m_left == old_pos) {
@@ -65,7 +105,7 @@ private:
     }
   }
 
-  bool is_one_of_positions_equal(ssa_position pos)
+  bool is_one_of_positions_equal(ssa_position pos) const
   {
     return (m_left == pos) || (m_right == pos);
   }
@@ -77,9 +117,40 @@ private:
   friend class control_flow_builder;
 };
 
+struct sharing_stats
+{
+  std::size_t independent_operations;  // Sum over outputs compiled alone
+  std::size_t shared_operations;  // Operations of the combined graph
+
+  std::size_t saved_operations() const
+  {
+    return independent_operations - shared_operations;
+  }
+};
+
+// Operations removed by rewriting polynomials in Horner form
+struct polynomial_savings
+{
+  std::size_t multiplications = 0;
+  std::size_t additions = 0;  // And subtractions
+};
+
+enum class differentiation_mode
+{
+  forward,  // One tangent sweep per variable
+  reverse,  // One adjoint sweep per output
+};
+
+// Containers allocate from the resource given to the constructor, copies
+// allocate from the default resource, so a graph built in the arena of a
+// compilation can be kept after it
 struct control_flow_data
 {
-  std::map<ssa_position, double> defines = {
+  control_flow_data() = default;
+
+  explicit control_flow_data(std::pmr::memory_resource* resource);
+
+  std::pmr::map<ssa_position, double> defines = {
 #define MINUS_ONE_SSA_POSITION 0
       {MINUS_ONE_SSA_POSITION, -1},
 #define ZERO_SSA_POSITION 1
@@ -87,18 +158,59 @@ struct control_flow_data
 #define ONE_SSA_POSITION 2
       {ONE_SSA_POSITION, 1},
   };
-  std::map<ssa_position, std::string> variables;
-  std::map<ssa_position, backend::expression> expressions;
-  std::map<ssa_position, std::set<ssa_position>> uses;
+  std::pmr::map<ssa_position, std::string> variables;
+  std::pmr::map<ssa_position, backend::expression> expressions;
+  std::pmr::map<ssa_position, std::pmr::set<ssa_position>> uses;
   ssa_position control_flow_index = 3;
-  ssa_position out_index;
+  ssa_position out_index;  // Position of the last value output
+  std::pmr::vector<std::pair<std::string, ssa_position>> outputs;
+
+  // Every position mapped to its define, variable or operation
+  void write_json(support::json_writer& writer) const;
+
+  // How many operations evaluating the outputs separately would take
+  // compared to the shared graph
+  sharing_stats get_sharing_stats() const;
 
-  boost::json::object to_json() const;
+  support::ir_size get_ir_size() const;
+
+  // Structural hash of the graph reachable from the outputs. It does not depend
+  // on ssa positions and treats operands of commutative operators as unordered
+  std::uint64_t canonical_hash() const;
+
+  // Whether both graphs compute the same outputs with the same operations,
+  // up to ssa positions and the order of commutative operands. Graphs with
+  // equal canonical_hash() are equivalent unless their hashes collide
+  bool is_equivalent(const control_flow_data& other) const;
 };
 
 class control_flow_builder
 {
+  // Graph and pass temporaries live in the arena of the compilation
+  std::pmr::memory_resource* m_resource;
   control_flow_data m_data;
+  // Receives the timings of every pass when given
+  support::statistics* m_statistics = nullptr;
+
+  // Names introduced by let bindings and named outputs
+  std::pmr::map<std::string, ssa_position, std::less<>> m_bindings;
+  // Every occurrence of a variable shares one position
+  std::pmr::map<std::string, ssa_position, std::less<>> m_variable_positions;
+  // Defines ordered by value while lowering, to find equal literals
+  std::pmr::map<double, ssa_position> m_define_values {
+      {{-1, MINUS_ONE_SSA_POSITION},
+       {0, ZERO_SSA_POSITION},
+       {1, ONE_SSA_POSITION}},
+      m_resource};
+
+  void add_statement(const frontend::statement& statement,
+                     ssa_position position);
+
+  // Lower subtrees of about partition_nodes nodes concurrently on the pool,
+  // then merge them in source order. False when the program is too small to
+  // be partitioned and nothing was lowered
+  bool add_partitioned(const std::vector<frontend::statement>& statements,
+                       support::thread_pool& pool);
 
   ssa_position add_expression(const frontend::expression& expr);
   ssa_position add_expression(const frontend::binary_expression& expr);
@@ -107,23 +219,127 @@ class control_flow_builder
   ssa_position add_expression(const frontend::variable_expression& expr);
   ssa_position add_expression(const frontend::unary_expression& expr);
 
+  // Position of a literal, shared with every literal equal to it
+  ssa_position add_define(double value);
+  // Lowest position of a define equal to the value
+  std::optional<ssa_position> find_define(double value) const;
+  // Turn the value at a position into a constant, merged with an equal
+  // define at a lower position when there is one
+  void make_define(ssa_position position, double value);
+  // Dead code elimination may have dropped the fixed constants
+  void restore_fixed_defines();
+  // Position of a let binding, named output or variable
+  ssa_position add_name(std::string_view name);
+
+  ssa_position add_operation(ssa_position left,
+                             expression_op op,
+                             ssa_position right);
+  // Multiplications of an addition chain for integer exponents, a power
+  // operation otherwise
+  ssa_position add_power(ssa_position base, ssa_position exponent);
+
+  using derivative_map = std::pmr::map<
+      ssa_position,
+      std::pmr::map<ssa_position, ssa_position>>;  // Output, variable
+
+  // Derivative of base^exponent by the base, for an exponent not depending
+  // on a variable
+  ssa_position power_derivative(ssa_position base, ssa_position exponent);
+
+  derivative_map forward_derivatives();
+  derivative_map reverse_derivatives();
+
   void replace_position(ssa_position old_position, ssa_position new_position);
 
+  void constant_folding();
   void copy_propagation();
   void algebraic_simplification();
   void dead_code_elimination();
   void defragment_indexes();
+  void polynomial_normalization();
+
+  polynomial_savings m_polynomial_savings;
+
+  // Run a pass, measured when statistics are collected
+  void run_pass(const char* name, void (control_flow_builder::*pass)())
+  {
+    if (m_statistics == nullptr) {
+      (this->*pass)();
+      return;
+    }
+    m_statistics->begin_phase(name, m_data.get_ir_size());
+    (this->*pass)();
+    m_statistics->end_phase(m_data.get_ir_size());
+  }
+
+  static std::pmr::memory_resource* resource_of(support::arena* arena)
+  {
+    return arena != nullptr ? arena : std::pmr::get_default_resource();
+  }
+
+  // Value numbering while lowering already merged the copies
+  void optimize(bool values_numbered = false)
+  {
+    if (!values_numbered) {
+      run_pass("copy_propagation", &control_flow_builder::copy_propagation);
+    }
+    run_pass("algebraic_simplification",
+             &control_flow_builder::algebraic_simplification);
+    run_pass("dead_code_elimination",
+             &control_flow_builder::dead_code_elimination);
+  }
 
 public:
-  explicit control_flow_builder(const frontend::expression& expr)
+  // Size of the subtrees lowered as separate partitions when a thread pool
+  // is given, smaller programs are lowered on the calling thread
+  static constexpr std::size_t partition_nodes = 1 << 14;
+
+  // Everything is allocated in the arena when one is given. It must outlive
+  // the builder, but not get_data() copies
+  explicit control_flow_builder(const frontend::expression& expr,
+                                support::statistics* statistics = nullptr,
+                                support::arena* arena = nullptr)
+      : m_resource(resource_of(arena))
+      , m_data(m_resource)
+      , m_statistics(statistics)
+      , m_bindings(m_resource)
+      , m_variable_positions(m_resource)
   {
     add_expression(expr);
-    copy_propagation();
-    algebraic_simplification();
-    dead_code_elimination();
+    m_data.outputs.emplace_back("result", m_data.out_index);
+    optimize();
   }
 
-  control_flow_data get_data() const { return m_data; }
+  // Lower every statement into one graph, so the outputs share common
+  // subexpressions. With a pool, large programs are lowered and their common
+  // subexpressions merged concurrently, which gives the same graph as
+  // lowering them on the calling thread. Unless optimized, the graph is left
+  // as lowered, for code that must be ready soon rather than run fast
+  explicit control_flow_builder(
+      const std::vector<frontend::statement>& statements,
+      support::statistics* statistics = nullptr,
+      support::arena* arena = nullptr,
+      support::thread_pool* pool = nullptr,
+      bool optimized = true);
+
+  // Append a "d<output>/d<variable>" output for every output and variable,
+  // so one evaluation computes the values together with the whole gradient.
+  // Derivative terms go through the same optimizations as the values, which
+  // shares them with each other and with the original graph
+  void add_derivatives(differentiation_mode mode);
+
+  // Expand sums and products of variables and literals into polynomials,
+  // collect their like terms and evaluate them in Horner form when this
+  // takes fewer multiplications and additions. It changes how results are
+  // rounded, so it is only done on request
+  polynomial_savings normalize_polynomials();
+
+  // Bind variables to values, so they become defines, and fold whatever only
+  // depends on defines. What is left is a program over the other variables.
+  // Names the program does not use are ignored
+  void define_variables(const std::map<std::string, double>& values);
+
+  const control_flow_data& get_data() const { return m_data; }
 };
 
 }  // namespace backend
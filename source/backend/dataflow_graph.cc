@@ -0,0 +1,60 @@
+#include <numeric>
+
+#include "dataflow_graph.h"
+
+namespace backend
+{
+
+dataflow_graph build_dataflow_graph(const bytecode& code)
+{
+  dataflow_graph graph;
+  // Follow which instruction last wrote every slot
+  graph.first_result = code.first_variable_slot() + code.variables.size();
+  std::vector<std::uint32_t> slot_values(code.slots_count);
+  std::iota(slot_values.begin(), slot_values.end(), 0);
+  graph.operands.reserve(3 * code.instructions.size());
+  for (std::uint32_t index = 0; index < code.instructions.size(); index++) {
+    const auto& instruction = code.instructions[index];
+    graph.operands.push_back(slot_values[instruction.left]);
+    graph.operands.push_back(slot_values[instruction.right]);
+    graph.operands.push_back(slot_values[instruction.addend]);
+    slot_values[instruction.destination] =
+        static_cast<std::uint32_t>(graph.first_result + index);
+  }
+  for (const auto slot : code.output_slots) {
+    graph.output_values.push_back(slot_values[slot]);
+  }
+  graph.result_value = slot_values[code.output_slot];
+  const auto values_count = graph.first_result + code.instructions.size();
+
+  // Same edges as control_flow_data::uses, counting every distinct operand
+  // once
+  auto for_each_operand = [&](std::size_t index, auto&& function)
+  {
+    const auto* operands = graph.operands.data() + 3 * index;
+    function(operands[0]);
+    if (operands[1] != operands[0]) {
+      function(operands[1]);
+    }
+    if (operands[2] != operands[0] && operands[2] != operands[1]) {
+      function(operands[2]);
+    }
+  };
+  auto& offsets = graph.users_offsets;
+  offsets.assign(values_count + 1, 0);
+  for (std::size_t index = 0; index < code.instructions.size(); index++) {
+    for_each_operand(index, [&](auto value) { offsets[value + 1]++; });
+  }
+  for (std::size_t value = 0; value < values_count; value++) {
+    offsets[value + 1] += offsets[value];
+  }
+  graph.users.resize(offsets.back());
+  auto next_user = offsets;
+  for (std::uint32_t index = 0; index < code.instructions.size(); index++) {
+    for_each_operand(
+        index, [&](auto value) { graph.users[next_user[value]++] = index; });
+  }
+  return graph;
+}
+
+}  // namespace backend
@@ -0,0 +1,52 @@
+#ifndef DATAFLOW_GRAPH_H
+#define DATAFLOW_GRAPH_H
+
+#include <cstdint>
+#include <span>
+#include <vector>
+
+#include "bytecode.h"
+
+namespace backend
+{
+
+// Def-use edges of a bytecode, with values numbered the way lowering without
+// slot reuse would: constants and variables keep their slot and instruction i
+// defines value first_result + i, so no value is ever overwritten
+struct dataflow_graph
+{
+  std::size_t first_result = 0;
+  // Values read by every instruction: left, right and addend
+  std::vector<std::uint32_t> operands;
+  std::vector<std::uint32_t> output_values;
+  std::uint32_t result_value = 0;
+  // Instructions reading every value, each listed once, as offsets into users
+  std::vector<std::uint32_t> users_offsets;
+  std::vector<std::uint32_t> users;
+
+  std::size_t values_count() const { return users_offsets.size() - 1; }
+
+  std::span<const std::uint32_t> users_of(std::size_t value) const
+  {
+    return std::span(users).subspan(
+        users_offsets[value], users_offsets[value + 1] - users_offsets[value]);
+  }
+
+  // Result of an instruction reading its operands from values
+  double apply(const bytecode& code,
+               std::size_t index,
+               std::span<const double> values) const
+  {
+    const auto* instruction_operands = operands.data() + 3 * index;
+    return apply_instruction(code.instructions[index],
+                             values[instruction_operands[0]],
+                             values[instruction_operands[1]],
+                             values[instruction_operands[2]]);
+  }
+};
+
+dataflow_graph build_dataflow_graph(const bytecode& code);
+
+}  // namespace backend
+
+#endif
@@ -1,15 +1,22 @@
 #ifndef EXECUTOR_H
 #define EXECUTOR_H
 
+#include <algorithm>
+#include <utility>
+
 #include "control_flow_builder.h"
+#include "parallel_evaluation.h"
+#include "type_inference.h"
 
 namespace backend
 {
 class executor
 {
   std::map<ssa_position, double> memory;
+  // Values computed exactly, also kept converted in memory
+  std::map<ssa_position, std::int64_t> exact_memory;
 
-  double input_variable(std::string& name)
+  double input_variable(const std::string& name)
   {
     std::cout << "Give a value to the variable \"" << name << "\" = ";
     std::string input_line;
@@ -17,53 +24,133 @@ class executor
     return std::stod(input_line);
   }
 
+  // Compute every expression level by level: an expression is one level above
+  // its deepest operand, so the expressions of a level only read memory and
+  // the wide ones are split between the pool workers
+  void compute_by_levels(const control_flow_data& data,
+                         support::thread_pool& pool)
+  {
+    std::map<ssa_position, std::size_t> levels;
+    std::vector<std::vector<std::pair<ssa_position, const expression*>>>
+        expressions;
+    auto level_of = [&](ssa_position operand)
+    {
+      const auto it = levels.find(operand);
+      return it == levels.end() ? 0 : it->second;
+    };
+    for (const auto& [pos, expression] : data.expressions) {
+      const auto level = std::max(level_of(expression.get_left()),
+                                  level_of(expression.get_right()));
+      levels[pos] = level + 1;
+      expressions.resize(std::max(expressions.size(), level + 1));
+      expressions[level].emplace_back(pos, &expression);
+    }
+
+    std::vector<double> results;
+    for (const auto& level : expressions) {
+      results.resize(level.size());
+      auto run = [&, &values = std::as_const(memory)](std::size_t begin,
+                                                      std::size_t end)
+      {
+        for (auto i = begin; i < end; i++) {
+          const auto& expression = *level[i].second;
+          results[i] = apply_operator(expression.get_operator(),
+                                      values.at(expression.get_left()),
+                                      values.at(expression.get_right()));
+        }
+      };
+      const auto tasks_count = parallel_tasks(level.size(), pool.size());
+      if (tasks_count == 1) {
+        run(0, level.size());
+      } else {
+        run_parallel(level.size(), tasks_count, pool, run);
+      }
+      for (std::size_t i = 0; i < level.size(); i++) {
+        memory.emplace(level[i].first, results[i]);
+      }
+    }
+  }
+
 public:
   explicit executor() {}
 
-  double execute(control_flow_data data)
+  double get_value(ssa_position pos) const { return memory.at(pos); }
+
+  // Compute every output and return the last one. Values with exact_scales
+  // (see infer_types) are computed in int64, programs without them are
+  // computed level by level on the pool when given, then printed in order
+  double execute(const control_flow_data& data,
+                 const std::map<ssa_position, unsigned>& exact_scales = {},
+                 support::thread_pool* pool = nullptr)
   {
     for (auto& [pos, define] : data.defines) {
       memory.insert(std::make_pair(pos, define));
+      if (exact_scales.contains(pos)) {
+        exact_memory[pos] = to_exact(define, exact_scales.at(pos));
+      }
       std::cout << "%" << pos << " = " << define << '\n';
     }
-    for (auto& [pos, variable_name] : data.variables) {
+    for (const auto& [pos, variable_name] : data.variables) {
       auto define = input_variable(variable_name);
       memory.insert(std::make_pair(pos, define));
+      if (exact_scales.contains(pos)) {
+        exact_memory[pos] = to_exact(define, exact_scales.at(pos));
+      }
       std::cout << "%" << pos << " = " << define << '\n';
     }
 
-    do {
+    auto print = [&](ssa_position pos, const expression& expression)
+    {
+      std::cout << "%" << pos << " = " << "%" << expression.get_left() << " "
+                << expression_op_to_string(expression.get_operator()) << " "
+                << "%" << expression.get_right() << " = " << memory.at(pos)
+                << '\n';
+    };
+    if (pool != nullptr && exact_scales.empty()) {
+      compute_by_levels(data, *pool);
+      for (const auto& [pos, expression] : data.expressions) {
+        print(pos, expression);
+      }
+      return memory.at(data.out_index);
+    }
+
+    auto outputs_ready = [&]
+    {
+      return std::all_of(data.outputs.begin(),
+                         data.outputs.end(),
+                         [&](const auto& output)
+                         { return memory.contains(output.second); });
+    };
+    while (!outputs_ready()) {
       for (auto& [pos, expression] : data.expressions) {
-        if (memory.contains(expression.get_left())
+        if (!memory.contains(pos) && memory.contains(expression.get_left())
             && memory.contains(expression.get_right()))
         {
-          double left = memory.at(expression.get_left()),
-                 right = memory.at(expression.get_right()), define;
-          switch (expression.get_operator()) {
-            case expression_op::add:
-              define = left + right;
-              break;
-            case expression_op::subtract:
-              define = left - right;
-              break;
-            case expression_op::multiply:
-              define = left * right;
-              break;
-            case expression_op::divide:
-              define = left / right;
-              break;
+          double define = 0;
+          if (auto it = exact_scales.find(pos); it != exact_scales.end()) {
+            const auto left = expression.get_left();
+            const auto right = expression.get_right();
+            const auto factors =
+                get_exact_factors(expression.get_operator(),
+                                  exact_scales.at(left),
+                                  exact_scales.at(right),
+                                  exact_memory.at(right),
+                                  it->second);
+            exact_memory[pos] = apply_exact_operator(expression.get_operator(),
+                                                     exact_memory.at(left),
+                                                     exact_memory.at(right),
+                                                     factors);
+            define = from_exact(exact_memory.at(pos), it->second);
+          } else {
+            define = apply_operator(expression.get_operator(),
+                                    memory.at(expression.get_left()),
+                                    memory.at(expression.get_right()));
           }
           memory.insert(std::make_pair(pos, define));
-          std::cout << "%" << pos << " = " << "%" << expression.get_left()
-                    << " " << expression_op_to_string(expression.get_operator())
-                    << " " << "%" << expression.get_right() << " = " << define
-                    << '\n';
-          if (pos == data.out_index) {
-            return define;
-          }
+          print(pos, expression);
         }
       }
-    } while (!memory.contains(data.out_index));
+    }
     return memory.at(data.out_index);
   }
 };
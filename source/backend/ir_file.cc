@@ -0,0 +1,325 @@
+#include <array>
+#include <bit>
+#include <cstring>
+#include <stdexcept>
+#include <string>
+#include <system_error>
+#include <type_traits>
+
+#include "ir_file.h"
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+namespace
+{
+constexpr std::array<char, 8> ir_magic = {
+    'M', 'S', 'C', '-', 'I', 'R', '\0', '\0'};
+constexpr std::uint32_t byte_order_mark = 0x01020304;
+constexpr std::size_t section_alignment = 8;
+
+constexpr std::uint32_t has_single_precision_flag = 1U << 0U;
+constexpr std::uint32_t has_exact_scales_flag = 1U << 1U;
+
+struct ir_header
+{
+  std::array<char, 8> magic;
+  std::uint32_t version;
+  std::uint32_t byte_order;  // Files are only read on hosts of the same order
+  std::uint32_t instruction_size;
+  std::uint32_t flags;
+  std::uint32_t slots_count;
+  std::uint32_t output_slot;
+  std::uint32_t constants_count;
+  std::uint32_t variables_count;
+  std::uint32_t instructions_count;
+  std::uint32_t outputs_count;
+  std::uint64_t saved_operations;
+  double error_bound;
+  std::uint64_t payload_size;
+  // Of the header, with this field zeroed, and of the payload following it
+  std::uint64_t checksum;
+};
+
+static_assert(std::is_trivially_copyable_v<ir_header>);
+static_assert(sizeof(ir_header) % section_alignment == 0);
+static_assert(std::is_trivially_copyable_v<backend::instruction>);
+
+// Word-at-a-time hash, the header and the payload are always a whole number
+// of words
+std::uint64_t checksum(const std::byte* data,
+                       std::size_t size,
+                       std::uint64_t hash = 0xcbf29ce484222325ULL)
+{
+  for (std::size_t offset = 0; offset < size; offset += sizeof(std::uint64_t))
+  {
+    std::uint64_t word = 0;
+    std::memcpy(&word, data + offset, sizeof(word));
+    hash = std::rotl((hash ^ word) * 0x9e3779b97f4a7c15ULL, 31);
+  }
+  return hash;
+}
+
+std::uint64_t file_checksum(ir_header header,
+                            std::span<const std::byte> payload)
+{
+  header.checksum = 0;
+  return checksum(
+      payload.data(),
+      payload.size(),
+      checksum(reinterpret_cast<const std::byte*>(&header), sizeof(header)));
+}
+
+class payload_writer
+{
+public:
+  template<typename T>
+  void append(std::span<const T> values)
+  {
+    const auto* bytes = reinterpret_cast<const char*>(values.data());
+    m_payload.append(bytes, values.size_bytes());
+    m_payload.resize((m_payload.size() + section_alignment - 1)
+                     / section_alignment * section_alignment);
+  }
+
+  const std::string& payload() const { return m_payload; }
+
+private:
+  std::string m_payload;
+};
+
+// Hands out the sections of a mapped payload in the order they were written
+class payload_reader
+{
+public:
+  explicit payload_reader(std::span<const std::byte> payload)
+      : m_payload(payload)
+  {
+  }
+
+  template<typename T>
+  std::span<const T> take(std::size_t count)
+  {
+    const auto bytes = count * sizeof(T);
+    if (count > m_payload.size() / sizeof(T)
+        || bytes > m_payload.size() - m_offset)
+    {
+      throw std::invalid_argument("IR file is truncated");
+    }
+    const auto* data = reinterpret_cast<const T*>(m_payload.data() + m_offset);
+    m_offset += (bytes + section_alignment - 1) / section_alignment
+        * section_alignment;
+    m_offset = std::min(m_offset, m_payload.size());
+    return {data, count};
+  }
+
+private:
+  std::span<const std::byte> m_payload;
+  std::size_t m_offset = 0;
+};
+
+class mapped_file
+{
+public:
+  explicit mapped_file(const std::filesystem::path& path)
+  {
+    const int fd = ::open(path.c_str(), O_RDONLY | O_CLOEXEC);
+    if (fd < 0) {
+      throw std::system_error(
+          errno, std::generic_category(), "Unable to open " + path.string());
+    }
+    struct stat status = {};
+    if (::fstat(fd, &status) != 0) {
+      const int error = errno;
+      ::close(fd);
+      throw std::system_error(
+          error, std::generic_category(), "Unable to stat " + path.string());
+    }
+    m_size = static_cast<std::size_t>(status.st_size);
+    if (m_size < sizeof(ir_header)) {
+      ::close(fd);
+      throw std::invalid_argument(path.string() + " is not an IR file");
+    }
+    void* address = ::mmap(nullptr, m_size, PROT_READ, MAP_SHARED, fd, 0);
+    const int error = errno;
+    ::close(fd);  // The mapping keeps the file referenced
+    if (address == MAP_FAILED) {
+      throw std::system_error(
+          error, std::generic_category(), "Unable to map " + path.string());
+    }
+    m_data = static_cast<const std::byte*>(address);
+  }
+
+  mapped_file(const mapped_file&) = delete;
+  mapped_file& operator=(const mapped_file&) = delete;
+
+  ~mapped_file()
+  {
+    ::munmap(const_cast<std::byte*>(m_data), m_size);
+  }
+
+  std::span<const std::byte> bytes() const { return {m_data, m_size}; }
+
+private:
+  const std::byte* m_data = nullptr;
+  std::size_t m_size = 0;
+};
+
+void check(bool condition, const std::string& message)
+{
+  if (!condition) {
+    throw std::invalid_argument("Invalid IR file: " + message);
+  }
+}
+
+// The checksum guards against corruption, these checks against files that
+// would make evaluation read or write outside of its slots
+void check_slots(const backend::bytecode& code)
+{
+  const auto first_result_slot =
+      code.first_variable_slot() + code.variables.size();
+  check(first_result_slot <= code.slots_count, "too many constants");
+  // Kernels for single precision and exact slots only run basic opcodes
+  const bool double_only =
+      code.single_precision_slots.empty() && code.exact_scales.empty();
+  for (const auto& instruction : code.instructions) {
+    check(instruction.op <= backend::last_opcode
+              && (double_only || backend::is_basic(instruction.op)),
+          "unknown opcode");
+    check(first_result_slot <= instruction.destination
+              && instruction.destination < code.slots_count
+              && instruction.left < code.slots_count
+              && instruction.right < code.slots_count
+              && instruction.addend < code.slots_count,
+          "instruction slot out of range");
+  }
+  check(code.output_slot < code.slots_count, "output slot out of range");
+  for (const auto slot : code.output_slots) {
+    check(slot < code.slots_count, "output slot out of range");
+  }
+}
+
+}  // namespace
+
+namespace backend
+{
+
+void write_ir(std::ostream& stream, const bytecode& code)
+{
+  payload_writer writer;
+  writer.append(code.constants);
+  writer.append(code.instructions);
+  writer.append(std::span<const slot_index>(code.output_slots));
+
+  std::uint32_t flags = 0;
+  if (!code.single_precision_slots.empty()) {
+    flags |= has_single_precision_flag;
+    std::vector<std::uint8_t> single_precision(
+        code.single_precision_slots.begin(), code.single_precision_slots.end());
+    writer.append(std::span<const std::uint8_t>(single_precision));
+  }
+  if (!code.exact_scales.empty()) {
+    flags |= has_exact_scales_flag;
+    std::vector<std::int32_t> exact_scales(code.exact_scales.begin(),
+                                           code.exact_scales.end());
+    writer.append(std::span<const std::int32_t>(exact_scales));
+  }
+
+  // Variables followed by outputs, as offsets into the concatenated names
+  std::vector<std::uint32_t> name_offsets {0};
+  std::string names;
+  for (const auto* table : {&code.variables, &code.output_names}) {
+    for (const auto& name : *table) {
+      names += name;
+      name_offsets.push_back(static_cast<std::uint32_t>(names.size()));
+    }
+  }
+  writer.append(std::span<const std::uint32_t>(name_offsets));
+  writer.append(std::span<const char>(names));
+
+  const auto& payload = writer.payload();
+  ir_header header {
+      .magic = ir_magic,
+      .version = ir_format_version,
+      .byte_order = byte_order_mark,
+      .instruction_size = sizeof(instruction),
+      .flags = flags,
+      .slots_count = code.slots_count,
+      .output_slot = code.output_slot,
+      .constants_count = static_cast<std::uint32_t>(code.constants.size()),
+      .variables_count = static_cast<std::uint32_t>(code.variables.size()),
+      .instructions_count =
+          static_cast<std::uint32_t>(code.instructions.size()),
+      .outputs_count = static_cast<std::uint32_t>(code.output_slots.size()),
+      .saved_operations = code.saved_operations,
+      .error_bound = code.error_bound,
+      .payload_size = payload.size(),
+      .checksum = 0,
+  };
+  header.checksum = file_checksum(
+      header, std::as_bytes(std::span(payload.data(), payload.size())));
+  stream.write(reinterpret_cast<const char*>(&header), sizeof(header));
+  stream.write(payload.data(), static_cast<std::streamsize>(payload.size()));
+}
+
+std::shared_ptr<const bytecode> map_ir(const std::filesystem::path& path)
+{
+  auto file = std::make_shared<const mapped_file>(path);
+  const auto bytes = file->bytes();
+
+  ir_header header {};
+  std::memcpy(&header, bytes.data(), sizeof(header));
+  check(header.magic == ir_magic, "missing magic number");
+  check(header.version == ir_format_version,
+        "version " + std::to_string(header.version) + " instead of "
+            + std::to_string(ir_format_version));
+  check(header.byte_order == byte_order_mark, "written with another byte order");
+  check(header.instruction_size == sizeof(instruction),
+        "unexpected instruction size");
+  check(header.payload_size == bytes.size() - sizeof(header)
+            && header.payload_size % section_alignment == 0,
+        "unexpected size");
+  const auto payload = bytes.subspan(sizeof(header));
+  check(file_checksum(header, payload) == header.checksum,
+        "checksum mismatch");
+
+  auto code = std::make_shared<bytecode>();
+  payload_reader reader(payload);
+  code->constants = reader.take<double>(header.constants_count);
+  code->instructions = reader.take<instruction>(header.instructions_count);
+  const auto output_slots = reader.take<slot_index>(header.outputs_count);
+  code->output_slots.assign(output_slots.begin(), output_slots.end());
+  if ((header.flags & has_single_precision_flag) != 0) {
+    const auto single_precision = reader.take<std::uint8_t>(header.slots_count);
+    code->single_precision_slots.assign(single_precision.begin(),
+                                        single_precision.end());
+  }
+  if ((header.flags & has_exact_scales_flag) != 0) {
+    const auto exact_scales = reader.take<std::int32_t>(header.slots_count);
+    code->exact_scales.assign(exact_scales.begin(), exact_scales.end());
+  }
+
+  const auto names_count =
+      std::size_t {header.variables_count} + header.outputs_count;
+  const auto name_offsets = reader.take<std::uint32_t>(names_count + 1);
+  const auto names = reader.take<char>(name_offsets.back());
+  for (std::size_t i = 0; i < names_count; i++) {
+    check(name_offsets[i] <= name_offsets[i + 1], "invalid name table");
+    auto& table = i < header.variables_count ? code->variables
+                                             : code->output_names;
+    table.emplace_back(names.data() + name_offsets[i],
+                       name_offsets[i + 1] - name_offsets[i]);
+  }
+
+  code->slots_count = header.slots_count;
+  code->output_slot = header.output_slot;
+  code->saved_operations = header.saved_operations;
+  code->error_bound = header.error_bound;
+  code->storage = std::move(file);
+  check_slots(*code);
+  return code;
+}
+
+}  // namespace backend
@@ -0,0 +1,33 @@
+#ifndef IR_FILE_H
+#define IR_FILE_H
+
+#include <cstdint>
+#include <filesystem>
+#include <memory>
+#include <ostream>
+
+#include "bytecode.h"
+
+namespace backend
+{
+
+constexpr std::uint32_t ir_format_version = 4;
+
+// Write the bytecode in the binary IR format: a fixed header followed by the
+// constant pool, the instruction array, the output slots, the optional
+// precision and exactness tables and the variable and output names. Every
+// section starts at a multiple of 8 bytes, so a mapped file can be used in
+// place. The header holds the format version and a checksum of the whole
+// file
+void write_ir(std::ostream& stream, const bytecode& code);
+
+// Map a file written by write_ir() read-only. The constants and instructions
+// of the returned bytecode point into the mapping, which stays alive as long
+// as the bytecode does, so processes mapping the same file share its pages.
+// Throws std::invalid_argument when the file is not a valid IR file of this
+// version and std::system_error when it cannot be mapped
+std::shared_ptr<const bytecode> map_ir(const std::filesystem::path& path);
+
+}  // namespace backend
+
+#endif
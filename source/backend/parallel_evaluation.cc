@@ -0,0 +1,246 @@
+#include <algorithm>
+#include <latch>
+#include <thread>
+#include <type_traits>
+
+#include "parallel_evaluation.h"
+
+namespace
+{
+// Operations a task should run to pay for waking up a worker and waiting for
+// it, about ten microseconds of arithmetic
+constexpr std::size_t min_task_operations = 1 << 13;
+
+// Rows of the blocks evaluate_batch() runs, runs of rows given to a task are
+// multiples of it
+constexpr std::size_t block_rows = 256;
+
+// Run task(begin, end) on ranges splitting [0, size) between tasks_count
+// pool tasks and wait for all of them. Tasks taking a third argument also
+// get their index, ranges follow the order of the indexes
+template<typename Task>
+void run_split(std::size_t size,
+               std::size_t tasks_count,
+               std::size_t granularity,
+               support::thread_pool& pool,
+               Task&& task)
+{
+  const auto units = (size + granularity - 1) / granularity;
+  std::latch finished(static_cast<std::ptrdiff_t>(tasks_count));
+  for (std::size_t index = 0; index < tasks_count; index++) {
+    const auto begin =
+        std::min(size, units * index / tasks_count * granularity);
+    const auto end =
+        std::min(size, units * (index + 1) / tasks_count * granularity);
+    pool.submit(
+        [&, begin, end, index]
+        {
+          if constexpr (std::is_invocable_v<Task&,
+                                            std::size_t,
+                                            std::size_t,
+                                            std::size_t>)
+          {
+            task(begin, end, index);
+          } else {
+            task(begin, end);
+          }
+          finished.count_down();
+        });
+  }
+  finished.wait();
+}
+}  // namespace
+
+namespace backend
+{
+
+evaluation_levels compute_levels(const dataflow_graph& graph)
+{
+  // Values are numbered in instruction order, so operands come first
+  const auto instructions_count = graph.operands.size() / 3;
+  std::vector<std::uint32_t> value_levels(graph.values_count(), 0);
+  std::vector<std::size_t> level_sizes;
+  for (std::size_t index = 0; index < instructions_count; index++) {
+    const auto* operands = graph.operands.data() + 3 * index;
+    const auto level = 1
+        + std::max({value_levels[operands[0]],
+                    value_levels[operands[1]],
+                    value_levels[operands[2]]});
+    value_levels[graph.first_result + index] = level;
+    level_sizes.resize(std::max<std::size_t>(level_sizes.size(), level));
+    level_sizes[level - 1]++;
+  }
+
+  evaluation_levels levels;
+  levels.offsets.assign(level_sizes.size() + 1, 0);
+  for (std::size_t level = 0; level < level_sizes.size(); level++) {
+    levels.offsets[level + 1] = levels.offsets[level] + level_sizes[level];
+  }
+  levels.instructions.resize(instructions_count);
+  auto next = levels.offsets;
+  for (std::uint32_t index = 0; index < instructions_count; index++) {
+    const auto level = value_levels[graph.first_result + index] - 1;
+    levels.instructions[next[level]++] = index;
+  }
+  return levels;
+}
+
+std::size_t parallel_tasks(std::size_t operations, std::size_t workers_count)
+{
+  // Workers beyond the hardware threads only add switches
+  const auto threads_count = std::max<std::size_t>(
+      1,
+      std::min<std::size_t>(workers_count,
+                            std::thread::hardware_concurrency()));
+  return std::clamp<std::size_t>(
+      operations / min_task_operations, 1, threads_count);
+}
+
+void run_parallel(std::size_t size,
+                  std::size_t tasks_count,
+                  support::thread_pool& pool,
+                  const std::function<void(std::size_t, std::size_t)>& task)
+{
+  run_split(size, tasks_count, 1, pool, task);
+}
+
+void execute_parallel(const bytecode& code,
+                      const dataflow_graph& graph,
+                      const evaluation_levels& levels,
+                      std::span<const double> variables,
+                      std::span<double> values,
+                      support::thread_pool& pool)
+{
+  std::copy(code.constants.begin(), code.constants.end(), values.begin());
+  std::copy(variables.begin(),
+            variables.end(),
+            values.begin() + code.first_variable_slot());
+  auto run = [&](std::size_t begin, std::size_t end)
+  {
+    for (auto position = begin; position < end; position++) {
+      const auto index = levels.instructions[position];
+      values[graph.first_result + index] = graph.apply(code, index, values);
+    }
+  };
+  std::size_t max_width = 0;
+  for (std::size_t level = 0; level < levels.levels_count(); level++) {
+    max_width =
+        std::max(max_width, levels.offsets[level + 1] - levels.offsets[level]);
+  }
+  if (parallel_tasks(max_width, pool.size()) == 1) {
+    // Instruction order reads recent values, level order jumps around
+    for (std::size_t index = 0; index < code.instructions.size(); index++) {
+      values[graph.first_result + index] = graph.apply(code, index, values);
+    }
+    return;
+  }
+  for (std::size_t level = 0; level < levels.levels_count(); level++) {
+    const auto begin = levels.offsets[level];
+    const auto width = levels.offsets[level + 1] - begin;
+    const auto tasks_count = parallel_tasks(width, pool.size());
+    if (tasks_count == 1) {
+      run(begin, begin + width);
+      continue;
+    }
+    run_split(width,
+              tasks_count,
+              1,
+              pool,
+              [&](std::size_t first, std::size_t last)
+              { run(begin + first, begin + last); });
+  }
+}
+
+std::shared_ptr<const parallel_schedule> schedule_parallel(
+    const bytecode& code)
+{
+  // No level is wider than the whole program
+  const auto hardware_threads = std::thread::hardware_concurrency();
+  if (!code.exact_scales.empty()
+      || parallel_tasks(code.instructions.size(), hardware_threads) == 1)
+  {
+    return nullptr;
+  }
+  auto schedule = std::make_shared<parallel_schedule>();
+  schedule->graph = build_dataflow_graph(code);
+  schedule->levels = compute_levels(schedule->graph);
+  const auto& levels = schedule->levels;
+  for (std::size_t level = 0; level < levels.levels_count(); level++) {
+    const auto width = levels.offsets[level + 1] - levels.offsets[level];
+    if (parallel_tasks(width, hardware_threads) > 1) {
+      return schedule;
+    }
+  }
+  return nullptr;
+}
+
+void evaluate_batch_parallel(const bytecode& code,
+                             std::span<const double> rows,
+                             std::span<const slot_index> outputs,
+                             std::span<double> results,
+                             support::thread_pool& pool)
+{
+  const auto rows_count = results.size() / outputs.size();
+  const auto tasks_count = std::min(
+      parallel_tasks(rows_count * code.instructions.size(), pool.size()),
+      (rows_count + block_rows - 1) / block_rows);
+  if (tasks_count <= 1) {
+    evaluate_batch(code, rows, outputs, results);
+    return;
+  }
+  // Every task evaluates its rows into its own thread local columns
+  const auto variables_count = code.variables.size();
+  run_split(rows_count,
+            tasks_count,
+            block_rows,
+            pool,
+            [&](std::size_t first, std::size_t last)
+            {
+              evaluate_batch(
+                  code,
+                  rows.subspan(first * variables_count,
+                               (last - first) * variables_count),
+                  outputs,
+                  results.subspan(first * outputs.size(),
+                                  (last - first) * outputs.size()));
+            });
+}
+
+aggregate aggregate_batch_parallel(const bytecode& code,
+                                   std::span<const double> rows,
+                                   slot_index output,
+                                   const aggregation_options& options,
+                                   support::thread_pool& pool)
+{
+  const auto variables_count = code.variables.size();
+  const auto rows_count =
+      variables_count == 0 ? 0 : rows.size() / variables_count;
+  const auto tasks_count = std::min(
+      parallel_tasks(rows_count * code.instructions.size(), pool.size()),
+      (rows_count + block_rows - 1) / block_rows);
+  if (tasks_count <= 1) {
+    return aggregate_batch(code, rows, output, options);
+  }
+  // One partial aggregate per task, so tasks never share one
+  std::vector<aggregate> partials(tasks_count, aggregate(options));
+  run_split(rows_count,
+            tasks_count,
+            block_rows,
+            pool,
+            [&](std::size_t first, std::size_t last, std::size_t task)
+            {
+              partials[task] = aggregate_batch(
+                  code,
+                  rows.subspan(first * variables_count,
+                               (last - first) * variables_count),
+                  output,
+                  options);
+            });
+  auto result = std::move(partials.front());
+  for (std::size_t task = 1; task < tasks_count; task++) {
+    result.merge(partials[task]);
+  }
+  return result;
+}
+
+}  // namespace backend
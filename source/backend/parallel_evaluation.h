@@ -0,0 +1,86 @@
+#ifndef PARALLEL_EVALUATION_H
+#define PARALLEL_EVALUATION_H
+
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <span>
+#include <vector>
+
+#include "aggregation.h"
+#include "bytecode.h"
+#include "dataflow_graph.h"
+#include "support/thread_pool.h"
+
+namespace backend
+{
+
+// Instructions grouped by topological level: an instruction only reads
+// constants, variables and results of earlier levels, so the instructions of
+// one level may run in any order and on any thread
+struct evaluation_levels
+{
+  std::vector<std::uint32_t> instructions;  // Level by level
+  std::vector<std::size_t> offsets;  // Start of every level, then the end
+
+  std::size_t levels_count() const { return offsets.size() - 1; }
+};
+
+evaluation_levels compute_levels(const dataflow_graph& graph);
+
+// Cost model: number of pool tasks worth splitting this many operations into,
+// at most one per hardware thread and 1 when the work would not pay for
+// waking up workers. An operation is one instruction applied to one row
+std::size_t parallel_tasks(std::size_t operations, std::size_t workers_count);
+
+// Run task(begin, end) on runs of [0, size) split between tasks_count pool
+// tasks and wait for all of them
+void run_parallel(std::size_t size,
+                  std::size_t tasks_count,
+                  support::thread_pool& pool,
+                  const std::function<void(std::size_t, std::size_t)>& task);
+
+// Evaluate every instruction into values, numbered by the graph, from the
+// variables given in bytecode::variables order. Levels wide enough for the
+// cost model are split between the pool workers, narrow levels run on the
+// calling thread
+void execute_parallel(const bytecode& code,
+                      const dataflow_graph& graph,
+                      const evaluation_levels& levels,
+                      std::span<const double> variables,
+                      std::span<double> values,
+                      support::thread_pool& pool);
+
+// What execute_parallel() needs to evaluate a bytecode
+struct parallel_schedule
+{
+  dataflow_graph graph;
+  evaluation_levels levels;
+};
+
+// Schedule of a program with a level wide enough for the cost model to split
+// on this machine, nullptr when execute_parallel() would only run it in
+// instruction order or when it computes exact values
+std::shared_ptr<const parallel_schedule> schedule_parallel(
+    const bytecode& code);
+
+// evaluate_batch() with the rows split into runs of whole blocks evaluated by
+// the pool workers, when the batch is large enough for the cost model
+void evaluate_batch_parallel(const bytecode& code,
+                             std::span<const double> rows,
+                             std::span<const slot_index> outputs,
+                             std::span<double> results,
+                             support::thread_pool& pool);
+
+// aggregate_batch() with the rows split into runs of whole blocks reduced by
+// the pool workers into partial aggregates, merged in row order once every
+// worker is done
+aggregate aggregate_batch_parallel(const bytecode& code,
+                                   std::span<const double> rows,
+                                   slot_index output,
+                                   const aggregation_options& options,
+                                   support::thread_pool& pool);
+
+}  // namespace backend
+
+#endif
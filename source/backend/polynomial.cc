@@ -0,0 +1,272 @@
+#include <algorithm>
+#include <cmath>
+
+#include "polynomial.h"
+
+namespace backend
+{
+
+namespace
+{
+// Term of a sum in Horner form: coefficient * atom when the quotient is a
+// constant, quotient * atom otherwise, or a lone constant
+struct summand
+{
+  std::optional<double> coefficient = std::nullopt;
+  std::size_t quotient = 0;
+  std::optional<ssa_position> atom = std::nullopt;
+};
+
+class horner_emitter
+{
+public:
+  explicit horner_emitter(horner_form& form)
+      : m_form(form)
+  {
+  }
+
+  std::size_t emit(const std::map<monomial, double>& terms)
+  {
+    std::vector<summand> summands;
+    auto remaining = terms;
+    while (!remaining.empty()) {
+      if (remaining.size() == 1 && remaining.begin()->first.empty()) {
+        summands.push_back({.coefficient = remaining.begin()->second});
+        break;
+      }
+      const auto factor = most_frequent_atom(remaining);
+      std::map<monomial, double> quotient;
+      std::map<monomial, double> rest;
+      for (auto& [term, coefficient] : remaining) {
+        auto it = std::ranges::find(
+            term, factor, &std::pair<ssa_position, unsigned>::first);
+        if (it == term.end()) {
+          rest.emplace(term, coefficient);
+          continue;
+        }
+        auto divided = term;
+        auto& power = divided[static_cast<std::size_t>(it - term.begin())];
+        if (--power.second == 0) {
+          divided.erase(divided.begin() + (it - term.begin()));
+        }
+        quotient.emplace(std::move(divided), coefficient);
+      }
+      if (quotient.size() == 1 && quotient.begin()->first.empty()) {
+        summands.push_back(
+            {.coefficient = quotient.begin()->second, .atom = factor});
+      } else {
+        summands.push_back({.quotient = emit(quotient), .atom = factor});
+      }
+      remaining = std::move(rest);
+    }
+    return sum(summands);
+  }
+
+private:
+  static ssa_position most_frequent_atom(
+      const std::map<monomial, double>& terms)
+  {
+    std::map<ssa_position, std::size_t> counts;
+    for (const auto& [term, _] : terms) {
+      for (const auto& [atom, __] : term) {
+        counts[atom]++;
+      }
+    }
+    // The smallest position wins ties, so the form is deterministic
+    return std::ranges::max_element(
+               counts,
+               [](const auto& left, const auto& right)
+               { return left.second < right.second; })
+        ->first;
+  }
+
+  std::size_t leaf(double value)
+  {
+    m_form.nodes.push_back({.value = value});
+    return m_form.nodes.size() - 1;
+  }
+
+  std::size_t leaf(ssa_position atom)
+  {
+    m_form.nodes.push_back({.atom = atom, .is_atom = true});
+    return m_form.nodes.size() - 1;
+  }
+
+  std::size_t operation(std::size_t left, expression_op op, std::size_t right)
+  {
+    m_form.nodes.push_back({.op = op, .left = left, .right = right});
+    return m_form.nodes.size() - 1;
+  }
+
+  static bool is_negative(const summand& term)
+  {
+    return term.coefficient.has_value() && *term.coefficient < 0;
+  }
+
+  // Summands with a negative coefficient are emitted with their magnitude
+  // and subtracted, unless every summand is negative
+  std::size_t emit(const summand& term, bool magnitude)
+  {
+    if (!term.coefficient.has_value()) {
+      return operation(
+          term.quotient, expression_op::multiply, leaf(*term.atom));
+    }
+    const double coefficient =
+        magnitude ? std::fabs(*term.coefficient) : *term.coefficient;
+    if (!term.atom.has_value()) {
+      return leaf(coefficient);
+    }
+    if (std::fpclassify(coefficient - 1) == FP_ZERO) {
+      return leaf(*term.atom);
+    }
+    return operation(
+        leaf(*term.atom), expression_op::multiply, leaf(coefficient));
+  }
+
+  std::size_t sum(const std::vector<summand>& summands)
+  {
+    auto first = std::ranges::find_if_not(summands, is_negative);
+    if (first == summands.end()) {
+      first = summands.begin();
+    }
+    auto result = emit(*first, false);
+    for (auto it = summands.begin(); it != summands.end(); it++) {
+      if (it != first) {
+        result = operation(result,
+                           is_negative(*it) ? expression_op::subtract
+                                            : expression_op::add,
+                           emit(*it, true));
+      }
+    }
+    return result;
+  }
+
+  horner_form& m_form;
+};
+
+std::size_t count_operations(const horner_form& form,
+                             std::initializer_list<expression_op> ops)
+{
+  return static_cast<std::size_t>(std::ranges::count_if(
+      form.nodes,
+      [&](const horner_form::node& node)
+      {
+        return node.op.has_value()
+            && std::ranges::find(ops, *node.op) != ops.end();
+      }));
+}
+
+}  // namespace
+
+polynomial polynomial::constant(double value)
+{
+  polynomial result;
+  result.add_term({}, value);
+  return result;
+}
+
+polynomial polynomial::atom(ssa_position position)
+{
+  polynomial result;
+  result.add_term({{position, 1}}, 1);
+  return result;
+}
+
+unsigned polynomial::degree() const
+{
+  unsigned result = 0;
+  for (const auto& [term, _] : m_terms) {
+    unsigned term_degree = 0;
+    for (const auto& [__, power] : term) {
+      term_degree += power;
+    }
+    result = std::max(result, term_degree);
+  }
+  return result;
+}
+
+polynomial& polynomial::operator+=(const polynomial& other)
+{
+  for (const auto& [term, coefficient] : other.m_terms) {
+    add_term(term, coefficient);
+  }
+  return *this;
+}
+
+polynomial& polynomial::operator-=(const polynomial& other)
+{
+  for (const auto& [term, coefficient] : other.m_terms) {
+    add_term(term, -coefficient);
+  }
+  return *this;
+}
+
+polynomial& polynomial::operator*=(double factor)
+{
+  if (std::fpclassify(factor) == FP_ZERO) {
+    m_terms.clear();
+  }
+  for (auto& [_, coefficient] : m_terms) {
+    coefficient *= factor;
+  }
+  return *this;
+}
+
+polynomial operator*(const polynomial& left, const polynomial& right)
+{
+  polynomial result;
+  for (const auto& [left_term, left_coefficient] : left.m_terms) {
+    for (const auto& [right_term, right_coefficient] : right.m_terms) {
+      monomial product;
+      std::ranges::merge(left_term, right_term, std::back_inserter(product));
+      // Merging keeps equal atoms next to each other
+      auto out = product.begin();
+      for (auto it = product.begin(); it != product.end(); it++) {
+        if (out != product.begin() && std::prev(out)->first == it->first) {
+          std::prev(out)->second += it->second;
+        } else {
+          *out++ = *it;
+        }
+      }
+      product.erase(out, product.end());
+      result.add_term(product, left_coefficient * right_coefficient);
+    }
+  }
+  return result;
+}
+
+void polynomial::add_term(const monomial& term, double coefficient)
+{
+  auto [it, inserted] = m_terms.emplace(term, coefficient);
+  if (!inserted) {
+    it->second += coefficient;
+  }
+  if (std::fpclassify(it->second) == FP_ZERO) {
+    m_terms.erase(it);
+  }
+}
+
+std::size_t horner_form::multiplications() const
+{
+  return count_operations(*this, {expression_op::multiply});
+}
+
+std::size_t horner_form::additions() const
+{
+  return count_operations(*this,
+                          {expression_op::add, expression_op::subtract});
+}
+
+horner_form to_horner_form(const polynomial& value)
+{
+  horner_form form;
+  horner_emitter emitter(form);
+  if (value.terms().empty()) {
+    form.nodes.push_back({});
+  } else {
+    emitter.emit(value.terms());
+  }
+  return form;
+}
+
+}  // namespace backend
@@ -0,0 +1,73 @@
+#ifndef POLYNOMIAL_H
+#define POLYNOMIAL_H
+
+#include <cstddef>
+#include <map>
+#include <optional>
+#include <utility>
+#include <vector>
+
+#include "control_flow_builder.h"
+
+namespace backend
+{
+
+// Product of atoms, each raised to a positive power, ordered by position.
+// Atoms are the values a polynomial is built from: variables and operations
+// that are not additions, subtractions or multiplications
+using monomial = std::vector<std::pair<ssa_position, unsigned>>;
+
+// Sum of monomials with their coefficients. Like terms are collected as the
+// polynomial is built and terms with a zero coefficient are dropped
+class polynomial
+{
+public:
+  static polynomial constant(double value);
+  static polynomial atom(ssa_position position);
+
+  const std::map<monomial, double>& terms() const { return m_terms; }
+
+  unsigned degree() const;
+
+  polynomial& operator+=(const polynomial& other);
+  polynomial& operator-=(const polynomial& other);
+  polynomial& operator*=(double factor);
+
+  friend polynomial operator*(const polynomial& left,
+                              const polynomial& right);
+
+private:
+  void add_term(const monomial& term, double coefficient);
+
+  std::map<monomial, double> m_terms;
+};
+
+// Operations evaluating a polynomial, operands before their users and the
+// value of the polynomial last
+struct horner_form
+{
+  struct node
+  {
+    // Leaves have no operator and hold a constant or an atom
+    std::optional<expression_op> op = std::nullopt;
+    double value = 0;
+    ssa_position atom = 0;
+    bool is_atom = false;
+    std::size_t left = 0;
+    std::size_t right = 0;
+  };
+
+  std::vector<node> nodes;
+
+  std::size_t multiplications() const;
+  // Additions and subtractions
+  std::size_t additions() const;
+};
+
+// Factor out the atom found in the most terms, recursively, which gives the
+// Horner scheme for polynomials in one variable
+horner_form to_horner_form(const polynomial& value);
+
+}  // namespace backend
+
+#endif
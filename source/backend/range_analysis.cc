@@ -0,0 +1,251 @@
+#include <algorithm>
+#include <cmath>
+#include <limits>
+#include <vector>
+
+#include "range_analysis.h"
+
+#include "exceptions.h"
+
+namespace
+{
+constexpr double infinity = std::numeric_limits<double>::infinity();
+// Unit roundoff of both precisions
+constexpr double single_roundoff = 0x1p-24;
+constexpr double double_roundoff = 0x1p-53;
+// Largest absolute error of a single precision result flushed towards zero
+constexpr double single_underflow = 0x1p-150;
+
+// Infinite ranges produce NaN errors (inf * 0), which are unbounded too
+double bounded(double error)
+{
+  return std::isnan(error) ? infinity : error;
+}
+
+backend::interval apply_interval(backend::expression_op op,
+                                 backend::interval left,
+                                 backend::interval right)
+{
+  switch (op) {
+    case backend::expression_op::add:
+      return {left.lower + right.lower, left.upper + right.upper};
+    case backend::expression_op::subtract:
+      return {left.lower - right.upper, left.upper - right.lower};
+    case backend::expression_op::multiply: {
+      const auto products = {left.lower * right.lower,
+                             left.lower * right.upper,
+                             left.upper * right.lower,
+                             left.upper * right.upper};
+      if (std::ranges::any_of(products, [](double x) { return std::isnan(x); }))
+      {
+        return {-infinity, infinity};
+      }
+      return {std::min(products), std::max(products)};
+    }
+    case backend::expression_op::divide:
+      if (right.lower <= 0 && right.upper >= 0) {
+        return {-infinity, infinity};
+      }
+      return apply_interval(backend::expression_op::multiply,
+                            left,
+                            {1 / right.upper, 1 / right.lower});
+    case backend::expression_op::power: {
+      // With a positive base, exponent * log(base) takes its extremes at the
+      // corners. Other bases may give NaN or change sign
+      if (!(left.lower > 0)) {
+        return {-infinity, infinity};
+      }
+      const auto powers = {std::pow(left.lower, right.lower),
+                           std::pow(left.lower, right.upper),
+                           std::pow(left.upper, right.lower),
+                           std::pow(left.upper, right.upper)};
+      if (std::ranges::any_of(powers, [](double x) { return std::isnan(x); }))
+      {
+        return {-infinity, infinity};
+      }
+      return {std::min(powers), std::max(powers)};
+    }
+  }
+  return {-infinity, infinity};  // UNREACHABLE
+}
+
+// Smallest magnitude of a range not containing zero
+double min_magnitude(backend::interval range)
+{
+  if (range.lower <= 0 && range.upper >= 0) {
+    return 0;
+  }
+  return std::min(std::fabs(range.lower), std::fabs(range.upper));
+}
+
+}  // namespace
+
+namespace backend
+{
+
+precision_analysis analyze_precision(
+    const control_flow_data& data,
+    const std::map<std::string, interval>& variable_ranges,
+    double tolerance)
+{
+  precision_analysis analysis {};
+  for (const auto& [position, define] : data.defines) {
+    analysis.ranges[position] = {define, define};
+  }
+  for (const auto& [position, variable] : data.variables) {
+    auto it = variable_ranges.find(variable);
+    if (it == variable_ranges.end()) {
+      throw control_flow_error("Expect a range for variable \"" + variable
+                               + "\"");
+    }
+    if (!(it->second.lower <= it->second.upper)) {
+      throw control_flow_error("Empty range for variable \"" + variable + "\"");
+    }
+    analysis.ranges[position] = it->second;
+  }
+  for (const auto& [position, expr] : data.expressions) {
+    analysis.ranges[position] =
+        apply_interval(expr.get_operator(),
+                       analysis.ranges.at(expr.get_left()),
+                       analysis.ranges.at(expr.get_right()));
+  }
+
+  auto error_bound = [&](const std::set<ssa_position>& single_precision)
+  {
+    auto is_single = [&](ssa_position position)
+    { return single_precision.contains(position); };
+    // Error of an operand as read by an operation of the given precision
+    auto operand_error = [&](const std::map<ssa_position, double>& errors,
+                             ssa_position operand,
+                             bool single_operation)
+    {
+      const auto error = errors.at(operand);
+      return single_operation && !is_single(operand)
+          ? error + single_roundoff * analysis.ranges.at(operand).magnitude()
+          : error;
+    };
+
+    std::map<ssa_position, double> errors;
+    for (const auto& [position, define] : data.defines) {
+      errors[position] = is_single(position)
+          ? std::fabs(define
+                      - static_cast<double>(static_cast<float>(define)))
+          : 0;
+    }
+    for (const auto& [position, _] : data.variables) {
+      errors[position] = is_single(position)
+          ? single_roundoff * analysis.ranges.at(position).magnitude()
+          : 0;
+    }
+    for (const auto& [position, expr] : data.expressions) {
+      const bool single = is_single(position);
+      const auto left = analysis.ranges.at(expr.get_left());
+      const auto right = analysis.ranges.at(expr.get_right());
+      const auto result = analysis.ranges.at(position);
+      const auto left_error = operand_error(errors, expr.get_left(), single);
+      const auto right_error = operand_error(errors, expr.get_right(), single);
+
+      double error = 0;
+      switch (expr.get_operator()) {
+        case expression_op::add:
+        case expression_op::subtract:
+          error = left_error + right_error;
+          break;
+        case expression_op::multiply:
+          error = left_error * right.magnitude()
+              + right_error * left.magnitude() + left_error * right_error;
+          break;
+        case expression_op::divide: {
+          const auto divisor = min_magnitude(right) - right_error;
+          error = divisor > 0
+              ? (left_error + result.magnitude() * right_error) / divisor
+              : infinity;
+          break;
+        }
+        case expression_op::power: {
+          // Mean value bound over the ranges widened by the operand errors,
+          // with d/dl = r * l^r / l and d/dr = l^r * log(l). The library
+          // pow() is within one more rounding
+          const interval base {left.lower - left_error,
+                               left.upper + left_error};
+          const interval exponent {right.lower - right_error,
+                                   right.upper + right_error};
+          const auto widened =
+              apply_interval(expression_op::power, base, exponent);
+          error = base.lower > 0
+              ? widened.magnitude()
+                  * (exponent.magnitude() * left_error / base.lower
+                     + std::max(std::fabs(std::log(base.lower)),
+                                std::fabs(std::log(base.upper)))
+                         * right_error
+                     + (single ? single_roundoff : double_roundoff))
+              : infinity;
+          break;
+        }
+      }
+      error += single ? single_roundoff * result.magnitude() + single_underflow
+                      : double_roundoff * result.magnitude();
+      errors[position] = bounded(error);
+    }
+
+    double bound = 0;
+    for (const auto& [_, position] : data.outputs) {
+      const auto magnitude = analysis.ranges.at(position).magnitude();
+      const auto error = errors.at(position);
+      bound = std::max(bound, error > 0 ? bounded(error / magnitude) : 0);
+    }
+    return bound;
+  };
+
+  // Candidates ordered by the rounding error they introduce on their own,
+  // values beyond the single precision range never are candidates
+  std::vector<std::pair<double, ssa_position>> candidates;
+  for (const auto& [position, range] : analysis.ranges) {
+    const auto magnitude = range.magnitude();
+    if (magnitude > static_cast<double>(std::numeric_limits<float>::max())) {
+      continue;
+    }
+    const auto rounding = data.defines.contains(position)
+        ? std::fabs(data.defines.at(position)
+                    - static_cast<double>(
+                        static_cast<float>(data.defines.at(position))))
+        : single_roundoff * magnitude;
+    candidates.emplace_back(rounding, position);
+  }
+  std::ranges::sort(candidates, std::greater<> {});
+
+  // Keep every candidate after the first promoted_count in single precision
+  auto single_precision_after = [&](std::size_t promoted_count)
+  {
+    std::set<ssa_position> single_precision;
+    for (std::size_t i = promoted_count; i < candidates.size(); i++) {
+      single_precision.insert(candidates[i].second);
+    }
+    return single_precision;
+  };
+
+  auto double_bound = error_bound({});
+  if (!(double_bound <= tolerance)) {
+    analysis.error_bound = double_bound;
+    analysis.meets_tolerance = false;
+    return analysis;
+  }
+
+  // Promoting values lowers the bound, so search for the fewest promotions
+  std::size_t lower = 0;
+  std::size_t upper = candidates.size();
+  while (lower < upper) {
+    const auto middle = lower + (upper - lower) / 2;
+    if (error_bound(single_precision_after(middle)) <= tolerance) {
+      upper = middle;
+    } else {
+      lower = middle + 1;
+    }
+  }
+  analysis.single_precision = single_precision_after(upper);
+  analysis.error_bound = error_bound(analysis.single_precision);
+  analysis.meets_tolerance = true;
+  return analysis;
+}
+
+}  // namespace backend
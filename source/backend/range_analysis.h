@@ -0,0 +1,54 @@
+#ifndef RANGE_ANALYSIS_H
+#define RANGE_ANALYSIS_H
+
+#include <algorithm>
+#include <cmath>
+#include <map>
+#include <set>
+#include <string>
+
+#include "control_flow_builder.h"
+
+namespace backend
+{
+
+struct interval
+{
+  double lower;
+  double upper;
+
+  double magnitude() const
+  {
+    return std::max(std::fabs(lower), std::fabs(upper));
+  }
+};
+
+struct precision_analysis
+{
+  // Range of every value for the declared variable ranges
+  std::map<ssa_position, interval> ranges;
+  // Positions that may be computed and stored in single precision
+  std::set<ssa_position> single_precision;
+  // Largest error of any output, relative to the largest magnitude the output
+  // takes, when single_precision is used and everything else is double
+  double error_bound;
+  bool meets_tolerance;
+};
+
+// Prove how much of the graph may run in single precision while every output
+// stays within the tolerance.
+//
+// Ranges are propagated with interval arithmetic and rounding errors with
+// first-order bounds, including the conversions between single and double
+// precision. Values are moved back to double precision, largest rounding error
+// first, until the bound holds. When even double precision cannot be proven
+// (e.g. a divisor range contains zero) single_precision is empty and
+// meets_tolerance is false
+precision_analysis analyze_precision(
+    const control_flow_data& data,
+    const std::map<std::string, interval>& variable_ranges,
+    double tolerance);
+
+}  // namespace backend
+
+#endif
@@ -0,0 +1,65 @@
+#include <algorithm>
+#include <cstdint>
+#include <utility>
+
+#include "scheduling.h"
+
+namespace backend
+{
+
+std::vector<ssa_position> schedule_operations(const control_flow_data& data)
+{
+  std::vector<const expression*> operations(data.control_flow_index, nullptr);
+  // Slots needed to evaluate every operation, leaves have their own slots
+  std::vector<std::uint32_t> needs(data.control_flow_index, 0);
+  // Operands always have lower positions, so one ordered pass is enough
+  for (const auto& [position, expr] : data.expressions) {
+    operations[position] = &expr;
+    const auto left = needs[expr.get_left()];
+    const auto right = needs[expr.get_right()];
+    needs[position] = left == right ? left + 1 : std::max(left, right);
+  }
+
+  std::vector<ssa_position> order;
+  order.reserve(data.expressions.size());
+  std::vector<bool> scheduled(data.control_flow_index, false);
+  // Operations whose operands are scheduled before them when expanded
+  std::vector<std::pair<ssa_position, bool>> work;
+  auto schedule_from = [&](ssa_position root)
+  {
+    work.emplace_back(root, false);
+    while (!work.empty()) {
+      const auto [position, expanded] = work.back();
+      work.pop_back();
+      if (operations[position] == nullptr || scheduled[position]) {
+        continue;
+      }
+      if (expanded) {
+        scheduled[position] = true;
+        order.push_back(position);
+        continue;
+      }
+      auto first = operations[position]->get_left();
+      auto second = operations[position]->get_right();
+      if (needs[second] > needs[first]) {
+        std::swap(first, second);
+      }
+      work.emplace_back(position, true);
+      work.emplace_back(second, false);
+      work.emplace_back(first, false);
+    }
+  };
+  for (const auto& [_, position] : data.outputs) {
+    schedule_from(position);
+  }
+  schedule_from(data.out_index);
+  // Unreachable operations are kept, e.g. before dead code elimination
+  for (const auto& [position, _] : data.expressions) {
+    if (!scheduled[position]) {
+      order.push_back(position);
+    }
+  }
+  return order;
+}
+
+}  // namespace backend
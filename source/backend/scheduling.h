@@ -0,0 +1,22 @@
+#ifndef SCHEDULING_H
+#define SCHEDULING_H
+
+#include <vector>
+
+#include "control_flow_builder.h"
+
+namespace backend
+{
+
+// Evaluation order of every operation that keeps few values live at once.
+//
+// Operations are emitted depth first from the outputs, and the operand
+// needing more slots is evaluated first, so its slots are free again when
+// the other operand is computed (Sethi-Ullman numbering). On trees this
+// needs the fewest slots. On DAGs it is a heuristic: shared operands count
+// at every use and stay live until their last user
+std::vector<ssa_position> schedule_operations(const control_flow_data& data);
+
+}  // namespace backend
+
+#endif
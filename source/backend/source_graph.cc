@@ -0,0 +1,31 @@
+#include <string>
+
+#include "source_graph.h"
+
+#include "frontend/parsing/parser.h"
+#include "frontend/scanning/lexer.h"
+
+namespace
+{
+std::vector<frontend::statement> parse(std::string_view source,
+                                       support::arena& arena)
+{
+  auto lexer = frontend::lexer(std::string(source));
+  auto parser = frontend::parser(lexer.scan_tokens(), &arena);
+  return parser.parse_program();
+}
+}  // namespace
+
+namespace backend
+{
+
+source_graph::source_graph(std::string_view source, build_options options)
+    : m_builder(parse(source, m_arena),
+                nullptr,
+                &m_arena,
+                nullptr,
+                options.optimized)
+{
+}
+
+}  // namespace backend
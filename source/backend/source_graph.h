@@ -0,0 +1,40 @@
+#ifndef SOURCE_GRAPH_H
+#define SOURCE_GRAPH_H
+
+#include <string_view>
+
+#include "control_flow_builder.h"
+#include "support/arena.h"
+
+namespace backend
+{
+
+// How the builder of a source_graph lowers the program
+struct build_options
+{
+  // Unless optimized, the graph is left as lowered, see control_flow_builder
+  bool optimized = true;
+};
+
+// Program scanned, parsed and lowered into a graph that callers go on
+// transforming and lowering to bytecode. Tokens, syntax trees and the graph
+// live in an arena that frees the whole compilation at once, with the object
+class source_graph
+{
+public:
+  explicit source_graph(std::string_view source, build_options options = {});
+
+  source_graph(const source_graph&) = delete;
+  source_graph& operator=(const source_graph&) = delete;
+
+  control_flow_builder& builder() { return m_builder; }
+  const control_flow_data& data() const { return m_builder.get_data(); }
+
+private:
+  support::arena m_arena;
+  control_flow_builder m_builder;
+};
+
+}  // namespace backend
+
+#endif
@@ -0,0 +1,185 @@
+#include <cmath>
+#include <optional>
+
+#include "type_inference.h"
+
+namespace
+{
+// Literals are exact with at most this many decimals
+constexpr unsigned max_literal_scale = 9;
+// Doubles represent every integer up to 2^53 exactly
+constexpr double max_exact_literal = 0x1p53;
+
+std::optional<unsigned> literal_scale(double value)
+{
+  for (unsigned scale = 0; scale <= max_literal_scale; scale++) {
+    const auto power = static_cast<double>(backend::power_of_ten(scale));
+    const auto units = std::round(value * power);
+    if (std::fabs(units) > max_exact_literal) {
+      return std::nullopt;
+    }
+    // Round trip rather than integrality of value * power, which misses
+    // literals like 1.1 whose product with ten is not exactly integral
+    if (std::fpclassify(units / power - value) == FP_ZERO) {
+      return scale;
+    }
+  }
+  return std::nullopt;
+}
+
+// Smallest k such that the divisor divides 10^k, if any
+std::optional<unsigned> decimal_inverse_exponent(std::int64_t divisor)
+{
+  if (divisor == 0) {
+    return std::nullopt;
+  }
+  for (unsigned exponent = 0; exponent <= backend::max_exact_scale; exponent++)
+  {
+    if (backend::power_of_ten(exponent) % divisor == 0) {
+      return exponent;
+    }
+  }
+  return std::nullopt;
+}
+
+}  // namespace
+
+namespace backend
+{
+
+type_analysis infer_types(const control_flow_data& data,
+                          const std::map<std::string, unsigned>& variable_scales)
+{
+  type_analysis analysis;
+  auto& scales = analysis.exact_scales;
+  for (const auto& [position, define] : data.defines) {
+    if (auto scale = literal_scale(define)) {
+      scales[position] = *scale;
+    }
+  }
+  for (const auto& [position, variable] : data.variables) {
+    if (auto it = variable_scales.find(variable); it != variable_scales.end()) {
+      if (it->second > max_exact_scale) {
+        throw control_flow_error("Scale of \"" + variable + "\" is above "
+                                 + std::to_string(max_exact_scale));
+      }
+      scales[position] = it->second;
+    }
+  }
+  for (const auto& [position, expr] : data.expressions) {
+    auto left = scales.find(expr.get_left());
+    auto right = scales.find(expr.get_right());
+    if (left == scales.end() || right == scales.end()) {
+      continue;
+    }
+    std::optional<unsigned> scale;
+    switch (expr.get_operator()) {
+      case expression_op::add:
+      case expression_op::subtract:
+        scale = std::max(left->second, right->second);
+        break;
+      case expression_op::multiply:
+        scale = left->second + right->second;
+        break;
+      case expression_op::divide:
+        if (data.defines.contains(expr.get_right())) {
+          const auto divisor =
+              to_exact(data.defines.at(expr.get_right()), right->second);
+          if (auto exponent = decimal_inverse_exponent(divisor)) {
+            // left * 10^(scale - left_scale + right_scale) / divisor must
+            // be a whole number of units
+            const auto result_scale = static_cast<unsigned>(std::max<int>(
+                0,
+                static_cast<int>(left->second + *exponent)
+                    - static_cast<int>(right->second)));
+            if (result_scale + right->second - left->second
+                <= max_exact_scale)
+            {
+              scale = result_scale;
+            }
+          }
+        }
+        break;
+      case expression_op::power:
+        break;  // Integer exponents were lowered to multiplications
+    }
+    if (scale.has_value() && *scale <= max_exact_scale) {
+      scales[position] = *scale;
+    }
+  }
+  return analysis;
+}
+
+std::int64_t to_exact(double value, unsigned scale)
+{
+  const auto scaled = value * static_cast<double>(power_of_ten(scale));
+  const auto units = std::round(scaled);
+  if (!(std::fabs(units) < 0x1p63)) {
+    throw std::overflow_error("Value " + std::to_string(value)
+                              + " does not fit an exact integer");
+  }
+  // Tolerate the representation error of decimals such as 19.99
+  if (std::fabs(scaled - units) > 1e-6) {
+    throw std::invalid_argument(
+        "Value " + std::to_string(value) + " is not a multiple of 10^-"
+        + std::to_string(scale));
+  }
+  return static_cast<std::int64_t>(units);
+}
+
+exact_factors get_exact_factors(expression_op op,
+                                unsigned left_scale,
+                                unsigned right_scale,
+                                std::int64_t right,
+                                unsigned scale)
+{
+  switch (op) {
+    case expression_op::add:
+    case expression_op::subtract:
+      return {power_of_ten(scale - left_scale),
+              power_of_ten(scale - right_scale)};
+    case expression_op::multiply:
+      return {1, 1};
+    case expression_op::divide:
+      return {power_of_ten(scale + right_scale - left_scale) / right, 1};
+    case expression_op::power:
+      break;  // UNREACHABLE, powers are never exact
+  }
+  return {1, 1};  // UNREACHABLE
+}
+
+std::int64_t apply_exact_operator(expression_op op,
+                                  std::int64_t left,
+                                  std::int64_t right,
+                                  exact_factors factors)
+{
+  bool overflow = false;
+  std::int64_t result = 0;
+  switch (op) {
+    case expression_op::add:
+    case expression_op::subtract: {
+      std::int64_t scaled_left = 0;
+      std::int64_t scaled_right = 0;
+      overflow = multiply_overflows(left, factors.left, scaled_left)
+          || multiply_overflows(right, factors.right, scaled_right)
+          || (op == expression_op::add
+                  ? add_overflows(scaled_left, scaled_right, result)
+                  : subtract_overflows(scaled_left, scaled_right, result));
+      break;
+    }
+    case expression_op::multiply:
+      overflow = multiply_overflows(left, right, result);
+      break;
+    case expression_op::divide:
+      overflow = multiply_overflows(left, factors.left, result);
+      break;
+    case expression_op::power:
+      break;  // UNREACHABLE, powers are never exact
+  }
+  if (overflow) {
+    throw std::overflow_error("Exact evaluation overflowed 64-bit integers");
+  }
+  return result;
+}
+
+}  // namespace backend
@@ -0,0 +1,96 @@
+#ifndef TYPE_INFERENCE_H
+#define TYPE_INFERENCE_H
+
+#include <cstdint>
+#include <map>
+#include <stdexcept>
+#include <string>
+
+#include "control_flow_builder.h"
+
+namespace backend
+{
+
+// Exact values are int64 counts of 10^-scale units, so a scale of 0 is an
+// integer and a scale of 2 holds cents
+constexpr unsigned max_exact_scale = 18;
+
+struct type_analysis
+{
+  // Scale of every value evaluated exactly, values not listed are doubles
+  std::map<ssa_position, unsigned> exact_scales;
+};
+
+// Find the values that can be computed exactly: integer and short decimal
+// literals, the variables declared with a scale and the additions,
+// subtractions and multiplications of exact values. Divisions stay exact only
+// by constants whose inverse is a finite decimal (e.g. "x / 100" or "x / 8"),
+// every other operation with a double operand is a double too
+type_analysis infer_types(const control_flow_data& data,
+                          const std::map<std::string, unsigned>& variable_scales);
+
+constexpr std::int64_t power_of_ten(unsigned exponent)
+{
+  std::int64_t power = 1;
+  for (unsigned i = 0; i < exponent; i++) {
+    power *= 10;
+  }
+  return power;
+}
+
+// Conversions at the boundaries between exact values and doubles. to_exact
+// throws std::invalid_argument when the value is not a whole number of units
+// and std::overflow_error when it does not fit
+std::int64_t to_exact(double value, unsigned scale);
+
+inline double from_exact(std::int64_t units, unsigned scale)
+{
+  return static_cast<double>(units) / static_cast<double>(power_of_ten(scale));
+}
+
+// Checked int64 arithmetic, returning true on overflow
+inline bool add_overflows(std::int64_t left,
+                          std::int64_t right,
+                          std::int64_t& result)
+{
+  return __builtin_add_overflow(left, right, &result);
+}
+
+inline bool subtract_overflows(std::int64_t left,
+                               std::int64_t right,
+                               std::int64_t& result)
+{
+  return __builtin_sub_overflow(left, right, &result);
+}
+
+inline bool multiply_overflows(std::int64_t left,
+                               std::int64_t right,
+                               std::int64_t& result)
+{
+  return __builtin_mul_overflow(left, right, &result);
+}
+
+// Multipliers bringing both operands of an exact operation to the scale of
+// its result. Division multiplies the left operand by the exact inverse of
+// the constant right one
+struct exact_factors
+{
+  std::int64_t left;
+  std::int64_t right;
+};
+
+exact_factors get_exact_factors(expression_op op,
+                                unsigned left_scale,
+                                unsigned right_scale,
+                                std::int64_t right,
+                                unsigned scale);
+
+// Apply an operator of an exact value, throws std::overflow_error
+std::int64_t apply_exact_operator(expression_op op,
+                                  std::int64_t left,
+                                  std::int64_t right,
+                                  exact_factors factors);
+
+}  // namespace backend
+
+#endif
@@ -1,52 +1,98 @@
-#include <iostream>
 #include <string>
+#include <vector>
 
 #include "expression.h"
 
 namespace frontend
 {
 
-boost::json::object binary_expression::to_json() const
+namespace
 {
-  boost::json::object obj;
-  obj["type"] = "binary";
-  obj["left"] = m_left->to_json();
-  obj["token_type"] = token_type_to_string(m_token.get_type());
-  obj["right"] = m_right->to_json();
-  return obj;
-}
-
-boost::json::object grouping_expression::to_json() const
+// Remaining work of the tree walk: an expression to open, the key of the
+// member holding the next expression, a member with a string value, or the
+// end of an open object
+enum class write_kind
 {
-  boost::json::object obj;
-  obj["type"] = "grouping";
-  obj["expr"] = m_expr->to_json();
-  return obj;
-}
+  expression,
+  key,
+  member,
+  end_object,
+};
 
-boost::json::object number_expression::to_json() const
+struct pending_write
 {
-  boost::json::object obj;
-  obj["type"] = "number";
-  obj["value"] = std::to_string(m_value);
-  return obj;
-}
+  write_kind kind;
+  const expression* expr = nullptr;
+  const char* key = nullptr;
+  const char* value = nullptr;
+};
+}  // namespace
 
-boost::json::object variable_expression::to_json() const
+void write_json(support::json_writer& writer, const expression& root)
 {
-  boost::json::object obj;
-  obj["type"] = "variable";
-  obj["lexeme"] = m_token.get_lexeme();
-  return obj;
-}
+  using kind = write_kind;
+  std::vector<pending_write> stack {{.kind = kind::expression, .expr = &root}};
+  while (!stack.empty()) {
+    const auto pending = stack.back();
+    stack.pop_back();
+    if (pending.kind == kind::key) {
+      writer.key(pending.key);
+      continue;
+    }
+    if (pending.kind == kind::member) {
+      writer.member(pending.key, pending.value);
+      continue;
+    }
+    if (pending.kind == kind::end_object) {
+      writer.end_object();
+      continue;
+    }
 
-boost::json::object unary_expression::to_json() const
-{
-  boost::json::object obj;
-  obj["type"] = "unary";
-  obj["token_type"] = token_type_to_string(m_token.get_type());
-  obj["expr"] = m_expr->to_json();
-  return obj;
+    writer.begin_object();
+    // Members are pushed in reverse, the stack pops them in schema order
+    if (const auto* binary =
+            dynamic_cast<const binary_expression*>(pending.expr))
+    {
+      writer.member("type", "binary");
+      writer.key("left");
+      stack.push_back({.kind = kind::end_object});
+      stack.push_back({.kind = kind::expression, .expr = binary->get_right()});
+      stack.push_back({.kind = kind::key, .key = "right"});
+      stack.push_back(
+          {.kind = kind::member,
+           .key = "token_type",
+           .value = token_type_to_string(binary->get_token().get_type())});
+      stack.push_back({.kind = kind::expression, .expr = binary->get_left()});
+    } else if (const auto* grouping =
+                   dynamic_cast<const grouping_expression*>(pending.expr))
+    {
+      writer.member("type", "grouping");
+      writer.key("expr");
+      stack.push_back({.kind = kind::end_object});
+      stack.push_back({.kind = kind::expression, .expr = grouping->get_expr()});
+    } else if (const auto* number =
+                   dynamic_cast<const number_expression*>(pending.expr))
+    {
+      writer.member("type", "number");
+      writer.member("value", std::to_string(number->get_value()));
+      writer.end_object();
+    } else if (const auto* variable =
+                   dynamic_cast<const variable_expression*>(pending.expr))
+    {
+      writer.member("type", "variable");
+      writer.member("lexeme", variable->get_token().get_lexeme());
+      writer.end_object();
+    } else if (const auto* unary =
+                   dynamic_cast<const unary_expression*>(pending.expr))
+    {
+      writer.member("type", "unary");
+      writer.member("token_type",
+                    token_type_to_string(unary->get_token().get_type()));
+      writer.key("expr");
+      stack.push_back({.kind = kind::end_object});
+      stack.push_back({.kind = kind::expression, .expr = unary->get_expr()});
+    }
+  }
 }
 
 }  // namespace frontend
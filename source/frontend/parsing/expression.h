@@ -5,9 +5,9 @@
 #include <limits>
 #include <memory>
 
-#include <boost/json.hpp>
 #include <frontend/scanning/token.h>
 #include <math.h>
+#include <support/json_writer.h>
 
 namespace frontend
 {
@@ -19,16 +19,49 @@ public:
   virtual ~expression() = default;
 
   virtual bool operator==(const expression& _) const { return true; }
+};
+
+// Owner of a syntax tree node. Nodes created by the parser in an arena only
+// have their destructor run, the arena releases their memory at once. Nodes
+// made with std::make_unique are deleted
+class node_deleter
+{
+public:
+  node_deleter() = default;
+
+  explicit node_deleter(bool in_arena)
+      : m_in_arena(in_arena)
+  {
+  }
+
+  // Implicit, so nodes made with std::make_unique convert to expression_ptr
+  template<typename T>
+  // NOLINTNEXTLINE(google-explicit-constructor, hicpp-explicit-conversions)
+  node_deleter(std::default_delete<T> /*deleter*/)
+  {
+  }
+
+  void operator()(expression* expr) const
+  {
+    if (m_in_arena) {
+      expr->~expression();
+    } else {
+      delete expr;
+    }
+  }
 
-  virtual boost::json::object to_json() const = 0;
+private:
+  bool m_in_arena = false;
 };
 
+using expression_ptr = std::unique_ptr<expression, node_deleter>;
+
 class binary_expression : public expression
 {
 public:
-  binary_expression(std::unique_ptr<expression> left,
+  binary_expression(expression_ptr left,
                     const token token,
-                    std::unique_ptr<expression> right)
+                    expression_ptr right)
       : m_left(std::move(left))
       , m_token(token)
       , m_right(std::move(right))
@@ -50,22 +83,20 @@ public:
 
   constexpr expression* get_left() const { return m_left.get(); }
 
-  token get_token() const { return m_token; }
+  const token& get_token() const { return m_token; }
 
   constexpr expression* get_right() const { return m_right.get(); }
 
-  boost::json::object to_json() const override;
-
 private:
-  const std::unique_ptr<expression> m_left;
+  const expression_ptr m_left;
   const token m_token;
-  const std::unique_ptr<expression> m_right;
+  const expression_ptr m_right;
 };
 
 class grouping_expression : public expression
 {
 public:
-  grouping_expression(std::unique_ptr<expression> expr)
+  grouping_expression(expression_ptr expr)
       : m_expr(std::move(expr))
   {
   }
@@ -82,10 +113,8 @@ public:
 
   expression* get_expr() const { return m_expr.get(); }
 
-  boost::json::object to_json() const override;
-
 private:
-  const std::unique_ptr<expression> m_expr;
+  const expression_ptr m_expr;
 };
 
 class number_expression : public expression
@@ -110,8 +139,6 @@ public:
 
   constexpr double get_value() const { return m_value; }
 
-  boost::json::object to_json() const override;
-
 private:
   double m_value;
 };
@@ -142,9 +169,7 @@ public:
     return expression::operator==(other) && (m_token == other_casted->m_token);
   }
 
-  token get_token() const { return m_token; }
-
-  boost::json::object to_json() const override;
+  const token& get_token() const { return m_token; }
 
 private:
   token m_token;
@@ -153,7 +178,7 @@ private:
 class unary_expression : public expression
 {
 public:
-  unary_expression(std::unique_ptr<expression> expr, token token)
+  unary_expression(expression_ptr expr, token token)
       : m_expr(std::move(expr))
       , m_token(std::move(token))
   {
@@ -173,14 +198,16 @@ public:
 
   constexpr expression* get_expr() const { return m_expr.get(); }
 
-  token get_token() const { return m_token; }
-
-  boost::json::object to_json() const override;
+  const token& get_token() const { return m_token; }
 
 private:
-  const std::unique_ptr<expression> m_expr;
+  const expression_ptr m_expr;
   const token m_token;
 };
 
+// Write the tree in the schema of the JSON debug file. The tree is walked
+// with an explicit stack, so its depth is only limited by the heap
+void write_json(support::json_writer& writer, const expression& root);
+
 }  // namespace frontend
 #endif
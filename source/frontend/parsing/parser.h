@@ -1,80 +1,139 @@
 #ifndef PARSER_H
 #define PARSER_H
 
+#include <initializer_list>
 #include <iostream>
 #include <memory>
 #include <vector>
 
 #include <exceptions.h>
 #include <frontend/parsing/expression.h>
+#include <frontend/parsing/statement.h>
 #include <frontend/scanning/token.h>
+#include <support/arena.h>
 
 namespace frontend
 {
 class parser
 {
 public:
-  parser(std::vector<frontend::token> tokens)
-      : tokens(tokens)
+  // Nodes are allocated in the arena when one is given, otherwise on the heap
+  parser(std::vector<frontend::token> tokens, support::arena* arena = nullptr)
+      : tokens(std::move(tokens))
+      , m_arena(arena)
   {
   }
 
-  std::unique_ptr<expression> parse() { return term(); }
+  expression_ptr parse() { return term(); }
+
+  // Statements separated by ';', a trailing ';' is allowed
+  std::vector<statement> parse_program()
+  {
+    std::vector<statement> statements;
+    do {
+      if (is_at_end()) {
+        break;
+      }
+      statements.push_back(parse_statement());
+    } while (match({token_type::semicolon}));
+    if (statements.empty()) {
+      throw parse_exception("Expect expression");
+    }
+    if (!is_at_end()) {
+      throw parse_exception("Expect ';' after statement.");
+    }
+    return statements;
+  }
 
 private:
-  std::unique_ptr<expression> term()
+  statement parse_statement()
   {
-    std::unique_ptr<expression> expr = factor();
+    if (match({token_type::let})) {
+      auto name = consume(token_type::variable, "Expect name after 'let'.");
+      consume(token_type::assign, "Expect '=' after name.");
+      return statement(name, true, parse());
+    }
+    if (check(token_type::variable) && check_next(token_type::assign)) {
+      auto name = advance();
+      advance();
+      return statement(name, false, parse());
+    }
+    return statement(std::nullopt, false, parse());
+  }
+
+  expression_ptr term()
+  {
+    expression_ptr expr = factor();
     while (match({token_type::subtract, token_type::add})) {
       auto prev = previous();
-      expr =
-          std::make_unique<binary_expression>(std::move(expr), prev, factor());
+      expr = make_node<binary_expression>(std::move(expr), prev, factor());
     };
     return expr;
   }
 
-  std::unique_ptr<expression> factor()
+  expression_ptr factor()
   {
-    std::unique_ptr<expression> expr = unary();
+    expression_ptr expr = unary();
     while (match({token_type::delimiter, token_type::multiply})) {
       auto prev = previous();
-      expr =
-          std::make_unique<binary_expression>(std::move(expr), prev, unary());
+      expr = make_node<binary_expression>(std::move(expr), prev, unary());
     };
     return expr;
   }
 
-  std::unique_ptr<expression> unary()
+  // Negation applies to the whole power, -x^2 is -(x^2)
+  expression_ptr unary()
   {
     if (match({token_type::subtract})) {
       auto prev = previous();
-      return std::make_unique<unary_expression>(unary(), prev);
+      return make_node<unary_expression>(unary(), prev);
     }
-    return primary();
+    return power();
   }
 
-  std::unique_ptr<expression> primary()
+  // Right-associative, x^y^z is x^(y^z), and the exponent may be negated
+  expression_ptr power()
+  {
+    expression_ptr expr = primary();
+    if (match({token_type::power})) {
+      auto prev = previous();
+      return make_node<binary_expression>(std::move(expr), prev, unary());
+    }
+    return expr;
+  }
+
+  expression_ptr primary()
   {
     if (match({token_type::number})) {
-      return std::make_unique<number_expression>(
-          std::stod(previous().get_lexeme()));
+      return make_node<number_expression>(std::stod(previous().get_lexeme()));
     }
     if (match({token_type::variable})) {
-      return std::make_unique<variable_expression>(previous());
+      return make_node<variable_expression>(previous());
     }
 
     if (match({token_type::open_bracket})) {
-      std::unique_ptr<expression> expr = parse();
+      expression_ptr expr = parse();
       consume(token_type::close_bracket, "Expect ')' after expression.");
-      return std::make_unique<grouping_expression>(std::move(expr));
+      return make_node<grouping_expression>(std::move(expr));
     }
     throw parse_exception("Expect expression");
   }
 
+  template<typename T, typename... Args>
+  expression_ptr make_node(Args&&... args)
+  {
+    if (m_arena == nullptr) {
+      return expression_ptr(new T(std::forward<Args>(args)...));
+    }
+    return expression_ptr(m_arena->create<T>(std::forward<Args>(args)...),
+                          node_deleter(true));
+  }
+
   std::vector<frontend::token> tokens;
   std::size_t token_index = 0;
+  support::arena* m_arena;
 
-  bool match(std::vector<token_type> types)
+  bool match(std::initializer_list<token_type> types)
   {
     for (auto m_type : types) {
       if (check(m_type)) {
@@ -90,11 +149,17 @@ private:
     return !is_at_end() && peek().get_type() == m_type;
   }
 
-  token peek() const { return tokens[token_index]; }
+  bool check_next(token_type m_type) const
+  {
+    return token_index + 1 < tokens.size()
+        && tokens[token_index + 1].get_type() == m_type;
+  }
+
+  const token& peek() const { return tokens[token_index]; }
 
   bool is_at_end() const { return peek().get_type() == eof; }
 
-  token consume(token_type m_type, const std::string& message)
+  const token& consume(token_type m_type, const char* message)
   {
     if (check(m_type)) {
       return advance();
@@ -102,7 +167,7 @@ private:
     throw parse_exception(message);
   }
 
-  token advance()
+  const token& advance()
   {
     if (!is_at_end()) {
       token_index += 1;
@@ -110,7 +175,7 @@ private:
     return previous();
   }
 
-  token previous() const { return tokens[token_index - 1]; }
+  const token& previous() const { return tokens[token_index - 1]; }
 };
 
 }  // namespace frontend
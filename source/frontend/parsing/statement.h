@@ -0,0 +1,55 @@
+#ifndef STATEMENT_H
+#define STATEMENT_H
+
+#include <memory>
+#include <optional>
+
+#include <frontend/parsing/expression.h>
+#include <frontend/scanning/token.h>
+#include <support/json_writer.h>
+
+namespace frontend
+{
+
+// One statement of a program:
+//   let name = expression  (binding, not an output)
+//   name = expression      (named output)
+//   expression             (unnamed output)
+class statement
+{
+public:
+  statement(std::optional<token> name,
+            bool is_let,
+            expression_ptr expr)
+      : m_name(std::move(name))
+      , m_is_let(is_let)
+      , m_expr(std::move(expr))
+  {
+  }
+
+  const std::optional<token>& get_name() const { return m_name; }
+
+  bool is_let() const { return m_is_let; }
+
+  expression* get_expr() const { return m_expr.get(); }
+
+  void write_json(support::json_writer& writer) const
+  {
+    writer.begin_object();
+    writer.member("type", m_is_let ? "let" : "output");
+    if (m_name.has_value()) {
+      writer.member("name", m_name->get_lexeme());
+    }
+    writer.key("expr");
+    frontend::write_json(writer, *m_expr);
+    writer.end_object();
+  }
+
+private:
+  std::optional<token> m_name;
+  bool m_is_let;
+  expression_ptr m_expr;
+};
+
+}  // namespace frontend
+#endif
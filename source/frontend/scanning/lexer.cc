@@ -1,4 +1,5 @@
 #include <map>
+#include <string_view>
 
 #include "lexer.h"
 
@@ -26,7 +27,7 @@ auto constexpr is_whitespace(char symbol) -> bool
 namespace frontend
 {
 
-std::vector<token> lexer::scan_tokens()
+const std::vector<token>& lexer::scan_tokens()
 {
   while (m_current_index < m_source.size()) {
     scan_token();
@@ -39,14 +40,25 @@ std::vector<token> lexer::scan_tokens()
 void lexer::scan_token()
 {
   const char letter = m_source[m_current_index++];
-  const std::map<char, frontend::token_type> single_character_operators {
+  static const std::map<char, frontend::token_type>
+      single_character_operators {
       {'(', token_type::open_bracket},
       {')', token_type::close_bracket},
       {'*', token_type::multiply},
       {'/', token_type::delimiter},
       {'+', token_type::add},
       {'-', token_type::subtract},
+      {'^', token_type::power},
+      {'=', token_type::assign},
+      {';', token_type::semicolon},
   };
+  if (letter == '*' && m_current_index < m_source.size()
+      && m_source[m_current_index] == '*')
+  {
+    m_current_index++;
+    add_token(token_type::power);
+    return;
+  }
   if (single_character_operators.contains(letter)) {
     add_token(single_character_operators.at(letter));
     return;
@@ -74,7 +86,9 @@ void lexer::variable()
     next_index++;
   }
   m_current_index = next_index;
-  add_token(token_type::variable);
+  const auto lexeme =
+      std::string_view(m_source).substr(m_start_index, next_index - m_start_index);
+  add_token(lexeme == "let" ? token_type::let : token_type::variable);
 }
 
 void lexer::number()
@@ -95,9 +109,10 @@ void lexer::number()
 
 void lexer::add_token(token_type type)
 {
-  const std::string m_lexeme =
-      m_source.substr(m_start_index, m_current_index - m_start_index);
-  m_tokens.emplace_back(type, m_lexeme, m_start_index);
+  m_tokens.emplace_back(
+      type,
+      m_source.substr(m_start_index, m_current_index - m_start_index),
+      m_start_index);
 }
 
 }  // namespace frontend
@@ -17,7 +17,7 @@ public:
   {
   }
 
-  std::vector<token> scan_tokens();
+  const std::vector<token>& scan_tokens();
 
   std::vector<token> get_tokens() const { return m_tokens; }
 
@@ -1,10 +1,12 @@
 #ifndef TOKEN_H
 #define TOKEN_H
 
+#include <array>
+#include <cstdint>
 #include <iostream>
 #include <string>
 
-#include <boost/json.hpp>
+#include <support/json_writer.h>
 
 namespace frontend
 {
@@ -17,24 +19,33 @@ enum token_type : unsigned char
   add,  // +
   subtract,  // -
   delimiter,  // /
+  power,  // ^ or **
 
   number,  // 0-9* | 0-9*.0-9*
   variable,  // a-z*0-9*
 
+  assign,  // =
+  semicolon,  // ;
+  let,  // let
+
   eof  // End of expression / input
 };
 
 static const char* token_type_to_string(token_type type)
 {
-  static const std::array<const char*, 9> mapper = {"open_bracket",
-                                                    "close_bracket",
-                                                    "multiply",
-                                                    "add",
-                                                    "subtract",
-                                                    "delimiter",
-                                                    "number",
-                                                    "variable",
-                                                    "eof"};
+  static const std::array<const char*, 13> mapper = {"open_bracket",
+                                                     "close_bracket",
+                                                     "multiply",
+                                                     "add",
+                                                     "subtract",
+                                                     "delimiter",
+                                                     "power",
+                                                     "number",
+                                                     "variable",
+                                                     "assign",
+                                                     "semicolon",
+                                                     "let",
+                                                     "eof"};
   return mapper[static_cast<size_t>(type)];
 }
 
@@ -53,19 +64,19 @@ struct token
         && m_pos == other.m_pos;
   }
 
-  std::string get_lexeme() const { return m_lexeme; }
+  const std::string& get_lexeme() const { return m_lexeme; }
 
   token_type constexpr get_type() const { return m_type; }
 
   std::size_t constexpr get_pos() const { return m_pos; }
 
-  boost::json::object to_json() const
+  void write_json(support::json_writer& writer) const
   {
-    boost::json::object obj;
-    obj["type"] = token_type_to_string(m_type);
-    obj["lexeme"] = m_lexeme;
-    obj["pos"] = m_pos;
-    return obj;
+    writer.begin_object();
+    writer.member("type", token_type_to_string(m_type));
+    writer.member("lexeme", m_lexeme);
+    writer.member("pos", static_cast<std::uint64_t>(m_pos));
+    writer.end_object();
   }
 
 private:
@@ -1,18 +1,47 @@
+#include <chrono>
+#include <csignal>
 #include <fstream>
 #include <iostream>
+#include <random>
+#include <set>
+#include <sstream>
 
-#include <boost/json.hpp>
 #include <boost/program_options.hpp>
 
 #include "args.cc"
+#include "backend/aggregation.h"
+#include "backend/bytecode.h"
+#include "backend/compilation_cache.h"
 #include "backend/control_flow_builder.h"
 #include "backend/executor.h"
+#include "backend/parallel_evaluation.h"
+#include "backend/range_analysis.h"
+#include "backend/type_inference.h"
 #include "exceptions.h"
 #include "frontend/parsing/expression.h"
 #include "frontend/parsing/parser.h"
 #include "frontend/scanning/lexer.h"
+#include "maths_static_compiler/maths_static_compiler.hpp"
+#include "server/server.h"
+#include "support/allocation_tracking.h"
+#include "support/arena.h"
+#include "support/json_writer.h"
+#include "support/statistics.h"
+#include "support/thread_pool.h"
 #include "vars.h"
 
+namespace
+{
+server::server* running_server = nullptr;
+
+void stop_running_server(int /*signal*/)
+{
+  if (running_server != nullptr) {
+    running_server->stop();
+  }
+}
+}  // namespace
+
 class program
 {
 public:
@@ -30,49 +59,243 @@ public:
     if (options.version) {
       return version();
     }
+    if (options.server_socket.has_value()) {
+      return serve();
+    }
 
     try {
-      boost::json::object json_debug_obj;
+      if (options.load_ir.has_value()) {
+        return load_ir();
+      }
 
       const auto input_expression = get_input_expression();
 
-      // Syntactic analysis
-      auto lexer = frontend::lexer(input_expression);
-      auto tokens = lexer.scan_tokens();
+      // Sections are streamed to the file as soon as they are known, nothing
+      // is serialized without a debug file
+      const auto json_sections = get_json_sections();
+      std::ofstream json_debug_file;
+      std::optional<support::json_writer> json_debug;
+      if (options.json_debug_filename.has_value()) {
+        const auto& json_debug_filename = options.json_debug_filename.value();
+        json_debug_file.open(json_debug_filename);
+        if (!json_debug_file.is_open()) {
+          throw std::invalid_argument("Unable to open file "
+                                      + json_debug_filename);
+        }
+        json_debug.emplace(json_debug_file);
+        json_debug->begin_object();
+      }
+      auto is_json_section = [&](const std::string& section)
+      { return json_debug.has_value() && json_sections.contains(section); };
 
-      boost::json::array tokens_serialized;
-      for (auto token : tokens) {
-        tokens_serialized.push_back(token.to_json());
+      // Collected for the debug file too, otherwise only a null check per
+      // phase remains
+      std::optional<support::statistics> statistics;
+      if (options.time_passes || options.stats || is_json_section("stats")) {
+        statistics.emplace();
+        support::enable_allocation_tracking();
       }
-      json_debug_obj["tokens"] = tokens_serialized;
+      auto begin_phase = [&](const char* name)
+      {
+        if (statistics.has_value()) {
+          statistics->begin_phase(name);
+        }
+      };
+      auto end_phase = [&](std::optional<support::ir_size> after = std::nullopt)
+      {
+        if (statistics.has_value()) {
+          statistics->end_phase(after);
+        }
+      };
+      auto* statistics_ptr = statistics.has_value() ? &*statistics : nullptr;
 
-      // Semantic analysis
-      auto parser = frontend::parser(tokens);
-      auto expr = parser.parse();
-      json_debug_obj["syntax_expression_tree"] = expr->to_json();
+      std::shared_ptr<const backend::control_flow_data> cfd;
+      std::optional<std::size_t> value_operations;
+      std::optional<backend::polynomial_savings> polynomial_savings;
+      // The cache only holds value graphs as written, gradients and
+      // normalized polynomials are always rebuilt
+      if (options.cache_directory.has_value() && !options.gradient.has_value()
+          && !options.fast_math)
+      {
+        // Tokens and the syntax tree are not available on a cache hit
+        begin_phase("compilation_cache");
+        auto cache = backend::compilation_cache(
+            1, std::filesystem::path(options.cache_directory.value()));
+        cfd = cache.get_or_compile(input_expression, get_definitions());
+        end_phase(cfd->get_ir_size());
+      } else {
+        // Tokens, syntax tree and graph are freed at once with the arena
+        support::arena arena;
+        if (statistics.has_value()) {
+          statistics->set_arena(&arena);
+        }
 
-      // Optimizations
-      auto cfb = backend::control_flow_builder(*expr);
+        // Syntactic analysis
+        begin_phase("lexer");
+        auto lexer = frontend::lexer(input_expression);
+        auto tokens = lexer.scan_tokens();
+        end_phase();
 
-      auto exec = backend::executor();
-      auto result = exec.execute(cfb.get_data());
-      json_debug_obj["cfd"] = cfb.get_data().to_json();
-      json_debug_obj["result"] = std::to_string(result);
+        if (is_json_section("tokens")) {
+          json_debug->key("tokens");
+          json_debug->begin_array();
+          for (const auto& token : tokens) {
+            token.write_json(*json_debug);
+          }
+          json_debug->end_array();
+        }
 
-      // Write additional information to file
-      if (options.json_debug_filename.has_value()) {
-        auto json_debug_filename = options.json_debug_filename.value();
-        std::ofstream json_debug_file(json_debug_filename);
-        if (!json_debug_file.is_open()) {
-          throw std::invalid_argument("Unable to open file "
-                                      + json_debug_filename);
+        // Semantic analysis
+        const auto tokens_count = tokens.size();
+        begin_phase("parser");
+        auto parser = frontend::parser(std::move(tokens), &arena);
+        auto statements = parser.parse_program();
+        end_phase();
+        if (is_json_section("ast")) {
+          json_debug->key("syntax_expression_tree");
+          if (statements.size() == 1 && !statements.front().get_name()) {
+            frontend::write_json(*json_debug,
+                                 *statements.front().get_expr());
+          } else {
+            json_debug->begin_array();
+            for (const auto& statement : statements) {
+              statement.write_json(*json_debug);
+            }
+            json_debug->end_array();
+          }
+        }
+
+        // Optimizations, starting threads only for programs large enough to
+        // be partitioned
+        std::optional<support::thread_pool> pool;
+        if (options.jobs_count > 1
+            && tokens_count
+                >= 2 * backend::control_flow_builder::partition_nodes)
+        {
+          pool.emplace(options.jobs_count);
+        }
+        begin_phase("control_flow_builder");
+        auto cfb = backend::control_flow_builder(statements,
+                                                 statistics_ptr,
+                                                 &arena,
+                                                 pool ? &*pool : nullptr);
+        end_phase(cfb.get_data().get_ir_size());
+        if (!options.definitions.empty()) {
+          cfb.define_variables(get_definitions());
+        }
+        if (options.fast_math) {
+          polynomial_savings = cfb.normalize_polynomials();
+        }
+        if (options.gradient.has_value()) {
+          value_operations = cfb.get_data().expressions.size();
+          begin_phase("add_derivatives");
+          cfb.add_derivatives(get_differentiation_mode());
+          end_phase(cfb.get_data().get_ir_size());
+        }
+        cfd = std::make_shared<const backend::control_flow_data>(
+            cfb.get_data());
+        if (statistics.has_value()) {
+          statistics->set_arena(nullptr);
+        }
+      }
+
+      // Closed after the result, or without one when only emitting IR
+      auto finish_json_debug = [&](std::optional<double> result)
+      {
+        if (!json_debug.has_value()) {
+          return;
+        }
+        if (is_json_section("ir")) {
+          json_debug->key("cfd");
+          cfd->write_json(*json_debug);
+        }
+        if (result.has_value()) {
+          json_debug->member("result", std::to_string(*result));
+        }
+        if (is_json_section("stats")) {
+          json_debug->key("stats");
+          statistics->write_json(*json_debug);
         }
-        json_debug_file << json_debug_obj;
+        json_debug->end_object();
+        json_debug.reset();
         json_debug_file.close();
+      };
+
+      // Values are only computed exactly when --exact asks for it
+      backend::type_analysis types;
+      if (!options.exact_variables.empty()) {
+        types = backend::infer_types(*cfd, get_exact_variables());
+      }
+      if (options.emit_ir.has_value()) {
+        begin_phase("emit_ir");
+        emit_ir(*cfd, types.exact_scales);
+        end_phase();
+        finish_json_debug(std::nullopt);
+        print_statistics(statistics);
+        return 0;
+      }
+      if (options.aggregates.has_value()) {
+        begin_phase("aggregate");
+        aggregate_rows(*cfd, types.exact_scales);
+        end_phase();
+        finish_json_debug(std::nullopt);
+        print_statistics(statistics);
+        return 0;
       }
+      // Includes the time spent waiting for variable values
+      begin_phase("executor");
+      std::optional<support::thread_pool> pool;
+      if (evaluates_in_parallel(cfd->expressions.size())) {
+        pool.emplace(options.jobs_count);
+      }
+      auto exec = backend::executor();
+      auto result =
+          exec.execute(*cfd, types.exact_scales, pool ? &*pool : nullptr);
+      end_phase();
+      finish_json_debug(result);
 
+      if (cfd->outputs.size() > 1) {
+        for (const auto& [name, position] : cfd->outputs) {
+          std::cout << name << " = " << exec.get_value(position) << '\n';
+        }
+        std::cout << "Operations saved by sharing: "
+                  << cfd->get_sharing_stats().saved_operations() << '\n';
+      }
+      if (value_operations.has_value()) {
+        // Central differences take two calls per variable plus the value
+        const auto calls = 2 * cfd->variables.size() + 1;
+        const auto finite_difference_operations = calls * *value_operations;
+        std::cout << "Gradient cost: " << cfd->expressions.size()
+                  << " operations, replacing " << calls
+                  << " finite difference calls of " << *value_operations
+                  << " operations (" << finite_difference_operations
+                  << " in total)\n";
+      }
+      if (polynomial_savings.has_value()) {
+        std::cout << "Polynomial normalization saved "
+                  << polynomial_savings->multiplications
+                  << " multiplications and " << polynomial_savings->additions
+                  << " additions\n";
+      }
       std::cout << "Result: " << result << '\n';
+      if (!options.exact_variables.empty()) {
+        const auto exact_operations = std::count_if(
+            cfd->expressions.begin(),
+            cfd->expressions.end(),
+            [&](const auto& expression)
+            { return types.exact_scales.contains(expression.first); });
+        std::cout << "Exact operations: " << exact_operations << " of "
+                  << cfd->expressions.size() << '\n';
+      }
+
+      if (!options.ranges.empty()) {
+        report_precision(*cfd);
+      }
+      print_statistics(statistics);
 
+      if (options.incremental) {
+        return incremental(*cfd, exec);
+      }
       return 0;
     } catch (const std::exception& exception) {
       std::cerr << exception.what();
@@ -103,6 +326,415 @@ private:
     return 0;
   }
 
+  // Answer compile and evaluate requests until interrupted
+  // Triggered by flag --server
+  int serve() const
+  {
+    try {
+      server::server instance({
+          .socket_path = options.server_socket.value(),
+          .workers_count = options.workers_count,
+          .cache_directory = options.cache_directory.has_value()
+              ? std::optional<std::filesystem::path>(
+                    options.cache_directory.value())
+              : std::nullopt,
+      });
+      running_server = &instance;
+      std::signal(SIGINT, stop_running_server);
+      std::signal(SIGTERM, stop_running_server);
+      std::cout << "Listening on " << options.server_socket.value() << '\n';
+      instance.run();
+      running_server = nullptr;
+      return 0;
+    } catch (const std::exception& exception) {
+      running_server = nullptr;
+      std::cerr << exception.what() << '\n';
+      return 1;
+    }
+  }
+
+  // Print what --time-passes and --stats ask for
+  void print_statistics(
+      const std::optional<support::statistics>& statistics) const
+  {
+    if (options.time_passes) {
+      statistics->print(std::cout);
+    }
+    if (options.stats) {
+      auto writer = support::json_writer(std::cout);
+      statistics->write_json(writer);
+      std::cout << '\n';
+    }
+  }
+
+  // Reduce the result over rows of variable values read from the standard
+  // input, a chunk of rows at a time so memory does not grow with them
+  // Triggered by flag --aggregate
+  void aggregate_rows(
+      const backend::control_flow_data& data,
+      const std::map<ssa_position, unsigned>& exact_scales) const
+  {
+    static const std::set<std::string> known_reductions = {
+        "count", "sum", "mean", "min", "max", "histogram"};
+    std::vector<std::string> reductions;
+    backend::aggregation_options aggregation {
+        .compensated = options.compensated_sum, .histogram = std::nullopt};
+    std::istringstream stream(options.aggregates.value());
+    std::string reduction;
+    while (std::getline(stream, reduction, ',')) {
+      const auto equals = reduction.find('=');
+      const auto name = reduction.substr(0, equals);
+      if (!known_reductions.contains(name)
+          || (name == "histogram") == (equals == std::string::npos))
+      {
+        throw std::invalid_argument(
+            "Unknown reduction \"" + reduction
+            + "\", expected count, sum, mean, min, max or "
+              "histogram=lower:upper:bins");
+      }
+      if (name == "histogram") {
+        const auto first_colon = reduction.find(':', equals);
+        const auto second_colon = reduction.find(':', first_colon + 1);
+        if (first_colon == std::string::npos
+            || second_colon == std::string::npos)
+        {
+          throw std::invalid_argument("Invalid histogram \"" + reduction
+                                      + "\", expected lower:upper:bins");
+        }
+        aggregation.histogram = backend::histogram_bins {
+            .lower = std::stod(
+                reduction.substr(equals + 1, first_colon - equals - 1)),
+            .upper = std::stod(reduction.substr(
+                first_colon + 1, second_colon - first_colon - 1)),
+            .count = std::stoul(reduction.substr(second_colon + 1)),
+        };
+        if (!(aggregation.histogram->lower < aggregation.histogram->upper)
+            || aggregation.histogram->count == 0)
+        {
+          throw std::invalid_argument("Invalid histogram \"" + reduction
+                                      + "\", expected lower:upper:bins");
+        }
+      }
+      reductions.push_back(name);
+    }
+
+    const auto code = backend::lower(data, {}, exact_scales, lowering());
+    const auto columns = code.variables.size();
+    if (columns == 0) {
+      throw std::invalid_argument(
+          "Aggregating needs an expression with variables to read rows of");
+    }
+    std::optional<support::thread_pool> pool;
+    if (options.jobs_count > 1) {
+      pool.emplace(options.jobs_count);
+    }
+    constexpr std::size_t chunk_rows = 1 << 16;
+    std::vector<double> rows;
+    rows.reserve(chunk_rows * columns);
+    backend::aggregate total(aggregation);
+    auto reduce_rows = [&]
+    {
+      total.merge(pool.has_value()
+                      ? backend::aggregate_batch_parallel(
+                            code, rows, code.output_slot, aggregation, *pool)
+                      : backend::aggregate_batch(
+                            code, rows, code.output_slot, aggregation));
+      rows.clear();
+    };
+    double value = 0;
+    while (std::cin >> value) {
+      rows.push_back(value);
+      if (rows.size() == chunk_rows * columns) {
+        reduce_rows();
+      }
+    }
+    if (!std::cin.eof()) {
+      throw std::invalid_argument("Invalid value in the rows");
+    }
+    if (rows.size() % columns != 0) {
+      throw std::invalid_argument("The last row has "
+                                  + std::to_string(rows.size() % columns)
+                                  + " values instead of "
+                                  + std::to_string(columns));
+    }
+    reduce_rows();
+
+    // The mean, the minimum and the maximum of no rows are undefined
+    auto print_defined = [&](const std::string& name, double result)
+    {
+      std::cout << name << " = ";
+      if (total.count() == 0) {
+        std::cout << "no rows\n";
+      } else {
+        std::cout << result << '\n';
+      }
+    };
+    for (const auto& name : reductions) {
+      if (name == "count") {
+        std::cout << "count = " << total.count() << '\n';
+      } else if (name == "sum") {
+        std::cout << "sum = " << total.sum() << '\n';
+      } else if (name == "mean") {
+        print_defined(name, total.mean());
+      } else if (name == "min") {
+        print_defined(name, total.min());
+      } else if (name == "max") {
+        print_defined(name, total.max());
+      } else {
+        const auto& bins = *aggregation.histogram;
+        const auto& counts = total.histogram();
+        const double width =
+            (bins.upper - bins.lower) / static_cast<double>(bins.count);
+        std::cout << "histogram below " << bins.lower << " = "
+                  << counts[bins.count] << '\n';
+        for (std::size_t bin = 0; bin < bins.count; bin++) {
+          const auto lower = bins.lower + width * static_cast<double>(bin);
+          std::cout << "histogram [" << lower << ", " << lower + width
+                    << ") = " << counts[bin] << '\n';
+        }
+        std::cout << "histogram at or above " << bins.upper << " = "
+                  << counts[bins.count + 1] << '\n';
+      }
+    }
+  }
+
+  // Bytecode lowering, fusing multiply-adds with --fast-math
+  backend::lowering_options lowering() const
+  {
+    return {.fuse_multiply_add = options.fast_math};
+  }
+
+  // Write the program given to --emit-ir
+  void emit_ir(const backend::control_flow_data& data,
+               const std::map<ssa_position, unsigned>& exact_scales) const
+  {
+    const auto compiled = maths_static_compiler::compiled_expression(
+        std::make_shared<const backend::bytecode>(
+            backend::lower(data, {}, exact_scales, lowering())));
+    const auto path = std::filesystem::path(options.emit_ir.value());
+    compiled.save_ir(path);
+    std::cout << "IR written to " << path.string() << " ("
+              << std::filesystem::file_size(path) << " bytes, "
+              << compiled.code().instructions.size() << " instructions)\n";
+  }
+
+  // Evaluate the program given to --load-ir, asking for every variable
+  int load_ir() const
+  {
+    const auto start = std::chrono::steady_clock::now();
+    const auto compiled =
+        maths_static_compiler::load_ir(options.load_ir.value());
+    const auto load_time = std::chrono::duration<double, std::micro>(
+        std::chrono::steady_clock::now() - start);
+    std::cout << "Loaded " << compiled.code().instructions.size()
+              << " instructions in " << load_time.count() << " us\n";
+
+    std::vector<double> values;
+    for (const auto& name : compiled.variables()) {
+      std::cout << "Give a value to the variable \"" << name << "\" = ";
+      std::string input_line;
+      std::getline(std::cin, input_line);
+      values.push_back(std::stod(input_line));
+    }
+    std::optional<support::thread_pool> pool;
+    if (evaluates_in_parallel(compiled.code().instructions.size())) {
+      pool.emplace(options.jobs_count);
+    }
+    std::vector<double> results(compiled.outputs().size());
+    if (pool.has_value()) {
+      compiled.evaluate_all(values, results, *pool);
+    } else {
+      compiled.evaluate_all(values, results);
+    }
+    if (results.size() > 1) {
+      for (std::size_t i = 0; i < results.size(); i++) {
+        std::cout << compiled.outputs()[i] << " = " << results[i] << '\n';
+      }
+    }
+    std::cout << "Result: " << results.back() << '\n';
+    return 0;
+  }
+
+  // Read variable updates line by line and recompute only their uses
+  // Triggered by flag --incremental
+  int incremental(const backend::control_flow_data& data,
+                  const backend::executor& exec) const
+  {
+    auto compiled = maths_static_compiler::compiled_expression(
+        std::make_shared<const backend::bytecode>(
+            backend::lower(data, {}, {}, lowering())));
+    std::map<std::string, double> bound;
+    for (const auto& [pos, name] : data.variables) {
+      bound[name] = exec.get_value(pos);
+    }
+    std::vector<double> values;
+    for (const auto& name : compiled.variables()) {
+      values.push_back(bound.at(name));
+    }
+    auto session = maths_static_compiler::evaluation_session(compiled, values);
+
+    std::string input_line;
+    while (std::getline(std::cin, input_line)) {
+      std::vector<std::size_t> updated;
+      std::vector<double> updated_values;
+      std::istringstream input_stream(input_line);
+      for (std::string binding; input_stream >> binding;) {
+        const auto equals = binding.find('=');
+        const auto name = binding.substr(0, equals);
+        const auto it = std::find(
+            compiled.variables().begin(), compiled.variables().end(), name);
+        if (equals == std::string::npos || it == compiled.variables().end()) {
+          throw std::invalid_argument("Invalid update \"" + binding
+                                      + "\", expected variable=value");
+        }
+        updated.push_back(
+            static_cast<std::size_t>(it - compiled.variables().begin()));
+        updated_values.push_back(std::stod(binding.substr(equals + 1)));
+      }
+      session.update(updated, updated_values);
+      std::cout << "Result: " << session.result() << " (recomputed "
+                << session.last_recomputed() << " of "
+                << session.instructions_count() << " instructions)\n";
+    }
+    return 0;
+  }
+
+  // Prove the error of single precision batches and measure their speed
+  // Triggered by flag --range
+  void report_precision(const backend::control_flow_data& data) const
+  {
+    std::map<std::string, backend::interval> ranges;
+    for (const auto& range : options.ranges) {
+      const auto equals = range.find('=');
+      const auto colon = range.find(':', equals);
+      if (equals == std::string::npos || colon == std::string::npos) {
+        throw std::invalid_argument("Invalid range \"" + range
+                                    + "\", expected variable=lower:upper");
+      }
+      ranges[range.substr(0, equals)] = {
+          std::stod(range.substr(equals + 1, colon - equals - 1)),
+          std::stod(range.substr(colon + 1))};
+    }
+    const auto analysis =
+        backend::analyze_precision(data, ranges, options.tolerance);
+    if (!analysis.meets_tolerance) {
+      std::cout << "Error bound in double precision: " << analysis.error_bound
+                << ", above the tolerance " << options.tolerance << '\n';
+      return;
+    }
+    const auto double_code = backend::lower(data, {}, {}, lowering());
+    const auto mixed_code = backend::lower(data, analysis.single_precision);
+    const auto single_instructions = std::count_if(
+        mixed_code.instructions.begin(),
+        mixed_code.instructions.end(),
+        [&](const backend::instruction& instruction)
+        { return mixed_code.single_precision_slots[instruction.destination]; });
+    std::cout << "Proven error bound: " << analysis.error_bound
+              << " (tolerance " << options.tolerance << ")\n"
+              << "Single precision instructions: " << single_instructions
+              << " of " << mixed_code.instructions.size() << '\n';
+
+    // Rows spread over the declared ranges
+    constexpr std::size_t rows_count = 1 << 16;
+    std::mt19937_64 generator(rows_count);
+    std::vector<double> rows;
+    rows.reserve(rows_count * double_code.variables.size());
+    for (std::size_t row = 0; row < rows_count; row++) {
+      for (const auto& variable : double_code.variables) {
+        const auto range = ranges.at(variable);
+        rows.push_back(std::uniform_real_distribution<double>(
+            range.lower, range.upper)(generator));
+      }
+    }
+    auto rows_per_second = [&](const backend::bytecode& code)
+    {
+      constexpr int repetitions = 16;
+      std::vector<double> results(rows_count);
+      const auto output = std::span(&code.output_slot, 1);
+      backend::evaluate_batch(code, rows, output, results);
+      const auto start = std::chrono::steady_clock::now();
+      for (int i = 0; i < repetitions; i++) {
+        backend::evaluate_batch(code, rows, output, results);
+      }
+      const std::chrono::duration<double> elapsed =
+          std::chrono::steady_clock::now() - start;
+      return repetitions * rows_count / elapsed.count();
+    };
+    const auto double_speed = rows_per_second(double_code);
+    const auto mixed_speed = rows_per_second(mixed_code);
+    std::cout << "Batch throughput: " << double_speed
+              << " rows/s in double, " << mixed_speed
+              << " rows/s with single precision (" << mixed_speed / double_speed
+              << "x)\n";
+  }
+
+  // Whether --jobs threads pay for evaluating this many operations
+  bool evaluates_in_parallel(std::size_t operations) const
+  {
+    return backend::parallel_tasks(operations, options.jobs_count) > 1;
+  }
+
+  // Parse the declarations given with --exact
+  std::map<std::string, unsigned> get_exact_variables() const
+  {
+    std::map<std::string, unsigned> scales;
+    for (const auto& declaration : options.exact_variables) {
+      const auto equals = declaration.find('=');
+      scales[declaration.substr(0, equals)] = equals == std::string::npos
+          ? 0
+          : static_cast<unsigned>(std::stoul(declaration.substr(equals + 1)));
+    }
+    return scales;
+  }
+
+  // Parse the bindings given with --define
+  std::map<std::string, double> get_definitions() const
+  {
+    std::map<std::string, double> values;
+    for (const auto& definition : options.definitions) {
+      const auto equals = definition.find('=');
+      if (equals == std::string::npos) {
+        throw std::invalid_argument("Invalid definition \"" + definition
+                                    + "\", expected variable=value");
+      }
+      values[definition.substr(0, equals)] =
+          std::stod(definition.substr(equals + 1));
+    }
+    return values;
+  }
+
+  // Parse the comma-separated list given with --json-sections
+  std::set<std::string> get_json_sections() const
+  {
+    static const std::set<std::string> known_sections = {
+        "tokens", "ast", "ir", "stats"};
+    std::set<std::string> sections;
+    std::istringstream stream(options.json_sections);
+    std::string section;
+    while (std::getline(stream, section, ',')) {
+      if (!known_sections.contains(section)) {
+        throw std::invalid_argument("Unknown JSON section \"" + section
+                                    + "\", expected tokens, ast, ir or stats");
+      }
+      sections.insert(section);
+    }
+    return sections;
+  }
+
+  // Parse the mode given with --gradient
+  backend::differentiation_mode get_differentiation_mode() const
+  {
+    if (options.gradient.value() == "forward") {
+      return backend::differentiation_mode::forward;
+    }
+    if (options.gradient.value() == "reverse") {
+      return backend::differentiation_mode::reverse;
+    }
+    throw std::invalid_argument("Unknown differentiation mode \""
+                                + options.gradient.value()
+                                + "\", expected forward or reverse");
+  }
+
   // Entering an expression
   // The [--input_line,-i] flags or requested from the user (std::cin)
   std::string get_input_expression() const
@@ -0,0 +1,992 @@
+#include <algorithm>
+#include <bit>
+#include <chrono>
+#include <fstream>
+#include <functional>
+#include <mutex>
+#include <stdexcept>
+
+#include "maths_static_compiler/maths_static_compiler.hpp"
+
+#include "backend/bytecode.h"
+#include "backend/control_flow_builder.h"
+#include "backend/dataflow_graph.h"
+#include "backend/ir_file.h"
+#include "backend/parallel_evaluation.h"
+#include "backend/range_analysis.h"
+#include "backend/source_graph.h"
+#include "backend/type_inference.h"
+#include "support/rcu.h"
+#include "support/thread_pool.h"
+
+namespace
+{
+// Values of an asynchronous evaluation, variables are delivered from any
+// thread and every instruction runs once its last operand is known
+class dataflow_evaluation
+{
+public:
+  dataflow_evaluation(const backend::bytecode& code,
+                      const backend::dataflow_graph& graph)
+      : m_code(code)
+      , m_graph(graph)
+      , m_values(graph.values_count())
+      , m_missing_operands(code.instructions.size(), 0)
+  {
+    std::copy(code.constants.begin(), code.constants.end(), m_values.begin());
+    for (auto value = code.first_variable_slot(); value < m_values.size();
+         value++)
+    {
+      for (const auto user : graph.users_of(value)) {
+        m_missing_operands[user]++;
+      }
+    }
+    // Instructions only reading constants never wait. They are found before
+    // running any, since propagating one completes the others reading it
+    std::vector<std::size_t> ready;
+    for (std::size_t index = 0; index < code.instructions.size(); index++) {
+      if (m_missing_operands[index] == 0) {
+        ready.push_back(index);
+      }
+    }
+    for (const auto index : ready) {
+      m_values[graph.first_result + index] = graph.apply(code, index, m_values);
+      propagate(graph.first_result + index);
+    }
+  }
+
+  void deliver(std::size_t variable, double value)
+  {
+    std::lock_guard lock(m_mutex);
+    const auto position = m_code.first_variable_slot() + variable;
+    m_values[position] = value;
+    propagate(position);
+  }
+
+  std::vector<double> outputs() const
+  {
+    std::lock_guard lock(m_mutex);
+    std::vector<double> results;
+    results.reserve(m_graph.output_values.size());
+    for (const auto value : m_graph.output_values) {
+      results.push_back(m_values[value]);
+    }
+    return results;
+  }
+
+private:
+  // Run the instructions a newly known value completes, then theirs
+  void propagate(std::size_t known)
+  {
+    std::vector<std::size_t> known_values {known};
+    while (!known_values.empty()) {
+      const auto value = known_values.back();
+      known_values.pop_back();
+      for (const auto user : m_graph.users_of(value)) {
+        if (--m_missing_operands[user] == 0) {
+          m_values[m_graph.first_result + user] =
+              m_graph.apply(m_code, user, m_values);
+          known_values.push_back(m_graph.first_result + user);
+        }
+      }
+    }
+  }
+
+  const backend::bytecode& m_code;
+  const backend::dataflow_graph& m_graph;
+  mutable std::mutex m_mutex;
+  std::vector<double> m_values;
+  std::vector<std::uint32_t> m_missing_operands;
+};
+
+maths_static_compiler::task<void> fetch_variable(
+    dataflow_evaluation& evaluation,
+    std::size_t variable,
+    maths_static_compiler::task<double> value)
+{
+  evaluation.deliver(variable, co_await std::move(value));
+}
+
+}  // namespace
+
+namespace maths_static_compiler
+{
+
+compiled_expression::compiled_expression(
+    std::shared_ptr<const backend::bytecode> code)
+    : m_code(std::move(code))
+    , m_schedule(backend::schedule_parallel(*m_code))
+{
+}
+
+compiled_expression::compiled_expression(
+    std::shared_ptr<const backend::bytecode> code,
+    std::shared_ptr<const backend::guarded_code> fast_path)
+    : m_code(std::move(code))
+    , m_fast_path(std::move(fast_path))
+    , m_schedule(backend::schedule_parallel(*m_code))
+{
+}
+
+const std::vector<std::string>& compiled_expression::variables() const
+{
+  return m_code->variables;
+}
+
+const std::vector<std::string>& compiled_expression::outputs() const
+{
+  return m_code->output_names;
+}
+
+double compiled_expression::evaluate(std::span<const double> values) const
+{
+  check_values_count(values.size());
+  if (!m_code->exact_scales.empty()) {
+    // The integer kernels only exist in the batch form
+    double result = 0;
+    backend::evaluate_batch(
+        *m_code, values, std::span(&m_code->output_slot, 1), std::span(&result, 1));
+    return result;
+  }
+  // Reused between calls, so evaluation does not allocate once warmed up
+  thread_local std::vector<double> slots;
+  const auto& code = m_fast_path != nullptr && m_fast_path->guards_hold(values)
+      ? m_fast_path->code
+      : *m_code;
+  slots.resize(std::max<std::size_t>(slots.size(), code.slots_count));
+  return backend::evaluate(code, values, slots);
+}
+
+void compiled_expression::evaluate_all(std::span<const double> values,
+                                       std::span<double> results) const
+{
+  check_values_count(values.size());
+  check_results_count(results.size());
+  if (!m_code->exact_scales.empty()) {
+    backend::evaluate_batch(*m_code, values, m_code->output_slots, results);
+    return;
+  }
+  thread_local std::vector<double> slots;
+  const auto& code = m_fast_path != nullptr && m_fast_path->guards_hold(values)
+      ? m_fast_path->code
+      : *m_code;
+  slots.resize(std::max<std::size_t>(slots.size(), code.slots_count));
+  backend::execute(code, values, slots);
+  for (std::size_t i = 0; i < results.size(); i++) {
+    results[i] = slots[code.output_slots[i]];
+  }
+}
+
+void compiled_expression::evaluate_batch(std::span<const double> rows,
+                                         std::span<double> results) const
+{
+  check_rows_count(rows.size(), results.size());
+  run_batch(rows, false, results, nullptr);
+}
+
+void compiled_expression::evaluate_batch_all(std::span<const double> rows,
+                                             std::span<double> results) const
+{
+  const auto outputs_count = m_code->output_slots.size();
+  if (results.size() % outputs_count != 0) {
+    throw std::invalid_argument("Expected " + std::to_string(outputs_count)
+                                + " results per row, got "
+                                + std::to_string(results.size()) + " values");
+  }
+  check_rows_count(rows.size(), results.size() / outputs_count);
+  run_batch(rows, true, results, nullptr);
+}
+
+double compiled_expression::evaluate(std::span<const double> values,
+                                     support::thread_pool& pool) const
+{
+  check_values_count(values.size());
+  if (!runs_parallel(values)) {
+    return evaluate(values);
+  }
+  return execute_parallel(values, pool)[m_schedule->graph.result_value];
+}
+
+void compiled_expression::evaluate_all(std::span<const double> values,
+                                       std::span<double> results,
+                                       support::thread_pool& pool) const
+{
+  check_values_count(values.size());
+  check_results_count(results.size());
+  if (!runs_parallel(values)) {
+    evaluate_all(values, results);
+    return;
+  }
+  const auto graph_values = execute_parallel(values, pool);
+  const auto& output_values = m_schedule->graph.output_values;
+  for (std::size_t i = 0; i < results.size(); i++) {
+    results[i] = graph_values[output_values[i]];
+  }
+}
+
+void compiled_expression::evaluate_batch(std::span<const double> rows,
+                                         std::span<double> results,
+                                         support::thread_pool& pool) const
+{
+  check_rows_count(rows.size(), results.size());
+  run_batch(rows, false, results, &pool);
+}
+
+void compiled_expression::evaluate_batch_all(std::span<const double> rows,
+                                             std::span<double> results,
+                                             support::thread_pool& pool) const
+{
+  const auto outputs_count = m_code->output_slots.size();
+  if (results.size() % outputs_count != 0) {
+    throw std::invalid_argument("Expected " + std::to_string(outputs_count)
+                                + " results per row, got "
+                                + std::to_string(results.size()) + " values");
+  }
+  check_rows_count(rows.size(), results.size() / outputs_count);
+  run_batch(rows, true, results, &pool);
+}
+
+std::size_t compiled_expression::saved_operations() const
+{
+  return m_code->saved_operations;
+}
+
+double compiled_expression::error_bound() const
+{
+  return m_code->error_bound;
+}
+
+std::size_t compiled_expression::single_precision_instructions() const
+{
+  const auto& single = m_code->single_precision_slots;
+  return static_cast<std::size_t>(
+      std::count_if(m_code->instructions.begin(),
+                    m_code->instructions.end(),
+                    [&](const backend::instruction& instruction)
+                    { return !single.empty() && single[instruction.destination]; }));
+}
+
+std::size_t compiled_expression::exact_instructions() const
+{
+  const auto& scales = m_code->exact_scales;
+  return static_cast<std::size_t>(
+      std::count_if(m_code->instructions.begin(),
+                    m_code->instructions.end(),
+                    [&](const backend::instruction& instruction)
+                    { return !scales.empty() && scales[instruction.destination] >= 0; }));
+}
+
+std::map<std::string, double> compiled_expression::guarded_values() const
+{
+  std::map<std::string, double> values;
+  if (m_fast_path != nullptr) {
+    for (const auto& [variable, value] : m_fast_path->guards) {
+      values[m_code->variables[variable]] = value;
+    }
+  }
+  return values;
+}
+
+std::size_t compiled_expression::fast_path_instructions() const
+{
+  return m_fast_path != nullptr ? m_fast_path->code.instructions.size() : 0;
+}
+
+bool compiled_expression::runs_parallel(std::span<const double> values) const
+{
+  return m_schedule != nullptr
+      && (m_fast_path == nullptr || !m_fast_path->guards_hold(values));
+}
+
+std::span<const double> compiled_expression::execute_parallel(
+    std::span<const double> values, support::thread_pool& pool) const
+{
+  thread_local std::vector<double> graph_values;
+  graph_values.resize(m_schedule->graph.values_count());
+  backend::execute_parallel(*m_code,
+                            m_schedule->graph,
+                            m_schedule->levels,
+                            values,
+                            graph_values,
+                            pool);
+  return graph_values;
+}
+
+void compiled_expression::run_batch(std::span<const double> rows,
+                                    bool all_outputs,
+                                    std::span<double> results,
+                                    support::thread_pool* pool) const
+{
+  auto batch = [&](const backend::bytecode& code,
+                   std::span<const double> batch_rows,
+                   std::span<double> batch_results)
+  {
+    const auto outputs = all_outputs
+        ? std::span<const backend::slot_index>(code.output_slots)
+        : std::span(&code.output_slot, 1);
+    if (pool != nullptr) {
+      backend::evaluate_batch_parallel(
+          code, batch_rows, outputs, batch_results, *pool);
+    } else {
+      backend::evaluate_batch(code, batch_rows, outputs, batch_results);
+    }
+  };
+  if (m_fast_path == nullptr) {
+    batch(*m_code, rows, results);
+    return;
+  }
+
+  // Every row takes the fast path, which is cheap, then the rows the guards
+  // do not hold for are gathered and recomputed by the general code
+  batch(m_fast_path->code, rows, results);
+  const auto columns = m_code->variables.size();
+  const auto outputs_count = all_outputs ? m_code->output_slots.size() : 1;
+  const auto rows_count = results.size() / outputs_count;
+  thread_local std::vector<double> general_rows;
+  thread_local std::vector<std::size_t> general_indexes;
+  general_rows.clear();
+  general_indexes.clear();
+  for (std::size_t row = 0; row < rows_count; row++) {
+    const auto values = rows.subspan(row * columns, columns);
+    if (!m_fast_path->guards_hold(values)) {
+      general_rows.insert(general_rows.end(), values.begin(), values.end());
+      general_indexes.push_back(row);
+    }
+  }
+  if (general_indexes.empty()) {
+    return;
+  }
+  thread_local std::vector<double> general_results;
+  general_results.resize(general_indexes.size() * outputs_count);
+  batch(*m_code, general_rows, general_results);
+  for (std::size_t i = 0; i < general_indexes.size(); i++) {
+    std::copy_n(general_results.begin()
+                    + static_cast<std::ptrdiff_t>(i * outputs_count),
+                outputs_count,
+                results.begin()
+                    + static_cast<std::ptrdiff_t>(general_indexes[i]
+                                                  * outputs_count));
+  }
+}
+
+void compiled_expression::check_values_count(std::size_t values_count) const
+{
+  if (values_count != m_code->variables.size()) {
+    throw std::invalid_argument(
+        "Expected " + std::to_string(m_code->variables.size())
+        + " variable values, got " + std::to_string(values_count));
+  }
+}
+
+void compiled_expression::check_results_count(std::size_t results_count) const
+{
+  if (results_count != m_code->output_slots.size()) {
+    throw std::invalid_argument(
+        "Expected space for " + std::to_string(m_code->output_slots.size())
+        + " outputs, got " + std::to_string(results_count));
+  }
+}
+
+void compiled_expression::check_rows_count(std::size_t values_count,
+                                           std::size_t rows_count) const
+{
+  if (values_count != rows_count * m_code->variables.size()) {
+    throw std::invalid_argument(
+        "Expected " + std::to_string(rows_count) + " rows of "
+        + std::to_string(m_code->variables.size()) + " values, got "
+        + std::to_string(values_count) + " values");
+  }
+}
+
+value_profile::value_profile(const compiled_expression& compiled)
+    : m_variables(compiled.variables())
+    , m_counts(m_variables.size())
+{
+}
+
+void value_profile::record(std::span<const double> values)
+{
+  if (values.size() != m_variables.size()) {
+    throw std::invalid_argument(
+        "Expected " + std::to_string(m_variables.size())
+        + " variable values, got " + std::to_string(values.size()));
+  }
+  for (std::size_t variable = 0; variable < values.size(); variable++) {
+    auto& counts = m_counts[variable];
+    auto it = std::find_if(counts.begin(),
+                           counts.end(),
+                           [&](const std::pair<double, std::size_t>& count)
+                           { return backend::identical(count.first,
+                                                       values[variable]); });
+    if (it != counts.end()) {
+      it->second++;
+    } else if (counts.size() < tracked_values) {
+      counts.emplace_back(values[variable], 1);
+    }
+  }
+  m_rows++;
+}
+
+void value_profile::record_batch(std::span<const double> rows)
+{
+  const auto columns = m_variables.size();
+  if (columns == 0 || rows.size() % columns != 0) {
+    throw std::invalid_argument("Expected rows of " + std::to_string(columns)
+                                + " values, got "
+                                + std::to_string(rows.size()) + " values");
+  }
+  for (std::size_t offset = 0; offset < rows.size(); offset += columns) {
+    record(rows.subspan(offset, columns));
+  }
+}
+
+std::map<std::string, double> value_profile::dominant_values(
+    double min_share) const
+{
+  std::map<std::string, double> values;
+  for (std::size_t variable = 0; variable < m_variables.size(); variable++) {
+    const auto& counts = m_counts[variable];
+    auto it = std::max_element(
+        counts.begin(),
+        counts.end(),
+        [](const auto& left, const auto& right)
+        { return left.second < right.second; });
+    if (it != counts.end()
+        && static_cast<double>(it->second)
+            >= min_share * static_cast<double>(m_rows))
+    {
+      values[m_variables[variable]] = it->first;
+    }
+  }
+  return values;
+}
+
+evaluation_session::evaluation_session(compiled_expression compiled,
+                                       std::span<const double> values)
+    : m_compiled(std::move(compiled))
+{
+  const auto& code = m_compiled.code();
+  if (values.size() != code.variables.size()) {
+    throw std::invalid_argument(
+        "Expected " + std::to_string(code.variables.size())
+        + " variable values, got " + std::to_string(values.size()));
+  }
+
+  m_graph = std::make_shared<const backend::dataflow_graph>(
+      backend::build_dataflow_graph(code));
+  m_values.resize(m_graph->values_count());
+  std::copy(code.constants.begin(), code.constants.end(), m_values.begin());
+  std::copy(values.begin(),
+            values.end(),
+            m_values.begin() + code.first_variable_slot());
+  for (std::size_t index = 0; index < code.instructions.size(); index++) {
+    m_values[m_graph->first_result + index] =
+        m_graph->apply(code, index, m_values);
+  }
+  m_is_pending.assign(code.instructions.size(), false);
+  m_last_recomputed = code.instructions.size();
+}
+
+void evaluation_session::update(std::span<const std::size_t> variables,
+                                std::span<const double> values)
+{
+  const auto& code = m_compiled.code();
+  if (variables.size() != values.size()) {
+    throw std::invalid_argument("Expected one value per updated variable");
+  }
+  for (std::size_t i = 0; i < variables.size(); i++) {
+    if (variables[i] >= code.variables.size()) {
+      throw std::invalid_argument("Unknown variable index "
+                                  + std::to_string(variables[i]));
+    }
+    const auto value = code.first_variable_slot() + variables[i];
+    if (std::bit_cast<std::uint64_t>(m_values[value])
+        == std::bit_cast<std::uint64_t>(values[i]))
+    {
+      continue;
+    }
+    m_values[value] = values[i];
+    schedule_users(value);
+  }
+  recompute();
+}
+
+void evaluation_session::schedule_users(std::size_t value)
+{
+  for (const auto user : m_graph->users_of(value)) {
+    if (!m_is_pending[user]) {
+      m_is_pending[user] = true;
+      m_pending.push_back(user);
+      std::push_heap(m_pending.begin(), m_pending.end(), std::greater<> {});
+    }
+  }
+}
+
+void evaluation_session::recompute()
+{
+  const auto& code = m_compiled.code();
+  m_last_recomputed = 0;
+  while (!m_pending.empty()) {
+    std::pop_heap(m_pending.begin(), m_pending.end(), std::greater<> {});
+    const auto index = m_pending.back();
+    m_pending.pop_back();
+    m_is_pending[index] = false;
+    m_last_recomputed++;
+
+    const auto value = m_graph->apply(code, index, m_values);
+    const auto result = m_graph->first_result + index;
+    // Compared bitwise, so an unchanged NaN also stops the propagation
+    if (std::bit_cast<std::uint64_t>(value)
+        == std::bit_cast<std::uint64_t>(m_values[result]))
+    {
+      continue;
+    }
+    m_values[result] = value;
+    schedule_users(result);
+  }
+}
+
+double evaluation_session::result() const
+{
+  return m_values[m_graph->result_value];
+}
+
+void evaluation_session::outputs(std::span<double> results) const
+{
+  const auto& output_values = m_graph->output_values;
+  if (results.size() != output_values.size()) {
+    throw std::invalid_argument(
+        "Expected space for " + std::to_string(output_values.size())
+        + " outputs, got " + std::to_string(results.size()));
+  }
+  for (std::size_t i = 0; i < results.size(); i++) {
+    results[i] = m_values[output_values[i]];
+  }
+}
+
+std::size_t evaluation_session::instructions_count() const
+{
+  return m_compiled.code().instructions.size();
+}
+
+void compiled_expression::save_ir(const std::filesystem::path& path) const
+{
+  std::ofstream file(path, std::ios::binary | std::ios::trunc);
+  if (!file.is_open()) {
+    throw std::invalid_argument("Unable to open file " + path.string());
+  }
+  backend::write_ir(file, *m_code);
+  if (!file.flush()) {
+    throw std::runtime_error("Unable to write file " + path.string());
+  }
+}
+
+task<std::vector<double>> evaluate_async(compiled_expression compiled,
+                                         variable_provider provider)
+{
+  const auto& code = compiled.code();
+  const auto graph = backend::build_dataflow_graph(code);
+  dataflow_evaluation evaluation(code, graph);
+  std::vector<task<void>> fetches;
+  fetches.reserve(code.variables.size());
+  for (std::size_t variable = 0; variable < code.variables.size(); variable++) {
+    fetches.push_back(fetch_variable(
+        evaluation, variable, provider(code.variables[variable])));
+  }
+  co_await when_all(std::span(fetches));
+  co_return evaluation.outputs();
+}
+
+compiled_expression compile(std::string_view source)
+{
+  const auto graph = backend::source_graph(source);
+  return compiled_expression(
+      std::make_shared<const backend::bytecode>(backend::lower(graph.data())));
+}
+
+compiled_expression compile_fast_math(std::string_view source)
+{
+  auto graph = backend::source_graph(source);
+  graph.builder().normalize_polynomials();
+  return compiled_expression(std::make_shared<const backend::bytecode>(
+      backend::lower(graph.data(), {}, {}, {.fuse_multiply_add = true})));
+}
+
+compiled_expression compile_specialized(
+    std::string_view source, const std::map<std::string, double>& definitions)
+{
+  auto graph = backend::source_graph(source);
+  graph.builder().define_variables(definitions);
+  return compiled_expression(
+      std::make_shared<const backend::bytecode>(backend::lower(graph.data())));
+}
+
+namespace
+{
+// compile_profiled() given the code of compile(), which may read variables
+// the program does not use
+compiled_expression add_fast_path(std::string_view source,
+                                  compiled_expression general,
+                                  const value_profile& profile,
+                                  double min_share)
+{
+  const auto values = profile.dominant_values(min_share);
+  if (values.empty()) {
+    return general;
+  }
+  auto specialized = compile_specialized(source, values);
+  if (specialized.code().instructions.size()
+      >= general.code().instructions.size())
+  {
+    return general;  // Guards would only add to the cost
+  }
+
+  const auto& variables = general.variables();
+  auto index_of = [&](const std::string& name)
+  {
+    return static_cast<std::size_t>(
+        std::find(variables.begin(), variables.end(), name)
+        - variables.begin());
+  };
+  auto fast_path = std::make_shared<backend::guarded_code>();
+  for (const auto& [name, value] : values) {
+    if (index_of(name) < variables.size()) {
+      fast_path->guards.emplace_back(index_of(name), value);
+    }
+  }
+  fast_path->code =
+      backend::rebase_variables(specialized.code(), general.variables());
+  return compiled_expression(
+      std::make_shared<const backend::bytecode>(general.code()),
+      std::move(fast_path));
+}
+
+}  // namespace
+
+compiled_expression compile_profiled(std::string_view source,
+                                     const value_profile& profile,
+                                     double min_share)
+{
+  return add_fast_path(source, compile(source), profile, min_share);
+}
+
+namespace
+{
+compiled_expression compile_baseline(std::string_view source)
+{
+  const auto graph = backend::source_graph(source, {.optimized = false});
+  return compiled_expression(std::make_shared<const backend::bytecode>(
+      backend::lower(graph.data(), {}, {}, {.reuse_slots = false})));
+}
+
+double seconds_since(std::chrono::steady_clock::time_point start)
+{
+  return std::chrono::duration<double>(std::chrono::steady_clock::now()
+                                       - start)
+      .count();
+}
+
+// Promotions of every tiered expression are compiled one at a time
+support::thread_pool& compilation_thread()
+{
+  static support::thread_pool pool(1);
+  return pool;
+}
+
+}  // namespace
+
+struct tiered_expression::state : std::enable_shared_from_this<state>
+{
+  struct tier_code
+  {
+    compiled_expression compiled;
+    execution_tier tier;
+  };
+
+  struct tier_counters
+  {
+    std::atomic<std::uint64_t> evaluations = 0;
+    std::atomic<std::uint64_t> rows = 0;
+    // Of the evaluations that were timed
+    std::atomic<std::uint64_t> timed_rows = 0;
+    std::atomic<std::uint64_t> nanoseconds = 0;
+  };
+
+  static constexpr std::uint64_t timing_interval = 64;
+
+  state(std::string_view program, tier_thresholds promotion_thresholds)
+      : source(program)
+      , thresholds(promotion_thresholds)
+  {
+    const auto start = std::chrono::steady_clock::now();
+    auto baseline = compile_baseline(source);
+    variables = baseline.variables();
+    outputs = baseline.outputs();
+    instructions[0] = baseline.code().instructions.size();
+    current.store(new tier_code {std::move(baseline),
+                                 execution_tier::baseline});
+    compile_seconds[0] = seconds_since(start);
+    entered_after[0] = 0;
+  }
+
+  state(const state&) = delete;
+  state& operator=(const state&) = delete;
+
+  // Background compilations hold the state, no evaluation can be running
+  ~state() { delete current.load(); }
+
+  // Evaluate the rows with the code of the current tier, which stays alive
+  // until the evaluation is done even when a promotion replaces it
+  template<typename Evaluation>
+  void run(std::span<const double> rows,
+           std::uint64_t rows_count,
+           const Evaluation& evaluation)
+  {
+    auto section = support::rcu_domain::global().read_lock();
+    const auto* code = current.load(std::memory_order_acquire);
+    auto& counter = counters[static_cast<std::size_t>(code->tier)];
+    const auto call =
+        counter.evaluations.fetch_add(1, std::memory_order_relaxed);
+    // Reading the clock takes about as long as evaluating a small formula,
+    // so single rows are only timed once in a while
+    if (rows_count == 1 && call % timing_interval != 0) {
+      evaluation(code->compiled);
+    } else {
+      const auto start = std::chrono::steady_clock::now();
+      evaluation(code->compiled);
+      const auto elapsed = std::chrono::steady_clock::now() - start;
+      counter.nanoseconds.fetch_add(
+          static_cast<std::uint64_t>(
+              std::chrono::duration_cast<std::chrono::nanoseconds>(elapsed)
+                  .count()),
+          std::memory_order_relaxed);
+      counter.timed_rows.fetch_add(rows_count, std::memory_order_relaxed);
+    }
+    const auto tier_rows =
+        counter.rows.fetch_add(rows_count, std::memory_order_relaxed)
+        + rows_count;
+    if (code->tier == execution_tier::baseline
+        && tier_rows >= thresholds.optimize_after
+        && !optimization_queued.exchange(true))
+    {
+      compilation_thread().submit([self = shared_from_this()]
+                                  { self->optimize(); });
+    } else if (code->tier == execution_tier::optimized
+               && profiling.load(std::memory_order_relaxed))
+    {
+      record(rows);
+    }
+  }
+
+  // Profiling is skipped while another thread records, so evaluations never
+  // wait for each other
+  void record(std::span<const double> rows)
+  {
+    std::unique_lock lock(profile_mutex, std::try_to_lock);
+    if (!lock.owns_lock() || !profile.has_value()) {
+      return;
+    }
+    profile->record_batch(rows);
+    if (profile->rows() >= thresholds.specialize_after) {
+      profiling.store(false, std::memory_order_relaxed);
+      compilation_thread().submit(
+          [self = shared_from_this(), recorded = std::move(*profile)]
+          { self->specialize(recorded); });
+      profile.reset();
+    }
+  }
+
+  void optimize()
+  {
+    const auto start = std::chrono::steady_clock::now();
+    // Same variables as the baseline, whatever optimizations removed
+    auto optimized =
+        compiled_expression(std::make_shared<const backend::bytecode>(
+            backend::rebase_variables(compile(source).code(), variables)));
+    // Without variables there is nothing to specialize for
+    if (!variables.empty()) {
+      std::lock_guard lock(profile_mutex);
+      profile.emplace(optimized);
+      profiling.store(true, std::memory_order_relaxed);
+    }
+    promote(std::move(optimized), execution_tier::optimized, start);
+  }
+
+  void specialize(const value_profile& recorded)
+  {
+    const auto start = std::chrono::steady_clock::now();
+    // Only this thread swaps the code, it cannot be retired meanwhile
+    auto specialized = add_fast_path(source,
+                                     current.load()->compiled,
+                                     recorded,
+                                     thresholds.min_share);
+    if (specialized.guarded_values().empty()) {
+      // No value is dominant enough to pay for guards
+      std::lock_guard lock(statistics_mutex);
+      compile_seconds[2] = seconds_since(start);
+      return;
+    }
+    promote(std::move(specialized), execution_tier::specialized, start);
+  }
+
+  void promote(compiled_expression compiled,
+               execution_tier tier,
+               std::chrono::steady_clock::time_point start)
+  {
+    const auto index = static_cast<std::size_t>(tier);
+    {
+      std::lock_guard lock(statistics_mutex);
+      compile_seconds[index] = seconds_since(start);
+      instructions[index] = tier == execution_tier::specialized
+          ? compiled.fast_path_instructions()
+          : compiled.code().instructions.size();
+      entered_after[index] = 0;
+      for (std::size_t lower = 0; lower < index; lower++) {
+        *entered_after[index] += counters[lower].rows.load();
+      }
+    }
+    const auto* replaced =
+        current.exchange(new tier_code {std::move(compiled), tier});
+    support::rcu_domain::global().retire(replaced);
+  }
+
+  const std::string source;
+  const tier_thresholds thresholds;
+  std::vector<std::string> variables;
+  std::vector<std::string> outputs;
+
+  std::atomic<const tier_code*> current = nullptr;
+  std::array<tier_counters, 3> counters;
+  // Never cleared: evaluations still running the baseline after the
+  // promotion must not queue another one
+  std::atomic<bool> optimization_queued = false;
+
+  std::mutex profile_mutex;
+  std::optional<value_profile> profile;  // At the optimized tier
+  std::atomic<bool> profiling = false;
+
+  mutable std::mutex statistics_mutex;
+  std::array<double, 3> compile_seconds {};
+  std::array<std::size_t, 3> instructions {};
+  std::array<std::optional<std::uint64_t>, 3> entered_after;
+};
+
+tiered_expression::tiered_expression(std::string_view source,
+                                     tier_thresholds thresholds)
+    : m_state(std::make_shared<state>(source, thresholds))
+{
+}
+
+const std::vector<std::string>& tiered_expression::variables() const
+{
+  return m_state->variables;
+}
+
+const std::vector<std::string>& tiered_expression::outputs() const
+{
+  return m_state->outputs;
+}
+
+double tiered_expression::evaluate(std::span<const double> values) const
+{
+  double result = 0;
+  m_state->run(values,
+               1,
+               [&](const compiled_expression& compiled)
+               { result = compiled.evaluate(values); });
+  return result;
+}
+
+void tiered_expression::evaluate_all(std::span<const double> values,
+                                     std::span<double> results) const
+{
+  m_state->run(values,
+               1,
+               [&](const compiled_expression& compiled)
+               { compiled.evaluate_all(values, results); });
+}
+
+void tiered_expression::evaluate_batch(std::span<const double> rows,
+                                       std::span<double> results) const
+{
+  m_state->run(rows,
+               results.size(),
+               [&](const compiled_expression& compiled)
+               { compiled.evaluate_batch(rows, results); });
+}
+
+execution_tier tiered_expression::tier() const
+{
+  auto section = support::rcu_domain::global().read_lock();
+  return m_state->current.load(std::memory_order_acquire)->tier;
+}
+
+std::array<tier_statistics, 3> tiered_expression::statistics() const
+{
+  std::array<tier_statistics, 3> result;
+  std::lock_guard lock(m_state->statistics_mutex);
+  for (std::size_t index = 0; index < result.size(); index++) {
+    const auto& counter = m_state->counters[index];
+    const auto rows = counter.rows.load();
+    const auto timed_rows = counter.timed_rows.load();
+    result[index] = {
+        .evaluations = counter.evaluations.load(),
+        .rows = rows,
+        .evaluation_seconds = timed_rows == 0
+            ? 0
+            : static_cast<double>(counter.nanoseconds.load()) * 1e-9
+                * static_cast<double>(rows) / static_cast<double>(timed_rows),
+        .compile_seconds = m_state->compile_seconds[index],
+        .instructions = m_state->instructions[index],
+        .entered_after = m_state->entered_after[index],
+    };
+  }
+  return result;
+}
+
+compiled_expression compile(std::string_view source,
+                            const std::map<std::string, variable_range>& ranges,
+                            double tolerance)
+{
+  const auto graph = backend::source_graph(source);
+
+  std::map<std::string, backend::interval> intervals;
+  for (const auto& [name, range] : ranges) {
+    intervals[name] = {range.lower, range.upper};
+  }
+  const auto analysis =
+      backend::analyze_precision(graph.data(), intervals, tolerance);
+  auto code = std::make_shared<backend::bytecode>(
+      backend::lower(graph.data(), analysis.single_precision));
+  code->error_bound = analysis.error_bound;
+  return compiled_expression(std::move(code));
+}
+
+compiled_expression compile_exact(
+    std::string_view source,
+    const std::map<std::string, unsigned>& variable_scales)
+{
+  const auto graph = backend::source_graph(source);
+  const auto types = backend::infer_types(graph.data(), variable_scales);
+  return compiled_expression(std::make_shared<const backend::bytecode>(
+      backend::lower(graph.data(), {}, types.exact_scales)));
+}
+
+compiled_expression compile_gradient(std::string_view source,
+                                     differentiation_mode mode)
+{
+  auto graph = backend::source_graph(source);
+  graph.builder().add_derivatives(
+      mode == differentiation_mode::forward
+          ? backend::differentiation_mode::forward
+          : backend::differentiation_mode::reverse);
+  return compiled_expression(
+      std::make_shared<const backend::bytecode>(backend::lower(graph.data())));
+}
+
+compiled_expression load_ir(const std::filesystem::path& path)
+{
+  return compiled_expression(backend::map_ir(path));
+}
+
+}  // namespace maths_static_compiler
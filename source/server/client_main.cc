@@ -0,0 +1,69 @@
+#include <csignal>
+#include <iostream>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <boost/program_options.hpp>
+
+#include "server/unix_socket_client.h"
+
+namespace po = boost::program_options;
+
+// Send requests to a running server and print its responses in order.
+// Requests come from --request options or, when none are given, from the
+// standard input (one per line); all of them are pipelined on one connection
+int main(int argc, const char* const* argv)
+{
+  po::options_description desc(
+      "A command-line client for the maths_static_compiler server"
+      "\n\n"
+      "Allowed options");
+  desc.add_options()("help,h", "Produce help message")(
+      "socket,s",
+      po::value<std::string>()->required(),
+      "Path of the server socket, e.g. /tmp/maths_static_compiler.sock")(
+      "request,r",
+      po::value<std::vector<std::string>>(),
+      "Request line, e.g. \"evaluate-expression x * 2 | x=4\"");
+
+  try {
+    po::variables_map vm;
+    po::store(po::parse_command_line(argc, argv, desc), vm);
+    if (vm.count("help") > 0) {
+      std::cout << desc << "\n";
+      return 0;
+    }
+    po::notify(vm);
+
+    std::signal(SIGPIPE, SIG_IGN);
+    auto client = server::unix_socket_client(vm.at("socket").as<std::string>());
+    auto requests = vm.count("request") > 0
+        ? vm.at("request").as<std::vector<std::string>>()
+        : std::vector<std::string> {};
+
+    std::thread sender(
+        [&]
+        {
+          if (!requests.empty()) {
+            for (const auto& request : requests) {
+              client.send_line(request);
+            }
+          } else {
+            std::string line;
+            while (std::getline(std::cin, line)) {
+              client.send_line(line);
+            }
+          }
+          client.finish_sending();
+        });
+    while (auto response = client.receive_line()) {
+      std::cout << *response << '\n';
+    }
+    sender.join();
+    return 0;
+  } catch (const std::exception& exception) {
+    std::cerr << exception.what() << '\n';
+    return 1;
+  }
+}
@@ -0,0 +1,70 @@
+#include <memory>
+
+#include "formula_registry.h"
+
+#include "support/rcu.h"
+
+namespace server
+{
+
+formula_registry::formula_registry()
+    : m_table(new table())
+{
+}
+
+formula_registry::~formula_registry()
+{
+  delete m_table.load();
+}
+
+std::optional<formula_registry::formula> formula_registry::find(
+    std::string_view name) const
+{
+  auto section = support::rcu_domain::global().read_lock();
+  const auto* current = m_table.load(std::memory_order_acquire);
+  auto it = current->find(name);
+  if (it == current->end()) {
+    return std::nullopt;
+  }
+  return it->second;
+}
+
+std::uint64_t formula_registry::publish(const std::string& name,
+                                        tiered_expression expression)
+{
+  std::lock_guard lock(m_writer_mutex);
+  const auto* current = m_table.load(std::memory_order_relaxed);
+  auto next = std::make_unique<table>(*current);
+  const auto version = ++m_last_version;
+  next->insert_or_assign(name, formula {std::move(expression), version});
+  m_table.store(next.release(), std::memory_order_seq_cst);
+  support::rcu_domain::global().retire(current);
+  return version;
+}
+
+bool formula_registry::remove(std::string_view name)
+{
+  std::lock_guard lock(m_writer_mutex);
+  const auto* current = m_table.load(std::memory_order_relaxed);
+  auto it = current->find(name);
+  if (it == current->end()) {
+    return false;
+  }
+  auto next = std::make_unique<table>(*current);
+  next->erase(next->find(name));
+  m_table.store(next.release(), std::memory_order_seq_cst);
+  support::rcu_domain::global().retire(current);
+  return true;
+}
+
+std::vector<std::string> formula_registry::names() const
+{
+  auto section = support::rcu_domain::global().read_lock();
+  std::vector<std::string> result;
+  for (const auto& [name, _] : *m_table.load(std::memory_order_acquire)) {
+    result.push_back(name);
+  }
+  return result;
+}
+
+}  // namespace server
@@ -0,0 +1,72 @@
+#ifndef FORMULA_REGISTRY_H
+#define FORMULA_REGISTRY_H
+
+#include <atomic>
+#include <cstdint>
+#include <map>
+#include <mutex>
+#include <optional>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include "maths_static_compiler/maths_static_compiler.hpp"
+
+namespace server
+{
+
+// Formulas by name, replaced while they are being evaluated.
+//
+// Lookups never wait: they read the current table of formulas in an RCU read
+// section and copy the expression out of it, which keeps that version alive
+// for as long as the caller evaluates it. Writers compile before taking their
+// lock, then publish a copy of the table with one atomic store. A replaced
+// table is deleted once no lookup can still read it, and a replaced version
+// once the last evaluator holding it is done. Formulas are tiered, so the
+// ones evaluated often are optimized in the background
+class formula_registry
+{
+public:
+  using tiered_expression = maths_static_compiler::tiered_expression;
+
+  struct formula
+  {
+    tiered_expression expression;
+    // Increases with every publication in the registry
+    std::uint64_t version;
+  };
+
+  formula_registry();
+
+  formula_registry(const formula_registry&) = delete;
+  formula_registry& operator=(const formula_registry&) = delete;
+
+  // No lookup may still be running
+  ~formula_registry();
+
+  std::optional<formula> find(std::string_view name) const;
+
+  // Add the formula or replace its current version, returns the new version
+  std::uint64_t publish(const std::string& name, tiered_expression expression);
+
+  std::uint64_t publish(const std::string& name, std::string_view source)
+  {
+    return publish(name, tiered_expression(source));
+  }
+
+  // False when there was no formula of that name
+  bool remove(std::string_view name);
+
+  std::vector<std::string> names() const;
+
+private:
+  using table = std::map<std::string, formula, std::less<>>;
+
+  std::atomic<const table*> m_table;
+  std::mutex m_writer_mutex;  // Writers copy the table one at a time
+  std::uint64_t m_last_version = 0;
+};
+
+}  // namespace server
+
+#endif
@@ -0,0 +1,185 @@
+#include <algorithm>
+#include <chrono>
+#include <csignal>
+#include <deque>
+#include <iostream>
+#include <mutex>
+#include <random>
+#include <sstream>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <boost/program_options.hpp>
+
+#include "server/unix_socket_client.h"
+
+namespace po = boost::program_options;
+
+using latency_clock = std::chrono::steady_clock;
+
+namespace
+{
+struct load_options
+{
+  std::string socket_path;
+  std::string expression;
+  std::size_t connections;
+  std::size_t depth;
+  std::size_t requests;
+};
+
+// Compile the expression once, then keep `depth` evaluations in flight on
+// the connection and record the latency of every one of them
+std::vector<double> run_connection(const load_options& options,
+                                   unsigned seed)
+{
+  auto client = server::unix_socket_client(options.socket_path);
+  client.send_line("compile " + options.expression);
+  auto compiled = client.receive_line();
+  if (!compiled.has_value() || !compiled->starts_with("ok ")) {
+    throw std::runtime_error("Compilation failed: "
+                             + compiled.value_or("connection closed"));
+  }
+  std::istringstream compiled_stream(compiled->substr(3));
+  std::string handle;
+  compiled_stream >> handle;
+  std::vector<std::string> variables;
+  for (std::string variable; compiled_stream >> variable;) {
+    variables.push_back(variable);
+  }
+
+  std::mt19937 generator(seed);
+  std::uniform_real_distribution<double> distribution(-100, 100);
+  auto next_request = [&]
+  {
+    std::string request = "evaluate " + handle + " |";
+    for (const auto& variable : variables) {
+      request += ' ' + variable + '=' + std::to_string(distribution(generator));
+    }
+    return request;
+  };
+
+  std::vector<double> latencies;
+  latencies.reserve(options.requests);
+  std::deque<latency_clock::time_point> in_flight;
+  std::size_t sent = 0;
+  while (latencies.size() < options.requests) {
+    while (sent < options.requests && in_flight.size() < options.depth) {
+      in_flight.push_back(latency_clock::now());
+      client.send_line(next_request());
+      sent++;
+    }
+    auto response = client.receive_line();
+    if (!response.has_value()) {
+      throw std::runtime_error("Server closed the connection");
+    }
+    if (!response->starts_with("ok")) {
+      throw std::runtime_error("Request failed: " + *response);
+    }
+    latencies.push_back(std::chrono::duration<double, std::micro>(
+                            latency_clock::now() - in_flight.front())
+                            .count());
+    in_flight.pop_front();
+  }
+  return latencies;
+}
+
+}  // namespace
+
+// Load generator for the server: reports requests/second and p50/p99 latency
+int main(int argc, const char* const* argv)
+{
+  po::options_description desc(
+      "A load generator for the maths_static_compiler server"
+      "\n\n"
+      "Allowed options");
+  desc.add_options()("help,h", "Produce help message")(
+      "socket,s",
+      po::value<std::string>()->required(),
+      "Path of the server socket, e.g. /tmp/maths_static_compiler.sock")(
+      "expression,e",
+      po::value<std::string>()->default_value("(x + 1) * (y - 2) / 3 + x * y"),
+      "Expression compiled once and evaluated with random bindings")(
+      "connections,c",
+      po::value<std::size_t>()->default_value(4),
+      "Number of concurrent connections")(
+      "depth,d",
+      po::value<std::size_t>()->default_value(16),
+      "Number of pipelined requests in flight per connection")(
+      "requests,n",
+      po::value<std::size_t>()->default_value(10000),
+      "Number of evaluations per connection");
+
+  try {
+    po::variables_map vm;
+    po::store(po::parse_command_line(argc, argv, desc), vm);
+    if (vm.count("help") > 0) {
+      std::cout << desc << "\n";
+      return 0;
+    }
+    po::notify(vm);
+
+    const load_options options {
+        .socket_path = vm.at("socket").as<std::string>(),
+        .expression = vm.at("expression").as<std::string>(),
+        .connections = std::max<std::size_t>(
+            1, vm.at("connections").as<std::size_t>()),
+        .depth = std::max<std::size_t>(1, vm.at("depth").as<std::size_t>()),
+        .requests = vm.at("requests").as<std::size_t>(),
+    };
+
+    std::signal(SIGPIPE, SIG_IGN);
+    std::mutex latencies_mutex;
+    std::vector<double> latencies;
+    std::exception_ptr failure;
+    std::vector<std::thread> threads;
+    const auto start = latency_clock::now();
+    for (std::size_t i = 0; i < options.connections; i++) {
+      threads.emplace_back(
+          [&, i]
+          {
+            try {
+              auto connection_latencies =
+                  run_connection(options, static_cast<unsigned>(i));
+              std::lock_guard lock(latencies_mutex);
+              latencies.insert(latencies.end(),
+                               connection_latencies.begin(),
+                               connection_latencies.end());
+            } catch (...) {
+              std::lock_guard lock(latencies_mutex);
+              failure = std::current_exception();
+            }
+          });
+    }
+    for (auto& thread : threads) {
+      thread.join();
+    }
+    const auto elapsed =
+        std::chrono::duration<double>(latency_clock::now() - start).count();
+    if (failure) {
+      std::rethrow_exception(failure);
+    }
+    if (latencies.empty()) {
+      std::cout << "No requests were sent\n";
+      return 0;
+    }
+
+    std::sort(latencies.begin(), latencies.end());
+    auto percentile = [&](double fraction)
+    {
+      const auto index = static_cast<std::size_t>(
+          fraction * static_cast<double>(latencies.size() - 1));
+      return latencies[index];
+    };
+    std::cout << "Requests: " << latencies.size() << '\n'
+              << "Requests/second: "
+              << static_cast<double>(latencies.size()) / elapsed << '\n'
+              << "Latency p50: " << percentile(0.50) << " us\n"
+              << "Latency p99: " << percentile(0.99) << " us\n";
+    return 0;
+  } catch (const std::exception& exception) {
+    std::cerr << exception.what() << '\n';
+    return 1;
+  }
+}
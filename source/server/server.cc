@@ -0,0 +1,550 @@
+#include <algorithm>
+#include <charconv>
+#include <mutex>
+#include <set>
+#include <span>
+#include <system_error>
+#include <vector>
+
+#include "server.h"
+
+#include <fcntl.h>
+#include <poll.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+#include "backend/bytecode.h"
+#include "support/thread_pool.h"
+
+namespace
+{
+constexpr std::size_t max_request_size = 1 << 20;
+
+#ifdef MSG_NOSIGNAL
+constexpr int send_flags = MSG_NOSIGNAL;
+#else
+constexpr int send_flags = 0;  // SO_NOSIGPIPE is set on the socket instead
+#endif
+
+struct connection
+{
+  explicit connection(int descriptor)
+      : fd(descriptor)
+  {
+  }
+
+  int fd;
+  std::string read_buffer;
+  std::string write_buffer;
+  std::uint64_t next_request = 0;
+  std::uint64_t next_response = 0;
+  bool reading_closed = false;
+
+  // Responses computed by workers, waiting for the earlier ones to finish
+  std::mutex completed_mutex;
+  std::map<std::uint64_t, std::string> completed;
+
+  void move_completed_to_write_buffer()
+  {
+    std::lock_guard lock(completed_mutex);
+    for (auto it = completed.begin();
+         it != completed.end() && it->first == next_response;
+         it = completed.erase(it), next_response++)
+    {
+      write_buffer += it->second;
+      write_buffer += '\n';
+    }
+  }
+
+  bool is_finished() const
+  {
+    return reading_closed && next_response == next_request
+        && write_buffer.empty();
+  }
+};
+
+void set_non_blocking(int fd)
+{
+  if (fcntl(fd, F_SETFL, fcntl(fd, F_GETFL) | O_NONBLOCK) < 0) {
+    throw std::system_error(errno, std::generic_category(), "fcntl");
+  }
+}
+
+bool is_would_block(int error)
+{
+  return error == EAGAIN || error == EWOULDBLOCK || error == EINTR;
+}
+
+std::string_view trim(std::string_view str)
+{
+  const auto first = str.find_first_not_of(" \t\r\n");
+  if (first == std::string_view::npos) {
+    return {};
+  }
+  const auto last = str.find_last_not_of(" \t\r\n");
+  return str.substr(first, last - first + 1);
+}
+
+std::vector<std::string_view> split(std::string_view str, char delimiter)
+{
+  std::vector<std::string_view> parts;
+  std::size_t start = 0;
+  while (true) {
+    const auto end = str.find(delimiter, start);
+    parts.push_back(trim(str.substr(start, end - start)));
+    if (end == std::string_view::npos) {
+      return parts;
+    }
+    start = end + 1;
+  }
+}
+
+std::string format_number(double value)
+{
+  std::array<char, 32> buffer {};
+  auto [end, _] = std::to_chars(buffer.begin(), buffer.end(), value);
+  return std::string(buffer.begin(), end);
+}
+
+// Outputs of one evaluation separated by commas
+std::string format_results(std::span<const double> results)
+{
+  std::string response;
+  for (const auto result : results) {
+    if (!response.empty()) {
+      response += ',';
+    }
+    response += format_number(result);
+  }
+  return response;
+}
+
+// Current tier, then "<tier>=<rows>,<evaluation seconds>,<compile seconds>"
+// for every tier the formula has reached
+std::string format_tier_statistics(
+    const maths_static_compiler::tiered_expression& expression)
+{
+  static const char* const tier_names[] = {
+      "baseline", "optimized", "specialized"};
+  std::string response =
+      tier_names[static_cast<std::size_t>(expression.tier())];
+  const auto statistics = expression.statistics();
+  for (std::size_t tier = 0; tier < statistics.size(); tier++) {
+    if (statistics[tier].entered_after.has_value()) {
+      response += ' ';
+      response += tier_names[tier];
+      response += '=' + std::to_string(statistics[tier].rows) + ','
+          + format_number(statistics[tier].evaluation_seconds) + ','
+          + format_number(statistics[tier].compile_seconds);
+    }
+  }
+  return response;
+}
+
+// Messages of the pipeline's exceptions may span several lines
+std::string to_single_line(std::string_view message)
+{
+  std::string line(trim(message));
+  std::replace(line.begin(), line.end(), '\n', ' ');
+  return line;
+}
+
+}  // namespace
+
+namespace server
+{
+
+server::server(server_options options)
+    : m_options {std::move(options)}
+    , m_cache {m_options.cache_capacity, m_options.cache_directory}
+{
+  sockaddr_un address {};
+  address.sun_family = AF_UNIX;
+  const auto path = m_options.socket_path.string();
+  if (path.size() >= sizeof(address.sun_path)) {
+    throw std::invalid_argument("Socket path is too long: " + path);
+  }
+  std::copy(path.begin(), path.end(), address.sun_path);
+
+  m_listen_fd = socket(AF_UNIX, SOCK_STREAM, 0);
+  if (m_listen_fd < 0) {
+    throw std::system_error(errno, std::generic_category(), "socket");
+  }
+  unlink(path.c_str());  // Left behind by a previous instance
+  // NOLINTNEXTLINE(cppcoreguidelines-pro-type-reinterpret-cast)
+  if (bind(m_listen_fd, reinterpret_cast<sockaddr*>(&address), sizeof(address))
+          < 0
+      || listen(m_listen_fd, SOMAXCONN) < 0)
+  {
+    const int error = errno;
+    close(m_listen_fd);
+    throw std::system_error(error, std::generic_category(), "bind " + path);
+  }
+  set_non_blocking(m_listen_fd);
+
+  if (pipe(m_wake_fds.data()) < 0) {
+    throw std::system_error(errno, std::generic_category(), "pipe");
+  }
+  set_non_blocking(m_wake_fds[0]);
+  set_non_blocking(m_wake_fds[1]);
+}
+
+server::~server()
+{
+  close(m_listen_fd);
+  close(m_wake_fds[0]);
+  close(m_wake_fds[1]);
+  unlink(m_options.socket_path.c_str());
+}
+
+void server::run()
+{
+  auto workers = support::thread_pool(m_options.workers_count);
+  std::map<int, std::shared_ptr<connection>> connections;
+  std::vector<pollfd> poll_fds;
+
+  auto dispatch_requests = [&](const std::shared_ptr<connection>& conn)
+  {
+    std::size_t line_end = 0;
+    while ((line_end = conn->read_buffer.find('\n')) != std::string::npos) {
+      auto request = conn->read_buffer.substr(0, line_end);
+      conn->read_buffer.erase(0, line_end + 1);
+      const auto sequence = conn->next_request++;
+      workers.submit(
+          [this, conn, sequence, request = std::move(request)]
+          {
+            auto response = handle_request(request);
+            {
+              std::lock_guard lock(conn->completed_mutex);
+              conn->completed.emplace(sequence, std::move(response));
+            }
+            wake();
+          });
+    }
+    if (conn->read_buffer.size() > max_request_size) {
+      std::lock_guard lock(conn->completed_mutex);
+      conn->completed.emplace(conn->next_request++,
+                              "error Request is too long");
+      conn->read_buffer.clear();
+      conn->reading_closed = true;
+    }
+  };
+
+  auto read_requests = [&](const std::shared_ptr<connection>& conn)
+  {
+    std::array<char, 1 << 16> buffer {};
+    while (true) {
+      const auto count = read(conn->fd, buffer.data(), buffer.size());
+      if (count > 0) {
+        conn->read_buffer.append(buffer.data(),
+                                 static_cast<std::size_t>(count));
+        continue;
+      }
+      if (count < 0 && is_would_block(errno)) {
+        break;
+      }
+      // The peer finished sending (or failed), answer what was received
+      conn->reading_closed = true;
+      break;
+    }
+    dispatch_requests(conn);
+  };
+
+  // Returns false when the connection is broken
+  auto write_responses = [&](const std::shared_ptr<connection>& conn)
+  {
+    while (!conn->write_buffer.empty()) {
+      const auto count = send(conn->fd,
+                              conn->write_buffer.data(),
+                              conn->write_buffer.size(),
+                              send_flags);
+      if (count < 0) {
+        return is_would_block(errno);
+      }
+      conn->write_buffer.erase(0, static_cast<std::size_t>(count));
+    }
+    return true;
+  };
+
+  while (!m_stopping.load()) {
+    poll_fds.clear();
+    poll_fds.push_back({m_listen_fd, POLLIN, 0});
+    poll_fds.push_back({m_wake_fds[0], POLLIN, 0});
+    for (const auto& [fd, conn] : connections) {
+      short events = conn->reading_closed ? 0 : POLLIN;
+      if (!conn->write_buffer.empty()) {
+        events |= POLLOUT;
+      }
+      poll_fds.push_back({fd, events, 0});
+    }
+
+    if (poll(poll_fds.data(), poll_fds.size(), -1) < 0) {
+      if (errno == EINTR) {
+        continue;
+      }
+      throw std::system_error(errno, std::generic_category(), "poll");
+    }
+
+    if ((poll_fds[1].revents & POLLIN) != 0) {
+      std::array<char, 256> buffer {};
+      while (read(m_wake_fds[0], buffer.data(), buffer.size()) > 0) {
+      }
+    }
+
+    if ((poll_fds[0].revents & POLLIN) != 0) {
+      int fd = -1;
+      while ((fd = accept(m_listen_fd, nullptr, nullptr)) >= 0) {
+        set_non_blocking(fd);
+#ifdef SO_NOSIGPIPE
+        int enabled = 1;
+        setsockopt(fd, SOL_SOCKET, SO_NOSIGPIPE, &enabled, sizeof(enabled));
+#endif
+        connections.emplace(fd, std::make_shared<connection>(fd));
+      }
+    }
+
+    std::set<int> broken;
+    for (std::size_t i = 2; i < poll_fds.size(); i++) {
+      const auto& poll_fd = poll_fds[i];
+      const auto& conn = connections.at(poll_fd.fd);
+      if ((poll_fd.revents & (POLLIN | POLLHUP)) != 0) {
+        read_requests(conn);
+      }
+      if ((poll_fd.revents & POLLERR) != 0) {
+        broken.insert(poll_fd.fd);
+      }
+    }
+
+    for (auto it = connections.begin(); it != connections.end();) {
+      auto& conn = it->second;
+      conn->move_completed_to_write_buffer();
+      if (broken.contains(it->first) || !write_responses(conn)
+          || conn->is_finished())
+      {
+        close(it->first);
+        it = connections.erase(it);
+      } else {
+        ++it;
+      }
+    }
+  }
+
+  for (const auto& [fd, _] : connections) {
+    close(fd);
+  }
+}
+
+void server::stop()
+{
+  m_stopping.store(true);
+  wake();
+}
+
+void server::wake() const
+{
+  const char signal = 0;
+  [[maybe_unused]] auto _ = write(m_wake_fds[1], &signal, 1);
+}
+
+std::string server::handle_request(std::string_view request)
+{
+  request = trim(request);
+  const auto command_end = request.find(' ');
+  const auto command = request.substr(0, command_end);
+  const auto arguments = command_end == std::string_view::npos
+      ? std::string_view {}
+      : request.substr(command_end + 1);
+
+  try {
+    if (command == "compile") {
+      auto [handle, compiled] = compile(trim(arguments));
+      std::array<char, 16> buffer {};
+      auto [end, _] = std::to_chars(buffer.begin(), buffer.end(), handle, 16);
+      std::string response = "ok " + std::string(buffer.begin(), end);
+      for (const auto& variable : compiled.variables()) {
+        response += ' ' + variable;
+      }
+      return response;
+    }
+    if (command == "publish") {
+      const auto name_end = arguments.find(' ');
+      const auto name = trim(arguments.substr(0, name_end));
+      if (name.empty() || name_end == std::string_view::npos) {
+        throw std::invalid_argument("Expected a name and an expression");
+      }
+      // Only lowered before the registry is touched, lookups never wait for
+      // it and the optimizations wait until the formula is evaluated often
+      auto expression = maths_static_compiler::tiered_expression(
+          trim(arguments.substr(name_end + 1)));
+      auto variables = expression.variables();
+      const auto version =
+          m_formulas.publish(std::string(name), std::move(expression));
+      std::string response = "ok " + std::to_string(version);
+      for (const auto& variable : variables) {
+        response += ' ' + variable;
+      }
+      return response;
+    }
+    if (command == "formula-stats") {
+      return "ok " + format_tier_statistics(find_formula(arguments));
+    }
+    if (command == "evaluate" || command == "evaluate-expression"
+        || command == "evaluate-formula")
+    {
+      auto parts = split(arguments, '|');
+      if (parts.size() == 1) {
+        parts.emplace_back();  // Formulas without variables need no bindings
+      }
+      std::string response = "ok";
+      auto evaluate_groups = [&](const auto& expression)
+      {
+        std::vector<double> results(expression.outputs().size());
+        for (std::size_t i = 1; i < parts.size(); i++) {
+          expression.evaluate_all(
+              bind_values(expression.variables(), parts[i]), results);
+          response += ' ';
+          response += format_results(results);
+        }
+      };
+      if (command == "evaluate-formula") {
+        evaluate_groups(find_formula(parts.front()));
+      } else {
+        evaluate_groups(command == "evaluate"
+                            ? find_handle(parts.front())
+                            : compile_unregistered(parts.front()));
+      }
+      return response;
+    }
+    return "error Unknown command \"" + std::string(command) + "\"";
+  } catch (const std::exception& exception) {
+    return "error " + to_single_line(exception.what());
+  }
+}
+
+std::pair<std::uint64_t, server::handle_entry*> server::find_entry(
+    const backend::compilation_cache::data_ptr& data)
+{
+  // Graphs whose hashes collide with a different graph take the next handle
+  auto handle = data->canonical_hash();
+  for (auto it = m_handles.find(handle); it != m_handles.end();
+       it = m_handles.find(++handle))
+  {
+    if (it->second.data == data || it->second.data->is_equivalent(*data)) {
+      m_handles_recency.splice(
+          m_handles_recency.begin(), m_handles_recency, it->second.recency);
+      return {handle, &it->second};
+    }
+  }
+  return {handle, nullptr};
+}
+
+std::pair<std::uint64_t, server::compiled_expression> server::compile(
+    std::string_view expression)
+{
+  auto data = m_cache.get_or_compile(expression);
+  {
+    std::lock_guard lock(m_handles_mutex);
+    if (auto [handle, entry] = find_entry(data); entry != nullptr) {
+      return {handle, entry->compiled};
+    }
+  }
+  auto compiled = compiled_expression(
+      std::make_shared<const backend::bytecode>(backend::lower(*data)));
+  std::lock_guard lock(m_handles_mutex);
+  auto [handle, entry] = find_entry(data);  // Another request may have added it
+  if (entry == nullptr) {
+    m_handles_recency.push_front(handle);
+    auto inserted = m_handles.emplace(
+        handle,
+        handle_entry {data, std::move(compiled), m_handles_recency.begin()});
+    entry = &inserted.first->second;
+    // The new handle is the most recent one and is always kept
+    const auto capacity = std::max<std::size_t>(m_options.cache_capacity, 1);
+    while (m_handles_recency.size() > capacity) {
+      m_handles.erase(m_handles_recency.back());
+      m_handles_recency.pop_back();
+    }
+  }
+  return {handle, entry->compiled};
+}
+
+server::compiled_expression server::compile_unregistered(
+    std::string_view expression)
+{
+  auto data = m_cache.get_or_compile(expression);
+  {
+    std::lock_guard lock(m_handles_mutex);
+    if (auto [_, entry] = find_entry(data); entry != nullptr) {
+      return entry->compiled;
+    }
+  }
+  return compiled_expression(
+      std::make_shared<const backend::bytecode>(backend::lower(*data)));
+}
+
+std::vector<double> server::bind_values(
+    const std::vector<std::string>& variables, std::string_view bindings)
+{
+  std::map<std::string_view, double> bound;
+  for (auto binding : split(bindings, ' ')) {
+    if (binding.empty()) {
+      continue;
+    }
+    const auto equals = binding.find('=');
+    double value = 0;
+    auto [end, error] = equals == std::string_view::npos
+        ? std::from_chars_result {binding.data(), std::errc::invalid_argument}
+        : std::from_chars(binding.data() + equals + 1,
+                          binding.data() + binding.size(),
+                          value);
+    if (error != std::errc() || end != binding.data() + binding.size()) {
+      throw std::invalid_argument("Invalid binding \"" + std::string(binding)
+                                  + "\", expected name=value");
+    }
+    bound[binding.substr(0, equals)] = value;
+  }
+
+  std::vector<double> values;
+  values.reserve(variables.size());
+  for (const auto& variable : variables) {
+    auto it = bound.find(variable);
+    if (it == bound.end()) {
+      throw std::invalid_argument("No value given for the variable \""
+                                  + variable + "\"");
+    }
+    values.push_back(it->second);
+  }
+  return values;
+}
+
+server::compiled_expression server::find_handle(std::string_view handle)
+{
+  std::uint64_t key = 0;
+  auto [end, error] =
+      std::from_chars(handle.data(), handle.data() + handle.size(), key, 16);
+  std::lock_guard lock(m_handles_mutex);
+  auto it = m_handles.find(key);
+  if (error != std::errc() || end != handle.data() + handle.size()
+      || it == m_handles.end())
+  {
+    throw std::invalid_argument("Unknown handle \"" + std::string(handle)
+                                + "\"");
+  }
+  m_handles_recency.splice(
+      m_handles_recency.begin(), m_handles_recency, it->second.recency);
+  return it->second.compiled;
+}
+
+maths_static_compiler::tiered_expression server::find_formula(
+    std::string_view name) const
+{
+  auto found = m_formulas.find(trim(name));
+  if (!found.has_value()) {
+    throw std::invalid_argument("Unknown formula \"" + std::string(trim(name))
+                                + "\"");
+  }
+  return std::move(found->expression);
+}
+
+}  // namespace server
@@ -0,0 +1,134 @@
+#ifndef SERVER_H
+#define SERVER_H
+
+#include <array>
+#include <atomic>
+#include <filesystem>
+#include <list>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <vector>
+
+#include "backend/compilation_cache.h"
+#include "formula_registry.h"
+#include "maths_static_compiler/maths_static_compiler.hpp"
+
+namespace server
+{
+
+struct server_options
+{
+  std::filesystem::path socket_path;
+  std::size_t workers_count;
+  std::size_t cache_capacity = 4096;  // Also bounds the number of handles
+  std::optional<std::filesystem::path> cache_directory = std::nullopt;
+};
+
+// Long-running compile/evaluate service listening on a Unix domain socket.
+//
+// The protocol is line based, every request line gets exactly one response
+// line and responses keep the order of requests on the connection, so clients
+// may pipeline any number of requests:
+//
+//   compile <expression>
+//     -> ok <handle> <variable>...
+//   evaluate <handle> | <name>=<value>... [| <name>=<value>...]...
+//     -> ok <result>...
+//   evaluate-expression <expression> | <name>=<value>... [| ...]...
+//     -> ok <result>...
+//   publish <name> <expression>
+//     -> ok <version> <variable>...
+//   evaluate-formula <name> | <name>=<value>... [| ...]...
+//     -> ok <result>...
+//   formula-stats <name>
+//     -> ok <tier> <tier>=<rows>,<evaluation seconds>,<compile seconds>...
+//
+// Each "|"-separated group of bindings is evaluated and answered in order.
+// Programs with several outputs answer each group with the outputs separated
+// by commas. Failures are reported as "error <message>".
+//
+// Only compile requests register handles, at most cache_capacity of them:
+// the least recently used ones are dropped beyond that, and evaluating them
+// answers "error Unknown handle" until they are compiled again.
+//
+// Publishing a formula under a name that is already taken replaces it, and
+// requests evaluating the formula at that moment finish with the version
+// they looked up. Published formulas start out only lowered and are
+// optimized in the background once they are evaluated often, see
+// maths_static_compiler::tiered_expression; formula-stats reports the rows,
+// evaluation and compilation times of every tier reached.
+//
+// A single thread runs the poll() event loop over all connections, requests
+// are computed by a fixed pool of workers sharing a warm compilation cache.
+class server
+{
+public:
+  explicit server(server_options options);
+
+  server(const server&) = delete;
+  server& operator=(const server&) = delete;
+
+  ~server();
+
+  // Serve connections until stop() is called
+  void run();
+
+  // Safe to call from other threads and from signal handlers
+  void stop();
+
+  // Compute the response line (without '\n') for one request line
+  std::string handle_request(std::string_view request);
+
+private:
+  using compiled_expression = maths_static_compiler::compiled_expression;
+
+  std::pair<std::uint64_t, compiled_expression> compile(
+      std::string_view expression);
+  // Like compile(), without registering a handle
+  compiled_expression compile_unregistered(std::string_view expression);
+  // Values in the order of the variables from "<name>=<value>..." bindings
+  static std::vector<double> bind_values(
+      const std::vector<std::string>& variables, std::string_view bindings);
+
+  compiled_expression find_handle(std::string_view handle);
+  maths_static_compiler::tiered_expression find_formula(
+      std::string_view name) const;
+
+  void wake() const;
+
+  server_options m_options;
+  backend::compilation_cache m_cache;
+
+  struct handle_entry
+  {
+    backend::compilation_cache::data_ptr data;  // Tells colliding hashes apart
+    compiled_expression compiled;
+    std::list<std::uint64_t>::iterator recency;
+  };
+
+  // Handle of the data's entry, or the free handle it would get along with
+  // nullptr. Requires m_handles_mutex
+  std::pair<std::uint64_t, handle_entry*> find_entry(
+      const backend::compilation_cache::data_ptr& data);
+
+  // Compiled expressions stay reachable by handle even after the cache has
+  // evicted them, until the handles are evicted in turn
+  std::mutex m_handles_mutex;
+  std::unordered_map<std::uint64_t, handle_entry> m_handles;
+  std::list<std::uint64_t> m_handles_recency;  // Most recently used first
+
+  formula_registry m_formulas;
+
+  int m_listen_fd = -1;
+  std::array<int, 2> m_wake_fds = {-1, -1};  // Self-pipe waking up run()
+  std::atomic<bool> m_stopping = false;
+};
+
+}  // namespace server
+
+#endif
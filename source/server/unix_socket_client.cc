@@ -0,0 +1,86 @@
+#include <array>
+#include <system_error>
+
+#include "unix_socket_client.h"
+
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+namespace server
+{
+
+unix_socket_client::unix_socket_client(const std::filesystem::path& socket_path)
+{
+  sockaddr_un address {};
+  address.sun_family = AF_UNIX;
+  const auto path = socket_path.string();
+  if (path.size() >= sizeof(address.sun_path)) {
+    throw std::invalid_argument("Socket path is too long: " + path);
+  }
+  std::copy(path.begin(), path.end(), address.sun_path);
+
+  m_fd = socket(AF_UNIX, SOCK_STREAM, 0);
+  if (m_fd < 0) {
+    throw std::system_error(errno, std::generic_category(), "socket");
+  }
+  // NOLINTNEXTLINE(cppcoreguidelines-pro-type-reinterpret-cast)
+  if (connect(m_fd, reinterpret_cast<sockaddr*>(&address), sizeof(address))
+      < 0)
+  {
+    const int error = errno;
+    close(m_fd);
+    throw std::system_error(error, std::generic_category(), "connect " + path);
+  }
+}
+
+unix_socket_client::~unix_socket_client()
+{
+  close(m_fd);
+}
+
+void unix_socket_client::send_line(std::string_view line)
+{
+  std::string message(line);
+  message += '\n';
+  std::size_t sent = 0;
+  while (sent < message.size()) {
+    const auto count = write(m_fd, message.data() + sent, message.size() - sent);
+    if (count < 0) {
+      if (errno == EINTR) {
+        continue;
+      }
+      throw std::system_error(errno, std::generic_category(), "write");
+    }
+    sent += static_cast<std::size_t>(count);
+  }
+}
+
+void unix_socket_client::finish_sending()
+{
+  shutdown(m_fd, SHUT_WR);
+}
+
+std::optional<std::string> unix_socket_client::receive_line()
+{
+  std::array<char, 1 << 16> buffer {};
+  std::size_t line_end = 0;
+  while ((line_end = m_buffer.find('\n')) == std::string::npos) {
+    const auto count = read(m_fd, buffer.data(), buffer.size());
+    if (count < 0) {
+      if (errno == EINTR) {
+        continue;
+      }
+      throw std::system_error(errno, std::generic_category(), "read");
+    }
+    if (count == 0) {
+      return std::nullopt;
+    }
+    m_buffer.append(buffer.data(), static_cast<std::size_t>(count));
+  }
+  auto line = m_buffer.substr(0, line_end);
+  m_buffer.erase(0, line_end + 1);
+  return line;
+}
+
+}  // namespace server
@@ -0,0 +1,40 @@
+#ifndef UNIX_SOCKET_CLIENT_H
+#define UNIX_SOCKET_CLIENT_H
+
+#include <filesystem>
+#include <optional>
+#include <string>
+#include <string_view>
+
+namespace server
+{
+
+// Blocking line-oriented connection to a running server
+class unix_socket_client
+{
+public:
+  explicit unix_socket_client(const std::filesystem::path& socket_path);
+
+  unix_socket_client(const unix_socket_client&) = delete;
+  unix_socket_client& operator=(const unix_socket_client&) = delete;
+
+  ~unix_socket_client();
+
+  // Send one request, the line terminator is appended
+  void send_line(std::string_view line);
+
+  // Signal that no more requests will be sent
+  void finish_sending();
+
+  // Wait for the next response, std::nullopt once the server closed the
+  // connection
+  std::optional<std::string> receive_line();
+
+private:
+  int m_fd;
+  std::string m_buffer;
+};
+
+}  // namespace server
+
+#endif
@@ -0,0 +1,93 @@
+// Replacement of the global allocation functions feeding the counters of
+// statistics.h. Only linked into the executable, so programs embedding the
+// library keep their own allocator. Counting starts with
+// enable_allocation_tracking() and costs a single relaxed load before that.
+// Sizes come from malloc_usable_size, so only glibc is supported
+
+#include <atomic>
+#include <cstdlib>
+#include <new>
+
+#include "allocation_tracking.h"
+#include "statistics.h"
+
+#if defined(__GLIBC__)
+#  include <malloc.h>
+
+namespace
+{
+std::atomic<bool> counting = false;
+
+void* allocate(std::size_t size)
+{
+  void* pointer = std::malloc(size == 0 ? 1 : size);
+  if (pointer == nullptr) {
+    throw std::bad_alloc();
+  }
+  if (counting.load(std::memory_order_relaxed)) {
+    support::note_allocation(malloc_usable_size(pointer));
+  }
+  return pointer;
+}
+
+void deallocate(void* pointer)
+{
+  if (pointer != nullptr && counting.load(std::memory_order_relaxed)) {
+    support::note_deallocation(malloc_usable_size(pointer));
+  }
+  std::free(pointer);
+}
+
+}  // namespace
+
+namespace support
+{
+
+void enable_allocation_tracking()
+{
+  counting.store(true, std::memory_order_relaxed);
+  set_allocation_tracking_enabled();
+}
+
+}  // namespace support
+
+void* operator new(std::size_t size)
+{
+  return allocate(size);
+}
+
+void* operator new[](std::size_t size)
+{
+  return allocate(size);
+}
+
+void operator delete(void* pointer) noexcept
+{
+  deallocate(pointer);
+}
+
+void operator delete[](void* pointer) noexcept
+{
+  deallocate(pointer);
+}
+
+void operator delete(void* pointer, std::size_t /*size*/) noexcept
+{
+  deallocate(pointer);
+}
+
+void operator delete[](void* pointer, std::size_t /*size*/) noexcept
+{
+  deallocate(pointer);
+}
+
+#else
+
+namespace support
+{
+
+void enable_allocation_tracking() {}
+
+}  // namespace support
+
+#endif
@@ -0,0 +1,13 @@
+#ifndef ALLOCATION_TRACKING_H
+#define ALLOCATION_TRACKING_H
+
+namespace support
+{
+
+// Start counting allocations in the counters of statistics.h. Only available
+// to programs linking allocation_tracking.cc
+void enable_allocation_tracking();
+
+}  // namespace support
+
+#endif
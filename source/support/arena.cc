@@ -0,0 +1,34 @@
+#include "arena.h"
+
+namespace support
+{
+
+arena::arena(std::size_t initial_size)
+    : m_upstream(m_counters)
+    , m_buffer(initial_size, &m_upstream)
+{
+}
+
+void* arena::do_allocate(std::size_t bytes, std::size_t alignment)
+{
+  m_counters.allocations++;
+  m_counters.allocated_bytes += bytes;
+  return m_buffer.allocate(bytes, alignment);
+}
+
+void* arena::upstream_resource::do_allocate(std::size_t bytes,
+                                            std::size_t alignment)
+{
+  m_counters.chunks++;
+  m_counters.reserved_bytes += bytes;
+  return std::pmr::new_delete_resource()->allocate(bytes, alignment);
+}
+
+void arena::upstream_resource::do_deallocate(void* pointer,
+                                             std::size_t bytes,
+                                             std::size_t alignment)
+{
+  std::pmr::new_delete_resource()->deallocate(pointer, bytes, alignment);
+}
+
+}  // namespace support
@@ -0,0 +1,87 @@
+#ifndef ARENA_H
+#define ARENA_H
+
+#include <cstddef>
+#include <cstdint>
+#include <memory_resource>
+#include <new>
+#include <utility>
+
+namespace support
+{
+
+struct arena_counters
+{
+  std::uint64_t allocations;  // Calls served by the arena
+  std::uint64_t allocated_bytes;  // Bytes requested by those calls
+  std::uint64_t chunks;  // Heap allocations made by the arena itself
+  // Bytes of those chunks. The arena never gives memory back before it is
+  // destroyed, so this is also its high-water mark
+  std::uint64_t reserved_bytes;
+};
+
+// Monotonic memory of one compilation. Tokens, syntax trees and the control
+// flow graph are allocated from growing chunks and released all at once when
+// the arena is destroyed, deallocating a single object does nothing.
+// An arena is used by one thread at a time
+class arena : public std::pmr::memory_resource
+{
+public:
+  explicit arena(std::size_t initial_size = 16 * 1024);
+
+  arena(const arena&) = delete;
+  arena& operator=(const arena&) = delete;
+
+  // Construct an object in the arena. Only its destructor has to be run
+  template<typename T, typename... Args>
+  T* create(Args&&... args)
+  {
+    return new (allocate(sizeof(T), alignof(T))) T(std::forward<Args>(args)...);
+  }
+
+  const arena_counters& counters() const { return m_counters; }
+
+private:
+  // Counts the chunks the monotonic buffer takes from the heap
+  class upstream_resource : public std::pmr::memory_resource
+  {
+  public:
+    explicit upstream_resource(arena_counters& counters)
+        : m_counters(counters)
+    {
+    }
+
+  private:
+    void* do_allocate(std::size_t bytes, std::size_t alignment) override;
+    void do_deallocate(void* pointer,
+                       std::size_t bytes,
+                       std::size_t alignment) override;
+    bool do_is_equal(
+        const std::pmr::memory_resource& other) const noexcept override
+    {
+      return this == &other;
+    }
+
+    arena_counters& m_counters;
+  };
+
+  void* do_allocate(std::size_t bytes, std::size_t alignment) override;
+  void do_deallocate(void* /*pointer*/,
+                     std::size_t /*bytes*/,
+                     std::size_t /*alignment*/) override
+  {
+  }
+  bool do_is_equal(
+      const std::pmr::memory_resource& other) const noexcept override
+  {
+    return this == &other;
+  }
+
+  arena_counters m_counters {};
+  upstream_resource m_upstream;
+  std::pmr::monotonic_buffer_resource m_buffer;
+};
+
+}  // namespace support
+
+#endif
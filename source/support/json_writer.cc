@@ -0,0 +1,128 @@
+#include <array>
+#include <charconv>
+#include <cmath>
+
+#include "json_writer.h"
+
+namespace support
+{
+
+void json_writer::begin_object()
+{
+  separate();
+  m_stream.put('{');
+  m_has_elements.push_back(false);
+}
+
+void json_writer::end_object()
+{
+  m_has_elements.pop_back();
+  m_stream.put('}');
+}
+
+void json_writer::begin_array()
+{
+  separate();
+  m_stream.put('[');
+  m_has_elements.push_back(false);
+}
+
+void json_writer::end_array()
+{
+  m_has_elements.pop_back();
+  m_stream.put(']');
+}
+
+void json_writer::key(std::string_view name)
+{
+  separate();
+  write_string(name);
+  m_stream.put(':');
+  m_after_key = true;
+}
+
+void json_writer::value(std::string_view str)
+{
+  separate();
+  write_string(str);
+}
+
+void json_writer::value(double number)
+{
+  separate();
+  if (!std::isfinite(number)) {
+    m_stream << "null";  // Not representable in JSON
+    return;
+  }
+  std::array<char, 32> buffer {};
+  auto [end, _] = std::to_chars(buffer.begin(), buffer.end(), number);
+  m_stream.write(buffer.data(), end - buffer.data());
+}
+
+void json_writer::value(std::uint64_t number)
+{
+  separate();
+  m_stream << number;
+}
+
+void json_writer::value(std::int64_t number)
+{
+  separate();
+  m_stream << number;
+}
+
+void json_writer::value(bool boolean)
+{
+  separate();
+  m_stream << (boolean ? "true" : "false");
+}
+
+void json_writer::separate()
+{
+  if (m_after_key) {
+    m_after_key = false;  // The value of a member follows its colon
+    return;
+  }
+  if (!m_has_elements.empty()) {
+    if (m_has_elements.back()) {
+      m_stream.put(',');
+    }
+    m_has_elements.back() = true;
+  }
+}
+
+void json_writer::write_string(std::string_view str)
+{
+  static constexpr std::string_view hex_digits = "0123456789abcdef";
+  m_stream.put('"');
+  for (const char symbol : str) {
+    switch (symbol) {
+      case '"':
+        m_stream << "\\\"";
+        break;
+      case '\\':
+        m_stream << "\\\\";
+        break;
+      case '\n':
+        m_stream << "\\n";
+        break;
+      case '\r':
+        m_stream << "\\r";
+        break;
+      case '\t':
+        m_stream << "\\t";
+        break;
+      default:
+        if (static_cast<unsigned char>(symbol) < 0x20) {
+          const auto code = static_cast<unsigned char>(symbol);
+          m_stream << "\\u00" << hex_digits[code >> 4U]
+                   << hex_digits[code & 0xFU];
+        } else {
+          m_stream.put(symbol);
+        }
+    }
+  }
+  m_stream.put('"');
+}
+
+}  // namespace support
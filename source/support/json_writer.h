@@ -0,0 +1,61 @@
+#ifndef JSON_WRITER_H
+#define JSON_WRITER_H
+
+#include <cstdint>
+#include <ostream>
+#include <string_view>
+#include <vector>
+
+namespace support
+{
+
+// Writes JSON straight to a stream as it is produced, without building a
+// document first. Commas and colons are inserted automatically, the caller
+// only has to keep objects and arrays balanced and to write a key before
+// every member of an object
+class json_writer
+{
+public:
+  explicit json_writer(std::ostream& stream)
+      : m_stream(stream)
+  {
+  }
+
+  json_writer(const json_writer&) = delete;
+  json_writer& operator=(const json_writer&) = delete;
+
+  void begin_object();
+  void end_object();
+  void begin_array();
+  void end_array();
+
+  void key(std::string_view name);
+
+  void value(std::string_view str);
+  void value(const char* str) { value(std::string_view(str)); }
+  void value(double number);
+  void value(std::uint64_t number);
+  void value(std::int64_t number);
+  void value(bool boolean);
+
+  // Shorthand for key() followed by value()
+  template<typename T>
+  void member(std::string_view name, const T& member_value)
+  {
+    key(name);
+    value(member_value);
+  }
+
+private:
+  void separate();
+  void write_string(std::string_view str);
+
+  std::ostream& m_stream;
+  // Whether the innermost open object or array already has an element
+  std::vector<bool> m_has_elements;
+  bool m_after_key = false;
+};
+
+}  // namespace support
+
+#endif
@@ -0,0 +1,102 @@
+#include <algorithm>
+
+#include "rcu.h"
+
+namespace support
+{
+
+rcu_domain& rcu_domain::global()
+{
+  static auto* const domain = new rcu_domain();
+  return *domain;
+}
+
+rcu_domain::read_section rcu_domain::read_lock()
+{
+  // Gives the slot back when the thread exits
+  struct slot_owner
+  {
+    reader_slot* slot = nullptr;
+
+    ~slot_owner()
+    {
+      if (slot != nullptr) {
+        slot->in_use.store(false, std::memory_order_release);
+      }
+    }
+  };
+  thread_local slot_owner owner;
+  if (owner.slot == nullptr) {
+    owner.slot = acquire_slot();
+  }
+
+  auto* slot = owner.slot;
+  if (slot->depth++ == 0) {
+    slot->epoch.store(m_epoch.load(std::memory_order_seq_cst),
+                      std::memory_order_relaxed);
+    // The epoch is visible to writers before the section reads a pointer
+    std::atomic_thread_fence(std::memory_order_seq_cst);
+  }
+  return read_section(slot);
+}
+
+void rcu_domain::retire(std::function<void()> deleter)
+{
+  {
+    std::lock_guard lock(m_retired_mutex);
+    // Only sections that read a later epoch are sure to read the new pointer
+    m_retired.emplace_back(m_epoch.fetch_add(1, std::memory_order_seq_cst),
+                           std::move(deleter));
+  }
+  reclaim();
+}
+
+std::size_t rcu_domain::reclaim()
+{
+  std::atomic_thread_fence(std::memory_order_seq_cst);
+  auto oldest = idle;
+  for (auto* slot = m_slots.load(std::memory_order_acquire); slot != nullptr;
+       slot = slot->next)
+  {
+    oldest = std::min(oldest, slot->epoch.load(std::memory_order_seq_cst));
+  }
+
+  std::vector<std::function<void()>> reclaimable;
+  std::size_t waiting = 0;
+  {
+    std::lock_guard lock(m_retired_mutex);
+    auto waiting_end = std::stable_partition(
+        m_retired.begin(),
+        m_retired.end(),
+        [&](const auto& retired) { return retired.first >= oldest; });
+    for (auto it = waiting_end; it != m_retired.end(); it++) {
+      reclaimable.push_back(std::move(it->second));
+    }
+    m_retired.erase(waiting_end, m_retired.end());
+    waiting = m_retired.size();
+  }
+  // Deleters run outside of the lock, they may retire objects themselves
+  for (auto& deleter : reclaimable) {
+    deleter();
+  }
+  return waiting;
+}
+
+rcu_domain::reader_slot* rcu_domain::acquire_slot()
+{
+  for (auto* slot = m_slots.load(std::memory_order_acquire); slot != nullptr;
+       slot = slot->next)
+  {
+    bool in_use = false;
+    if (slot->in_use.compare_exchange_strong(in_use, true)) {
+      return slot;
+    }
+  }
+  auto* slot = new reader_slot();
+  slot->next = m_slots.load(std::memory_order_relaxed);
+  while (!m_slots.compare_exchange_weak(slot->next, slot)) {
+  }
+  return slot;
+}
+
+}  // namespace support
@@ -0,0 +1,99 @@
+#ifndef RCU_H
+#define RCU_H
+
+#include <atomic>
+#include <cstdint>
+#include <functional>
+#include <limits>
+#include <mutex>
+#include <utility>
+#include <vector>
+
+namespace support
+{
+
+// Epoch-based read-copy-update shared by the whole process.
+//
+// Readers enter a read section by copying the global epoch into a slot of
+// their own thread, which never waits for writers or other readers. Writers
+// replace the pointer readers follow, then retire the object it pointed to:
+// the object is tagged with the current epoch, the epoch advances and the
+// object is deleted once every read section that may have read the old
+// pointer has ended. Pointers read in a section must not be used after it
+class rcu_domain
+{
+  struct reader_slot
+  {
+    alignas(64) std::atomic<std::uint64_t> epoch {idle};
+    std::atomic<bool> in_use {true};
+    reader_slot* next = nullptr;
+    std::size_t depth = 0;  // Nested sections, only used by the owner
+  };
+
+public:
+  static constexpr std::uint64_t idle =
+      std::numeric_limits<std::uint64_t>::max();
+
+  class read_section
+  {
+  public:
+    read_section(const read_section&) = delete;
+    read_section& operator=(const read_section&) = delete;
+
+    ~read_section()
+    {
+      if (--m_slot->depth == 0) {
+        m_slot->epoch.store(idle, std::memory_order_release);
+      }
+    }
+
+  private:
+    explicit read_section(reader_slot* slot)
+        : m_slot(slot)
+    {
+    }
+
+    reader_slot* m_slot;
+
+    friend class rcu_domain;
+  };
+
+  // Never destroyed, so threads may still end read sections during exit
+  static rcu_domain& global();
+
+  rcu_domain(const rcu_domain&) = delete;
+  rcu_domain& operator=(const rcu_domain&) = delete;
+
+  // Sections may be nested within a thread
+  read_section read_lock();
+
+  // Delete the object once no read section can reach it any more. The
+  // pointer to it must already have been replaced
+  template<typename T>
+  void retire(const T* object)
+  {
+    retire(std::function<void()>([object] { delete object; }));
+  }
+
+  void retire(std::function<void()> deleter);
+
+  // Delete the retired objects no read section can reach and return how
+  // many are still waiting
+  std::size_t reclaim();
+
+private:
+  rcu_domain() = default;
+
+  reader_slot* acquire_slot();
+
+  std::atomic<std::uint64_t> m_epoch = 0;
+  // Slots are reused once their thread has exited and are never freed
+  std::atomic<reader_slot*> m_slots = nullptr;
+
+  std::mutex m_retired_mutex;
+  std::vector<std::pair<std::uint64_t, std::function<void()>>> m_retired;
+};
+
+}  // namespace support
+
+#endif
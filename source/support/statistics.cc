@@ -0,0 +1,221 @@
+#include <algorithm>
+#include <atomic>
+#include <iomanip>
+
+#include "statistics.h"
+
+namespace
+{
+std::atomic<std::int64_t> allocation_calls = 0;
+std::atomic<std::int64_t> allocated_bytes = 0;
+std::atomic<std::int64_t> current_bytes = 0;
+std::atomic<std::int64_t> peak_bytes = 0;
+std::atomic<bool> tracking_enabled = false;
+
+void write_ir_size(support::json_writer& writer, const support::ir_size& size)
+{
+  writer.begin_object();
+  writer.member("instructions", std::uint64_t {size.instructions});
+  writer.member("constants", std::uint64_t {size.constants});
+  writer.member("variables", std::uint64_t {size.variables});
+  writer.member("uses", std::uint64_t {size.uses});
+  writer.end_object();
+}
+
+std::string ir_size_to_string(const std::optional<support::ir_size>& size)
+{
+  if (!size.has_value()) {
+    return "";
+  }
+  return std::to_string(size->instructions) + "/"
+      + std::to_string(size->constants) + "/"
+      + std::to_string(size->variables) + "/" + std::to_string(size->uses);
+}
+
+}  // namespace
+
+namespace support
+{
+
+allocation_counters get_allocation_counters()
+{
+  return allocation_counters {
+      .calls = allocation_calls.load(std::memory_order_relaxed),
+      .allocated = allocated_bytes.load(std::memory_order_relaxed),
+      .current = current_bytes.load(std::memory_order_relaxed),
+      .peak = peak_bytes.load(std::memory_order_relaxed),
+  };
+}
+
+void reset_allocation_peak()
+{
+  peak_bytes.store(current_bytes.load(std::memory_order_relaxed),
+                   std::memory_order_relaxed);
+}
+
+void note_allocation(std::size_t bytes)
+{
+  const auto size = static_cast<std::int64_t>(bytes);
+  allocation_calls.fetch_add(1, std::memory_order_relaxed);
+  allocated_bytes.fetch_add(size, std::memory_order_relaxed);
+  const auto current =
+      current_bytes.fetch_add(size, std::memory_order_relaxed) + size;
+  auto peak = peak_bytes.load(std::memory_order_relaxed);
+  while (current > peak
+         && !peak_bytes.compare_exchange_weak(
+             peak, current, std::memory_order_relaxed))
+  {
+  }
+}
+
+void note_deallocation(std::size_t bytes)
+{
+  current_bytes.fetch_sub(static_cast<std::int64_t>(bytes),
+                          std::memory_order_relaxed);
+}
+
+void set_allocation_tracking_enabled()
+{
+  tracking_enabled.store(true, std::memory_order_relaxed);
+}
+
+bool is_allocation_tracking_enabled()
+{
+  return tracking_enabled.load(std::memory_order_relaxed);
+}
+
+void statistics::begin_phase(std::string name, std::optional<ir_size> before)
+{
+  const auto outer_peak = get_allocation_counters().peak;
+  reset_allocation_peak();
+  m_open_phases.push_back(open_phase {
+      .index = m_phases.size(),
+      .wall_start = std::chrono::steady_clock::now(),
+      .cpu_start = std::clock(),
+      .allocations_start = get_allocation_counters(),
+      .outer_peak = outer_peak,
+      .arena_start = m_arena != nullptr
+          ? std::optional<arena_counters>(m_arena->counters())
+          : std::nullopt,
+  });
+  m_phases.push_back(phase_statistics {
+      .name = std::move(name),
+      .depth = m_open_phases.size() - 1,
+      .before = before,
+      // Filled in by end_phase()
+      .after = std::nullopt,
+      .arena = std::nullopt,
+  });
+}
+
+void statistics::end_phase(std::optional<ir_size> after)
+{
+  const auto cpu_end = std::clock();
+  const auto wall_end = std::chrono::steady_clock::now();
+  const auto allocations_end = get_allocation_counters();
+  const auto open = m_open_phases.back();
+  m_open_phases.pop_back();
+
+  auto& phase = m_phases[open.index];
+  phase.wall_seconds =
+      std::chrono::duration<double>(wall_end - open.wall_start).count();
+  phase.cpu_seconds =
+      static_cast<double>(cpu_end - open.cpu_start) / CLOCKS_PER_SEC;
+  phase.allocations = allocations_end.calls - open.allocations_start.calls;
+  phase.allocated_bytes =
+      allocations_end.allocated - open.allocations_start.allocated;
+  phase.peak_bytes = allocations_end.peak - open.allocations_start.current;
+  phase.retained_bytes =
+      allocations_end.current - open.allocations_start.current;
+  phase.after = after;
+  if (open.arena_start.has_value() && m_arena != nullptr) {
+    const auto& arena_end = m_arena->counters();
+    phase.arena = arena_counters {
+        .allocations = arena_end.allocations - open.arena_start->allocations,
+        .allocated_bytes =
+            arena_end.allocated_bytes - open.arena_start->allocated_bytes,
+        .chunks = arena_end.chunks - open.arena_start->chunks,
+        .reserved_bytes = arena_end.reserved_bytes,
+    };
+  }
+
+  // The enclosing phase keeps the highest peak of its own and its children
+  peak_bytes.store(std::max(open.outer_peak, allocations_end.peak),
+                   std::memory_order_relaxed);
+}
+
+void statistics::write_json(json_writer& writer) const
+{
+  writer.begin_array();
+  for (const auto& phase : m_phases) {
+    writer.begin_object();
+    writer.member("name", phase.name);
+    writer.member("depth", std::uint64_t {phase.depth});
+    writer.member("wall_seconds", phase.wall_seconds);
+    writer.member("cpu_seconds", phase.cpu_seconds);
+    if (is_allocation_tracking_enabled()) {
+      writer.member("allocations", phase.allocations);
+      writer.member("allocated_bytes", phase.allocated_bytes);
+      writer.member("peak_bytes", phase.peak_bytes);
+      writer.member("retained_bytes", phase.retained_bytes);
+    }
+    if (phase.before.has_value()) {
+      writer.key("before");
+      write_ir_size(writer, *phase.before);
+    }
+    if (phase.after.has_value()) {
+      writer.key("after");
+      write_ir_size(writer, *phase.after);
+    }
+    if (phase.arena.has_value()) {
+      writer.key("arena");
+      writer.begin_object();
+      writer.member("allocations", phase.arena->allocations);
+      writer.member("allocated_bytes", phase.arena->allocated_bytes);
+      writer.member("chunks", phase.arena->chunks);
+      writer.member("reserved_bytes", phase.arena->reserved_bytes);
+      writer.end_object();
+    }
+    writer.end_object();
+  }
+  writer.end_array();
+}
+
+void statistics::print(std::ostream& stream) const
+{
+  const auto flags = stream.flags();
+  stream << std::left << std::setw(30) << "Phase" << std::right
+         << std::setw(11) << "Wall ms" << std::setw(11) << "CPU ms"
+         << std::setw(9) << "Allocs" << std::setw(13) << "Allocated"
+         << std::setw(13) << "Peak" << std::setw(13) << "Retained"
+         << std::setw(13) << "Arena" << "  IR before -> after "
+         << "(instructions/constants/variables/uses)\n";
+  for (const auto& phase : m_phases) {
+    stream << std::left << std::setw(30)
+           << std::string(2 * phase.depth, ' ') + phase.name << std::right
+           << std::fixed << std::setprecision(3) << std::setw(11)
+           << phase.wall_seconds * 1000 << std::setw(11)
+           << phase.cpu_seconds * 1000;
+    if (is_allocation_tracking_enabled()) {
+      stream << std::setw(9) << phase.allocations << std::setw(13)
+             << phase.allocated_bytes << std::setw(13) << phase.peak_bytes
+             << std::setw(13) << phase.retained_bytes;
+    } else {
+      stream << std::setw(9) << "-" << std::setw(13) << "-" << std::setw(13)
+             << "-" << std::setw(13) << "-";
+    }
+    if (phase.arena.has_value() && phase.arena->allocations > 0) {
+      stream << std::setw(13) << phase.arena->allocated_bytes;
+    } else {
+      stream << std::setw(13) << "-";
+    }
+    if (phase.before.has_value() || phase.after.has_value()) {
+      stream << "  " << ir_size_to_string(phase.before) << " -> "
+             << ir_size_to_string(phase.after);
+    }
+    stream << '\n';
+  }
+  stream.flags(flags);
+}
+
+}  // namespace support
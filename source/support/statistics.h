@@ -0,0 +1,101 @@
+#ifndef STATISTICS_H
+#define STATISTICS_H
+
+#include <chrono>
+#include <cstdint>
+#include <ctime>
+#include <optional>
+#include <ostream>
+#include <string>
+#include <vector>
+
+#include "support/arena.h"
+#include "support/json_writer.h"
+
+namespace support
+{
+
+struct ir_size
+{
+  std::size_t instructions;
+  std::size_t constants;
+  std::size_t variables;
+  std::size_t uses;  // Def-use edges
+};
+
+struct phase_statistics
+{
+  std::string name;
+  std::size_t depth;  // Nesting level, passes are nested in their phase
+  double wall_seconds = 0;
+  double cpu_seconds = 0;
+  std::int64_t allocations = 0;  // Heap allocation calls during the phase
+  std::int64_t allocated_bytes = 0;  // Allocated during the phase
+  std::int64_t peak_bytes = 0;  // Highest live allocation above the start
+  std::int64_t retained_bytes = 0;  // Still allocated at the end
+  std::optional<ir_size> before;
+  std::optional<ir_size> after;
+  // Served by the arena during the phase, with its reserved_bytes at the end
+  // of the phase, only while statistics::set_arena() is set
+  std::optional<arena_counters> arena;
+};
+
+// Allocation counters, maintained only by programs replacing the global
+// operator new with the one from allocation_tracking.cc
+struct allocation_counters
+{
+  std::int64_t calls;  // Total number of allocations
+  std::int64_t allocated;  // Total bytes ever allocated
+  std::int64_t current;  // Bytes currently allocated
+  std::int64_t peak;  // Highest current value since reset_allocation_peak()
+};
+
+allocation_counters get_allocation_counters();
+void reset_allocation_peak();
+void note_allocation(std::size_t bytes);
+void note_deallocation(std::size_t bytes);
+
+// Whether allocations are counted, see allocation_tracking.cc
+void set_allocation_tracking_enabled();
+bool is_allocation_tracking_enabled();
+
+// Wall time, CPU time, allocations and IR sizes of compiler phases. Phases
+// nest, every phase begun must be ended in reverse order
+class statistics
+{
+public:
+  void begin_phase(std::string name,
+                   std::optional<ir_size> before = std::nullopt);
+  void end_phase(std::optional<ir_size> after = std::nullopt);
+
+  // Also count what phases allocate from the arena of a compilation, until
+  // set_arena(nullptr)
+  void set_arena(const arena* arena) { m_arena = arena; }
+
+  const std::vector<phase_statistics>& phases() const { return m_phases; }
+
+  // Array of phases, one object per phase
+  void write_json(json_writer& writer) const;
+
+  // Human-readable table, one phase per line
+  void print(std::ostream& stream) const;
+
+private:
+  struct open_phase
+  {
+    std::size_t index;
+    std::chrono::steady_clock::time_point wall_start;
+    std::clock_t cpu_start;
+    allocation_counters allocations_start;
+    std::int64_t outer_peak;  // Restored for the enclosing phase
+    std::optional<arena_counters> arena_start;
+  };
+
+  std::vector<phase_statistics> m_phases;
+  std::vector<open_phase> m_open_phases;
+  const arena* m_arena = nullptr;
+};
+
+}  // namespace support
+
+#endif
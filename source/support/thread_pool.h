@@ -0,0 +1,82 @@
+#ifndef THREAD_POOL_H
+#define THREAD_POOL_H
+
+#include <condition_variable>
+#include <functional>
+#include <mutex>
+#include <queue>
+#include <thread>
+#include <vector>
+
+namespace support
+{
+
+// Fixed-size pool of worker threads executing submitted tasks in FIFO order.
+// The destructor finishes every task that was already submitted
+class thread_pool
+{
+public:
+  explicit thread_pool(std::size_t threads_count)
+  {
+    threads_count = std::max<std::size_t>(1, threads_count);
+    m_threads.reserve(threads_count);
+    for (std::size_t i = 0; i < threads_count; i++) {
+      m_threads.emplace_back([this] { work(); });
+    }
+  }
+
+  thread_pool(const thread_pool&) = delete;
+  thread_pool& operator=(const thread_pool&) = delete;
+
+  ~thread_pool()
+  {
+    {
+      std::lock_guard lock(m_mutex);
+      m_stopping = true;
+    }
+    m_condition.notify_all();
+    for (auto& thread : m_threads) {
+      thread.join();
+    }
+  }
+
+  void submit(std::function<void()> task)
+  {
+    {
+      std::lock_guard lock(m_mutex);
+      m_tasks.push(std::move(task));
+    }
+    m_condition.notify_one();
+  }
+
+  std::size_t size() const { return m_threads.size(); }
+
+private:
+  void work()
+  {
+    while (true) {
+      std::function<void()> task;
+      {
+        std::unique_lock lock(m_mutex);
+        m_condition.wait(lock,
+                         [this] { return m_stopping || !m_tasks.empty(); });
+        if (m_tasks.empty()) {
+          return;
+        }
+        task = std::move(m_tasks.front());
+        m_tasks.pop();
+      }
+      task();
+    }
+  }
+
+  std::mutex m_mutex;
+  std::condition_variable m_condition;
+  std::queue<std::function<void()>> m_tasks;
+  bool m_stopping = false;
+  std::vector<std::thread> m_threads;
+};
+
+}  // namespace support
+
+#endif
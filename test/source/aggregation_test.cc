@@ -0,0 +1,72 @@
+#include <algorithm>
+#include <numeric>
+#include <string>
+#include <vector>
+
+#include "backend/aggregation.h"
+
+#include "backend/parallel_evaluation.h"
+#include "test_helpers.h"
+
+#include <catch2/catch_test_macros.hpp>
+
+TEST_CASE("Fused reductions match reducing the stored results",
+          "[aggregation]")
+{
+  const auto code = compile("x * x - 3 * y");
+  std::vector<double> rows;
+  for (std::size_t row = 0; row < 100'000; row++) {
+    rows.push_back(static_cast<double>(row % 37) / 4);
+    rows.push_back(static_cast<double>(row % 11));
+  }
+  std::vector<double> results(rows.size() / 2);
+  backend::evaluate_batch(
+      code, rows, std::span(&code.output_slot, 1), results);
+
+  const backend::aggregation_options options {
+      .histogram =
+          backend::histogram_bins {.lower = 0, .upper = 50, .count = 5},
+  };
+  const auto serial =
+      backend::aggregate_batch(code, rows, code.output_slot, options);
+  REQUIRE(serial.count() == results.size());
+  REQUIRE(serial.sum() == std::accumulate(results.begin(), results.end(), 0.0));
+  REQUIRE(serial.min() == *std::min_element(results.begin(), results.end()));
+  REQUIRE(serial.max() == *std::max_element(results.begin(), results.end()));
+  const auto& histogram = serial.histogram();
+  REQUIRE(histogram.size() == 7);
+  REQUIRE(histogram[5]
+          == static_cast<std::size_t>(std::count_if(
+              results.begin(), results.end(), [](double r) { return r < 0; })));
+  REQUIRE(std::accumulate(histogram.begin(), histogram.end(), std::size_t {0})
+          == results.size());
+
+  // Partial aggregates are merged in row order, so every run gives the same
+  // result for a given pool
+  auto pool = support::thread_pool(4);
+  const auto parallel = backend::aggregate_batch_parallel(
+      code, rows, code.output_slot, options, pool);
+  REQUIRE(parallel.count() == serial.count());
+  REQUIRE(parallel.min() == serial.min());
+  REQUIRE(parallel.max() == serial.max());
+  REQUIRE(parallel.histogram() == serial.histogram());
+  REQUIRE(parallel.sum()
+          == backend::aggregate_batch_parallel(
+                 code, rows, code.output_slot, options, pool)
+                 .sum());
+}
+
+TEST_CASE("Compensated summation keeps the low-order bits", "[aggregation]")
+{
+  const auto code = compile("x");
+  const std::vector<double> rows {1, 1e100, 1, -1e100};
+  REQUIRE(backend::aggregate_batch(code, rows, code.output_slot, {}).sum()
+          == 0);
+  const auto compensated = backend::aggregate_batch(
+      code,
+      rows,
+      code.output_slot,
+      {.compensated = true, .histogram = std::nullopt});
+  REQUIRE(compensated.sum() == 2);
+  REQUIRE(compensated.mean() == 0.5);
+}
@@ -0,0 +1,109 @@
+#include <chrono>
+#include <coroutine>
+#include <map>
+#include <stdexcept>
+#include <string>
+#include <thread>
+#include <utility>
+#include <vector>
+
+#include "maths_static_compiler/maths_static_compiler.hpp"
+
+#include "support/thread_pool.h"
+
+#include <catch2/catch_test_macros.hpp>
+
+namespace
+{
+using namespace std::chrono_literals;
+
+// Stand-in for a slow variable source: resumes the awaiting coroutine on a
+// pool thread after a delay
+struct delay
+{
+  support::thread_pool& pool;
+  std::chrono::milliseconds duration;
+
+  bool await_ready() const noexcept { return false; }
+
+  void await_suspend(std::coroutine_handle<> handle) const
+  {
+    pool.submit(
+        [handle, duration = duration]
+        {
+          std::this_thread::sleep_for(duration);
+          handle.resume();
+        });
+  }
+
+  void await_resume() const noexcept {}
+};
+
+maths_static_compiler::task<double> delayed_value(
+    support::thread_pool& pool, std::chrono::milliseconds duration, double value)
+{
+  co_await delay {pool, duration};
+  co_return value;
+}
+
+}  // namespace
+
+TEST_CASE("Asynchronous lookups run concurrently", "[async_evaluation]")
+{
+  auto compiled = maths_static_compiler::compile(
+      "let s = a * b + c; total = s * d; ratio = (a - c) / 2");
+  const std::map<std::string, double> values {
+      {"a", 3}, {"b", 4}, {"c", 1}, {"d", 0.5}};
+  support::thread_pool pool(values.size());
+
+  const auto start = std::chrono::steady_clock::now();
+  const auto results = maths_static_compiler::sync_wait(
+      maths_static_compiler::evaluate_async(
+          compiled,
+          [&](const std::string& name)
+          { return delayed_value(pool, 100ms, values.at(name)); }));
+  const auto elapsed = std::chrono::steady_clock::now() - start;
+
+  REQUIRE(results == std::vector<double> {6.5, 1});
+  // Sequential lookups would take 400 ms
+  REQUIRE(elapsed >= 100ms);
+  REQUIRE(elapsed < 300ms);
+}
+
+TEST_CASE("Providers may complete synchronously", "[async_evaluation]")
+{
+  auto compiled = maths_static_compiler::compile("x * 2 + 1");
+  auto provider = [](const std::string&) -> maths_static_compiler::task<double>
+  { co_return 20; };
+  const auto results = maths_static_compiler::sync_wait(
+      maths_static_compiler::evaluate_async(compiled, provider));
+  REQUIRE(results == std::vector<double> {41});
+}
+
+TEST_CASE("Chains of constant instructions run once", "[async_evaluation]")
+{
+  auto compiled = maths_static_compiler::compile("2 * 3 * 4 + x");
+  auto provider = [](const std::string&) -> maths_static_compiler::task<double>
+  { co_return 10; };
+  const auto results = maths_static_compiler::sync_wait(
+      maths_static_compiler::evaluate_async(compiled, provider));
+  REQUIRE(results == std::vector<double> {34});
+}
+
+TEST_CASE("Provider errors are rethrown", "[async_evaluation]")
+{
+  auto compiled = maths_static_compiler::compile("x + y");
+  support::thread_pool pool(2);
+  auto provider = [&](const std::string& name)
+      -> maths_static_compiler::task<double>
+  {
+    co_await delay {pool, 10ms};
+    if (name == "y") {
+      throw std::runtime_error("y is unavailable");
+    }
+    co_return 1;
+  };
+  auto evaluation = maths_static_compiler::evaluate_async(compiled, provider);
+  REQUIRE_THROWS_WITH(maths_static_compiler::sync_wait(std::move(evaluation)),
+                      "y is unavailable");
+}
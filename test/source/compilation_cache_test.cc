@@ -0,0 +1,114 @@
+#include <filesystem>
+#include <fstream>
+
+#include "backend/compilation_cache.h"
+
+#include <catch2/catch_test_macros.hpp>
+
+TEST_CASE("Different spellings share one cache entry", "[compilation_cache]")
+{
+  auto cache = backend::compilation_cache();
+  auto first = cache.get_or_compile("(a * b) + 2");
+  auto second = cache.get_or_compile("2 + ((b)*a)");
+  auto third = cache.get_or_compile("  (a*b)+2 ");
+
+  REQUIRE(first == second);
+  REQUIRE(first == third);
+
+  auto stats = cache.stats();
+  REQUIRE(stats.misses == 2);
+  REQUIRE(stats.hits == 1);
+  REQUIRE(stats.evictions == 0);
+}
+
+TEST_CASE("Entries are only shared by equivalent graphs",
+          "[compilation_cache]")
+{
+  auto cache = backend::compilation_cache();
+  auto other_cache = backend::compilation_cache();
+  auto first = cache.get_or_compile("(a * b) + 2");
+  REQUIRE(first->is_equivalent(*other_cache.get_or_compile("2 + b * a")));
+  REQUIRE_FALSE(first->is_equivalent(*cache.get_or_compile("a * b + 3")));
+  REQUIRE_FALSE(cache.get_or_compile("a - b")->is_equivalent(
+      *cache.get_or_compile("b - a")));
+}
+
+TEST_CASE("Whitespace separating tokens is preserved", "[compilation_cache]")
+{
+  using backend::compilation_cache;
+  REQUIRE(compilation_cache::normalize_source(" 1 +  x2 * y ") == "1+x2*y");
+  REQUIRE(compilation_cache::normalize_source("1 2") == "1 2");
+  REQUIRE(compilation_cache::normalize_source("x * * y") == "x* *y");
+}
+
+TEST_CASE("Every parameter set has its own entry", "[compilation_cache]")
+{
+  auto cache = backend::compilation_cache();
+  const auto* source = "a * x + b";
+  auto plain = cache.get_or_compile(source);
+  auto bound = cache.get_or_compile(source, {{"a", 2}});
+  auto other = cache.get_or_compile(source, {{"a", 3}});
+  auto again = cache.get_or_compile(source, {{"a", 2}});
+
+  REQUIRE(plain != bound);
+  REQUIRE(bound != other);
+  REQUIRE(bound == again);
+  REQUIRE(bound->variables.size() == 2);
+  REQUIRE(cache.stats().misses == 3);
+  REQUIRE(cache.stats().hits == 1);
+}
+
+TEST_CASE("Least recently used entries are evicted", "[compilation_cache]")
+{
+  auto cache = backend::compilation_cache(1);
+  for (int i = 0; i < 64; i++) {
+    cache.get_or_compile("x + " + std::to_string(i));
+  }
+  REQUIRE(cache.stats().evictions > 0);
+}
+
+TEST_CASE("Cache directory survives restarts", "[compilation_cache]")
+{
+  auto directory =
+      std::filesystem::temp_directory_path() / "maths_static_compiler_cache";
+  std::filesystem::remove_all(directory);
+
+  backend::compilation_cache::data_ptr stored;
+  {
+    auto cache = backend::compilation_cache(16, directory);
+    stored = cache.get_or_compile("x * 3 - y / 2");
+  }
+
+  auto cache = backend::compilation_cache(16, directory);
+  auto loaded = cache.get_or_compile("x*3 - y/2");
+  REQUIRE(cache.stats().disk_hits == 1);
+  REQUIRE(cache.stats().misses == 0);
+  REQUIRE(loaded->canonical_hash() == stored->canonical_hash());
+  REQUIRE(loaded->out_index == stored->out_index);
+
+  std::filesystem::remove_all(directory);
+}
+
+TEST_CASE("Damaged cache files are misses", "[compilation_cache]")
+{
+  auto directory =
+      std::filesystem::temp_directory_path() / "maths_static_compiler_damaged";
+  std::filesystem::remove_all(directory);
+  {
+    auto cache = backend::compilation_cache(16, directory);
+    cache.get_or_compile("x * 3 - y / 2");
+  }
+  // An output and an operand at positions the graph does not have
+  for (const auto& entry : std::filesystem::directory_iterator(directory)) {
+    std::ofstream(entry.path(), std::ios::app)
+        << "expression 1000 999 + 0\noutput 1000 z\n";
+  }
+
+  auto cache = backend::compilation_cache(16, directory);
+  auto data = cache.get_or_compile("x * 3 - y / 2");
+  REQUIRE(cache.stats().disk_hits == 0);
+  REQUIRE(cache.stats().misses == 1);
+  REQUIRE(data->outputs.size() == 1);
+
+  std::filesystem::remove_all(directory);
+}
@@ -0,0 +1,439 @@
+#include <array>
+#include <atomic>
+#include <cmath>
+#include <cstdint>
+#include <limits>
+#include <map>
+#include <thread>
+#include <vector>
+
+#include "maths_static_compiler/maths_static_compiler.hpp"
+
+#include "backend/bytecode.h"
+
+#include <catch2/catch_test_macros.hpp>
+
+TEST_CASE("Compiled expressions are evaluated with positional values",
+          "[compiled_expression]")
+{
+  auto compiled = maths_static_compiler::compile("(x + y) * x - 4 / y");
+  REQUIRE(compiled.variables() == std::vector<std::string> {"x", "y"});
+
+  const std::vector<double> values {3, 2};
+  REQUIRE(compiled.evaluate(values) == 13);
+
+  const std::vector<double> too_few {3};
+  REQUIRE_THROWS_AS(compiled.evaluate(too_few), std::invalid_argument);
+}
+
+TEST_CASE("Literal expressions are folded to their value",
+          "[compiled_expression]")
+{
+  const std::vector<double> none;
+  REQUIRE(maths_static_compiler::compile("0").evaluate(none) == 0);
+  REQUIRE(maths_static_compiler::compile("-1").evaluate(none) == -1);
+  REQUIRE(maths_static_compiler::compile("(10+20) / (20+10)").evaluate(none)
+          == 1);
+}
+
+TEST_CASE("Batch evaluation matches single evaluation",
+          "[compiled_expression]")
+{
+  auto compiled = maths_static_compiler::compile("a * b + a / 2 - 1");
+  std::vector<double> rows;
+  for (int i = 0; i < 1000; i++) {
+    rows.push_back(i);
+    rows.push_back(1000 - i);
+  }
+  std::vector<double> results(1000);
+  compiled.evaluate_batch(rows, results);
+  for (std::size_t i = 0; i < results.size(); i++) {
+    const std::vector<double> row {rows[2 * i], rows[2 * i + 1]};
+    REQUIRE(results[i] == compiled.evaluate(row));
+  }
+}
+
+TEST_CASE("Compiled expressions are evaluated from many threads",
+          "[compiled_expression]")
+{
+  const auto compiled = maths_static_compiler::compile("x * x - y");
+  std::vector<std::thread> threads;
+  std::vector<bool> correct(8, true);
+  for (std::size_t t = 0; t < correct.size(); t++) {
+    threads.emplace_back(
+        [&, t]
+        {
+          for (int i = 0; i < 10000; i++) {
+            const std::vector<double> values {static_cast<double>(t),
+                                              static_cast<double>(i)};
+            // Small integers, computed exactly
+            if (static_cast<std::int64_t>(compiled.evaluate(values))
+                != static_cast<std::int64_t>(t * t) - i)
+            {
+              correct[t] = false;
+            }
+          }
+        });
+  }
+  for (auto& thread : threads) {
+    thread.join();
+  }
+  REQUIRE(std::find(correct.begin(), correct.end(), false) == correct.end());
+}
+
+TEST_CASE("Programs evaluate every output in one pass",
+          "[compiled_expression]")
+{
+  auto compiled = maths_static_compiler::compile(
+      "revenue = price * qty; margin = revenue - cost; "
+      "let unit = margin / qty; ratio = margin / revenue; unit * 100");
+  REQUIRE(compiled.outputs()
+          == std::vector<std::string> {"revenue", "margin", "ratio", "result3"});
+  REQUIRE(compiled.variables()
+          == std::vector<std::string> {"price", "qty", "cost"});
+
+  const std::vector<double> values {10, 4, 30};
+  std::vector<double> results(4);
+  compiled.evaluate_all(values, results);
+  REQUIRE(results == std::vector<double> {40, 10, 0.25, 250});
+  REQUIRE(compiled.evaluate(values) == 250);
+  // revenue is shared by three outputs and margin by two
+  REQUIRE(compiled.saved_operations() == 5);
+
+  std::vector<double> batch_results(4);
+  compiled.evaluate_batch_all(values, batch_results);
+  REQUIRE(batch_results == results);
+}
+
+TEST_CASE("Subtraction operands are not reordered", "[compiled_expression]")
+{
+  auto compiled = maths_static_compiler::compile("(x - y) * 10 + (y - x)");
+  const std::vector<double> values {5, 2};
+  REQUIRE(compiled.evaluate(values) == 27);
+}
+
+TEST_CASE("Gradients are computed together with the value",
+          "[compiled_expression]")
+{
+  using maths_static_compiler::differentiation_mode;
+  const std::vector<double> values {3, 2};
+  for (const auto mode :
+       {differentiation_mode::forward, differentiation_mode::reverse})
+  {
+    auto compiled =
+        maths_static_compiler::compile_gradient("x * y + x / y - 7", mode);
+    REQUIRE(compiled.outputs()
+            == std::vector<std::string> {"result", "dresult/dx", "dresult/dy"});
+
+    std::vector<double> results(3);
+    compiled.evaluate_all(values, results);
+    REQUIRE(results == std::vector<double> {0.5, 2.5, 2.25});
+    REQUIRE(compiled.evaluate(values) == 0.5);
+  }
+
+  const std::vector<double> none;
+  auto constant = maths_static_compiler::compile_gradient("x * 0 + 2");
+  REQUIRE(constant.variables().empty());
+  REQUIRE(constant.evaluate(none) == 2);
+}
+
+TEST_CASE("Batches stay within the proven error bound",
+          "[compiled_expression]")
+{
+  const auto source = "(x + y) * x - 4 / y";
+  auto exact = maths_static_compiler::compile(source);
+  auto reduced =
+      maths_static_compiler::compile(source, {{"x", {0, 100}}, {"y", {1, 2}}}, 1e-4);
+  REQUIRE(reduced.single_precision_instructions() > 0);
+  REQUIRE(reduced.error_bound() <= 1e-4);
+
+  std::vector<double> rows;
+  for (int i = 0; i < 1000; i++) {
+    rows.push_back(i / 10.0);
+    rows.push_back(1 + i / 1000.0);
+  }
+  std::vector<double> exact_results(1000);
+  std::vector<double> reduced_results(1000);
+  exact.evaluate_batch(rows, exact_results);
+  reduced.evaluate_batch(rows, reduced_results);
+  // Largest magnitude of the result over the ranges
+  const double magnitude = 200 * 100;
+  for (std::size_t i = 0; i < exact_results.size(); i++) {
+    REQUIRE(std::fabs(reduced_results[i] - exact_results[i])
+            <= reduced.error_bound() * magnitude);
+  }
+}
+
+TEST_CASE("Integer expressions are evaluated exactly", "[compiled_expression]")
+{
+  auto compiled =
+      maths_static_compiler::compile_exact("a * b - c", {{"a", 0}, {"b", 0}, {"c", 0}});
+  REQUIRE(compiled.exact_instructions() == 2);
+
+  // 2^52 + 1 times 3 is not representable in double, the difference is
+  const std::vector<double> values {4503599627370497.0, 3, 13510798882111480.0};
+  REQUIRE(compiled.evaluate(values) == 11);
+
+  const std::vector<double> overflowing {1e18, 100, 0};
+  REQUIRE_THROWS_AS(compiled.evaluate(overflowing), std::overflow_error);
+  const std::vector<double> fractional {1.5, 1, 0};
+  REQUIRE_THROWS_AS(compiled.evaluate(fractional), std::invalid_argument);
+
+  auto cents = maths_static_compiler::compile_exact("price * 3 / 100", {{"price", 2}});
+  const std::vector<double> price {0.1};
+  REQUIRE(cents.evaluate(price) == 0.003);
+}
+
+TEST_CASE("Fast math fuses products into multiply-adds",
+          "[compiled_expression]")
+{
+  const auto* const source = "a * b - c";
+  auto compiled = maths_static_compiler::compile(source);
+  auto fused = maths_static_compiler::compile_fast_math(source);
+  REQUIRE(compiled.code().instructions.size() == 2);
+  REQUIRE(fused.code().instructions.size() == 1);
+
+  // 0.1 * 10 rounds to 1, the fused product keeps its low bits
+  const std::vector<double> values {0.1, 10, 1};
+  REQUIRE(compiled.evaluate(values) == 0);
+  REQUIRE(fused.evaluate(values) == std::fma(0.1, 10, -1));
+  std::vector<double> batch(1);
+  fused.evaluate_batch(values, batch);
+  REQUIRE(batch.front() == fused.evaluate(values));
+  REQUIRE(maths_static_compiler::evaluation_session(fused, values).result()
+          == fused.evaluate(values));
+
+  auto horner = maths_static_compiler::compile_fast_math("(2 * x + 3) * x + 1");
+  REQUIRE(horner.code().instructions.size() == 2);
+  REQUIRE(horner.evaluate(std::vector<double> {2}) == 15);
+}
+
+TEST_CASE("Powers are right-associative and bind tighter than negation",
+          "[compiled_expression]")
+{
+  const std::vector<double> none;
+  REQUIRE(maths_static_compiler::compile("2 ^ 3 ^ 2").evaluate(none) == 512);
+  REQUIRE(maths_static_compiler::compile("-2 ** 2").evaluate(none) == -4);
+  REQUIRE(maths_static_compiler::compile("2 ^ -2 * 3").evaluate(none) == 0.75);
+  REQUIRE(maths_static_compiler::compile("2 ^ 10").code().instructions.empty());
+}
+
+TEST_CASE("Integer powers take the multiplications of an addition chain",
+          "[compiled_expression]")
+{
+  const std::vector<double> values {1.5};
+  auto power = maths_static_compiler::compile("x ^ 13");
+  REQUIRE(power.code().instructions.size() == 5);
+  REQUIRE(power.evaluate(values)
+          == maths_static_compiler::compile(
+                 "x * x * x * x * x * x * x * x * x * x * x * x * x")
+                 .evaluate(values));
+
+  // x^7 in 4 multiplications, computed once
+  auto shared = maths_static_compiler::compile("x ^ 7 + x ** 7 * y");
+  REQUIRE(shared.code().instructions.size() == 6);
+
+  auto inverse = maths_static_compiler::compile("x ^ -2");
+  REQUIRE(inverse.evaluate(std::vector<double> {2}) == 0.25);
+
+  auto root = maths_static_compiler::compile("x ^ 0.5");
+  REQUIRE(root.code().instructions.size() == 1);
+  REQUIRE(root.evaluate(std::vector<double> {9}) == 3);
+}
+
+TEST_CASE("Powers with a constant exponent are differentiated",
+          "[compiled_expression]")
+{
+  using maths_static_compiler::differentiation_mode;
+  for (const auto mode :
+       {differentiation_mode::forward, differentiation_mode::reverse})
+  {
+    auto compiled =
+        maths_static_compiler::compile_gradient("x ^ 3 + x ^ 0.5", mode);
+    std::vector<double> results(2);
+    compiled.evaluate_all(std::vector<double> {4}, results);
+    REQUIRE(results == std::vector<double> {66, 48.25});
+    REQUIRE_THROWS(maths_static_compiler::compile_gradient("x ^ y", mode));
+  }
+}
+
+TEST_CASE("Bound variables are folded out of the program",
+          "[compiled_expression]")
+{
+  const auto* source = "price * (1 + rate) + fee * (n * n + 3) - rate * n";
+  auto specialized = maths_static_compiler::compile_specialized(
+      source, {{"rate", 0.25}, {"fee", 0}, {"unused", 1}});
+  REQUIRE(specialized.variables() == std::vector<std::string> {"price", "n"});
+  // price * 1.25 - 0.25 * n
+  REQUIRE(specialized.code().instructions.size() == 3);
+  REQUIRE(specialized.evaluate(std::vector<double> {8, 4})
+          == maths_static_compiler::compile(source).evaluate(
+              std::vector<double> {8, 0.25, 0, 4}));
+
+  auto constant = maths_static_compiler::compile_specialized(
+      "x ^ 3 - x / y", {{"x", 2}, {"y", 4}});
+  REQUIRE(constant.variables().empty());
+  REQUIRE(constant.code().instructions.empty());
+  REQUIRE(constant.evaluate(std::vector<double> {}) == 7.5);
+}
+
+TEST_CASE("Profiled programs take a guarded fast path",
+          "[compiled_expression]")
+{
+  const auto* source = "(price * quantity - discount * price) * fx";
+  auto general = maths_static_compiler::compile(source);
+  maths_static_compiler::value_profile profile(general);
+  std::vector<double> rows;
+  for (int row = 0; row < 100; row++) {
+    const double discount = row % 10 == 0 ? 0.25 : 0;
+    const double fx = row % 50 == 0 ? 1.5 : 1;
+    for (const double value : {2.0 + row, 1.0 + row % 7, discount, fx}) {
+      rows.push_back(value);
+    }
+  }
+  profile.record_batch(rows);
+  REQUIRE(profile.rows() == 100);
+  REQUIRE(profile.dominant_values(0.9)
+          == std::map<std::string, double> {{"discount", 0}, {"fx", 1}});
+
+  auto profiled = maths_static_compiler::compile_profiled(source, profile);
+  REQUIRE(profiled.variables() == general.variables());
+  REQUIRE(profiled.guarded_values() == profile.dominant_values(0.9));
+  std::vector<double> expected(100);
+  std::vector<double> results(100);
+  general.evaluate_batch(rows, expected);
+  profiled.evaluate_batch(rows, results);
+  REQUIRE(results == expected);
+  for (const std::size_t row : {0, 1, 10}) {
+    const auto values = std::span(rows).subspan(row * 4, 4);
+    REQUIRE(profiled.evaluate(values) == general.evaluate(values));
+  }
+
+  // Values too spread out to specialize for leave the general code
+  REQUIRE(maths_static_compiler::compile_profiled(source, profile, 0.99)
+              .guarded_values()
+              .empty());
+}
+
+TEST_CASE("Guards tell negative zero from zero", "[compiled_expression]")
+{
+  const auto source = "y / d + d * d * d";
+  const auto general = maths_static_compiler::compile(source);
+  auto profile = maths_static_compiler::value_profile(general);
+  for (int row = 0; row < 10; row++) {
+    profile.record(std::array {1.0 + row, 0.0});
+  }
+  profile.record(std::array {1.0, -0.0});
+  REQUIRE(profile.dominant_values(0.9)
+          == std::map<std::string, double> {{"d", 0}});
+
+  const auto profiled =
+      maths_static_compiler::compile_profiled(source, profile);
+  REQUIRE(profiled.fast_path_instructions() > 0);
+  REQUIRE(profiled.evaluate(std::array {1.0, -0.0})
+          == -std::numeric_limits<double>::infinity());
+  REQUIRE(profiled.evaluate(std::array {1.0, 0.0})
+          == std::numeric_limits<double>::infinity());
+}
+
+TEST_CASE("Tiered expressions are promoted as they are evaluated",
+          "[compiled_expression]")
+{
+  using maths_static_compiler::execution_tier;
+  // Optimizations remove y, the variables must not change with the tier
+  auto tiered = maths_static_compiler::tiered_expression(
+      "(price * quantity - discount * price) * fx + (y - y)",
+      {.optimize_after = 10, .specialize_after = 100});
+  REQUIRE(tiered.variables()
+          == std::vector<std::string> {
+              "price", "quantity", "discount", "fx", "y"});
+  REQUIRE(tiered.tier() == execution_tier::baseline);
+
+  std::size_t row = 0;
+  auto evaluate_until = [&](execution_tier tier)
+  {
+    // Promotions are compiled in the background while evaluations go on
+    for (; tiered.tier() != tier && row < 1000000; row++) {
+      const double price = 2.0 + static_cast<double>(row % 100);
+      const double quantity = 1.0 + static_cast<double>(row % 7);
+      const double discount = row % 20 == 0 ? 0.25 : 0;
+      const double fx = row % 50 == 0 ? 1.5 : 1;
+      const auto values = std::array {price, quantity, discount, fx, 3.0};
+      REQUIRE(tiered.evaluate(values)
+              == (price * quantity - discount * price) * fx);
+      std::this_thread::yield();
+    }
+    REQUIRE(tiered.tier() == tier);
+  };
+  evaluate_until(execution_tier::optimized);
+  evaluate_until(execution_tier::specialized);
+  REQUIRE(tiered.evaluate(std::array {2.0, 3.0, 0.0, 1.0, 3.0}) == 6);
+
+  const auto statistics = tiered.statistics();
+  const auto& baseline = statistics[0];
+  const auto& optimized = statistics[1];
+  const auto& specialized = statistics[2];
+  REQUIRE(baseline.entered_after == 0);
+  REQUIRE(optimized.entered_after >= 10);
+  REQUIRE(specialized.entered_after >= *optimized.entered_after + 100);
+  REQUIRE(baseline.rows + optimized.rows + specialized.rows == row + 1);
+  REQUIRE(specialized.evaluations >= 1);
+  REQUIRE(optimized.instructions < baseline.instructions);
+  REQUIRE(specialized.instructions < optimized.instructions);
+  REQUIRE(specialized.compile_seconds > 0);
+}
+
+TEST_CASE("Tiered expressions are never demoted", "[compiled_expression]")
+{
+  using maths_static_compiler::execution_tier;
+  // Batches still running the baseline after the first promotion must not
+  // queue another one, which would replace the specialized tier
+  auto tiered = maths_static_compiler::tiered_expression(
+      "x * y + (y - y) * 2", {.optimize_after = 1, .specialize_after = 64});
+  std::atomic<bool> demoted = false;
+  std::vector<std::thread> threads;
+  for (int thread = 0; thread < 4; thread++) {
+    threads.emplace_back(
+        [&]
+        {
+          // Long batches, so evaluations overlap promotions
+          const std::vector<double> rows(2 * 20000, 1.0);
+          std::vector<double> results(20000);
+          for (int batch = 0; batch < 20; batch++) {
+            const auto before = tiered.tier();
+            tiered.evaluate_batch(rows, results);
+            if (tiered.tier() < before) {
+              demoted = true;
+            }
+          }
+        });
+  }
+  for (auto& thread : threads) {
+    thread.join();
+  }
+  REQUIRE_FALSE(demoted);
+}
+
+TEST_CASE("Tiered expressions without variables stay optimized",
+          "[compiled_expression]")
+{
+  auto tiered = maths_static_compiler::tiered_expression(
+      "1 + 2", {.optimize_after = 4, .specialize_after = 8});
+  std::vector<double> results(3);
+  for (std::size_t row = 0;
+       row < 1000000
+       && tiered.tier() != maths_static_compiler::execution_tier::optimized;
+       row++)
+  {
+    REQUIRE(tiered.evaluate({}) == 3);
+    std::this_thread::yield();
+  }
+  REQUIRE(tiered.tier() == maths_static_compiler::execution_tier::optimized);
+  // Past the profiling threshold
+  for (int row = 0; row < 16; row++) {
+    REQUIRE(tiered.evaluate({}) == 3);
+  }
+  tiered.evaluate_batch({}, results);
+  REQUIRE(results == std::vector<double> {3, 3, 3});
+  REQUIRE(tiered.statistics()[1].rows == 19);
+}
@@ -0,0 +1,83 @@
+#include <algorithm>
+#include <string>
+
+#include "backend/control_flow_builder.h"
+
+#include "backend/bytecode.h"
+#include "test_helpers.h"
+
+#include <catch2/catch_test_macros.hpp>
+
+namespace
+{
+// Enough terms for several partitions, with copies of subexpressions within
+// and across partitions and literals equal within the builder tolerance
+std::string large_program()
+{
+  static const char* const terms[] = {
+      "(x * y + 3 - t / (z - 2))",
+      "(y * x + 0.5 * -z)",
+      "(0.5000000000000001 * z - x * 0)",
+      "(x * y + 3 - t / (z - 2))",
+      "((x - x) + w ^ 3 / (4 + y) ** 0.5)",
+  };
+  std::string source = "let t = x * y - 1; ";
+  for (const char* output : {"a = ", "b = "}) {
+    source += output;
+    for (std::size_t i = 0; i < 6000; i++) {
+      if (i > 0) {
+        source += i % 3 == 0 ? " - " : " + ";
+      }
+      source += terms[(i * 7 + (output[0] == 'b' ? 1 : 0)) % 5];
+      source += " * " + std::to_string(i % 50);
+    }
+    source += "; ";
+  }
+  return source + "a / b";
+}
+}  // namespace
+
+TEST_CASE("Partitioned lowering builds the serial graph",
+          "[control_flow_builder]")
+{
+  const auto source = large_program();
+  const auto serial = build(source, nullptr);
+  const auto serial_code = backend::lower(serial);
+  for (std::size_t threads : {1U, 4U}) {
+    auto pool = support::thread_pool(threads);
+    support::statistics statistics;
+    const auto partitioned = build(source, &pool, &statistics);
+    REQUIRE(statistics.phases()[1].name == "partition_lowering");
+    REQUIRE(partitioned.canonical_hash() == serial.canonical_hash());
+    REQUIRE(partitioned.get_ir_size().instructions
+            == serial.get_ir_size().instructions);
+    REQUIRE(partitioned.get_ir_size().uses == serial.get_ir_size().uses);
+
+    const auto code = backend::lower(partitioned);
+    REQUIRE(std::ranges::equal(code.constants, serial_code.constants));
+    REQUIRE(code.variables == serial_code.variables);
+    REQUIRE(code.output_slots == serial_code.output_slots);
+    REQUIRE(std::ranges::equal(
+        code.instructions,
+        serial_code.instructions,
+        [](const auto& instruction, const auto& expected)
+        {
+          return instruction.op == expected.op
+              && instruction.destination == expected.destination
+              && instruction.left == expected.left
+              && instruction.right == expected.right
+              && instruction.addend == expected.addend
+              && backend::identical(instruction.immediate,
+                                    expected.immediate);
+        }));
+  }
+}
+
+TEST_CASE("Partitioned lowering reports errors like serial lowering",
+          "[control_flow_builder]")
+{
+  auto source = large_program();
+  source.insert(source.find("b = "), "a = 1; ");
+  auto pool = support::thread_pool(4);
+  REQUIRE_THROWS_WITH(build(source, &pool), "Redefinition of \"a\"");
+}
@@ -0,0 +1,37 @@
+#include <vector>
+
+#include "maths_static_compiler/maths_static_compiler.hpp"
+
+#include <catch2/catch_test_macros.hpp>
+
+TEST_CASE("Updates recompute only the affected instructions",
+          "[evaluation_session]")
+{
+  auto compiled =
+      maths_static_compiler::compile("(a * b + c) * (d - e) + a / 2");
+  const std::vector<double> values {1, 2, 3, 4, 5};
+  auto session = maths_static_compiler::evaluation_session(compiled, values);
+  REQUIRE(session.result() == compiled.evaluate(values));
+  REQUIRE(session.last_recomputed() == session.instructions_count());
+
+  // d - e, the product and the final sum
+  session.update(3, 10);
+  REQUIRE(session.last_recomputed() == 3);
+  const std::vector<double> updated {1, 2, 3, 10, 5};
+  REQUIRE(session.result() == compiled.evaluate(updated));
+
+  session.update(3, 10);
+  REQUIRE(session.last_recomputed() == 0);
+}
+
+TEST_CASE("Recomputation stops at unchanged values", "[evaluation_session]")
+{
+  auto compiled = maths_static_compiler::compile("(x * x + y) * 3");
+  const std::vector<double> values {2, 1};
+  auto session = maths_static_compiler::evaluation_session(compiled, values);
+
+  // x * x keeps its value, so nothing after it is recomputed
+  session.update(0, -2);
+  REQUIRE(session.last_recomputed() == 1);
+  REQUIRE(session.result() == 15);
+}
@@ -0,0 +1,92 @@
+#include <array>
+#include <atomic>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "server/formula_registry.h"
+
+#include "support/rcu.h"
+
+#include <catch2/catch_test_macros.hpp>
+
+TEST_CASE("Published formulas replace earlier versions",
+          "[formula_registry]")
+{
+  server::formula_registry registry;
+  REQUIRE_FALSE(registry.find("price").has_value());
+
+  REQUIRE(registry.publish("price", "x * 2") == 1);
+  REQUIRE(registry.publish("tax", "x / 5") == 2);
+  const auto first = registry.find("price");
+  REQUIRE(registry.publish("price", "x * 3") == 3);
+
+  // The version looked up before the swap stays usable
+  REQUIRE(first->version == 1);
+  REQUIRE(first->expression.evaluate(std::array {2.0}) == 4);
+  REQUIRE(registry.find("price")->expression.evaluate(std::array {2.0}) == 6);
+  REQUIRE(registry.names() == std::vector<std::string> {"price", "tax"});
+
+  REQUIRE(registry.remove("tax"));
+  REQUIRE_FALSE(registry.remove("tax"));
+  REQUIRE_FALSE(registry.find("tax").has_value());
+}
+
+TEST_CASE("Readers keep looking up formulas while they are swapped",
+          "[formula_registry]")
+{
+  constexpr std::size_t readers_count = 4;
+  constexpr std::uint64_t versions_count = 200;
+  server::formula_registry registry;
+  registry.publish("offset", "x + 1");
+
+  std::atomic<bool> done = false;
+  std::array<std::atomic<std::uint64_t>, readers_count> seen {};
+  std::array<bool, readers_count> consistent {};
+  std::vector<std::thread> readers;
+  for (std::size_t i = 0; i < readers_count; i++) {
+    readers.emplace_back(
+        [&, i]
+        {
+          consistent[i] = true;
+          std::uint64_t last = 0;
+          while (!done.load()) {
+            const auto found = registry.find("offset");
+            const auto version = found->version;
+            consistent[i] = consistent[i] && version >= last
+                && static_cast<std::uint64_t>(
+                       found->expression.evaluate(std::array {0.0}))
+                    == version;
+            last = version;
+            seen[i].store(version);
+            std::this_thread::yield();  // Lets the writer run on one core
+          }
+        });
+  }
+
+  {
+    // An evaluator holding a version for the whole test delays reclamation
+    // but neither the writer nor the other readers
+    auto slow_evaluator = support::rcu_domain::global().read_lock();
+    for (std::uint64_t version = 2; version <= versions_count; version++) {
+      registry.publish("offset", "x + " + std::to_string(version));
+      // Every reader looks up each version before the next swap
+      for (const auto& reader : seen) {
+        while (reader.load() < version) {
+          std::this_thread::yield();
+        }
+      }
+    }
+    done.store(true);
+    for (auto& reader : readers) {
+      reader.join();
+    }
+    REQUIRE(support::rcu_domain::global().reclaim() > 0);
+  }
+
+  for (std::size_t i = 0; i < readers_count; i++) {
+    REQUIRE(consistent[i]);
+    REQUIRE(seen[i].load() == versions_count);
+  }
+  REQUIRE(support::rcu_domain::global().reclaim() == 0);
+}
@@ -0,0 +1,73 @@
+#include <array>
+#include <filesystem>
+#include <fstream>
+#include <vector>
+
+#include "maths_static_compiler/maths_static_compiler.hpp"
+
+#include <catch2/catch_test_macros.hpp>
+
+TEST_CASE("Saved IR evaluates like the compiled expression", "[ir_file]")
+{
+  const auto path =
+      std::filesystem::temp_directory_path() / "maths_static_compiler_test.ir";
+  auto compiled = maths_static_compiler::compile(
+      "let t = price * count; total = t + 2.5; tax = t / 5");
+  compiled.save_ir(path);
+
+  auto loaded = maths_static_compiler::load_ir(path);
+  REQUIRE(loaded.variables() == compiled.variables());
+  REQUIRE(loaded.outputs() == compiled.outputs());
+  REQUIRE(loaded.saved_operations() == compiled.saved_operations());
+
+  const std::vector<double> values {4, 10};
+  std::vector<double> expected(2);
+  std::vector<double> results(2);
+  compiled.evaluate_all(values, expected);
+  loaded.evaluate_all(values, results);
+  REQUIRE(results == expected);
+
+  auto exact = maths_static_compiler::compile_exact("price * 3", {{"price", 2}});
+  exact.save_ir(path);
+  REQUIRE(maths_static_compiler::load_ir(path).exact_instructions() == 1);
+
+  std::filesystem::remove(path);
+}
+
+TEST_CASE("Corrupted IR files are rejected", "[ir_file]")
+{
+  const auto path =
+      std::filesystem::temp_directory_path() / "maths_static_compiler_bad.ir";
+  maths_static_compiler::compile("x * 2 + 1").save_ir(path);
+  {
+    std::fstream file(path, std::ios::in | std::ios::out | std::ios::binary);
+    file.seekp(-1, std::ios::end);
+    file.put('!');
+  }
+  REQUIRE_THROWS_AS(maths_static_compiler::load_ir(path),
+                    std::invalid_argument);
+
+  // Every header field is covered by the checksum too
+  maths_static_compiler::compile("x * 2 + y * 3").save_ir(path);
+  for (std::streamoff offset = 0; offset < 80; offset++) {
+    std::fstream file(path, std::ios::in | std::ios::out | std::ios::binary);
+    file.seekg(offset);
+    const auto byte = static_cast<char>(file.get());
+    file.seekp(offset);
+    file.put(static_cast<char>(byte ^ 4));
+    file.close();
+    REQUIRE_THROWS_AS(maths_static_compiler::load_ir(path),
+                      std::invalid_argument);
+    file.open(path, std::ios::in | std::ios::out | std::ios::binary);
+    file.seekp(offset);
+    file.put(byte);
+  }
+  REQUIRE(maths_static_compiler::load_ir(path).evaluate(std::array {2.0, 5.0})
+          == 19);
+
+  std::filesystem::resize_file(path, 16);
+  REQUIRE_THROWS_AS(maths_static_compiler::load_ir(path),
+                    std::invalid_argument);
+
+  std::filesystem::remove(path);
+}
@@ -0,0 +1,43 @@
+#include <sstream>
+
+#include "support/json_writer.h"
+
+#include "frontend/parsing/parser.h"
+#include "frontend/scanning/lexer.h"
+
+#include <catch2/catch_test_macros.hpp>
+
+TEST_CASE("Separators and escapes are written", "[json_writer]")
+{
+  std::ostringstream stream;
+  auto writer = support::json_writer(stream);
+  writer.begin_object();
+  writer.member("name", "a \"b\"\n");
+  writer.key("values");
+  writer.begin_array();
+  writer.value(std::uint64_t {1});
+  writer.value(0.5);
+  writer.begin_object();
+  writer.end_object();
+  writer.end_array();
+  writer.member("ok", true);
+  writer.end_object();
+  REQUIRE(stream.str()
+          == R"({"name":"a \"b\"\n","values":[1,0.5,{}],"ok":true})");
+}
+
+TEST_CASE("Syntax trees keep the debug file schema", "[json_writer]")
+{
+  auto lexer = frontend::lexer("-(x + 2)");
+  auto parser = frontend::parser(lexer.scan_tokens());
+  auto statements = parser.parse_program();
+
+  std::ostringstream stream;
+  auto writer = support::json_writer(stream);
+  frontend::write_json(writer, *statements.front().get_expr());
+  REQUIRE(stream.str()
+          == R"({"type":"unary","token_type":"subtract","expr":)"
+             R"({"type":"grouping","expr":{"type":"binary",)"
+             R"("left":{"type":"variable","lexeme":"x"},"token_type":"add",)"
+             R"("right":{"type":"number","value":"2.000000"}}}})");
+}
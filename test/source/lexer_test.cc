@@ -38,3 +38,23 @@ TEST_CASE("Incorrect lexemes cause an error", "[lexer]")
   auto lexer = frontend::lexer(line);
   REQUIRE_THROWS_AS(lexer.scan_tokens(), unknown_literal_error);
 }
+
+TEST_CASE("Both power operators are scanned", "[lexer]")
+{
+  auto lexer = frontend::lexer("x ** 2 ^ y*z");
+  lexer.scan_tokens();
+
+  using namespace frontend;
+
+  const std::vector<token> excepted_tokens {
+      token(variable, "x", 0),
+      token(power, "**", 2),
+      token(number, "2", 5),
+      token(power, "^", 7),
+      token(variable, "y", 9),
+      token(multiply, "*", 10),
+      token(variable, "z", 11),
+      token(eof, "", 12),
+  };
+  REQUIRE(lexer.get_tokens() == excepted_tokens);
+}
@@ -0,0 +1,108 @@
+#include <string>
+#include <vector>
+
+#include "backend/parallel_evaluation.h"
+
+#include "maths_static_compiler/maths_static_compiler.hpp"
+#include "test_helpers.h"
+
+#include <catch2/catch_test_macros.hpp>
+
+namespace
+{
+// Sum of many independent products, each level of the graph is wide
+std::string wide_sum(std::size_t terms_count)
+{
+  std::string source;
+  for (std::size_t i = 0; i < terms_count; i++) {
+    if (i > 0) {
+      source += " + ";
+    }
+    source += "(x * " + std::to_string(i) + ".5 + y) * (z - "
+        + std::to_string(i) + ")";
+  }
+  return source;
+}
+}  // namespace
+
+TEST_CASE("Levels only read values of earlier levels", "[parallel_evaluation]")
+{
+  const auto code = compile("(a * b + c) * (a - d) + e / 2");
+  const auto graph = backend::build_dataflow_graph(code);
+  const auto levels = backend::compute_levels(graph);
+  REQUIRE(levels.instructions.size() == code.instructions.size());
+
+  std::vector<std::size_t> value_levels(graph.values_count(), 0);
+  for (std::size_t level = 0; level < levels.levels_count(); level++) {
+    for (auto position = levels.offsets[level];
+         position < levels.offsets[level + 1];
+         position++)
+    {
+      const auto index = levels.instructions[position];
+      for (std::size_t operand = 0; operand < 3; operand++) {
+        REQUIRE(value_levels[graph.operands[3 * index + operand]] <= level);
+      }
+      value_levels[graph.first_result + index] = level + 1;
+    }
+  }
+}
+
+TEST_CASE("Parallel evaluation matches serial evaluation",
+          "[parallel_evaluation]")
+{
+  REQUIRE(backend::parallel_tasks(1000, 8) == 1);
+
+  const auto code = compile(wide_sum(30000));
+  const auto graph = backend::build_dataflow_graph(code);
+  const auto levels = backend::compute_levels(graph);
+
+  const std::vector<double> variables {1.25, -3, 0.5};
+  std::vector<double> slots(code.slots_count);
+  backend::execute(code, variables, slots);
+  auto pool = support::thread_pool(4);
+  std::vector<double> values(graph.values_count());
+  backend::execute_parallel(code, graph, levels, variables, values, pool);
+  REQUIRE(values[graph.result_value] == slots[code.output_slot]);
+
+  const std::size_t rows_count = 10000;
+  std::vector<double> rows;
+  for (std::size_t row = 0; row < rows_count; row++) {
+    const auto value = static_cast<double>(row);
+    rows.insert(rows.end(), {value * 0.5, 2.0 - value, 1.0 / (value + 1)});
+  }
+  std::vector<double> expected(rows_count);
+  std::vector<double> results(rows_count);
+  const auto outputs = std::span(&code.output_slot, 1);
+  backend::evaluate_batch(code, rows, outputs, expected);
+  backend::evaluate_batch_parallel(code, rows, outputs, results, pool);
+  REQUIRE(results == expected);
+}
+
+TEST_CASE("Compiled expressions evaluate on a pool", "[parallel_evaluation]")
+{
+  const auto compiled = maths_static_compiler::compile(
+      wide_sum(30000) + "; total = x * y + z");
+  auto pool = support::thread_pool(4);
+
+  const std::vector<double> variables {1.25, -3, 0.5};
+  REQUIRE(compiled.evaluate(variables, pool) == compiled.evaluate(variables));
+  std::vector<double> expected(2);
+  std::vector<double> results(2);
+  compiled.evaluate_all(variables, expected);
+  compiled.evaluate_all(variables, results, pool);
+  REQUIRE(results == expected);
+
+  const std::size_t rows_count = 5000;
+  std::vector<double> rows;
+  for (std::size_t row = 0; row < rows_count; row++) {
+    const auto value = static_cast<double>(row);
+    rows.insert(rows.end(), {value * 0.5, 2.0 - value, 1.0 / (value + 1)});
+  }
+  expected.resize(2 * rows_count);
+  results.resize(2 * rows_count);
+  compiled.evaluate_batch_all(rows, expected);
+  compiled.evaluate_batch_all(rows, results, pool);
+  REQUIRE(results == expected);
+  REQUIRE_THROWS_AS(compiled.evaluate_all(variables, expected, pool),
+                    std::invalid_argument);
+}
@@ -3,6 +3,7 @@
 #include <catch2/catch_test_macros.hpp>
 
 #include "frontend/parsing/expression.h"
+#include "frontend/scanning/lexer.h"
 
 TEST_CASE("Checking the operation of factor expressions", "[parser]")
 {
@@ -14,7 +15,7 @@ TEST_CASE("Checking the operation of factor expressions", "[parser]")
       token(eof, "", 3),
   };
   auto parser = frontend::parser(tokens);
-  std::unique_ptr<expression> expr_ptr = parser.parse();
+  expression_ptr expr_ptr = parser.parse();
 
   auto expected_expression = binary_expression(
       std::make_unique<number_expression>(number_expression(9.3)),
@@ -23,3 +24,25 @@ TEST_CASE("Checking the operation of factor expressions", "[parser]")
 
   REQUIRE(expected_expression == *expr_ptr);
 }
+
+TEST_CASE("Programs are split into statements", "[parser]")
+{
+  using namespace frontend;
+  auto lexer = frontend::lexer("let t = a * b; margin = t - c; t / 2;");
+  auto parser = frontend::parser(lexer.scan_tokens());
+  auto statements = parser.parse_program();
+
+  REQUIRE(statements.size() == 3);
+  REQUIRE(statements[0].is_let());
+  REQUIRE(statements[0].get_name()->get_lexeme() == "t");
+  REQUIRE(!statements[1].is_let());
+  REQUIRE(statements[1].get_name()->get_lexeme() == "margin");
+  REQUIRE(!statements[2].get_name().has_value());
+}
+
+TEST_CASE("Statements must be separated", "[parser]")
+{
+  auto lexer = frontend::lexer("a = 1 b = 2");
+  auto parser = frontend::parser(lexer.scan_tokens());
+  REQUIRE_THROWS_AS(parser.parse_program(), parse_exception);
+}
@@ -0,0 +1,94 @@
+#include <cmath>
+#include <map>
+#include <string>
+#include <vector>
+
+#include "backend/polynomial.h"
+
+#include "backend/bytecode.h"
+#include "test_helpers.h"
+
+#include <catch2/catch_test_macros.hpp>
+
+namespace
+{
+std::vector<double> evaluate(const backend::control_flow_data& data,
+                             const std::map<std::string, double>& values)
+{
+  const auto code = backend::lower(data);
+  std::vector<double> variables;
+  for (const auto& name : code.variables) {
+    variables.push_back(values.at(name));
+  }
+  std::vector<double> slots(code.slots_count);
+  backend::execute(code, variables, slots);
+  std::vector<double> results;
+  for (const auto slot : code.output_slots) {
+    results.push_back(slots[slot]);
+  }
+  return results;
+}
+
+// Normalized polynomials are rounded differently
+bool close(double value, double expected)
+{
+  return std::fabs(value - expected) <= 1e-12 * std::fabs(expected);
+}
+}  // namespace
+
+TEST_CASE("Polynomials in one variable are evaluated in Horner form",
+          "[polynomial]")
+{
+  auto builder = build_program("3 * x * x * x + 2 * x * x + x + 1");
+  const auto before = evaluate(builder.get_data(), {{"x", 1.5}});
+  const auto savings = builder.normalize_polynomials();
+  REQUIRE(savings.multiplications == 2);
+  REQUIRE(savings.additions == 0);
+  REQUIRE(builder.get_data().expressions.size() == 6);
+  REQUIRE(close(evaluate(builder.get_data(), {{"x", 1.5}})[0], before[0]));
+}
+
+TEST_CASE("Like terms are collected", "[polynomial]")
+{
+  auto builder = build_program("2 * x * y + y * x * 3 - 5 * x * y + z / 4");
+  const auto savings = builder.normalize_polynomials();
+  REQUIRE(savings.multiplications == 6);
+  REQUIRE(savings.additions == 3);
+  REQUIRE(builder.get_data().expressions.size() == 1);
+  REQUIRE(evaluate(builder.get_data(), {{"x", 2}, {"y", 3}, {"z", 8}})[0]
+          == 2);
+}
+
+TEST_CASE("Shared values and other operations are kept as atoms",
+          "[polynomial]")
+{
+  const std::map<std::string, double> values {{"x", 0.5}, {"y", -2}};
+  auto builder = build_program(
+      "let s = x * x + 1; a = s * s * s + 2 * s * s * s; "
+      "b = 1 / (x * y * x - y * x * x) + s");
+  const auto before = evaluate(builder.get_data(), values);
+  const auto savings = builder.normalize_polynomials();
+  REQUIRE(savings.multiplications > 0);
+  const auto after = evaluate(builder.get_data(), values);
+  REQUIRE(after.size() == 2);
+  REQUIRE(close(after[0], before[0]));
+  REQUIRE(after[1] == before[1]);  // Division by zero in both
+}
+
+TEST_CASE("The Horner form of a dense polynomial takes one multiplication "
+          "and one addition per degree",
+          "[polynomial]")
+{
+  auto value = backend::polynomial::constant(1);
+  for (int power = 1; power <= 8; power++) {
+    auto term = backend::polynomial::constant(power);
+    for (int i = 0; i < power; i++) {
+      term = term * backend::polynomial::atom(3);
+    }
+    value += term;
+  }
+  REQUIRE(value.degree() == 8);
+  const auto form = backend::to_horner_form(value);
+  REQUIRE(form.multiplications() == 8);
+  REQUIRE(form.additions() == 8);
+}
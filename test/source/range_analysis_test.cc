@@ -0,0 +1,37 @@
+#include "backend/range_analysis.h"
+
+#include "test_helpers.h"
+
+#include <catch2/catch_test_macros.hpp>
+
+TEST_CASE("Ranges are propagated through every operation", "[range_analysis]")
+{
+  const auto data = build("(x - y) * y / 2");
+  const auto analysis = backend::analyze_precision(
+      data, {{"x", {1, 2}}, {"y", {-1, 3}}}, 1e-4);
+  const auto result = analysis.ranges.at(data.out_index);
+  REQUIRE(result.lower == -3);
+  REQUIRE(result.upper == 4.5);
+}
+
+TEST_CASE("Single precision is only used within the tolerance",
+          "[range_analysis]")
+{
+  const auto data = build("a * b + a / b");
+  const std::map<std::string, backend::interval> ranges = {{"a", {1, 10}},
+                                                           {"b", {1, 2}}};
+
+  const auto loose = backend::analyze_precision(data, ranges, 1e-4);
+  REQUIRE(loose.meets_tolerance);
+  REQUIRE(loose.error_bound <= 1e-4);
+  REQUIRE(loose.single_precision.size() == 5);
+
+  const auto strict = backend::analyze_precision(data, ranges, 1e-12);
+  REQUIRE(strict.meets_tolerance);
+  REQUIRE(strict.single_precision.empty());
+
+  const auto unbounded = backend::analyze_precision(
+      data, {{"a", {1, 10}}, {"b", {-1, 1}}}, 1e-4);
+  REQUIRE_FALSE(unbounded.meets_tolerance);
+  REQUIRE(unbounded.single_precision.empty());
+}
@@ -0,0 +1,58 @@
+#include <vector>
+
+#include "backend/scheduling.h"
+
+#include "backend/bytecode.h"
+#include "test_helpers.h"
+
+#include <catch2/catch_test_macros.hpp>
+
+namespace
+{
+std::size_t result_slots(const backend::bytecode& code)
+{
+  return code.slots_count - code.first_variable_slot() - code.variables.size();
+}
+}  // namespace
+
+TEST_CASE("Balanced trees need one slot per level", "[scheduling]")
+{
+  const auto data = build(
+      "((a + b) * (c + d) - (e + f) * (g + h))"
+      " / ((i + j) * (k + l) - (m + n) * (o + p))");
+  const auto code = backend::lower(data);
+  REQUIRE(code.instructions.size() == 15);
+  REQUIRE(result_slots(code) == 4);
+  REQUIRE(result_slots(backend::lower(data, {}, {}, {.reuse_slots = false}))
+          == 15);
+}
+
+TEST_CASE("The operand needing more slots is evaluated first", "[scheduling]")
+{
+  // The left operand is a single operation, the right one needs two slots
+  const auto data = build("a * b - (c + d) * (e + f)");
+  const auto order = backend::schedule_operations(data);
+  REQUIRE(order.size() == 5);
+  REQUIRE(data.expressions.at(order.front()).get_operator()
+          == backend::expression_op::add);
+  REQUIRE(order.back() == data.out_index);
+  REQUIRE(result_slots(backend::lower(data)) == 2);
+}
+
+TEST_CASE("Reused slots give the same results", "[scheduling]")
+{
+  const auto data = build(
+      "let s = x * y + z; u = s * s - x / (y + 1); v = (s - u) * (x + z); "
+      "u * v - s");
+  const auto reused = backend::lower(data);
+  const auto separate = backend::lower(data, {}, {}, {.reuse_slots = false});
+  REQUIRE(reused.slots_count < separate.slots_count);
+
+  const std::vector<double> rows {1, 2, 3, -1.5, 0.25, 4, 7, -3, 0.5};
+  std::vector<double> reused_results(9);
+  std::vector<double> separate_results(9);
+  backend::evaluate_batch(reused, rows, reused.output_slots, reused_results);
+  backend::evaluate_batch(
+      separate, rows, separate.output_slots, separate_results);
+  REQUIRE(reused_results == separate_results);
+}
@@ -0,0 +1,77 @@
+#include "server/server.h"
+
+#include <catch2/catch_test_macros.hpp>
+
+TEST_CASE("Compile and evaluate requests", "[server]")
+{
+  auto path = std::filesystem::temp_directory_path()
+      / "maths_static_compiler_test.sock";
+  auto instance = server::server({.socket_path = path, .workers_count = 1});
+
+  auto compiled = instance.handle_request("compile x * 2 + y");
+  REQUIRE(compiled.starts_with("ok "));
+  REQUIRE(compiled.ends_with(" x y"));
+
+  auto handle = compiled.substr(3, compiled.find(' ', 3) - 3);
+  REQUIRE(instance.handle_request("evaluate " + handle + " | x=1 y=2 | x=3 y=0")
+          == "ok 4 6");
+  REQUIRE(instance.handle_request("evaluate-expression (1 + 2) / 4")
+          == "ok 0.75");
+
+  REQUIRE(instance.handle_request("publish total x * 2 + y") == "ok 1 x y");
+  REQUIRE(instance.handle_request("publish total x * 3") == "ok 2 x");
+  REQUIRE(instance.handle_request("evaluate-formula total | x=1 | x=2")
+          == "ok 3 6");
+  REQUIRE(instance.handle_request("formula-stats total")
+              .starts_with("ok baseline baseline=2,"));
+}
+
+TEST_CASE("Invalid requests are answered with errors", "[server]")
+{
+  auto path = std::filesystem::temp_directory_path()
+      / "maths_static_compiler_test.sock";
+  auto instance = server::server({.socket_path = path, .workers_count = 1});
+
+  REQUIRE(instance.handle_request("unknown").starts_with("error "));
+  REQUIRE(instance.handle_request("evaluate 123 | x=1").starts_with("error "));
+  REQUIRE(instance.handle_request("evaluate-expression x + 1 | y=1")
+              .starts_with("error "));
+  REQUIRE(instance.handle_request("evaluate-expression x + 1 | x")
+              .starts_with("error "));
+  REQUIRE(instance.handle_request("compile 1 + & 2").starts_with("error "));
+  REQUIRE(instance.handle_request("publish total").starts_with("error "));
+  REQUIRE(instance.handle_request("evaluate-formula total | x=1")
+              .starts_with("error "));
+}
+
+TEST_CASE("Least recently used handles are evicted", "[server]")
+{
+  auto path = std::filesystem::temp_directory_path()
+      / "maths_static_compiler_test.sock";
+  auto instance = server::server(
+      {.socket_path = path, .workers_count = 1, .cache_capacity = 2});
+
+  auto compile = [&](const std::string& expression)
+  {
+    auto compiled = instance.handle_request("compile " + expression);
+    REQUIRE(compiled.starts_with("ok "));
+    return compiled.substr(3, compiled.find(' ', 3) - 3);
+  };
+  auto first = compile("x + 1");
+  auto second = compile("x + 2");
+
+  // Evaluating expressions directly registers no handle
+  REQUIRE(instance.handle_request("evaluate-expression x + 3 | x=1")
+          == "ok 4");
+  REQUIRE(instance.handle_request("evaluate " + first + " | x=1") == "ok 2");
+
+  // The second handle is now the least recently used one
+  auto third = compile("x + 4");
+  REQUIRE(instance.handle_request("evaluate " + second + " | x=1")
+              .starts_with("error Unknown handle"));
+  REQUIRE(instance.handle_request("evaluate " + first + " | x=1") == "ok 2");
+  REQUIRE(instance.handle_request("evaluate " + third + " | x=1") == "ok 5");
+
+  REQUIRE(compile("x + 2") == second);
+  REQUIRE(instance.handle_request("evaluate " + second + " | x=1") == "ok 3");
+}
@@ -0,0 +1,66 @@
+#include "support/statistics.h"
+
+#include "backend/control_flow_builder.h"
+#include "frontend/parsing/parser.h"
+#include "frontend/scanning/lexer.h"
+
+#include <catch2/catch_test_macros.hpp>
+
+TEST_CASE("Every builder pass is measured", "[statistics]")
+{
+  auto lexer = frontend::lexer("a * b + a * b - 0");
+  auto parser = frontend::parser(lexer.scan_tokens());
+  support::statistics statistics;
+  statistics.begin_phase("control_flow_builder");
+  auto cfb = backend::control_flow_builder(parser.parse_program(), &statistics);
+  statistics.end_phase(cfb.get_data().get_ir_size());
+
+  const auto& phases = statistics.phases();
+  REQUIRE(phases.size() == 5);
+  REQUIRE(phases[0].depth == 0);
+  REQUIRE(phases[1].name == "lowering");
+  REQUIRE(phases[1].after->instructions == 4);
+  REQUIRE(phases[2].name == "copy_propagation");
+  REQUIRE(phases[2].depth == 1);
+  REQUIRE(phases[2].after->instructions == 3);
+  REQUIRE(phases[4].name == "dead_code_elimination");
+  REQUIRE(phases[4].after->instructions == 2);
+  REQUIRE(phases[0].after->instructions == 2);
+  for (const auto& phase : phases) {
+    REQUIRE(phase.wall_seconds >= 0);
+  }
+}
+
+TEST_CASE("Arena allocations are accounted per phase", "[statistics]")
+{
+  support::arena arena;
+  support::statistics statistics;
+  statistics.set_arena(&arena);
+
+  statistics.begin_phase("parser");
+  auto lexer = frontend::lexer("x * y + 3 - x / 2");
+  auto parser = frontend::parser(lexer.scan_tokens(), &arena);
+  auto statements = parser.parse_program();
+  statistics.end_phase();
+
+  statistics.begin_phase("control_flow_builder");
+  auto cfb = backend::control_flow_builder(
+      std::move(statements), nullptr, &arena);
+  statistics.end_phase(cfb.get_data().get_ir_size());
+  statistics.set_arena(nullptr);
+
+  const auto& phases = statistics.phases();
+  REQUIRE(phases.size() == 2);
+  for (const auto& phase : phases) {
+    REQUIRE(phase.arena.has_value());
+    REQUIRE(phase.arena->allocations > 0);
+    REQUIRE(phase.arena->allocated_bytes > 0);
+  }
+  REQUIRE(phases[1].arena->reserved_bytes >= phases[0].arena->reserved_bytes);
+  REQUIRE(arena.counters().reserved_bytes == phases[1].arena->reserved_bytes);
+
+  // Copies leave the arena, so they outlive it
+  const backend::control_flow_data copy = cfb.get_data();
+  REQUIRE(copy.get_ir_size().instructions
+          == cfb.get_data().get_ir_size().instructions);
+}
@@ -0,0 +1,37 @@
+#ifndef TEST_HELPERS_H
+#define TEST_HELPERS_H
+
+#include <string>
+
+#include "backend/bytecode.h"
+#include "backend/control_flow_builder.h"
+#include "frontend/parsing/parser.h"
+#include "frontend/scanning/lexer.h"
+
+// Builder of the graph of a program, for tests that go on transforming it
+inline backend::control_flow_builder build_program(
+    const std::string& source,
+    support::thread_pool* pool = nullptr,
+    support::statistics* statistics = nullptr)
+{
+  auto lexer = frontend::lexer(source);
+  auto parser = frontend::parser(lexer.scan_tokens());
+  return backend::control_flow_builder(
+      parser.parse_program(), statistics, nullptr, pool);
+}
+
+inline backend::control_flow_data build(
+    const std::string& source,
+    support::thread_pool* pool = nullptr,
+    support::statistics* statistics = nullptr)
+{
+  return build_program(source, pool, statistics).get_data();
+}
+
+// Bytecode of a program, lowered with the default options
+inline backend::bytecode compile(const std::string& source)
+{
+  return backend::lower(build(source));
+}
+
+#endif
@@ -0,0 +1,31 @@
+#include "backend/type_inference.h"
+
+#include "test_helpers.h"
+
+#include <catch2/catch_test_macros.hpp>
+
+TEST_CASE("Scales follow the exact operations", "[type_inference]")
+{
+  const auto data = build("price * quantity * 0.5 + fee / 100");
+  const auto types =
+      backend::infer_types(data, {{"price", 2}, {"quantity", 0}, {"fee", 2}});
+  REQUIRE(types.exact_scales.at(data.out_index) == 4);
+
+  const auto unknown = backend::infer_types(data, {{"price", 2}});
+  REQUIRE_FALSE(unknown.exact_scales.contains(data.out_index));
+}
+
+TEST_CASE("Divisions by other constants are not exact", "[type_inference]")
+{
+  const auto data = build("n / 3");
+  const auto types = backend::infer_types(data, {{"n", 0}});
+  REQUIRE_FALSE(types.exact_scales.contains(data.out_index));
+}
+
+TEST_CASE("Literals get the scale of their decimals", "[type_inference]")
+{
+  // 1.1 * 10 is not exactly 11 in binary floating point
+  const auto data = build("n * 1.1");
+  const auto types = backend::infer_types(data, {{"n", 0}});
+  REQUIRE(types.exact_scales.at(data.out_index) == 1);
+}